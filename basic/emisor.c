@@ -1,15 +1,43 @@
+#define _GNU_SOURCE     /* Para sendmmsg y struct mmsghdr */
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <sys/socket.h>
 #include <string.h>
 #include <stdbool.h>
 #include <arpa/inet.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <poll.h>
+#include <inttypes.h>
 
 #include "host.h"
 #include "loging.h"
+#include "traffic.h"
 
 #define MAX_MESSAGE_SIZE 2048
 
+/* Máximo tamaño de carga útil de un datagrama UDP sobre IPv4 */
+#define MAX_UDP_PAYLOAD 65507
+
+#define DEFAULT_GENERATOR_THREADS 1
+#define DEFAULT_GENERATOR_BATCH 32
+#define MAX_GENERATOR_THREADS 64
+#define MAX_GENERATOR_BATCH 1024
+#define DEFAULT_PAYLOAD_SIZE 64
+
+/* Margen antes del instante de envío a partir del cual se deja de dormir y se espera activamente */
+#define PACING_SPIN_NS 50000
+/* Máximo tiempo de envío que se permite agrupar en una única llamada a sendmmsg cuando se limita la tasa */
+#define PACING_MAX_BURST_NS 1000000
+/* Máximo tiempo que se duerme seguido al esperar, para atender enseguida una petición de terminación */
+#define PACING_MAX_SLEEP_NS 50000000
+/* Espera, cuando el socket no admite más datos, a que vuelva a admitirlos (también acota cuánto tarda en verse la terminación) */
+#define SEND_RETRY_POLL_MS 50
+/* Pausa tras ENOBUFS: el socket admite datos, pero la cola del dispositivo está llena y poll no avisa de cuándo se vacía */
+#define SEND_RETRY_BACKOFF_NS 100000
+
 #define DEFAULT_SENDER_PORT 8100
 #define IP_LOCALHOST "127.0.0.1"
 #define DEFAULT_RECEIVER_IP IP_LOCALHOST
@@ -17,6 +45,51 @@
 
 #define DEFAULT_LOG_FILE "emisor.log"
 
+/**
+ * Distribuciones posibles del tamaño de la carga útil de los paquetes generados.
+ */
+enum SizeDistribution {
+    SIZE_FIXED,     /* Todos los paquetes tienen el mismo tamaño */
+    SIZE_UNIFORM,   /* Tamaño uniformemente distribuido entre un mínimo y un máximo */
+    SIZE_IMIX       /* Mezcla IMIX clásica: 7 paquetes IP de 64 B, 4 de 576 B y 1 de 1500 B */
+};
+
+/**
+ * Configuración del modo generador de tráfico.
+ */
+struct GeneratorConfig {
+    bool enabled;                   /* Vale true si se pidió el modo generador en lugar del saludo */
+    double packets_per_second;      /* Tasa objetivo en paquetes por segundo (0 = sin límite) */
+    double bits_per_second;         /* Tasa objetivo en bits de carga útil por segundo (0 = sin límite) */
+    enum SizeDistribution size_distribution;    /* Distribución del tamaño de la carga útil */
+    size_t min_size;                /* Tamaño mínimo de la carga útil (bytes) */
+    size_t max_size;                /* Tamaño máximo de la carga útil (bytes) */
+    uint64_t count;                 /* Número total de paquetes a enviar (0 = sin límite) */
+    double duration;                /* Duración máxima del envío en segundos (0 = sin límite) */
+    unsigned threads;               /* Número de hilos emisores */
+    unsigned batch;                 /* Máximo número de paquetes por llamada a sendmmsg */
+};
+
+/**
+ * Estado y resultados de cada uno de los hilos emisores del generador.
+ */
+struct GeneratorThread {
+    pthread_t thread;               /* Hilo que ejecuta el emisor */
+    unsigned id;                    /* Identificador del hilo; se usa también como identificador de flujo */
+    Host *local_sender;             /* Host desde el que se envía */
+    Host *remote_receiver;          /* Host al que se envía */
+    const struct GeneratorConfig *config;   /* Configuración común a todos los hilos */
+    double packets_per_second;      /* Parte de la tasa en paquetes por segundo que corresponde al hilo */
+    double bits_per_second;         /* Parte de la tasa en bits por segundo que corresponde al hilo */
+    uint64_t count;                 /* Parte de la cuenta total de paquetes que corresponde al hilo */
+    uint64_t sent_packets;          /* Paquetes enviados con éxito */
+    uint64_t sent_bytes;            /* Bytes de carga útil enviados con éxito */
+    uint64_t send_errors;           /* Paquetes que no se pudieron enviar por un error */
+    uint64_t eagain_retries;        /* Veces que el socket no admitió más datos (EAGAIN/ENOBUFS) y hubo que reintentar */
+    int last_error;                 /* Último errno distinto de EAGAIN observado (0 si no hubo) */
+    uint64_t elapsed_ns;            /* Tiempo que estuvo enviando el hilo */
+};
+
 /**
  * Estructura de datos para pasar a la función process_args.
  * Contiene una cantidad variable de variables que se quieran inicializar
@@ -24,9 +97,12 @@
  */
 struct Arguments {
     uint16_t local_port;
-    char *remote_ip;
+    char *local_path;       /* Ruta del socket local (AF_UNIX); NULL para usar un nombre asignado por el núcleo */
+    char *remote_ip;        /* IP del receptor, o ruta de su socket si contiene alguna '/' */
     uint16_t remote_port;
+    bool seqpacket;         /* Usar SOCK_SEQPACKET en lugar de datagramas (solo con sockets locales) */
     char *logfile;
+    struct GeneratorConfig generator;
 };
 
 /**
@@ -38,6 +114,14 @@ enum Option {
     OPT_SOURCE_PORT = 'o',
     OPT_RECEIVER_IP = 'i',
     OPT_RECEIVER_PORT = 'p',
+    OPT_PACKETS_PER_SECOND = 'r',
+    OPT_BITS_PER_SECOND = 'b',
+    OPT_PAYLOAD_SIZE = 's',
+    OPT_COUNT = 'c',
+    OPT_DURATION = 'd',
+    OPT_THREADS = 't',
+    OPT_BATCH = 'k',
+    OPT_SEQPACKET = 'q',
     OPT_LOG_FILE_NAME = 'l',
     OPT_NO_LOG = 'n',
     OPT_HELP = 'h'
@@ -86,6 +170,53 @@ static uint16_t getPortOrFail(char **argv, int pos);
  */
 static void send_message(Host *local_sender, Host *remote_receiver);
 
+/**
+ * @brief   Obtiene una tasa de los argumentos del programa.
+ *
+ * Acepta un número real positivo, opcionalmente seguido de los sufijos 'k', 'M' o 'G'.
+ *
+ * @param argv  Lista con los argumentos del programa.
+ * @param pos   Posición en argv en la que se encuentra la string que se quiere interpretar como tasa.
+ *
+ * @return  Tasa leída de los argumentos del programa; falla si no es válida.
+ */
+static double getRateOrFail(char **argv, int pos);
+
+/**
+ * @brief   Obtiene un número positivo de los argumentos del programa.
+ *
+ * @param argv  Lista con los argumentos del programa.
+ * @param pos   Posición en argv en la que se encuentra la string que se quiere interpretar.
+ * @param max   Máximo valor permitido.
+ *
+ * @return  Número leído de los argumentos del programa; falla si no es válido.
+ */
+static uint64_t getPositiveNumberOrFail(char **argv, int pos, uint64_t max);
+
+/**
+ * @brief   Obtiene la distribución de tamaños de carga útil de los argumentos del programa.
+ *
+ * Acepta un tamaño fijo ("<n>"), un rango uniforme ("<min>-<max>") o "imix".
+ *
+ * @param config    Configuración del generador en la que guardar la distribución.
+ * @param argv      Lista con los argumentos del programa.
+ * @param pos       Posición en argv en la que se encuentra la distribución.
+ */
+static void getPayloadSizesOrFail(struct GeneratorConfig *config, char **argv, int pos);
+
+/**
+ * @brief   Genera tráfico hacia un host remoto.
+ *
+ * Lanza los hilos emisores configurados, que envían paquetes numerados y con marca de tiempo
+ * al host remote_receiver a la tasa pedida, agrupándolos con sendmmsg. Al terminar (por cuenta,
+ * duración o señal de terminación) imprime la tasa conseguida y los errores de envío.
+ *
+ * @param local_sender      Host que envía los paquetes.
+ * @param remote_receiver   Host al que enviar los paquetes.
+ * @param config            Configuración del generador.
+ */
+static void run_generator(Host *local_sender, Host *remote_receiver, const struct GeneratorConfig *config);
+
 
 int main(int argc, char **argv) {
     Host local_sender, remote_receiver;
@@ -95,7 +226,15 @@ int main(int argc, char **argv) {
             .local_port = DEFAULT_SENDER_PORT,
             .remote_ip = DEFAULT_RECEIVER_IP,
             .remote_port = DEFAULT_RECEIVER_PORT,
-            .logfile = DEFAULT_LOG_FILE
+            .logfile = DEFAULT_LOG_FILE,
+            .generator = {
+                    .enabled = false,
+                    .size_distribution = SIZE_FIXED,
+                    .min_size = DEFAULT_PAYLOAD_SIZE,
+                    .max_size = DEFAULT_PAYLOAD_SIZE,
+                    .threads = DEFAULT_GENERATOR_THREADS,
+                    .batch = DEFAULT_GENERATOR_BATCH
+            }
     };
 
     set_colors();
@@ -103,11 +242,33 @@ int main(int argc, char **argv) {
     /* Recogemos los parámetros recibidos en la línea de comandos */
     process_args(&args, argc, argv);
 
-    local_sender = create_own_host(AF_INET, SOCK_DGRAM, 0, args.local_port, args.logfile);
+    if (is_unix_socket_path(args.remote_ip)) {
+        int type = args.seqpacket ? SOCK_SEQPACKET : SOCK_DGRAM;
 
-    remote_receiver = create_remote_host(AF_INET, SOCK_DGRAM, 0, args.remote_ip, args.remote_port);
+        /* Con un receptor local el puerto de origen no tiene sentido: si no se dio una ruta, el núcleo asigna un nombre.
+         * Con SOCK_SEQPACKET el emisor solo se conecta, así que no necesita ruta propia */
+        local_sender = create_own_unix_host(type, args.seqpacket ? NULL : args.local_path, args.logfile);
+        remote_receiver = create_remote_host(AF_UNIX, type, 0, args.remote_ip, 0);
 
-    send_message(&local_sender, &remote_receiver);
+        if (args.seqpacket && connect_host(&local_sender, &remote_receiver) < 0) {
+            log_printf_err(local_sender.log, "Error al conectar con el receptor.\n");
+            fail("No se pudo conectar con el receptor");
+        }
+    } else {
+        if (args.seqpacket || args.local_path) {
+            fprintf(stderr, "ERROR: Las rutas de origen y la opción --seqpacket solo se admiten con un receptor local (ruta de socket)\n");
+            exit(EXIT_FAILURE);
+        }
+
+        local_sender = create_own_host(AF_INET, SOCK_DGRAM, 0, args.local_port, args.logfile);
+        remote_receiver = create_remote_host(AF_INET, SOCK_DGRAM, 0, args.remote_ip, args.remote_port);
+    }
+
+    if (args.generator.enabled) {
+        run_generator(&local_sender, &remote_receiver, &args.generator);
+    } else {
+        send_message(&local_sender, &remote_receiver);
+    }
 
     close_host(&local_sender);
     close_host(&remote_receiver);
@@ -118,23 +279,29 @@ int main(int argc, char **argv) {
 
 static void send_message(Host *local_sender, Host *remote_receiver) {
     char message_to_send[MAX_MESSAGE_SIZE];
+    char address_text[HOST_ADDRESS_STRLEN];
     ssize_t sent_bytes;
 
-    log_and_stdout_printf(local_sender->log, "IPs v4 del emisor     : %s\n", local_sender->local_ips_v4);
-    log_and_stdout_printf(local_sender->log, "IPs v6 del emisor     : %s\n", local_sender->local_ips_v6);
-    log_and_stdout_printf(local_sender->log, "Puerto del emisor     : %d UDP\n", local_sender->port);
-    log_and_stdout_printf(local_sender->log, "IP pública del emisor : %s\n", local_sender->public_ip);
+    wait_host_lookups(local_sender);
+
+    log_and_stdout_printf(local_sender->log, "IPs v4 del emisor     : %s\n", HOST_INFO_TEXT(local_sender->local_ips_v4));
+    log_and_stdout_printf(local_sender->log, "IPs v6 del emisor     : %s\n", HOST_INFO_TEXT(local_sender->local_ips_v6));
+    log_and_stdout_printf(local_sender->log, "Dirección del emisor  : %s %s\n",
+                          describe_address((struct sockaddr *) &local_sender->address, local_sender->address_len, address_text, sizeof(address_text)),
+                          host_transport_name(local_sender));
+    log_and_stdout_printf(local_sender->log, "IP pública del emisor : %s\n", HOST_INFO_TEXT(local_sender->public_ip));
 
     log_and_stdout_printf(local_sender->log, "---------------------\n");
 
-    log_and_stdout_printf(local_sender->log, "IP del receptor       : %s\n", inet_ntoa(remote_receiver->address.sin_addr));
-    log_and_stdout_printf(local_sender->log, "Puerto del receptor   : %d UDP\n", ntohs(remote_receiver->address.sin_port));
+    log_and_stdout_printf(local_sender->log, "Receptor              : %s %s\n",
+                          describe_address((struct sockaddr *) &remote_receiver->address, remote_receiver->address_len, address_text, sizeof(address_text)),
+                          host_transport_name(remote_receiver));
 
 //    sprintf(message_to_send, "El host %s en %s:%u te saluda.", local_sender->hostname, local_sender->ip, local_sender->port);
-    sprintf(message_to_send, "El host %s en %s:%u (%s) te saluda.", local_sender->hostname, local_sender->local_ips_v4, local_sender->port, local_sender->public_ip);
+    sprintf(message_to_send, "El host %s en %s:%u (%s) te saluda.", HOST_INFO_TEXT(local_sender->hostname), HOST_INFO_TEXT(local_sender->local_ips_v4), local_sender->port, HOST_INFO_TEXT(local_sender->public_ip));
 
     // Enviamos el mensaje al cliente
-    sent_bytes = sendto(local_sender->socket, message_to_send, strlen(message_to_send), /*__flags*/ 0, (struct sockaddr *) &remote_receiver->address, sizeof(remote_receiver->address));
+    sent_bytes = sendto(local_sender->socket, message_to_send, strlen(message_to_send), /*__flags*/ 0, (struct sockaddr *) &remote_receiver->address, remote_receiver->address_len);
 
     if (sent_bytes == -1) {
         log_printf_err(local_sender->log, "ERROR: Se produjo un error cuando se intentaba enviar el mensaje\n");
@@ -146,6 +313,291 @@ static void send_message(Host *local_sender, Host *remote_receiver) {
 }
 
 
+/* Tamaños IMIX a nivel IP, descontando las cabeceras IP (20 B) y UDP (8 B) */
+static const size_t imix_sizes[12] = {36, 36, 36, 36, 36, 36, 36, 548, 548, 548, 548, 1472};
+
+
+/**
+ * @brief   Elige el tamaño de la carga útil del siguiente paquete.
+ *
+ * @param config    Configuración del generador.
+ * @param rng       Estado del generador pseudoaleatorio (xorshift64) del hilo.
+ *
+ * @return  Tamaño en bytes de la carga útil.
+ */
+static size_t next_payload_size(const struct GeneratorConfig *config, uint64_t *rng) {
+    if (config->size_distribution == SIZE_FIXED) return config->min_size;
+
+    /* xorshift64: suficiente para repartir tamaños y muy barato */
+    *rng ^= *rng << 13;
+    *rng ^= *rng >> 7;
+    *rng ^= *rng << 17;
+
+    if (config->size_distribution == SIZE_IMIX) return imix_sizes[*rng % (sizeof(imix_sizes) / sizeof(imix_sizes[0]))];
+
+    return config->min_size + *rng % (config->max_size - config->min_size + 1);
+}
+
+
+/**
+ * @brief   Espera hasta un instante dado de CLOCK_MONOTONIC.
+ *
+ * Duerme con clock_nanosleep hasta poco antes del instante, y el resto lo espera activamente,
+ * para no depender de la granularidad del planificador. Duerme en tramos de como mucho
+ * PACING_MAX_SLEEP_NS y mira entre ellos, y durante la espera activa, si se pidió terminar.
+ *
+ * @param host          Host emisor.
+ * @param release_ns    Instante (en nanosegundos de CLOCK_MONOTONIC) hasta el que esperar.
+ *
+ * @return  true si se llegó al instante; false si antes se pidió terminar.
+ */
+static bool pace_until(Host *host, uint64_t release_ns) {
+    uint64_t now, sleep_until;
+    struct timespec wake_up;
+
+    while ( (now = traffic_monotonic_ns()) + PACING_SPIN_NS < release_ns) {
+        if (is_host_terminating(host)) return false;
+        sleep_until = release_ns - PACING_SPIN_NS;
+        if (sleep_until > now + PACING_MAX_SLEEP_NS) sleep_until = now + PACING_MAX_SLEEP_NS;
+
+        wake_up.tv_sec = sleep_until / 1000000000ULL;
+        wake_up.tv_nsec = sleep_until % 1000000000ULL;
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake_up, NULL);
+    }
+
+    /* Espera activa el resto del tiempo */
+    while (traffic_monotonic_ns() < release_ns) {
+        if (is_host_terminating(host)) return false;
+    }
+
+    return true;
+}
+
+
+/**
+ * @brief   Espera a que el socket del host vuelva a admitir datos tras un envío fallido por falta de espacio.
+ *
+ * @param host      Host emisor.
+ * @param error     errno del envío fallido (EAGAIN, EWOULDBLOCK o ENOBUFS).
+ */
+static void wait_for_send_room(Host *host, int error) {
+    struct pollfd writable = {.fd = host->socket, .events = POLLOUT};
+    struct timespec backoff = {.tv_sec = 0, .tv_nsec = SEND_RETRY_BACKOFF_NS};
+
+    if (error == ENOBUFS) {
+        nanosleep(&backoff, NULL);
+        return;
+    }
+
+    poll(&writable, 1, SEND_RETRY_POLL_MS);
+}
+
+
+/**
+ * @brief   Cuerpo de cada hilo emisor del generador.
+ *
+ * @param arg   Puntero a la struct GeneratorThread del hilo.
+ *
+ * @return  NULL.
+ */
+static void *generator_thread(void *arg) {
+    struct GeneratorThread *self = (struct GeneratorThread *) arg;
+    const struct GeneratorConfig *config = self->config;
+    unsigned batch = config->batch;
+    uint64_t attempted = 0;         /* Paquetes intentados (enviados o fallidos); determina secuencia y ritmo */
+    uint64_t attempted_bits = 0;    /* Bits de carga útil intentados, para el ritmo en bits por segundo */
+    uint64_t rng = 0x9E3779B97F4A7C15ULL * (self->id + 1);
+    uint64_t start_ns, duration_ns = (uint64_t) (config->duration * 1e9);
+    double average_size, burst_packets = 0;
+    char *payloads;
+    struct mmsghdr *messages;
+    struct iovec *iovecs;
+
+    /* Limitamos el tamaño de la ráfaga para que cada llamada a sendmmsg no agrupe más de PACING_MAX_BURST_NS de tráfico */
+    if (config->size_distribution == SIZE_IMIX) {
+        average_size = 0;
+        for (size_t i = 0; i < sizeof(imix_sizes) / sizeof(imix_sizes[0]); i++) average_size += imix_sizes[i];
+        average_size /= sizeof(imix_sizes) / sizeof(imix_sizes[0]);
+    } else {
+        average_size = (config->min_size + config->max_size) / 2.0;
+    }
+    if (self->packets_per_second > 0) {
+        burst_packets = self->packets_per_second * PACING_MAX_BURST_NS / 1e9;
+    } else if (self->bits_per_second > 0) {
+        burst_packets = self->bits_per_second / (8 * average_size) * PACING_MAX_BURST_NS / 1e9;
+    }
+    if (burst_packets > 0 && burst_packets < batch) {
+        batch = burst_packets < 1 ? 1 : (unsigned) burst_packets;
+    }
+
+    payloads = (char *) calloc((size_t) batch * config->max_size, sizeof(char));
+    messages = (struct mmsghdr *) calloc(batch, sizeof(struct mmsghdr));
+    iovecs = (struct iovec *) calloc(batch, sizeof(struct iovec));
+    if (!payloads || !messages || !iovecs) {
+        log_printf_err(self->local_sender->log, "ERROR: No se pudo reservar memoria para el hilo emisor %u\n", self->id);
+        fail("No se pudo reservar memoria para el hilo emisor");
+    }
+
+    /* Las direcciones y buffers de cada mensaje no cambian entre lotes; solo su tamaño y cabecera */
+    for (unsigned i = 0; i < batch; i++) {
+        memset(payloads + (size_t) i * config->max_size, 'x', config->max_size);
+        iovecs[i].iov_base = payloads + (size_t) i * config->max_size;
+        messages[i].msg_hdr = (struct msghdr) {
+            .msg_name = &self->remote_receiver->address,
+            .msg_namelen = self->remote_receiver->address_len,
+            .msg_iov = &iovecs[i],
+            .msg_iovlen = 1
+        };
+    }
+
+    start_ns = traffic_monotonic_ns();
+
+    while (!is_host_terminating(self->local_sender)) {
+        unsigned to_send = batch;
+        uint64_t now_ns;
+        int sent;
+
+        if (self->count) {
+            if (attempted >= self->count) break;
+            if (self->count - attempted < to_send) to_send = self->count - attempted;
+        }
+
+        if (duration_ns && traffic_monotonic_ns() - start_ns >= duration_ns) break;
+
+        /* Esperamos al instante en que toca enviar el primer paquete del lote */
+        if (self->packets_per_second > 0) {
+            if (!pace_until(self->local_sender, start_ns + (uint64_t) (attempted * 1e9 / self->packets_per_second))) break;
+        } else if (self->bits_per_second > 0) {
+            if (!pace_until(self->local_sender, start_ns + (uint64_t) (attempted_bits * 1e9 / self->bits_per_second))) break;
+        }
+
+        /* Preparamos el lote: tamaño de cada paquete, número de secuencia y marca de tiempo */
+        now_ns = traffic_realtime_ns();
+        for (unsigned i = 0; i < to_send; i++) {
+            iovecs[i].iov_len = next_payload_size(config, &rng);
+            traffic_header_write(iovecs[i].iov_base, self->id, attempted + i, now_ns);
+        }
+
+        sent = sendmmsg(self->local_sender->socket, messages, to_send, 0);
+
+        if (sent < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS) {
+                /* El buffer de envío del socket está lleno: esperamos a que haya sitio y reintentamos el mismo lote */
+                self->eagain_retries++;
+                wait_for_send_room(self->local_sender, errno);
+                continue;
+            }
+            /* El primer mensaje del lote falló: lo contamos como error y seguimos con el siguiente */
+            self->last_error = errno;
+            self->send_errors++;
+            attempted_bits += 8 * iovecs[0].iov_len;
+            attempted++;
+            continue;
+        }
+
+        for (int i = 0; i < sent; i++) {
+            self->sent_bytes += messages[i].msg_len;
+            attempted_bits += 8 * iovecs[i].iov_len;
+        }
+        self->sent_packets += sent;
+        attempted += sent;
+    }
+
+    self->elapsed_ns = traffic_monotonic_ns() - start_ns;
+
+    free(payloads);
+    free(messages);
+    free(iovecs);
+
+    return NULL;
+}
+
+
+static void run_generator(Host *local_sender, Host *remote_receiver, const struct GeneratorConfig *config) {
+    struct GeneratorThread threads[MAX_GENERATOR_THREADS];
+    unsigned thread_count;
+    uint64_t total_packets = 0, total_bytes = 0, total_errors = 0, total_retries = 0, max_elapsed_ns = 0;
+    sigset_t blocked_signals, previous_signals;
+    char address_text[HOST_ADDRESS_STRLEN];
+    double seconds;
+
+    /* Con menos paquetes que hilos, los que no tendrían ninguno no se arrancan (una cuenta de 0 sería sin límite) */
+    thread_count = config->count && config->count < config->threads ? (unsigned) config->count : config->threads;
+
+    log_and_stdout_printf(local_sender->log, "Receptor              : %s %s\n",
+                          describe_address((struct sockaddr *) &remote_receiver->address, remote_receiver->address_len, address_text, sizeof(address_text)),
+                          host_transport_name(remote_receiver));
+    log_and_stdout_printf(local_sender->log, "---------------------\n");
+    log_and_stdout_printf(local_sender->log, "Generando tráfico     : %u hilo(s), lotes de hasta %u paquetes, carga útil de %zu a %zu bytes%s\n",
+                          thread_count, config->batch, config->min_size, config->max_size, config->size_distribution == SIZE_IMIX ? " (IMIX)" : "");
+    log_and_stdout_printf(local_sender->log, "Tasa objetivo         : %s%.0f pps, %.3f Mbit/s\n",
+                          config->packets_per_second || config->bits_per_second ? "" : "sin límite; ", config->packets_per_second, config->bits_per_second / 1e6);
+    log_and_stdout_printf(local_sender->log, "Límite                : %" PRIu64 " paquetes, %.3f s (0 = sin límite)\n", config->count, config->duration);
+
+    /* Los hilos emisores no deben recibir las señales del host: las atiende el hilo principal,
+     * que es el que marca la terminación */
+    sigemptyset(&blocked_signals);
+    sigaddset(&blocked_signals, SIGIO);
+    sigaddset(&blocked_signals, SIGINT);
+    sigaddset(&blocked_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &blocked_signals, &previous_signals);
+
+    for (unsigned i = 0; i < thread_count; i++) {
+        threads[i] = (struct GeneratorThread) {
+            .id = i,
+            .local_sender = local_sender,
+            .remote_receiver = remote_receiver,
+            .config = config,
+            .packets_per_second = config->packets_per_second / thread_count,
+            .bits_per_second = config->bits_per_second / thread_count,
+            .count = config->count ? config->count / thread_count + (i < config->count % thread_count) : 0
+        };
+
+        if (pthread_create(&threads[i].thread, NULL, generator_thread, &threads[i])) {
+            log_printf_err(local_sender->log, "ERROR: No se pudo crear el hilo emisor %u\n", i);
+            fail("No se pudo crear el hilo emisor");
+        }
+    }
+
+    pthread_sigmask(SIG_SETMASK, &previous_signals, NULL);
+
+    for (unsigned i = 0; i < thread_count; i++) {
+        pthread_join(threads[i].thread, NULL);
+    }
+
+    log_and_stdout_printf(local_sender->log, "---------------------\n");
+    log_and_stdout_printf(local_sender->log, "Hilo\tPaquetes\tBytes\t\tErrores\tEAGAIN\tpps\t\tMbit/s\n");
+
+    for (unsigned i = 0; i < thread_count; i++) {
+        struct GeneratorThread *t = &threads[i];
+
+        seconds = t->elapsed_ns / 1e9;
+        log_and_stdout_printf(local_sender->log, "%u\t%" PRIu64 "\t\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%.0f\t\t%.3f\n", t->id, t->sent_packets, t->sent_bytes,
+                              t->send_errors, t->eagain_retries, seconds > 0 ? t->sent_packets / seconds : 0, seconds > 0 ? 8 * t->sent_bytes / seconds / 1e6 : 0);
+
+        if (t->last_error) {
+            log_and_stdout_printf(local_sender->log, "    Último error del hilo %u: %s\n", t->id, strerror(t->last_error));
+        }
+
+        total_packets += t->sent_packets;
+        total_bytes += t->sent_bytes;
+        total_errors += t->send_errors;
+        total_retries += t->eagain_retries;
+        if (t->elapsed_ns > max_elapsed_ns) max_elapsed_ns = t->elapsed_ns;
+    }
+
+    seconds = max_elapsed_ns / 1e9;
+    log_and_stdout_printf(local_sender->log, "---------------------\n");
+    log_and_stdout_printf(local_sender->log, "Paquetes enviados     : %" PRIu64 "\n", total_packets);
+    log_and_stdout_printf(local_sender->log, "Bytes enviados        : %" PRIu64 "\n", total_bytes);
+    log_and_stdout_printf(local_sender->log, "Errores de envío      : %" PRIu64 "\n", total_errors);
+    log_and_stdout_printf(local_sender->log, "Reintentos por EAGAIN : %" PRIu64 "\n", total_retries);
+    log_and_stdout_printf(local_sender->log, "Tiempo de envío       : %.6f s\n", seconds);
+    log_and_stdout_printf(local_sender->log, "Tasa conseguida       : %.0f pps, %.3f Mbit/s\n",
+                          seconds > 0 ? total_packets / seconds : 0, seconds > 0 ? 8 * total_bytes / seconds / 1e6 : 0);
+}
+
+
 static void print_help(char *exe_name) {
     printf("\n");
 
@@ -160,15 +612,34 @@ static void print_help(char *exe_name) {
     printf("  $ %s # Tomará los parámetros por defecto\n", exe_name);
     printf("  $ %s %d %s %d\n", exe_name, DEFAULT_SENDER_PORT, DEFAULT_RECEIVER_IP, DEFAULT_RECEIVER_PORT);
     printf("  $ %s -o %d -i %s -p %d\n", exe_name, DEFAULT_SENDER_PORT, DEFAULT_RECEIVER_IP, DEFAULT_RECEIVER_PORT);
+    printf("Ejemplo de generador: 4 hilos a 1 Mpps con cargas de 64 a 1400 bytes durante 10 segundos:\n");
+    printf("  $ %s -t 4 -r 1M -s 64-1400 -d 10\n", exe_name);
+    printf("Ejemplo con sockets locales (AF_UNIX) en lugar de UDP: basta con dar rutas en lugar de IP y puertos:\n");
+    printf("  $ %s -i /tmp/receptor.sock\n", exe_name);
 
     printf("\n");
 
     /** Lista de parámetros "importantes" **/
     printf("Parámetros \tParámetro largo \tPor defecto \tDescripción\n");
 
-    printf("  -o <origen>\t--origen <puerto_org> \t%d \t\tPuerto desde donde se enviará el mensaje.\n", DEFAULT_SENDER_PORT);
-    printf("  -i <ip>\t--ip <ip_dest>\t\t%s \tIP del receptor del mensaje.\n", DEFAULT_RECEIVER_IP);
-    printf("  -p <puerto>\t--puerto <puerto_dest>\t%d \t\tPuerto del receptor al que se enviará el mensaje.\n", DEFAULT_RECEIVER_PORT);
+    printf("  -o <origen>\t--origen <puerto_org> \t%d \t\tPuerto desde donde se enviará el mensaje (o ruta del socket local).\n", DEFAULT_SENDER_PORT);
+    printf("  -i <ip>\t--ip <ip_dest>\t\t%s \tIP del receptor del mensaje (o ruta de su socket local, p. ej. /tmp/receptor.sock).\n", DEFAULT_RECEIVER_IP);
+    printf("  -p <puerto>\t--puerto <puerto_dest>\t%d \t\tPuerto del receptor al que se enviará el mensaje (se ignora con sockets locales).\n", DEFAULT_RECEIVER_PORT);
+    printf("  -q\t\t--seqpacket\t\t\t\tCon sockets locales, usar SOCK_SEQPACKET (conexión) en lugar de datagramas.\n");
+
+    printf("\n");
+
+    /** Lista de opciones del generador de tráfico **/
+    printf("Generador de tráfico (cualquiera de estas opciones sustituye el mensaje de saludo por un flujo de paquetes numerados):\n");
+    printf("Opción \t\tOpción larga \t\tPor defecto \tDescripción\n");
+
+    printf("  -r <pps>\t--pps <pps>\t\tsin límite \tTasa objetivo en paquetes por segundo (admite sufijos k, M, G).\n");
+    printf("  -b <bps>\t--bps <bps>\t\tsin límite \tTasa objetivo en bits de carga útil por segundo (admite sufijos k, M, G).\n");
+    printf("  -s <tamaño>\t--tam <tamaño>\t\t%d \t\tCarga útil en bytes: fija (<n>), uniforme (<min>-<max>) o \"imix\".\n", DEFAULT_PAYLOAD_SIZE);
+    printf("  -c <n>\t--cuenta <n>\t\tsin límite \tNúmero total de paquetes a enviar.\n");
+    printf("  -d <seg>\t--duracion <seg>\tsin límite \tDuración máxima del envío en segundos.\n");
+    printf("  -t <hilos>\t--hilos <hilos>\t\t%d \t\tNúmero de hilos emisores (máximo %d).\n", DEFAULT_GENERATOR_THREADS, MAX_GENERATOR_THREADS);
+    printf("  -k <lote>\t--lote <lote>\t\t%d \t\tMáximo de paquetes por llamada a sendmmsg (máximo %d).\n", DEFAULT_GENERATOR_BATCH, MAX_GENERATOR_BATCH);
 
     printf("\n");
 
@@ -200,6 +671,71 @@ static uint16_t getPortOrFail(char **argv, int pos) {
 }
 
 
+static double getRateOrFail(char **argv, int pos) {
+    char *suffix;
+    double rate = strtod(argv[pos], &suffix);
+
+    switch (*suffix) {
+        case 'k': rate *= 1e3; suffix++; break;
+        case 'M': rate *= 1e6; suffix++; break;
+        case 'G': rate *= 1e9; suffix++; break;
+        default: break;
+    }
+
+    if (*suffix != '\0' || !(rate > 0)) {
+        fprintf(stderr, "ERROR: La tasa especificada (%s) no es válida\n", argv[pos]);
+        print_help(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    return rate;
+}
+
+static uint64_t getPositiveNumberOrFail(char **argv, int pos, uint64_t max) {
+    char *end;
+    unsigned long long read_number = strtoull(argv[pos], &end, 10);
+
+    if (*end != '\0' || read_number == 0 || read_number > max || argv[pos][0] == '-') {
+        fprintf(stderr, "ERROR: El valor especificado (%s) no es válido\n", argv[pos]);
+        print_help(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    return read_number;
+}
+
+static void getPayloadSizesOrFail(struct GeneratorConfig *config, char **argv, int pos) {
+    unsigned long min_size, max_size;
+    char extra;
+
+    if (!strcmp(argv[pos], "imix")) {
+        config->size_distribution = SIZE_IMIX;
+        config->min_size = 36;
+        config->max_size = 1472;
+        return;
+    }
+
+    if (sscanf(argv[pos], "%lu-%lu%c", &min_size, &max_size, &extra) == 2) {
+        config->size_distribution = SIZE_UNIFORM;
+    } else if (sscanf(argv[pos], "%lu%c", &min_size, &extra) == 1) {
+        config->size_distribution = SIZE_FIXED;
+        max_size = min_size;
+    } else {
+        min_size = max_size = 0;    /* Forzamos el error */
+    }
+
+    if (min_size < TRAFFIC_HEADER_LEN || max_size > MAX_UDP_PAYLOAD || min_size > max_size) {
+        fprintf(stderr, "ERROR: El tamaño de carga útil especificado (%s) no es válido (debe estar entre %d y %d bytes)\n",
+                argv[pos], TRAFFIC_HEADER_LEN, MAX_UDP_PAYLOAD);
+        print_help(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    config->min_size = min_size;
+    config->max_size = max_size;
+}
+
+
 static void process_args(struct Arguments *args, int argc, char **argv) {
     bool allow_unnamed_basic_params = true;
 
@@ -224,6 +760,22 @@ static void process_args(struct Arguments *args, int argc, char **argv) {
                     current_option = OPT_RECEIVER_IP; // 'i'
                 } else if (!strcmp(current_arg_str, "--puerto")) {
                     current_option = OPT_RECEIVER_PORT; // 'p'
+                } else if (!strcmp(current_arg_str, "--pps")) {
+                    current_option = OPT_PACKETS_PER_SECOND; // 'r'
+                } else if (!strcmp(current_arg_str, "--bps")) {
+                    current_option = OPT_BITS_PER_SECOND; // 'b'
+                } else if (!strcmp(current_arg_str, "--tam")) {
+                    current_option = OPT_PAYLOAD_SIZE; // 's'
+                } else if (!strcmp(current_arg_str, "--cuenta")) {
+                    current_option = OPT_COUNT; // 'c'
+                } else if (!strcmp(current_arg_str, "--duracion")) {
+                    current_option = OPT_DURATION; // 'd'
+                } else if (!strcmp(current_arg_str, "--hilos")) {
+                    current_option = OPT_THREADS; // 't'
+                } else if (!strcmp(current_arg_str, "--lote")) {
+                    current_option = OPT_BATCH; // 'k'
+                } else if (!strcmp(current_arg_str, "--seqpacket")) {
+                    current_option = OPT_SEQPACKET; // 'q'
                 } else if (!strcmp(current_arg_str, "--log")) {
                     current_option = OPT_LOG_FILE_NAME; // 'l'
                 } else if (!strcmp(current_arg_str, "--no-log")) {
@@ -261,7 +813,11 @@ static void process_args(struct Arguments *args, int argc, char **argv) {
         switch (current_option) {
             case OPT_SOURCE_PORT: // 'o' /* Puerto Emisor */
                 if (++pos < argc) {
-                    args->local_port = getPortOrFail(argv, pos);
+                    if (is_unix_socket_path(argv[pos])) {
+                        args->local_path = argv[pos];
+                    } else {
+                        args->local_port = getPortOrFail(argv, pos);
+                    }
                 } else {
                     fprintf(stderr, "ERROR: Puerto no especificado tras la opción '-o'\n");
                     print_help(argv[0]);
@@ -290,6 +846,87 @@ static void process_args(struct Arguments *args, int argc, char **argv) {
                 }
                 break;
 
+            case OPT_PACKETS_PER_SECOND: // 'r' /* Tasa en paquetes por segundo */
+                if (++pos < argc) {
+                    args->generator.packets_per_second = getRateOrFail(argv, pos);
+                    args->generator.enabled = true;
+                } else {
+                    fprintf(stderr, "ERROR: Tasa no especificada tras la opción '-r'\n");
+                    print_help(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+
+            case OPT_BITS_PER_SECOND: // 'b' /* Tasa en bits por segundo */
+                if (++pos < argc) {
+                    args->generator.bits_per_second = getRateOrFail(argv, pos);
+                    args->generator.enabled = true;
+                } else {
+                    fprintf(stderr, "ERROR: Tasa no especificada tras la opción '-b'\n");
+                    print_help(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+
+            case OPT_PAYLOAD_SIZE: // 's' /* Distribución del tamaño de la carga útil */
+                if (++pos < argc) {
+                    getPayloadSizesOrFail(&args->generator, argv, pos);
+                    args->generator.enabled = true;
+                } else {
+                    fprintf(stderr, "ERROR: Tamaño no especificado tras la opción '-s'\n");
+                    print_help(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+
+            case OPT_COUNT: // 'c' /* Número de paquetes */
+                if (++pos < argc) {
+                    args->generator.count = getPositiveNumberOrFail(argv, pos, UINT64_MAX);
+                    args->generator.enabled = true;
+                } else {
+                    fprintf(stderr, "ERROR: Número de paquetes no especificado tras la opción '-c'\n");
+                    print_help(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+
+            case OPT_DURATION: // 'd' /* Duración */
+                if (++pos < argc) {
+                    args->generator.duration = getRateOrFail(argv, pos);
+                    args->generator.enabled = true;
+                } else {
+                    fprintf(stderr, "ERROR: Duración no especificada tras la opción '-d'\n");
+                    print_help(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+
+            case OPT_THREADS: // 't' /* Hilos emisores */
+                if (++pos < argc) {
+                    args->generator.threads = getPositiveNumberOrFail(argv, pos, MAX_GENERATOR_THREADS);
+                    args->generator.enabled = true;
+                } else {
+                    fprintf(stderr, "ERROR: Número de hilos no especificado tras la opción '-t'\n");
+                    print_help(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+
+            case OPT_BATCH: // 'k' /* Tamaño del lote de sendmmsg */
+                if (++pos < argc) {
+                    args->generator.batch = getPositiveNumberOrFail(argv, pos, MAX_GENERATOR_BATCH);
+                    args->generator.enabled = true;
+                } else {
+                    fprintf(stderr, "ERROR: Tamaño de lote no especificado tras la opción '-k'\n");
+                    print_help(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+
+            case OPT_SEQPACKET: // 'q' /* SOCK_SEQPACKET */
+                args->seqpacket = true;
+                break;
+
             case OPT_LOG_FILE_NAME: // 'l' /* Log */
                 if (++pos < argc) {
                     args->logfile = argv[pos];
@@ -1,3 +1,5 @@
+#define _GNU_SOURCE     /* Para recvmmsg y struct mmsghdr */
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <sys/socket.h>
@@ -7,15 +9,41 @@
 #include <arpa/inet.h>
 #include <errno.h>
 #include <unistd.h>
+#include <inttypes.h>
 
 #include "host.h"
 #include "loging.h"
+#include "traffic.h"
+#include "timestamps.h"
+#include "packetring.h"
+#include "bufferpool.h"
 
 
 #define DEFAULT_MAX_BYTES_RECV 2048
 #define DEFAULT_RECEIVER_PORT 8200
 #define DEFAULT_LOG_FILE "receptor.log"
 
+#define DEFAULT_SINK_INTERVAL 1.0
+
+/* Máximo número de flujos (hilos emisores) distintos que distingue el modo medición */
+#define MAX_STREAMS 64
+/* Número de números de secuencia recientes que se recuerdan para detectar duplicados (múltiplo de 64) */
+#define SEQ_WINDOW 1024
+/* Máximo número de datagramas que se reciben en cada llamada a recvmmsg */
+#define SINK_BATCH 64
+
+
+/**
+ * Configuración del modo de medición.
+ */
+struct SinkConfig {
+    bool enabled;           /* Vale true si se pidió el modo de medición en lugar de recibir un único mensaje */
+    double interval;        /* Segundos entre cada informe parcial */
+    double duration;        /* Duración de la medición en segundos (0 = hasta recibir una señal de terminación) */
+    char *json_file;        /* Archivo en el que escribir el informe en JSON ("-" para stdout, NULL para no escribirlo) */
+    FILE *json_stdout;      /* Con json_file "-", la salida estándar original, reservada para el informe JSON */
+    char *ring_interface;   /* Interfaz de la que leer con un anillo TPACKET_V3 (NULL para leer del socket UDP) */
+};
 
 /**
  * Estructura de datos para pasar a la función process_args.
@@ -25,8 +53,65 @@
  */
 struct Arguments {
     uint16_t receiver_port;
+    char *receiver_path;    /* Ruta del socket local (AF_UNIX) en la que recibir en lugar del puerto UDP */
+    bool seqpacket;         /* Usar SOCK_SEQPACKET en lugar de datagramas (solo con sockets locales) */
     size_t max_bytes_to_read;
     char *logfile;
+    struct SinkConfig sink;
+};
+
+/**
+ * Estadísticas de cada flujo de tráfico (identificado por el campo stream de la cabecera).
+ */
+struct StreamStats {
+    bool active;                /* Vale true si se recibió algún paquete del flujo */
+    uint64_t next_seq;          /* Siguiente número de secuencia esperado (máximo recibido + 1) */
+    uint64_t window[SEQ_WINDOW / 64];   /* Mapa de bits de los últimos SEQ_WINDOW números de secuencia recibidos */
+    uint64_t packets;           /* Paquetes recibidos, incluidos duplicados */
+    uint64_t unique_packets;    /* Paquetes distintos recibidos */
+    uint64_t bytes;             /* Bytes de carga útil recibidos */
+    uint64_t reordered;         /* Paquetes recibidos después de otro con mayor número de secuencia */
+    uint64_t duplicates;        /* Paquetes recibidos más de una vez */
+    double jitter_ns;           /* Estimación del jitter entre llegadas (RFC 3550) */
+    int64_t transit_ns_min;     /* Mínimo tiempo de tránsito (latencia de un sentido) observado */
+    int64_t transit_ns_max;     /* Máximo tiempo de tránsito observado */
+    int64_t transit_ns_total;   /* Suma de los tiempos de tránsito, para la media */
+    int64_t last_transit;       /* Tiempo de tránsito relativo del último paquete */
+    bool has_transit;           /* Vale true si last_transit es válido */
+};
+
+/**
+ * Contadores acumulados de todos los flujos en un instante dado.
+ */
+struct SinkSnapshot {
+    uint64_t packets, bytes, expected, unique, reordered, duplicates;
+    double jitter_ns;
+};
+
+/**
+ * Resultados de un intervalo de medida.
+ */
+struct SinkInterval {
+    double start, end;          /* Inicio y fin del intervalo, en segundos desde el inicio de la medición */
+    uint64_t packets, bytes, expected, lost, reordered, duplicates;
+    double mbps, jitter_ms;
+};
+
+/**
+ * Estado completo del modo de medición.
+ */
+struct Sink {
+    struct StreamStats streams[MAX_STREAMS];
+    uint64_t packets;           /* Datagramas recibidos en total */
+    uint64_t bytes;             /* Bytes recibidos en total */
+    uint64_t foreign_packets;   /* Datagramas sin cabecera de tráfico válida */
+    uint64_t truncated;         /* Datagramas más grandes que el buffer, de los que solo se leyó el principio */
+    uint64_t kernel_timestamped;    /* Datagramas cuya llegada se fechó con la marca de tiempo del núcleo */
+    uint64_t start_ns;          /* Inicio de la medición (CLOCK_MONOTONIC) */
+    uint64_t interval_start_ns; /* Inicio del intervalo en curso (CLOCK_MONOTONIC) */
+    struct SinkSnapshot interval_base;  /* Contadores al inicio del intervalo en curso */
+    struct SinkInterval *intervals;     /* Intervalos cerrados, para el informe JSON */
+    size_t intervals_len, intervals_capacity;
 };
 
 /**
@@ -37,6 +122,12 @@ enum Option {
     OPT_OPTION_FLAG = '-',
     OPT_RECEIVER_PORT = 'p',
     OPT_MAX_BYTES_TO_READ = 'b',
+    OPT_SINK = 'm',
+    OPT_SINK_INTERVAL = 'i',
+    OPT_SINK_DURATION = 'd',
+    OPT_SINK_JSON = 'j',
+    OPT_SINK_RING = 'a',
+    OPT_SEQPACKET = 'q',
     OPT_LOG_FILE_NAME = 'l',
     OPT_NO_LOG = 'n',
     OPT_HELP = 'h'
@@ -94,24 +185,79 @@ static size_t getMaxBytesToReadOrFail(char **argv, int pos);
  *
  * Hace que el host escuche por su socket asociado por un mensaje.
  * Cuando lo recibe, lo imprime y muestra también desde qué IP y puerto se envió.
+ * El mensaje se lee siempre entero: si ocupa más de max_bytes_to_read, se amplía el buffer.
  *
  * @param local_receiver  Host que escuche por el mensaje.
+ * @param buffers         Reserva de la que tomar el buffer de recepción (de max_bytes_to_read + 1 bytes).
  * @param max_bytes_to_read Número de bytes máximo que aceptar en el mensaje.
  *
  * @return  Número de bytes recibidos.
  */
-static ssize_t handle_message(Host *local_receiver, size_t max_bytes_to_read);
+static ssize_t handle_message(Host *local_receiver, BufferPool *buffers, size_t max_bytes_to_read);
+
+/**
+ * @brief   Obtiene un número de segundos de los argumentos del programa.
+ *
+ * @param argv  Lista con los argumentos del programa.
+ * @param pos   Posición en argv en la que se encuentra la string que se quiere interpretar como segundos.
+ *
+ * @return  Número de segundos (positivo) leído de los argumentos del programa; falla si no es válido.
+ */
+static double getSecondsOrFail(char **argv, int pos);
+
+/**
+ * @brief   Mide el tráfico que llega al receptor.
+ *
+ * Recibe datagramas en lotes con recvmmsg (o, si se pidió, recorriendo en su sitio los bloques de un
+ * anillo TPACKET_V3 de la interfaz) y, a partir de la cabecera de secuencia y marca de tiempo
+ * que estampa el generador de tráfico del emisor, calcula para cada intervalo el caudal, las pérdidas,
+ * los paquetes desordenados y duplicados y el jitter según el RFC 3550. Al terminar imprime un resumen
+ * en forma de tabla y, si se pidió, en JSON.
+ *
+ * @param local_receiver    Host que recibe el tráfico.
+ * @param max_bytes_to_read Número de bytes máximo que copiar de cada datagrama.
+ * @param config            Configuración de la medición.
+ */
+static void run_sink(Host *local_receiver, size_t max_bytes_to_read, const struct SinkConfig *config);
+
+/**
+ * @brief   Contabiliza un datagrama leído del anillo TPACKET_V3 (ver PacketRingHandler).
+ *
+ * @param context       Medición en curso (struct Sink *).
+ * @param payload       Carga útil UDP.
+ * @param captured_len  Bytes de carga útil disponibles.
+ * @param wire_len      Longitud real de la carga útil.
+ * @param arrival_ns    Marca de tiempo de llegada del núcleo.
+ */
+static void sink_account_ring(void *context, const char *payload, size_t captured_len, size_t wire_len, uint64_t arrival_ns);
+
+/**
+ * @brief   Espera a que un emisor se conecte al receptor (SOCK_SEQPACKET).
+ *
+ * @param listener      Host que escucha conexiones.
+ * @param connection    Host en el que guardar la conexión aceptada.
+ *
+ * @return  true si se aceptó una conexión; false si se pidió la terminación antes.
+ */
+static bool wait_for_connection(Host *listener, Host *connection);
 
 
 int main(int argc, char **argv) {
-    Host local_receiver;
+    Host local_receiver, connection;
+    Host *receiving = &local_receiver;     /* Host por el que llegan los mensajes: el propio o la conexión aceptada */
+    char address_text[HOST_ADDRESS_STRLEN];
     ssize_t received_bytes = 0;
+    BufferPool buffers = {0};
 
     /* Inicializamos los parámetros a sus valores por defecto */
     struct Arguments args = {
             .receiver_port = DEFAULT_RECEIVER_PORT,
             .max_bytes_to_read = DEFAULT_MAX_BYTES_RECV,
-            .logfile = DEFAULT_LOG_FILE
+            .logfile = DEFAULT_LOG_FILE,
+            .sink = {
+                    .enabled = false,
+                    .interval = DEFAULT_SINK_INTERVAL
+            }
     };
 
     set_colors();
@@ -119,30 +265,71 @@ int main(int argc, char **argv) {
     /* Recogemos los parámetros recibidos en la línea de comandos */
     process_args(&args, argc, argv);
 
-    local_receiver = create_own_host(AF_INET, SOCK_DGRAM, 0, args.receiver_port, args.logfile);
+    /* Con "-j -" la salida estándar queda solo para el informe JSON: todo lo demás (también lo que muestra
+     * la biblioteca de hosts) pasa a la salida de errores */
+    if (args.sink.json_file && !strcmp(args.sink.json_file, "-")) {
+        int json_fd = dup(STDOUT_FILENO);
 
+        if (json_fd < 0 || !(args.sink.json_stdout = fdopen(json_fd, "w")) || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+            fail("ERROR: No se pudo reservar la salida estándar para el informe JSON");
+        }
+    }
 
-    log_and_stdout_printf(local_receiver.log, "IPs v4 del receptor     : %s\n", local_receiver.local_ips_v4);
-    log_and_stdout_printf(local_receiver.log, "IPs v6 del receptor     : %s\n", local_receiver.local_ips_v6);
-    log_and_stdout_printf(local_receiver.log, "Puerto del receptor     : %d UDP\n", local_receiver.port);
-    log_and_stdout_printf(local_receiver.log, "IP pública del receptor : %s\n", local_receiver.public_ip);
+    if (args.receiver_path && args.sink.ring_interface) {
+        fprintf(stderr, "ERROR: El anillo TPACKET_V3 solo captura UDP: no se admite con un socket local\n");
+        exit(EXIT_FAILURE);
+    } else if (args.receiver_path) {
+        local_receiver = create_own_unix_host(args.seqpacket ? SOCK_SEQPACKET : SOCK_DGRAM, args.receiver_path, args.logfile);
+    } else if (args.seqpacket) {
+        fprintf(stderr, "ERROR: La opción --seqpacket solo se admite con un socket local (ruta en lugar de puerto)\n");
+        exit(EXIT_FAILURE);
+    } else {
+        local_receiver = create_own_host(AF_INET, SOCK_DGRAM, 0, args.receiver_port, args.logfile);
+    }
+
+    describe_address((struct sockaddr *) &local_receiver.address, local_receiver.address_len, address_text, sizeof(address_text));
+
+    wait_host_lookups(&local_receiver);
+    log_and_stdout_printf(local_receiver.log, "IPs v4 del receptor     : %s\n", HOST_INFO_TEXT(local_receiver.local_ips_v4));
+    log_and_stdout_printf(local_receiver.log, "IPs v6 del receptor     : %s\n", HOST_INFO_TEXT(local_receiver.local_ips_v6));
+    log_and_stdout_printf(local_receiver.log, "Dirección del receptor  : %s %s\n", address_text, host_transport_name(&local_receiver));
+    log_and_stdout_printf(local_receiver.log, "IP pública del receptor : %s\n", HOST_INFO_TEXT(local_receiver.public_ip));
     log_and_stdout_printf(local_receiver.log, "Máximo de bytes a leer  : %ld (apartado c)\n", args.max_bytes_to_read);
 
     log_and_stdout_printf(local_receiver.log, "\n==============================\n");
 
-    log_and_stdout_printf(local_receiver.log, "Escuchando en el puerto : %d UDP...\n", local_receiver.port);
+    log_and_stdout_printf(local_receiver.log, "Escuchando en          : %s %s...\n", address_text, host_transport_name(&local_receiver));
+
+    /* Con SOCK_SEQPACKET los mensajes llegan por la conexión del emisor, no por el socket que escucha */
+    if (local_receiver.type == SOCK_SEQPACKET) {
+        if (wait_for_connection(&local_receiver, &connection)) {
+            receiving = &connection;
+        } else {
+            request_host_termination(&local_receiver);
+        }
+    }
+
+    if (args.sink.enabled && !is_host_terminating(&local_receiver)) {
+        run_sink(receiving, args.max_bytes_to_read, &args.sink);
+        request_host_termination(&local_receiver);    /* La medición solo termina al acabar su duración, al recibir una señal de terminación o al cerrarse la conexión */
+    }
+
+    /* Un único buffer, que se recicla en cada llamada a handle_message */
+    if (!is_host_terminating(&local_receiver) && !buffer_pool_init(&buffers, args.max_bytes_to_read + 1, 1, false)) {
+        fail("ERROR: No hay memoria para el buffer de recepción");
+    }
 
-    while (!terminate) {
+    while (!is_host_terminating(&local_receiver)) {
 
-        if (!socket_io_pending) {
-            /* Pausamos la ejecución hasta que se reciba una señal de I/O o de terminación */
-            pause();
+        if (!get_pending_io(receiving)) {
+            /* Pausamos la ejecución hasta que haya actividad en el socket o se pida la terminación */
+            wait_for_host_event(receiving, -1);
         }
 
         log_and_stdout_printf(local_receiver.log, "\n==============================\n");
         log_and_stdout_printf(local_receiver.log, "Posible mensaje recibido...\n");
 
-        received_bytes = handle_message(&local_receiver, args.max_bytes_to_read);
+        received_bytes = handle_message(receiving, &buffers, args.max_bytes_to_read);
 
         if (received_bytes == -1) {
             /* Falsa alarma, no había mensajes pendientes o se recibió una señal de terminación */
@@ -156,69 +343,514 @@ int main(int argc, char **argv) {
 //            continue;
 //        }
 
-        terminate = true;  /* Ya hemos recibido un mensaje completo, por lo que podemos terminar */
+        request_host_termination(&local_receiver);  /* Ya hemos recibido un mensaje completo, por lo que podemos terminar */
     };
 
     log_and_stdout_printf(local_receiver.log, "\n==============================\n");
 
     printf("\nCerrando el receptor y saliendo...\n");
 
+    buffer_pool_free(&buffers);
+
+    if (receiving != &local_receiver) close_host(receiving);
     close_host(&local_receiver);
 
     exit(EXIT_SUCCESS);
 }
 
 
-static ssize_t handle_message(Host *local_receiver, size_t max_bytes_to_read) {
-    char received_message[max_bytes_to_read + 1];
-    struct sockaddr_in remote_connection_info;
-    ssize_t received_bytes;
-    ssize_t total_received_bytes = 0;
-    socklen_t addr_len = sizeof(struct sockaddr_in);
+static ssize_t handle_message(Host *local_receiver, BufferPool *buffers, size_t max_bytes_to_read) {
+    char *received_message;
+    struct sockaddr_storage remote_connection_info;
+    char address_text[HOST_ADDRESS_STRLEN];
+    ssize_t datagram_bytes, received_bytes;
+    size_t capacity = max_bytes_to_read;
+    socklen_t addr_len = sizeof(remote_connection_info);
+
+    /* Cada recvfrom lee un datagrama entero o lo trunca (y el resto se pierde): antes de leerlo, miramos cuánto ocupa */
+    if ((datagram_bytes = peek_datagram_size(local_receiver)) < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            /* Hemos marcado al socket con O_NONBLOCK; no hay mensajes pendientes, así que lo registramos y salimos */
+            clear_pending_io(local_receiver);
+            return -1;
+        }
 
-    while (true) {
-//    received_bytes = recvfrom(local_receiver->socket, received_message, MAX_BYTES_RECVFROM, 0, (struct sockaddr *) &(remote_connection_info), &addr_len);
-        received_bytes = recvfrom(local_receiver->socket, received_message, max_bytes_to_read, 0, (struct sockaddr *) &(remote_connection_info), &addr_len);
+        log_printf_err(local_receiver->log, "ERROR: Se produjo un error en la recepción del mensaje\n");
+        fail("ERROR: Se produjo un error en la recepción del mensaje");
+    }
 
-        if (received_bytes == -1) {
-            if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                if (total_received_bytes > 0) {
-                    log_and_stdout_printf(local_receiver->log, "    Falsa alarma, no había mensajes pendientes o se recibió una señal de terminación\n");
-                    return total_received_bytes;
-                }
+    if ((size_t) datagram_bytes > max_bytes_to_read) {
+        /* Con el buffer del máximo pedido se perdería el final: lo ampliamos para este datagrama */
+        log_and_stdout_printf(local_receiver->log, "    El datagrama ocupa %zd bytes, más que el máximo de bytes a leer (%zu): se amplía el buffer para no truncarlo.\n",
+                              datagram_bytes, max_bytes_to_read);
+        capacity = datagram_bytes;
+    }
+
+    /* El tamaño lo elige el usuario (-b) o el emisor: en la pila podría no caber */
+    if (!(received_message = buffer_pool_get_sized(buffers, capacity + 1))) {
+        fail("ERROR: No hay memoria para el buffer de recepción");
+    }
+
+    /* Con MSG_TRUNC, recvfrom devuelve el tamaño real aunque no quepa: así se nota si aun así se truncó */
+    received_bytes = recvfrom(local_receiver->socket, received_message, capacity, MSG_TRUNC, (struct sockaddr *) &(remote_connection_info), &addr_len);
+
+    if (received_bytes == -1) {
+        buffer_pool_put(buffers, received_message);
+
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            clear_pending_io(local_receiver);
+            return -1;
+        }
+
+        log_printf_err(local_receiver->log, "ERROR: Se produjo un error en la recepción del mensaje\n");
+        fail("ERROR: Se produjo un error en la recepción del mensaje");
+    }
+
+    log_and_stdout_printf(local_receiver->log, "==============================\n");
 
-                /* Hemos marcado al socket con O_NONBLOCK; no hay mensajes pendientes, así que lo registramos y salimos */
-                socket_io_pending--;
-                return received_bytes;
+    if ((size_t) received_bytes > capacity) {
+        /* Solo si el datagrama que se leyó no era el que se miró (otro hilo o proceso leyó del mismo socket) */
+        log_printf_err(local_receiver->log, "Datagrama truncado: se leyeron %zu de sus %zd bytes.\n", capacity, received_bytes);
+        received_bytes = capacity;
+    }
+
+    received_message[received_bytes] = '\0';
+
+    log_and_stdout_printf(local_receiver->log, "Mensaje recibido  : \"%s\"\n", received_message);
+    log_and_stdout_printf(local_receiver->log, "Bytes recibidos   : %ld\n", received_bytes);
+    log_and_stdout_printf(local_receiver->log, "Emisor            : %s %s\n",
+                          describe_address((struct sockaddr *) &remote_connection_info, addr_len, address_text, sizeof(address_text)),
+                          host_transport_name(local_receiver));
+
+    consume_pending_io(local_receiver);
+    buffer_pool_put(buffers, received_message);
+
+    return received_bytes;
+}
+
+
+/**
+ * @brief   Registra la llegada de un número de secuencia en la ventana de duplicados de un flujo.
+ *
+ * @param stream    Estadísticas del flujo.
+ * @param seq       Número de secuencia recibido.
+ */
+static void stream_account_seq(struct StreamStats *stream, uint64_t seq) {
+    uint64_t distance;
+
+    if (!stream->active || seq >= stream->next_seq) {
+        /* Paquete nuevo en orden (o tras un hueco): desplazamos la ventana hasta él */
+        distance = stream->active ? seq - stream->next_seq + 1 : SEQ_WINDOW;
+
+        if (distance >= SEQ_WINDOW) {
+            memset(stream->window, 0, sizeof(stream->window));
+        } else {
+            for (uint64_t s = stream->next_seq; s <= seq; s++) {
+                stream->window[(s % SEQ_WINDOW) / 64] &= ~(1ULL << (s % 64));
             }
+        }
+
+        stream->window[(seq % SEQ_WINDOW) / 64] |= 1ULL << (seq % 64);
+        stream->next_seq = seq + 1;
+        stream->unique_packets++;
+        stream->active = true;
+        return;
+    }
+
+    if (stream->next_seq - seq > SEQ_WINDOW) {
+        /* Demasiado antiguo para saber si es duplicado: lo contamos como desordenado */
+        stream->reordered++;
+        stream->unique_packets++;
+        return;
+    }
+
+    if (stream->window[(seq % SEQ_WINDOW) / 64] & (1ULL << (seq % 64))) {
+        stream->duplicates++;
+        return;
+    }
+
+    /* Llega tarde un paquete que no se había recibido: desorden */
+    stream->window[(seq % SEQ_WINDOW) / 64] |= 1ULL << (seq % 64);
+    stream->reordered++;
+    stream->unique_packets++;
+}
+
+
+/**
+ * @brief   Contabiliza un paquete recibido en el modo de medición.
+ *
+ * Es la entrada común del proceso de medida: interpreta la cabecera de tráfico
+ * y actualiza las estadísticas del flujo al que pertenece el paquete.
+ *
+ * @param sink          Estado de la medición.
+ * @param data          Contenido del paquete (al menos los primeros bytes).
+ * @param captured_len  Número de bytes válidos en data.
+ * @param wire_len      Tamaño real de la carga útil del datagrama.
+ * @param arrival_ns    Instante de llegada (CLOCK_REALTIME, en nanosegundos).
+ */
+static void sink_account(struct Sink *sink, const char *data, size_t captured_len, size_t wire_len, uint64_t arrival_ns) {
+    TrafficHeader header;
+    struct StreamStats *stream;
+    int64_t transit, difference;
+
+    sink->packets++;
+    sink->bytes += wire_len;
+    if (captured_len < wire_len) sink->truncated++;
+
+    if (!traffic_header_read(data, captured_len, &header) || header.stream >= MAX_STREAMS) {
+        sink->foreign_packets++;
+        return;
+    }
+
+    stream = &sink->streams[header.stream];
+    stream->packets++;
+    stream->bytes += wire_len;
+
+    stream_account_seq(stream, header.seq);
+
+    /* Jitter entre llegadas según el RFC 3550 (sección 6.4.1): J += (|D| - J) / 16 */
+    transit = (int64_t) (arrival_ns - header.tx_ns);
+    if (!stream->has_transit || transit < stream->transit_ns_min) stream->transit_ns_min = transit;
+    if (!stream->has_transit || transit > stream->transit_ns_max) stream->transit_ns_max = transit;
+    stream->transit_ns_total += transit;
+    if (stream->has_transit) {
+        difference = transit - stream->last_transit;
+        if (difference < 0) difference = -difference;
+        stream->jitter_ns += (difference - stream->jitter_ns) / 16.0;
+    }
+    stream->last_transit = transit;
+    stream->has_transit = true;
+}
+
+
+/**
+ * @brief   Suma las estadísticas acumuladas de todos los flujos.
+ *
+ * @param sink  Estado de la medición.
+ *
+ * @return  Instantánea con los contadores acumulados desde el inicio.
+ */
+static struct SinkSnapshot sink_snapshot(const struct Sink *sink) {
+    struct SinkSnapshot snapshot = {
+        .packets = sink->packets,
+        .bytes = sink->bytes
+    };
+    unsigned active_streams = 0;
+
+    for (int i = 0; i < MAX_STREAMS; i++) {
+        const struct StreamStats *stream = &sink->streams[i];
+
+        if (!stream->active) continue;
+
+        snapshot.expected += stream->next_seq;
+        snapshot.unique += stream->unique_packets;
+        snapshot.reordered += stream->reordered;
+        snapshot.duplicates += stream->duplicates;
+        snapshot.jitter_ns += stream->jitter_ns;
+        active_streams++;
+    }
 
-            log_printf_err(local_receiver->log, "ERROR: Se produjo un error en la recepción del mensaje\n");
-            fail("ERROR: Se produjo un error en la recepción del mensaje");
+    if (active_streams) snapshot.jitter_ns /= active_streams;     /* Jitter medio entre los flujos */
+
+    return snapshot;
+}
+
+
+/**
+ * @brief   Cierra el intervalo de medida en curso.
+ *
+ * Calcula las diferencias de los contadores con el inicio del intervalo, imprime la fila
+ * correspondiente de la tabla y la guarda para el informe JSON.
+ *
+ * @param local_receiver    Host receptor (para el log).
+ * @param sink              Estado de la medición.
+ * @param now_ns            Instante de cierre del intervalo (CLOCK_MONOTONIC).
+ */
+static void sink_close_interval(Host *local_receiver, struct Sink *sink, uint64_t now_ns) {
+    struct SinkSnapshot current = sink_snapshot(sink);
+    struct SinkInterval interval;
+    double seconds = (now_ns - sink->interval_start_ns) / 1e9;
+    int64_t lost;
+
+    lost = (int64_t) (current.expected - sink->interval_base.expected) - (int64_t) (current.unique - sink->interval_base.unique);
+
+    interval = (struct SinkInterval) {
+        .start = (sink->interval_start_ns - sink->start_ns) / 1e9,
+        .end = (now_ns - sink->start_ns) / 1e9,
+        .packets = current.packets - sink->interval_base.packets,
+        .bytes = current.bytes - sink->interval_base.bytes,
+        .lost = lost < 0 ? 0 : lost,    /* Los paquetes desordenados de un intervalo anterior pueden hacerlo negativo */
+        .expected = current.expected - sink->interval_base.expected,
+        .reordered = current.reordered - sink->interval_base.reordered,
+        .duplicates = current.duplicates - sink->interval_base.duplicates,
+        .jitter_ms = current.jitter_ns / 1e6
+    };
+    interval.mbps = seconds > 0 ? 8 * interval.bytes / seconds / 1e6 : 0;
+
+    log_and_stdout_printf(local_receiver->log, "%7.2f-%-7.2f %10" PRIu64 " %10.3f %10" PRIu64 " %7.2f%% %8" PRIu64 " %6" PRIu64 " %10.3f\n",
+                          interval.start, interval.end, interval.packets, interval.mbps, interval.lost,
+                          interval.expected ? 100.0 * interval.lost / interval.expected : 0,
+                          interval.reordered, interval.duplicates, interval.jitter_ms);
+
+    if (sink->intervals_len == sink->intervals_capacity) {
+        sink->intervals_capacity = sink->intervals_capacity ? 2 * sink->intervals_capacity : 64;
+        sink->intervals = (struct SinkInterval *) realloc(sink->intervals, sink->intervals_capacity * sizeof(struct SinkInterval));
+        if (!sink->intervals) fail("ERROR: No se pudo reservar memoria para los intervalos de medida");
+    }
+    sink->intervals[sink->intervals_len++] = interval;
+
+    sink->interval_base = current;
+    sink->interval_start_ns = now_ns;
+}
+
+
+/**
+ * @brief   Imprime el resumen final de la medición en forma de tabla y, si se pidió, en JSON.
+ *
+ * @param local_receiver    Host receptor (para el log).
+ * @param sink              Estado de la medición.
+ * @param config            Configuración de la medición.
+ * @param now_ns            Instante de fin de la medición (CLOCK_MONOTONIC).
+ */
+static void sink_report(Host *local_receiver, const struct Sink *sink, const struct SinkConfig *config, uint64_t now_ns) {
+    struct SinkSnapshot total = sink_snapshot(sink);
+    double seconds = (now_ns - sink->start_ns) / 1e9;
+    uint64_t lost = total.expected > total.unique ? total.expected - total.unique : 0;
+    FILE *json;
+
+    log_and_stdout_printf(local_receiver->log, "\n==============================\n");
+    log_and_stdout_printf(local_receiver->log, "Flujo  Paquetes   Bytes        Perdidos   Pérdida  Desord.  Dup.   Jitter(ms) Latencia mín/media/máx (ms)\n");
+    for (int i = 0; i < MAX_STREAMS; i++) {
+        const struct StreamStats *stream = &sink->streams[i];
+        uint64_t stream_lost;
+
+        if (!stream->active) continue;
+
+        stream_lost = stream->next_seq > stream->unique_packets ? stream->next_seq - stream->unique_packets : 0;
+        log_and_stdout_printf(local_receiver->log, "%-6d %-10" PRIu64 " %-12" PRIu64 " %-10" PRIu64 " %6.2f%%  %-8" PRIu64 " %-6" PRIu64 " %-10.3f %.3f/%.3f/%.3f\n", i, stream->packets, stream->bytes,
+                              stream_lost, stream->next_seq ? 100.0 * stream_lost / stream->next_seq : 0,
+                              stream->reordered, stream->duplicates, stream->jitter_ns / 1e6, stream->transit_ns_min / 1e6,
+                              stream->transit_ns_total / 1e6 / stream->packets, stream->transit_ns_max / 1e6);
+    }
+    log_and_stdout_printf(local_receiver->log, "------------------------------\n");
+    log_and_stdout_printf(local_receiver->log, "Duración             : %.3f s\n", seconds);
+    log_and_stdout_printf(local_receiver->log, "Paquetes recibidos   : %" PRIu64 " (%" PRIu64 " sin cabecera de tráfico)\n", total.packets, sink->foreign_packets);
+    log_and_stdout_printf(local_receiver->log, "Bytes recibidos      : %" PRIu64 "\n", total.bytes);
+    log_and_stdout_printf(local_receiver->log, "Truncados            : %" PRIu64 " (más grandes que el buffer; se cuentan enteros, pero solo se leyó su principio)\n", sink->truncated);
+    log_and_stdout_printf(local_receiver->log, "Caudal medio         : %.3f Mbit/s, %.0f pps\n", seconds > 0 ? 8 * total.bytes / seconds / 1e6 : 0, seconds > 0 ? total.packets / seconds : 0);
+    log_and_stdout_printf(local_receiver->log, "Perdidos             : %" PRIu64 " de %" PRIu64 " (%.3f%%)\n", lost, total.expected, total.expected ? 100.0 * lost / total.expected : 0);
+    log_and_stdout_printf(local_receiver->log, "Desordenados         : %" PRIu64 "\n", total.reordered);
+    log_and_stdout_printf(local_receiver->log, "Duplicados           : %" PRIu64 "\n", total.duplicates);
+    log_and_stdout_printf(local_receiver->log, "Jitter (RFC 3550)    : %.3f ms\n", total.jitter_ns / 1e6);
+    log_and_stdout_printf(local_receiver->log, "Llegadas fechadas por el núcleo: %" PRIu64 " de %" PRIu64 " (la latencia de un sentido solo es exacta si los relojes de emisor y receptor están sincronizados)\n",
+                          sink->kernel_timestamped, total.packets);
+
+    if (!config->json_file) return;
+
+    if (config->json_stdout) {
+        json = config->json_stdout;
+    } else if (!(json = fopen(config->json_file, "w"))) {
+        perror("No se pudo crear el archivo del informe JSON");
+        log_printf_err(local_receiver->log, "Error al crear el archivo del informe JSON %s.\n", config->json_file);
+        return;
+    }
+
+    fprintf(json, "{\n  \"duration_s\": %.6f,\n  \"packets\": %" PRIu64 ",\n  \"bytes\": %" PRIu64 ",\n  \"foreign_packets\": %" PRIu64 ",\n  \"truncated\": %" PRIu64 ",\n"
+                  "  \"expected\": %" PRIu64 ",\n  \"lost\": %" PRIu64 ",\n  \"loss_percent\": %.6f,\n  \"reordered\": %" PRIu64 ",\n  \"duplicates\": %" PRIu64 ",\n"
+                  "  \"jitter_ms\": %.6f,\n  \"mbps\": %.6f,\n",
+            seconds, total.packets, total.bytes, sink->foreign_packets, sink->truncated, total.expected, lost,
+            total.expected ? 100.0 * lost / total.expected : 0, total.reordered, total.duplicates,
+            total.jitter_ns / 1e6, seconds > 0 ? 8 * total.bytes / seconds / 1e6 : 0);
+
+    fprintf(json, "  \"streams\": [");
+    for (int i = 0, first = 1; i < MAX_STREAMS; i++) {
+        const struct StreamStats *stream = &sink->streams[i];
+
+        if (!stream->active) continue;
+
+        fprintf(json, "%s\n    {\"stream\": %d, \"packets\": %" PRIu64 ", \"bytes\": %" PRIu64 ", \"expected\": %" PRIu64 ", \"lost\": %" PRIu64 ", \"reordered\": %" PRIu64 ", \"duplicates\": %" PRIu64 ", \"jitter_ms\": %.6f, "
+                      "\"latency_min_ms\": %.6f, \"latency_avg_ms\": %.6f, \"latency_max_ms\": %.6f}",
+                first ? "" : ",", i, stream->packets, stream->bytes, stream->next_seq,
+                stream->next_seq > stream->unique_packets ? stream->next_seq - stream->unique_packets : 0,
+                stream->reordered, stream->duplicates, stream->jitter_ns / 1e6, stream->transit_ns_min / 1e6,
+                stream->transit_ns_total / 1e6 / stream->packets, stream->transit_ns_max / 1e6);
+        first = 0;
+    }
+    fprintf(json, "\n  ],\n  \"intervals\": [");
+    for (size_t i = 0; i < sink->intervals_len; i++) {
+        const struct SinkInterval *interval = &sink->intervals[i];
+
+        fprintf(json, "%s\n    {\"start\": %.3f, \"end\": %.3f, \"packets\": %" PRIu64 ", \"bytes\": %" PRIu64 ", \"mbps\": %.6f, \"expected\": %" PRIu64 ", \"lost\": %" PRIu64 ", \"reordered\": %" PRIu64 ", \"duplicates\": %" PRIu64 ", \"jitter_ms\": %.6f}",
+                i ? "," : "", interval->start, interval->end, interval->packets, interval->bytes, interval->mbps,
+                interval->expected, interval->lost, interval->reordered, interval->duplicates, interval->jitter_ms);
+    }
+    fprintf(json, "\n  ]\n}\n");
+
+    if (json == config->json_stdout) fflush(json);
+    else fclose(json);
+}
+
+
+static void run_sink(Host *local_receiver, size_t max_bytes_to_read, const struct SinkConfig *config) {
+    struct Sink sink;
+    struct mmsghdr messages[SINK_BATCH];
+    struct iovec iovecs[SINK_BATCH];
+    char controls[SINK_BATCH][TIMESTAMP_CONTROL_LEN];
+    struct timespec kernel_rx_ts;
+    uint64_t user_rx_ns;
+    char *buffers = NULL;
+    PacketRing ring;
+    uint64_t interval_ns = (uint64_t) (config->interval * 1e9);
+    uint64_t duration_ns = (uint64_t) (config->duration * 1e9);
+    uint64_t now_ns, next_interval_ns;
+    bool peer_closed = false;
+    int received;
+
+    memset(&sink, 0, sizeof(sink));
+
+    if (config->ring_interface) {
+        if (!packet_ring_open(&ring, config->ring_interface, local_receiver->port)) {
+            log_printf_err(local_receiver->log, "ERROR: No se pudo abrir el anillo TPACKET_V3 en %s: %s\n", config->ring_interface, strerror(errno));
+            fail("ERROR: No se pudo abrir el anillo TPACKET_V3 (hace falta CAP_NET_RAW y una interfaz válida)");
         }
 
-        log_and_stdout_printf(local_receiver->log, "==============================\n");
+        /* El socket UDP sigue ocupando el puerto, pero lo que llega se lee del anillo */
+        if (discard_host_input(local_receiver) < 0) {
+            perror("No se pudo vaciar la entrada del socket UDP");
+            log_printf_err(local_receiver->log, "Error al descartar la entrada del socket UDP; su cola se llenará sin leerse.\n");
+        }
+    } else {
+        if (!(buffers = (char *) malloc(SINK_BATCH * max_bytes_to_read))) {
+            fail("ERROR: No se pudo reservar memoria para los buffers de recepción");
+        }
+
+        for (int i = 0; i < SINK_BATCH; i++) {
+            iovecs[i] = (struct iovec) {.iov_base = buffers + i * max_bytes_to_read, .iov_len = max_bytes_to_read};
+        }
+
+        /* Fechamos cada llegada con la marca de tiempo del núcleo: el lote de recvmmsg puede leerse bastante después */
+        enable_kernel_timestamps(local_receiver, TIMESTAMP_RX);
+    }
+
+    log_and_stdout_printf(local_receiver->log, "Modo medición        : intervalos de %.2f s%s\n", config->interval, config->duration > 0 ? "" : ", hasta recibir SIGINT");
+    if (config->ring_interface) {
+        log_and_stdout_printf(local_receiver->log, "Recepción            : anillo TPACKET_V3 en %s (%u bloques de %u KiB), puerto UDP %u\n",
+                              config->ring_interface, ring.block_count, ring.block_size / 1024, ring.port);
+    }
+    log_and_stdout_printf(local_receiver->log, "\n  Intervalo (s)    Paquetes     Mbit/s   Perdidos  Pérdida   Desord.   Dup. Jitter(ms)\n");
 
-        received_message[received_bytes] = '\0';
+    sink.start_ns = sink.interval_start_ns = traffic_monotonic_ns();
+    next_interval_ns = sink.start_ns + interval_ns;
 
-        log_and_stdout_printf(local_receiver->log, "Mensaje recibido  : \"%s\"\n", received_message);
-        log_and_stdout_printf(local_receiver->log, "Bytes recibidos   : %ld\n", received_bytes);
-        log_and_stdout_printf(local_receiver->log, "IP del emisor     : %s\n", inet_ntoa(remote_connection_info.sin_addr));
-        log_and_stdout_printf(local_receiver->log, "Puerto del emisor : %d UDP\n", ntohs(remote_connection_info.sin_port));
+    while (!is_host_terminating(local_receiver) && !peer_closed) {
+        now_ns = traffic_monotonic_ns();
 
-        total_received_bytes += received_bytes;
+        if (duration_ns && now_ns - sink.start_ns >= duration_ns) break;
 
-        if (received_bytes == max_bytes_to_read) {
-            log_and_stdout_printf(local_receiver->log, "    Como hemos recibido el máximo de bytes (%ld), es posible que haya más datos pendientes de recibir.\n", received_bytes);
-            log_and_stdout_printf(local_receiver->log, "    Volvamos a llamar (por si acaso) de nuevo a recvfrom()...\n\n");
+        if (now_ns >= next_interval_ns) {
+            sink_close_interval(local_receiver, &sink, now_ns);
+            next_interval_ns += interval_ns;
             continue;
-        } else {
-            socket_io_pending--;
-            break;
         }
 
+        if (config->ring_interface) {
+            /* Cada bloque se recorre en su sitio: ni copias ni una llamada al sistema por datagrama */
+            if (packet_ring_poll(&ring, (next_interval_ns - now_ns) / 1000000 + 1, sink_account_ring, &sink) < 0) {
+                log_printf_err(local_receiver->log, "ERROR: Se produjo un error al leer del anillo TPACKET_V3\n");
+                fail("ERROR: Se produjo un error al leer del anillo TPACKET_V3");
+            }
+            continue;
+        }
+
+        /* recvmmsg actualiza msg_controllen, así que hay que restaurarlo antes de cada llamada */
+        for (int i = 0; i < SINK_BATCH; i++) {
+            messages[i].msg_hdr = (struct msghdr) {
+                .msg_iov = &iovecs[i], .msg_iovlen = 1,
+                .msg_control = controls[i], .msg_controllen = TIMESTAMP_CONTROL_LEN
+            };
+        }
+
+        /* Pedimos el tamaño real del datagrama (MSG_TRUNC) para contar bien los bytes aunque no quepa en el buffer */
+        received = recvmmsg(local_receiver->socket, messages, SINK_BATCH, MSG_TRUNC, NULL);
+
+        if (received == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                /* No hay más datagramas: esperamos a que llegue alguno más o al fin del intervalo */
+                clear_pending_io(local_receiver);
+                wait_for_host_event(local_receiver, (next_interval_ns - now_ns) / 1000000 + 1);
+                continue;
+            }
+            log_printf_err(local_receiver->log, "ERROR: Se produjo un error en la recepción de los paquetes\n");
+            fail("ERROR: Se produjo un error en la recepción de los paquetes");
+        }
+
+        user_rx_ns = traffic_realtime_ns();
+        for (int i = 0; i < received; i++) {
+            size_t wire_len = messages[i].msg_len;
+            uint64_t arrival_ns = user_rx_ns;
+
+            /* En una conexión SOCK_SEQPACKET, un mensaje vacío indica que el emisor la cerró */
+            if (wire_len == 0 && local_receiver->type == SOCK_SEQPACKET) {
+                peer_closed = true;
+                break;
+            }
+
+            if (timestamp_from_message(&messages[i].msg_hdr, &kernel_rx_ts)) {
+                arrival_ns = timespec_to_ns(&kernel_rx_ts);
+                sink.kernel_timestamped++;
+            }
+
+            sink_account(&sink, iovecs[i].iov_base, wire_len < max_bytes_to_read ? wire_len : max_bytes_to_read, wire_len, arrival_ns);
+        }
+    }
+
+    now_ns = traffic_monotonic_ns();
+    if (now_ns > sink.interval_start_ns) sink_close_interval(local_receiver, &sink, now_ns);
+
+    sink_report(local_receiver, &sink, config, now_ns);
+
+    if (config->ring_interface) {
+        if (packet_ring_update_stats(&ring)) {
+            log_and_stdout_printf(local_receiver->log, "Anillo TPACKET_V3    : %" PRIu64 " paquetes pasaron el filtro, %" PRIu64 " descartados por falta de bloques libres\n",
+                                  ring.kernel_packets, ring.kernel_drops);
+        }
+        packet_ring_close(&ring);
+    }
+
+    free(sink.intervals);
+    free(buffers);
+}
+
+
+static void sink_account_ring(void *context, const char *payload, size_t captured_len, size_t wire_len, uint64_t arrival_ns) {
+    struct Sink *sink = context;
+
+    sink->kernel_timestamped++;     /* Todo paquete del anillo lleva la marca de tiempo del núcleo */
+    sink_account(sink, payload, captured_len, wire_len, arrival_ns);
+}
+
+
+static bool wait_for_connection(Host *listener, Host *connection) {
+    while (!is_host_terminating(listener)) {
+        if (!accept_host(listener, connection)) {
+            char address_text[HOST_ADDRESS_STRLEN];
+
+            log_and_stdout_printf(listener->log, "Emisor conectado desde : %s\n",
+                                  describe_address((struct sockaddr *) &connection->address, connection->address_len, address_text, sizeof(address_text)));
+            return true;
+        }
+
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            log_printf_err(listener->log, "ERROR: No se pudo aceptar la conexión del emisor\n");
+            fail("ERROR: No se pudo aceptar la conexión del emisor");
+        }
+
+        /* No hay conexiones pendientes: esperamos a que llegue alguna o se pida la terminación */
+        clear_pending_io(listener);
+        wait_for_host_event(listener, -1);
     }
 
-    return total_received_bytes;
+    return false;
 }
 
 
@@ -236,6 +868,8 @@ static void print_help(char *exe_name) {
     printf("  $ %s # Tomará los parámetros por defecto\n", exe_name);
     printf("  $ %s %d\n", exe_name, DEFAULT_RECEIVER_PORT);
     printf("  $ %s -p %d\n", exe_name, DEFAULT_RECEIVER_PORT);
+    printf("Ejemplo con un socket local (AF_UNIX) en lugar de UDP:\n");
+    printf("  $ %s -p /tmp/receptor.sock\n", exe_name);
 
     /** Lista de opciones de uso **/
     printf("\n");
@@ -243,8 +877,20 @@ static void print_help(char *exe_name) {
     /** Lista de parámetros "importantes" **/
     printf("Parámetros \tParámetro largo \tPor defecto \tDescripción\n");
 
-    printf("  -p <puerto>\t--puerto <puerto>\t%d\t\tPuerto en el que se espera recibir el mensaje.\n", DEFAULT_RECEIVER_PORT);
-    printf("  -b <bytes>\t--max-bytes <bytes>\t%d\t\tBytes máximos a leer por recvfrom (para el apartado c).\n", DEFAULT_MAX_BYTES_RECV);
+    printf("  -p <puerto>\t--puerto <puerto>\t%d\t\tPuerto en el que se espera recibir el mensaje (o ruta de un socket local).\n", DEFAULT_RECEIVER_PORT);
+    printf("  -q\t\t--seqpacket\t\t\t\tCon un socket local, usar SOCK_SEQPACKET: se atiende al primer emisor que se conecte (la medición acaba cuando cierra).\n");
+    printf("  -b <bytes>\t--max-bytes <bytes>\t%d\t\tTamaño inicial del buffer de recvfrom (para el apartado c); un mensaje mayor se lee entero igualmente. En modo medición, bytes que se guardan de cada datagrama.\n", DEFAULT_MAX_BYTES_RECV);
+
+    printf("\n");
+
+    /** Opciones del modo de medición **/
+    printf("Modo medición \tOpción larga \t\tPor defecto \tDescripción\n");
+
+    printf("  -m\t\t--medir\t\t\t\t\tMedir caudal, pérdidas, desorden, duplicados y jitter del tráfico del generador del emisor.\n");
+    printf("  -i <seg>\t--intervalo <seg>\t%.1f\t\tSegundos entre cada informe parcial.\n", DEFAULT_SINK_INTERVAL);
+    printf("  -d <seg>\t--duracion <seg>\tsin límite\tDuración de la medición (sin límite: hasta SIGINT o SIGTERM).\n");
+    printf("  -j <json>\t--json <json>\t\t\t\tEscribir también el informe en JSON en el archivo dado (\"-\" para la salida estándar, y entonces todo lo demás se muestra por la de errores).\n");
+    printf("  -a <if>\t--anillo <if>\t\t\t\tMedir leyendo de un anillo TPACKET_V3 de la interfaz dada (p. ej. lo), sin una llamada al sistema por paquete. Requiere CAP_NET_RAW.\n");
 
     printf("\n");
 
@@ -296,6 +942,20 @@ static size_t getMaxBytesToReadOrFail(char **argv, int pos) {
 }
 
 
+static double getSecondsOrFail(char **argv, int pos) {
+    char *end;
+    double seconds = strtod(argv[pos], &end);
+
+    if (*end != '\0' || !(seconds > 0)) {
+        fprintf(stderr, "ERROR: El número de segundos especificado (%s) no es válido\n", argv[pos]);
+        print_help(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    return seconds;
+}
+
+
 static void process_args(struct Arguments *args, int argc, char **argv) {
     bool allow_unnamed_basic_params = true;
 
@@ -319,6 +979,18 @@ static void process_args(struct Arguments *args, int argc, char **argv) {
                 }
                 if (!strcmp(current_arg_str, "--max-bytes")) {
                     current_option = OPT_MAX_BYTES_TO_READ; // 'b'
+                } else if (!strcmp(current_arg_str, "--medir")) {
+                    current_option = OPT_SINK; // 'm'
+                } else if (!strcmp(current_arg_str, "--intervalo")) {
+                    current_option = OPT_SINK_INTERVAL; // 'i'
+                } else if (!strcmp(current_arg_str, "--duracion")) {
+                    current_option = OPT_SINK_DURATION; // 'd'
+                } else if (!strcmp(current_arg_str, "--json")) {
+                    current_option = OPT_SINK_JSON; // 'j'
+                } else if (!strcmp(current_arg_str, "--anillo")) {
+                    current_option = OPT_SINK_RING; // 'a'
+                } else if (!strcmp(current_arg_str, "--seqpacket")) {
+                    current_option = OPT_SEQPACKET; // 'q'
                 } else if (!strcmp(current_arg_str, "--log")) {
                     current_option = OPT_LOG_FILE_NAME; // 'l'
                 } else if (!strcmp(current_arg_str, "--no-log")) {
@@ -346,7 +1018,11 @@ static void process_args(struct Arguments *args, int argc, char **argv) {
         switch (current_option) {
             case OPT_RECEIVER_PORT: // 'p' /* Puerto Receptor */
                 if (++pos < argc) {
-                    args->receiver_port = getPortOrFail(argv, pos);
+                    if (is_unix_socket_path(argv[pos])) {
+                        args->receiver_path = argv[pos];
+                    } else {
+                        args->receiver_port = getPortOrFail(argv, pos);
+                    }
                 } else {
                     fprintf(stderr, "ERROR: Puerto no especificado tras la opción '-p'\n");
                     print_help(argv[0]);
@@ -364,6 +1040,55 @@ static void process_args(struct Arguments *args, int argc, char **argv) {
                 }
                 break;
 
+            case OPT_SINK: // 'm' /* Modo medición */
+                args->sink.enabled = true;
+                break;
+
+            case OPT_SINK_INTERVAL: // 'i' /* Intervalo entre informes */
+                if (++pos < argc) {
+                    args->sink.interval = getSecondsOrFail(argv, pos);
+                } else {
+                    fprintf(stderr, "ERROR: Intervalo no especificado tras la opción '-i'\n");
+                    print_help(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+
+            case OPT_SINK_DURATION: // 'd' /* Duración de la medición */
+                if (++pos < argc) {
+                    args->sink.duration = getSecondsOrFail(argv, pos);
+                } else {
+                    fprintf(stderr, "ERROR: Duración no especificada tras la opción '-d'\n");
+                    print_help(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+
+            case OPT_SINK_RING: // 'a' /* Anillo TPACKET_V3 */
+                if (++pos < argc) {
+                    args->sink.ring_interface = argv[pos];
+                    args->sink.enabled = true;
+                } else {
+                    fprintf(stderr, "ERROR: Interfaz no especificada tras la opción '-a'\n");
+                    print_help(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+
+            case OPT_SINK_JSON: // 'j' /* Informe JSON */
+                if (++pos < argc) {
+                    args->sink.json_file = argv[pos];
+                } else {
+                    fprintf(stderr, "ERROR: Archivo JSON no especificado tras la opción '-j'\n");
+                    print_help(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+
+            case OPT_SEQPACKET: // 'q' /* SOCK_SEQPACKET */
+                args->seqpacket = true;
+                break;
+
             case OPT_LOG_FILE_NAME: // 'l' /* Log */
                 if (++pos < argc) {
                     args->logfile = argv[pos];
@@ -0,0 +1,173 @@
+#define _GNU_SOURCE     /* Para MAP_HUGETLB y MADV_HUGEPAGE */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "bufferpool.h"
+
+
+/**
+ * @brief   Redondea hacia arriba a un múltiplo de una potencia de dos.
+ */
+static inline size_t round_up(size_t value, size_t multiple) {
+    return (value + multiple - 1) & ~(multiple - 1);
+}
+
+
+/**
+ * @brief   Crea una reserva de buffers.
+ *
+ * @param pool          Reserva a crear.
+ * @param buffer_size   Bytes de cada buffer.
+ * @param count         Número de buffers.
+ * @param huge_pages    Intentar reservar la memoria en páginas enormes.
+ *
+ * @return  true si se creó; false en caso contrario (errno indica el motivo).
+ */
+bool buffer_pool_init(BufferPool *pool, size_t buffer_size, size_t count, bool huge_pages) {
+    size_t buffers_size;
+    void *memory = MAP_FAILED;
+
+    memset(pool, 0, sizeof(BufferPool));
+
+    if (!buffer_size || !count || buffer_size > SIZE_MAX / 2 / count) {
+        errno = EINVAL;
+        return false;
+    }
+    pool->buffer_size = round_up(buffer_size, BUFFER_POOL_ALIGN);
+    pool->count = count;
+
+    /* La pila de libres va tras los buffers, en la misma memoria: la reserva no usa el heap para nada */
+    buffers_size = pool->buffer_size * count;
+    pool->memory_size = buffers_size + count * sizeof(void *);
+
+    if (huge_pages) {
+        memory = mmap(NULL, round_up(pool->memory_size, BUFFER_POOL_HUGE_PAGE_SIZE), PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (memory != MAP_FAILED) {
+            pool->memory_size = round_up(pool->memory_size, BUFFER_POOL_HUGE_PAGE_SIZE);
+            pool->huge_pages = true;
+        }
+    }
+
+    if (memory == MAP_FAILED) {
+        pool->memory_size = round_up(pool->memory_size, (size_t) sysconf(_SC_PAGESIZE));
+        if ((memory = mmap(NULL, pool->memory_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED) {
+            return false;
+        }
+        /* Sin páginas enormes reservadas en el sistema: que el núcleo las junte si puede (no es crítico) */
+        if (huge_pages) madvise(memory, pool->memory_size, MADV_HUGEPAGE);
+    }
+    pool->memory = memory;
+    pool->free_buffers = (void **) (pool->memory + buffers_size);
+
+    /* Apilados al revés, para que se presten en orden de dirección */
+    for (size_t i = 0; i < count; i++) {
+        pool->free_buffers[i] = pool->memory + (count - 1 - i) * pool->buffer_size;
+    }
+    pool->free_count = count;
+
+    return true;
+}
+
+
+/**
+ * @brief   Toma prestado un buffer de la reserva.
+ *
+ * @param pool  Reserva.
+ *
+ * @return  Buffer de pool->buffer_size bytes; NULL si no hay memoria.
+ */
+void *buffer_pool_get(BufferPool *pool) {
+    void *buffer;
+
+    if (pool->free_count) {
+        buffer = pool->free_buffers[--pool->free_count];
+    } else if ((buffer = aligned_alloc(BUFFER_POOL_ALIGN, pool->buffer_size))) {
+        pool->stats.heap_allocations++;
+    } else {
+        return NULL;
+    }
+
+    pool->stats.acquired++;
+    if (++pool->in_use > pool->stats.peak_in_use) pool->stats.peak_in_use = pool->in_use;
+
+    return buffer;
+}
+
+
+/**
+ * @brief   Toma prestado un buffer de al menos un tamaño dado.
+ *
+ * @param pool  Reserva.
+ * @param size  Bytes que necesita el buffer.
+ *
+ * @return  Buffer de al menos size bytes; NULL si no hay memoria.
+ */
+void *buffer_pool_get_sized(BufferPool *pool, size_t size) {
+    void *buffer;
+
+    if (size <= pool->buffer_size) {
+        return buffer_pool_get(pool);
+    }
+
+    if (!(buffer = aligned_alloc(BUFFER_POOL_ALIGN, round_up(size, BUFFER_POOL_ALIGN)))) {
+        return NULL;
+    }
+    pool->stats.heap_allocations++;
+    pool->stats.oversized++;
+    pool->stats.acquired++;
+    if (++pool->in_use > pool->stats.peak_in_use) pool->stats.peak_in_use = pool->in_use;
+
+    return buffer;
+}
+
+
+/**
+ * @brief   Devuelve a la reserva un buffer prestado.
+ *
+ * @param pool      Reserva de la que se tomó.
+ * @param buffer    Buffer a devolver (NULL no hace nada).
+ */
+void buffer_pool_put(BufferPool *pool, void *buffer) {
+    if (!buffer) return;
+
+    pool->in_use--;
+
+    /* Los del heap no vuelven a la pila: solo caben los de la reserva */
+    if ((char *) buffer >= pool->memory && (char *) buffer < (char *) pool->free_buffers) {
+        pool->free_buffers[pool->free_count++] = buffer;
+    } else {
+        free(buffer);
+    }
+}
+
+
+/**
+ * @brief   Suma el uso de una reserva al de otra.
+ *
+ * @param total     Uso al que sumar.
+ * @param stats     Uso a sumar.
+ */
+void buffer_pool_stats_merge(BufferPoolStats *total, const BufferPoolStats *stats) {
+    total->acquired += stats->acquired;
+    total->heap_allocations += stats->heap_allocations;
+    total->oversized += stats->oversized;
+    if (stats->peak_in_use > total->peak_in_use) total->peak_in_use = stats->peak_in_use;
+}
+
+
+/**
+ * @brief   Libera la memoria de una reserva.
+ *
+ * @param pool  Reserva.
+ */
+void buffer_pool_free(BufferPool *pool) {
+    if (pool->memory) munmap(pool->memory, pool->memory_size);
+    pool->memory = NULL;
+    pool->free_buffers = NULL;
+    pool->free_count = 0;
+}
@@ -0,0 +1,115 @@
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Reserva de buffers de tamaño fijo que se reciclan.
+ *
+ * Toda la memoria de la reserva se pide de una vez al crearla (en páginas enormes si se piden y el
+ * sistema las tiene) y se reparte en buffers alineados a la línea de caché, que se prestan y se
+ * devuelven sin pasar por malloc. Si alguna vez se piden más buffers de los que tiene la reserva, el
+ * que falta se reserva en el heap y se cuenta: en régimen estacionario ese contador debe quedarse en
+ * cero, lo que demuestra que el camino de los paquetes no reserva memoria.
+ *
+ * Una reserva no usa cerrojos: la debe usar un solo hilo (cada hilo que atiende peticiones, la suya).
+ */
+
+/* Alineación de cada buffer (línea de caché) */
+#define BUFFER_POOL_ALIGN 64
+
+/* Tamaño de las páginas enormes que se piden con MAP_HUGETLB */
+#define BUFFER_POOL_HUGE_PAGE_SIZE (2UL << 20)
+
+/**
+ * Uso de una reserva de buffers.
+ */
+typedef struct {
+    uint64_t acquired;          /* Buffers prestados */
+    uint64_t heap_allocations;  /* Buffers reservados en el heap porque estaban todos prestados o no cabían */
+    uint64_t oversized;         /* De ellos, los pedidos más grandes que los de la reserva */
+    uint64_t peak_in_use;       /* Máximo de buffers prestados a la vez */
+} BufferPoolStats;
+
+/**
+ * Reserva de buffers de tamaño fijo.
+ */
+typedef struct {
+    char *memory;           /* Memoria de los buffers, seguida de la pila de libres */
+    size_t memory_size;     /* Bytes de memory */
+    size_t buffer_size;     /* Bytes de cada buffer (múltiplo de BUFFER_POOL_ALIGN) */
+    size_t count;           /* Número de buffers de la reserva */
+    void **free_buffers;    /* Pila de buffers libres */
+    size_t free_count;      /* Buffers en la pila de libres */
+    uint64_t in_use;        /* Buffers prestados ahora mismo (incluidos los del heap) */
+    bool huge_pages;        /* La memoria está en páginas enormes (MAP_HUGETLB) */
+    BufferPoolStats stats;  /* Uso de la reserva */
+} BufferPool;
+
+/**
+ * @brief   Crea una reserva de buffers.
+ *
+ * Si se piden páginas enormes y el sistema no tiene reservadas (MAP_HUGETLB), se usan páginas normales
+ * y se pide al núcleo que las junte en páginas enormes transparentes cuando pueda.
+ *
+ * @param pool          Reserva a crear.
+ * @param buffer_size   Bytes de cada buffer.
+ * @param count         Número de buffers.
+ * @param huge_pages    Intentar reservar la memoria en páginas enormes.
+ *
+ * @return  true si se creó; false en caso contrario (errno indica el motivo).
+ */
+bool buffer_pool_init(BufferPool *pool, size_t buffer_size, size_t count, bool huge_pages);
+
+/**
+ * @brief   Toma prestado un buffer de la reserva.
+ *
+ * Si están todos prestados, reserva uno en el heap y lo cuenta en stats.heap_allocations.
+ *
+ * @param pool  Reserva.
+ *
+ * @return  Buffer de pool->buffer_size bytes; NULL si no hay memoria.
+ */
+void *buffer_pool_get(BufferPool *pool);
+
+/**
+ * @brief   Toma prestado un buffer de al menos un tamaño dado.
+ *
+ * Si el tamaño cabe en los de la reserva, es como buffer_pool_get; si no, el buffer se reserva en el heap
+ * y se cuenta también en stats.oversized. Se devuelve igualmente con buffer_pool_put.
+ *
+ * @param pool  Reserva.
+ * @param size  Bytes que necesita el buffer.
+ *
+ * @return  Buffer de al menos size bytes; NULL si no hay memoria.
+ */
+void *buffer_pool_get_sized(BufferPool *pool, size_t size);
+
+/**
+ * @brief   Devuelve a la reserva un buffer prestado.
+ *
+ * @param pool      Reserva de la que se tomó.
+ * @param buffer    Buffer a devolver (NULL no hace nada).
+ */
+void buffer_pool_put(BufferPool *pool, void *buffer);
+
+/**
+ * @brief   Suma el uso de una reserva al de otra.
+ *
+ * @param total     Uso al que sumar.
+ * @param stats     Uso a sumar.
+ */
+void buffer_pool_stats_merge(BufferPoolStats *total, const BufferPoolStats *stats);
+
+/**
+ * @brief   Libera la memoria de una reserva.
+ *
+ * Todos sus buffers deben haberse devuelto.
+ *
+ * @param pool  Reserva.
+ */
+void buffer_pool_free(BufferPool *pool);
+
+#endif /* BUFFERPOOL_H */
@@ -0,0 +1,143 @@
+#define _GNU_SOURCE     /* Para sched_setaffinity y CPU_SET */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/socket.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#include <inttypes.h>
+#endif
+
+#include "busypoll.h"
+#include "loging.h"
+
+
+/**
+ * @brief   Lee un contador de ciclos barato y monótono.
+ *
+ * @return  Valor actual del contador.
+ */
+uint64_t read_cycle_counter(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+#endif
+}
+
+
+/**
+ * @brief   Cede brevemente el núcleo del procesador dentro de un bucle de espera activa.
+ */
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+
+/**
+ * @brief   Prepara el socket y el hilo de un host para el modo de espera activa.
+ *
+ * @param host      Host cuyo socket se va a sondear.
+ * @param config    Configuración del modo.
+ * @param stats     Contadores a inicializar.
+ */
+void configure_spin_mode(Host *host, const SpinConfig *config, SpinStats *stats) {
+    cpu_set_t cpus;
+
+    memset(stats, 0, sizeof(SpinStats));
+
+    /* Sin O_ASYNC: el núcleo deja de enviar una señal por cada datagrama, que en este modo nadie espera */
+    if (fcntl(host->socket, F_SETFL, O_NONBLOCK) < 0) {
+        log_printf_err(host->log, "Error al desactivar el envío de señales en el socket.\n");
+        fail("No se pudo desactivar el envío de señales en el socket");
+    }
+
+    if (config->busy_poll_us > 0) {
+        if (setsockopt(host->socket, SOL_SOCKET, SO_BUSY_POLL, &config->busy_poll_us, sizeof(config->busy_poll_us)) < 0) {
+            perror("No se pudo activar SO_BUSY_POLL en el socket");
+            log_printf_err(host->log, "Error al activar SO_BUSY_POLL (%d µs).\n", config->busy_poll_us);
+        } else {
+            log_printf(host->log, "SO_BUSY_POLL activado: %d µs.\n", config->busy_poll_us);
+        }
+    }
+
+    if (config->cpu >= 0) {
+        CPU_ZERO(&cpus);
+        CPU_SET(config->cpu, &cpus);
+        if (sched_setaffinity(0, sizeof(cpus), &cpus) < 0) {
+            perror("No se pudo fijar el hilo a la CPU pedida");
+            log_printf_err(host->log, "Error al fijar el hilo a la CPU %d.\n", config->cpu);
+        } else {
+            log_printf(host->log, "Hilo fijado a la CPU %d.\n", config->cpu);
+        }
+    }
+
+    log_and_stdout_printf(host->log, "Modo de espera activa: %s tras %u sondeos vacíos\n",
+                          config->spins_before_sleep ? "se duerme" : "nunca se duerme", config->spins_before_sleep);
+
+    stats->start_cycles = read_cycle_counter();
+}
+
+
+/**
+ * @brief   Registra un sondeo que no encontró datos y aplica la espera correspondiente.
+ *
+ * @param host          Host sondeado.
+ * @param config        Configuración del modo.
+ * @param stats         Contadores a actualizar.
+ * @param poll_start    Valor de read_cycle_counter() al empezar el sondeo.
+ * @param timeout_ms    Máximo que dormir, en milisegundos (-1 sin límite).
+ */
+void spin_idle_poll(Host *host, const SpinConfig *config, SpinStats *stats, uint64_t poll_start, int timeout_ms) {
+    stats->idle_polls++;
+
+    if (config->spins_before_sleep && ++stats->consecutive_idle >= config->spins_before_sleep) {
+        /* Demasiado tiempo sin tráfico: dormimos hasta que llegue algo (o venza el plazo) para liberar el núcleo */
+        stats->sleeps++;
+        stats->consecutive_idle = 0;
+        wait_for_host_event(host, timeout_ms);
+    } else {
+        cpu_relax();
+    }
+
+    stats->idle_cycles += read_cycle_counter() - poll_start;
+}
+
+
+/**
+ * @brief   Registra un sondeo que encontró datos.
+ *
+ * @param stats     Contadores a actualizar.
+ */
+void spin_useful_poll(SpinStats *stats) {
+    stats->useful_polls++;
+    stats->consecutive_idle = 0;
+}
+
+
+/**
+ * @brief   Imprime y registra en el log el reparto de ciclos entre espera y trabajo útil.
+ *
+ * @param host      Host del que se informa.
+ * @param stats     Contadores del modo.
+ */
+void report_spin_stats(Host *host, const SpinStats *stats) {
+    uint64_t total_cycles = read_cycle_counter() - stats->start_cycles;
+    uint64_t busy_cycles = total_cycles > stats->idle_cycles ? total_cycles - stats->idle_cycles : 0;
+
+    log_and_stdout_printf(host->log, "Sondeos útiles / vacíos      : %" PRIu64 " / %" PRIu64 " (%" PRIu64 " veces dormido)\n", stats->useful_polls, stats->idle_polls, stats->sleeps);
+    log_and_stdout_printf(host->log, "Ciclos en espera / en trabajo: %" PRIu64 " / %" PRIu64 " (%.2f%% en espera)\n", stats->idle_cycles, busy_cycles,
+                          total_cycles ? 100.0 * stats->idle_cycles / total_cycles : 0);
+}
@@ -0,0 +1,82 @@
+#ifndef BUSYPOLL_H
+#define BUSYPOLL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "host.h"
+
+/**
+ * Configuración del modo de espera activa (busy-poll) de un host.
+ */
+typedef struct {
+    bool enabled;               /* Vale true si el bucle principal sondea el socket en lugar de dormir */
+    int busy_poll_us;           /* Valor de SO_BUSY_POLL en microsegundos (0 para no activarlo) */
+    int cpu;                    /* CPU en la que fijar el hilo que sondea (-1 para no fijarlo) */
+    unsigned spins_before_sleep;    /* Sondeos vacíos seguidos tras los que se duerme hasta que haya datos (0 = nunca dormir) */
+} SpinConfig;
+
+/**
+ * Contadores del modo de espera activa, para saber cuánto tiempo se pasa sondeando en vano.
+ */
+typedef struct {
+    uint64_t start_cycles;      /* Contador de ciclos al empezar el modo */
+    uint64_t idle_cycles;       /* Ciclos gastados en sondeos que no encontraron datos (incluida la espera entre sondeos) */
+    uint64_t idle_polls;        /* Sondeos que no encontraron datos */
+    uint64_t useful_polls;      /* Sondeos que encontraron datos */
+    uint64_t sleeps;            /* Veces que se durmió tras demasiados sondeos vacíos */
+    unsigned consecutive_idle;  /* Sondeos vacíos seguidos desde el último útil */
+} SpinStats;
+
+/**
+ * @brief   Prepara el socket y el hilo de un host para el modo de espera activa.
+ *
+ * Desactiva el aviso por señal (O_ASYNC) del socket, que en este modo solo añadiría coste,
+ * activa SO_BUSY_POLL si se pidió y fija el hilo llamante a la CPU configurada.
+ * Los fallos de SO_BUSY_POLL y de la fijación de CPU no son críticos: se avisa y se sigue.
+ *
+ * @param host      Host cuyo socket se va a sondear.
+ * @param config    Configuración del modo.
+ * @param stats     Contadores a inicializar.
+ */
+void configure_spin_mode(Host *host, const SpinConfig *config, SpinStats *stats);
+
+/**
+ * @brief   Registra un sondeo que no encontró datos y aplica la espera correspondiente.
+ *
+ * Si se llevan config->spins_before_sleep sondeos vacíos seguidos, duerme hasta que haya actividad
+ * en el socket o pasen timeout_ms; si no, solo cede brevemente el núcleo del procesador (instrucción pause).
+ *
+ * @param host          Host sondeado.
+ * @param config        Configuración del modo.
+ * @param stats         Contadores a actualizar.
+ * @param poll_start    Valor de read_cycle_counter() al empezar el sondeo.
+ * @param timeout_ms    Máximo que dormir, en milisegundos (-1 sin límite).
+ */
+void spin_idle_poll(Host *host, const SpinConfig *config, SpinStats *stats, uint64_t poll_start, int timeout_ms);
+
+/**
+ * @brief   Registra un sondeo que encontró datos.
+ *
+ * @param stats     Contadores a actualizar.
+ */
+void spin_useful_poll(SpinStats *stats);
+
+/**
+ * @brief   Imprime y registra en el log el reparto de ciclos entre espera y trabajo útil.
+ *
+ * @param host      Host del que se informa.
+ * @param stats     Contadores del modo.
+ */
+void report_spin_stats(Host *host, const SpinStats *stats);
+
+/**
+ * @brief   Lee un contador de ciclos barato y monótono.
+ *
+ * En x86 es el TSC (rdtsc); en otras arquitecturas, nanosegundos de CLOCK_MONOTONIC.
+ *
+ * @return  Valor actual del contador.
+ */
+uint64_t read_cycle_counter(void);
+
+#endif /* BUSYPOLL_H */
@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <inttypes.h>
+
+#include "checkpoint.h"
+
+
+/* Primera línea del archivo, para reconocerlo y cambiar el formato sin leer uno antiguo como nuevo */
+#define CHECKPOINT_MAGIC "mayus-ckpt 1"
+
+/* Sufijo del archivo temporal que se renombra sobre el punto de control */
+#define CHECKPOINT_TEMP_SUFFIX ".tmp"
+
+/* Formato del punto de control, en texto para poder leerlo a mano (con los especificadores de printf o de scanf) */
+#define CHECKPOINT_FORMAT(u64, d64, x32) CHECKPOINT_MAGIC "\n" \
+    "input_dev %" u64 "\ninput_ino %" u64 "\ninput_size %" u64 "\ninput_mtime_ns %" d64 "\n" \
+    "transform %d\ninput_offset %" u64 "\noutput_len %" u64 "\noutput_crc %" x32 "\n"
+
+
+/**
+ * @brief   Anota en un punto de control la identidad del archivo de entrada.
+ *
+ * @param checkpoint    Punto de control.
+ * @param input_stat    Datos del archivo de entrada (de fstat).
+ */
+void checkpoint_set_input(Checkpoint *checkpoint, const struct stat *input_stat) {
+    checkpoint->input_dev = input_stat->st_dev;
+    checkpoint->input_ino = input_stat->st_ino;
+    checkpoint->input_size = input_stat->st_size;
+    checkpoint->input_mtime_ns = (int64_t) input_stat->st_mtim.tv_sec * 1000000000 + input_stat->st_mtim.tv_nsec;
+}
+
+
+/**
+ * @brief   Indica si un punto de control es del mismo archivo de entrada que otro.
+ *
+ * @param checkpoint    Punto de control.
+ * @param other         Punto de control con el que comparar.
+ *
+ * @return  true si el archivo de entrada y la operación coinciden.
+ */
+bool checkpoint_same_input(const Checkpoint *checkpoint, const Checkpoint *other) {
+    return checkpoint->input_dev == other->input_dev && checkpoint->input_ino == other->input_ino
+           && checkpoint->input_size == other->input_size && checkpoint->input_mtime_ns == other->input_mtime_ns
+           && checkpoint->transform == other->transform;
+}
+
+
+/**
+ * @brief   Guarda un punto de control de forma atómica y lo manda a disco.
+ *
+ * No hace falta sincronizar también el directorio: si el cambio de nombre no llegara a disco, quedaría
+ * el punto de control anterior, que sigue siendo válido (al reanudar desde él se recorta el archivo de salida).
+ *
+ * @param path          Ruta del punto de control.
+ * @param checkpoint    Punto de control a guardar.
+ *
+ * @return  true si quedó guardado; false en caso de error (errno indica el motivo).
+ */
+bool checkpoint_save(const char *path, const Checkpoint *checkpoint) {
+    char temp_path[strlen(path) + sizeof(CHECKPOINT_TEMP_SUFFIX)];
+    char text[512];
+    int len, fd, error;
+    ssize_t written;
+
+    len = snprintf(text, sizeof(text), CHECKPOINT_FORMAT(PRIu64, PRId64, "08" PRIx32), checkpoint->input_dev, checkpoint->input_ino, checkpoint->input_size,
+                   checkpoint->input_mtime_ns, checkpoint->transform, checkpoint->input_offset, checkpoint->output_len, checkpoint->output_crc);
+
+    strcpy(temp_path, path);
+    strcat(temp_path, CHECKPOINT_TEMP_SUFFIX);
+
+    if ((fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666)) < 0) return false;
+
+    /* Es tan pequeño que un write basta; uno parcial se trata como error (EIO, pues no deja errno) */
+    if ((written = write(fd, text, len)) != len || fsync(fd)) {
+        error = written >= 0 && written < len ? EIO : errno;
+        close(fd);
+        unlink(temp_path);
+        errno = error;
+        return false;
+    }
+    if (close(fd) || rename(temp_path, path)) {
+        error = errno;
+        unlink(temp_path);
+        errno = error;
+        return false;
+    }
+
+    return true;
+}
+
+
+/**
+ * @brief   Lee un punto de control.
+ *
+ * @param path          Ruta del punto de control.
+ * @param checkpoint    Dónde guardar el punto de control leído.
+ *
+ * @return  true si existía y era válido; false en otro caso.
+ */
+bool checkpoint_load(const char *path, Checkpoint *checkpoint) {
+    FILE *file;
+    int fields;
+
+    if (!(file = fopen(path, "r"))) return false;
+
+    fields = fscanf(file, CHECKPOINT_FORMAT(SCNu64, SCNd64, SCNx32), &checkpoint->input_dev, &checkpoint->input_ino, &checkpoint->input_size,
+                    &checkpoint->input_mtime_ns, &checkpoint->transform, &checkpoint->input_offset, &checkpoint->output_len, &checkpoint->output_crc);
+    fclose(file);
+
+    return fields == 8 && checkpoint->input_offset <= checkpoint->input_size;
+}
@@ -0,0 +1,77 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+
+/*
+ * Puntos de control para reanudar una transferencia interrumpida.
+ *
+ * Cada cierto tiempo, el cliente anota en un archivo pequeño, junto al de salida, hasta dónde leyó el
+ * archivo de entrada (solo las líneas ya respondidas) y cuántos bytes tiene el de salida. Antes de
+ * anotarlo, el archivo de salida debe estar en disco hasta ese punto (ver file_writer_sync); el punto
+ * de control se escribe en un archivo temporal, se manda a disco con fsync y se renombra sobre el
+ * anterior, de forma que tras cualquier caída queda el punto nuevo o el anterior, nunca uno a medias.
+ * Si la caída deja el archivo de salida más largo de lo anotado, al reanudar se recorta.
+ *
+ * El punto de control guarda también la identidad del archivo de entrada (dispositivo, nodo, tamaño y
+ * fecha de modificación) y la operación: solo se reanuda si el archivo y la operación son los mismos.
+ */
+
+/* Sufijo que se añade al nombre del archivo de salida para el del punto de control */
+#define CHECKPOINT_SUFFIX ".ckpt"
+
+/**
+ * Punto de control de una transferencia.
+ */
+typedef struct {
+    uint64_t input_dev;         /* Dispositivo del archivo de entrada */
+    uint64_t input_ino;         /* Nodo del archivo de entrada */
+    uint64_t input_size;        /* Tamaño del archivo de entrada */
+    int64_t input_mtime_ns;     /* Fecha de modificación del archivo de entrada */
+    int transform;              /* Operación pedida al servidor (enum TransformOp) */
+    uint64_t input_offset;      /* Bytes del archivo de entrada ya respondidos */
+    uint64_t output_len;        /* Bytes del archivo de salida ya en disco */
+    uint32_t output_crc;        /* CRC32C de esos bytes (0 si no se calculó) */
+} Checkpoint;
+
+/**
+ * @brief   Anota en un punto de control la identidad del archivo de entrada.
+ *
+ * @param checkpoint    Punto de control.
+ * @param input_stat    Datos del archivo de entrada (de fstat).
+ */
+void checkpoint_set_input(Checkpoint *checkpoint, const struct stat *input_stat);
+
+/**
+ * @brief   Indica si un punto de control es del mismo archivo de entrada que otro.
+ *
+ * @param checkpoint    Punto de control.
+ * @param other         Punto de control con el que comparar.
+ *
+ * @return  true si el archivo de entrada y la operación coinciden.
+ */
+bool checkpoint_same_input(const Checkpoint *checkpoint, const Checkpoint *other);
+
+/**
+ * @brief   Guarda un punto de control de forma atómica y lo manda a disco.
+ *
+ * @param path          Ruta del punto de control.
+ * @param checkpoint    Punto de control a guardar.
+ *
+ * @return  true si quedó guardado; false en caso de error (errno indica el motivo).
+ */
+bool checkpoint_save(const char *path, const Checkpoint *checkpoint);
+
+/**
+ * @brief   Lee un punto de control.
+ *
+ * @param path          Ruta del punto de control.
+ * @param checkpoint    Dónde guardar el punto de control leído.
+ *
+ * @return  true si existía y era válido; false en otro caso.
+ */
+bool checkpoint_load(const char *path, Checkpoint *checkpoint);
+
+#endif /* CHECKPOINT_H */
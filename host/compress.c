@@ -0,0 +1,317 @@
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include <endian.h>
+
+#include "compress.h"
+
+
+#define LZ4_MIN_MATCH 4         /* Longitud mínima de una coincidencia */
+#define LZ4_LAST_LITERALS 5     /* Los últimos bytes de un bloque son siempre literales */
+#define LZ4_MF_LIMIT 12         /* La última coincidencia debe empezar al menos a esta distancia del final */
+#define LZ4_MAX_DISTANCE 65535  /* Máximo desplazamiento de una coincidencia */
+#define LZ4_HASH_LOG 12         /* Entradas de la tabla de hash: 2^LZ4_HASH_LOG */
+
+
+/**
+ * @brief   Lee 4 bytes sin requisitos de alineamiento.
+ */
+static inline uint32_t read32(const uint8_t *p) {
+    uint32_t value;
+
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+
+/**
+ * @brief   Hash multiplicativo de 4 bytes para la tabla de coincidencias.
+ */
+static inline uint32_t hash4(uint32_t sequence) {
+    return (sequence * 2654435761U) >> (32 - LZ4_HASH_LOG);
+}
+
+
+/**
+ * @brief   Bytes adicionales que ocupa una longitud que no cabe en los 4 bits del token.
+ */
+static inline size_t extra_length_bytes(size_t length) {
+    return length >= 15 ? (length - 15) / 255 + 1 : 0;
+}
+
+
+/**
+ * @brief   Escribe los bytes adicionales de una longitud (de 255 en 255).
+ */
+static inline uint8_t *write_extra_length(uint8_t *op, size_t length) {
+    for (length -= 15; length >= 255; length -= 255) {
+        *op++ = 255;
+    }
+    *op++ = (uint8_t) length;
+
+    return op;
+}
+
+
+/**
+ * @brief   Tamaño máximo que puede ocupar un bloque LZ4 para unos datos de n bytes.
+ *
+ * @param n     Número de bytes de los datos originales.
+ *
+ * @return  Número de bytes que debe tener como mínimo el buffer de salida de lz4_compress.
+ */
+size_t lz4_compress_bound(size_t n) {
+    return n + n / 255 + 16;
+}
+
+
+/**
+ * @brief   Comprime un buffer en formato de bloque LZ4.
+ *
+ * @param src       Datos a comprimir.
+ * @param n         Número de bytes de src.
+ * @param dst       Buffer de salida.
+ * @param capacity  Tamaño de dst.
+ *
+ * @return  Número de bytes escritos en dst; -1 si no caben en capacity.
+ */
+ssize_t lz4_compress(const void *src, size_t n, void *dst, size_t capacity) {
+    uint32_t table[1 << LZ4_HASH_LOG];
+    const uint8_t *base = src;
+    const uint8_t *ip = base, *anchor = base, *iend = base + n;
+    const uint8_t *match_limit = iend - (n >= LZ4_LAST_LITERALS ? LZ4_LAST_LITERALS : n);
+    uint8_t *op = dst, *oend = op + capacity;
+    uint8_t *token;
+    size_t literals, match_length;
+
+    memset(table, 0, sizeof(table));
+
+    /* Búsqueda voraz: en cada posición, la última aparición de los mismos 4 bytes según la tabla de hash */
+    while (n >= LZ4_MF_LIMIT && ip <= iend - LZ4_MF_LIMIT) {
+        uint32_t sequence = read32(ip);
+        uint32_t h = hash4(sequence);
+        const uint8_t *ref = base + table[h];
+        const uint8_t *mp, *rp;
+
+        table[h] = (uint32_t) (ip - base);
+
+        if (ref >= ip || ip - ref > LZ4_MAX_DISTANCE || read32(ref) != sequence) {
+            ip++;
+            continue;
+        }
+
+        /* Extender la coincidencia hacia delante, respetando los literales finales obligatorios */
+        for (mp = ip + LZ4_MIN_MATCH, rp = ref + LZ4_MIN_MATCH; mp < match_limit && *mp == *rp; mp++, rp++);
+
+        literals = ip - anchor;
+        match_length = mp - ip - LZ4_MIN_MATCH;
+
+        if ((size_t) (oend - op) < 1 + extra_length_bytes(literals) + literals + 2 + extra_length_bytes(match_length)) {
+            return -1;
+        }
+
+        token = op++;
+        *token = (uint8_t) ((literals >= 15 ? 15 : literals) << 4);
+        if (literals >= 15) op = write_extra_length(op, literals);
+        memcpy(op, anchor, literals);
+        op += literals;
+
+        *op++ = (uint8_t) ((ip - ref) & 0xff);
+        *op++ = (uint8_t) ((ip - ref) >> 8);
+
+        *token |= (uint8_t) (match_length >= 15 ? 15 : match_length);
+        if (match_length >= 15) op = write_extra_length(op, match_length);
+
+        ip = anchor = mp;
+    }
+
+    /* Última secuencia: solo literales */
+    literals = iend - anchor;
+    if ((size_t) (oend - op) < 1 + extra_length_bytes(literals) + literals) {
+        return -1;
+    }
+
+    token = op++;
+    *token = (uint8_t) ((literals >= 15 ? 15 : literals) << 4);
+    if (literals >= 15) op = write_extra_length(op, literals);
+    memcpy(op, anchor, literals);
+    op += literals;
+
+    return op - (uint8_t *) dst;
+}
+
+
+/**
+ * @brief   Descomprime un bloque LZ4.
+ *
+ * @param src       Bloque comprimido.
+ * @param n         Número de bytes de src.
+ * @param dst       Buffer de salida.
+ * @param capacity  Tamaño de dst.
+ *
+ * @return  Número de bytes escritos en dst; -1 si el bloque está mal formado o no cabe en capacity.
+ */
+ssize_t lz4_decompress(const void *src, size_t n, void *dst, size_t capacity) {
+    const uint8_t *ip = src, *iend = ip + n;
+    uint8_t *base = dst, *op = base, *oend = base + capacity;
+    size_t literals, match_length, offset;
+    uint8_t token, byte;
+
+    while (ip < iend) {
+        token = *ip++;
+
+        literals = token >> 4;
+        if (literals == 15) {
+            do {
+                if (ip >= iend) return -1;
+                byte = *ip++;
+                literals += byte;
+            } while (byte == 255);
+        }
+
+        if (literals > (size_t) (iend - ip) || literals > (size_t) (oend - op)) {
+            return -1;
+        }
+        memcpy(op, ip, literals);
+        op += literals;
+        ip += literals;
+
+        if (ip == iend) {
+            /* La última secuencia no lleva coincidencia */
+            break;
+        }
+
+        if (iend - ip < 2) return -1;
+        offset = ip[0] | ((size_t) ip[1] << 8);
+        ip += 2;
+        if (!offset || offset > (size_t) (op - base)) {
+            return -1;
+        }
+
+        match_length = token & 15;
+        if (match_length == 15) {
+            do {
+                if (ip >= iend) return -1;
+                byte = *ip++;
+                match_length += byte;
+            } while (byte == 255);
+        }
+        match_length += LZ4_MIN_MATCH;
+
+        if (match_length > (size_t) (oend - op)) {
+            return -1;
+        }
+
+        /* Copia byte a byte: origen y destino pueden solaparse (repeticiones con desplazamiento corto) */
+        for (const uint8_t *match = op - offset; match_length--; ) {
+            *op++ = *match++;
+        }
+    }
+
+    return op - base;
+}
+
+
+/**
+ * @brief   Codifica unos datos en una trama, comprimiéndolos si eso los reduce.
+ *
+ * @param raw       Datos originales.
+ * @param raw_len   Número de bytes de raw.
+ * @param frame     Buffer en el que escribir la trama.
+ * @param capacity  Tamaño de frame.
+ *
+ * @return  Número de bytes de la trama; -1 si no cabe en capacity.
+ */
+ssize_t compress_frame(const void *raw, size_t raw_len, void *frame, size_t capacity) {
+    uint8_t *header = frame;
+    uint32_t be_raw_len = htobe32((uint32_t) raw_len);
+    ssize_t compressed_len = -1;
+    size_t payload_capacity;
+
+    if (capacity < COMPRESS_FRAME_HEADER_LEN || raw_len > UINT32_MAX) {
+        return -1;
+    }
+
+    header[0] = COMPRESS_FRAME_MARKER;
+    memcpy(header + 2, &be_raw_len, sizeof(be_raw_len));
+
+    /* Solo interesa el bloque comprimido si es estrictamente más pequeño que los datos originales */
+    payload_capacity = capacity - COMPRESS_FRAME_HEADER_LEN;
+    if (raw_len && payload_capacity > raw_len - 1) payload_capacity = raw_len - 1;
+    if (raw_len) {
+        compressed_len = lz4_compress(raw, raw_len, header + COMPRESS_FRAME_HEADER_LEN, payload_capacity);
+    }
+
+    if (compressed_len >= 0) {
+        header[1] = CODEC_LZ4;
+        return COMPRESS_FRAME_HEADER_LEN + compressed_len;
+    }
+
+    if (raw_len > capacity - COMPRESS_FRAME_HEADER_LEN) {
+        return -1;
+    }
+
+    header[1] = CODEC_NONE;
+    memcpy(header + COMPRESS_FRAME_HEADER_LEN, raw, raw_len);
+
+    return COMPRESS_FRAME_HEADER_LEN + raw_len;
+}
+
+
+/**
+ * @brief   Decodifica una trama y recupera los datos originales.
+ *
+ * @param frame     Trama recibida.
+ * @param frame_len Número de bytes de frame.
+ * @param raw       Buffer en el que escribir los datos originales.
+ * @param capacity  Tamaño de raw.
+ *
+ * @return  Número de bytes de los datos originales; -1 si la trama no es válida o no cabe en capacity.
+ */
+ssize_t decompress_frame(const void *frame, size_t frame_len, void *raw, size_t capacity) {
+    const uint8_t *header = frame;
+    const uint8_t *payload = header + COMPRESS_FRAME_HEADER_LEN;
+    size_t payload_len;
+    uint32_t raw_len;
+    ssize_t decoded_len;
+
+    if (!is_compressed_frame(frame, frame_len)) {
+        return -1;
+    }
+
+    memcpy(&raw_len, header + 2, sizeof(raw_len));
+    raw_len = be32toh(raw_len);
+    payload_len = frame_len - COMPRESS_FRAME_HEADER_LEN;
+
+    if (raw_len > capacity) {
+        return -1;
+    }
+
+    switch (header[1]) {
+        case CODEC_NONE:
+            if (payload_len != raw_len) return -1;
+            memcpy(raw, payload, raw_len);
+            return raw_len;
+
+        case CODEC_LZ4:
+            decoded_len = lz4_decompress(payload, payload_len, raw, raw_len);
+            return decoded_len == (ssize_t) raw_len ? decoded_len : -1;
+
+        default:
+            return -1;
+    }
+}
+
+
+/**
+ * @brief   Indica si un mensaje recibido es una trama comprimida.
+ *
+ * @param buffer    Mensaje recibido.
+ * @param len       Número de bytes del mensaje.
+ *
+ * @return  true si empieza por COMPRESS_FRAME_MARKER y tiene al menos una cabecera completa.
+ */
+bool is_compressed_frame(const void *buffer, size_t len) {
+    return len >= COMPRESS_FRAME_HEADER_LEN && ((const uint8_t *) buffer)[0] == COMPRESS_FRAME_MARKER;
+}
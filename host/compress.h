@@ -0,0 +1,118 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+/*
+ * Compresión de cargas útiles entre clienteUDP y servidorUDP.
+ *
+ * El códec es una implementación propia del formato de bloque de LZ4 (secuencias de literales
+ * y coincidencias con desplazamientos de hasta 64 KiB), sin dependencias externas.
+ *
+ * Cada datagrama comprimido va encapsulado en una trama que empieza por el byte
+ * COMPRESS_FRAME_MARKER (0x00). Como los mensajes de texto del protocolo original nunca empiezan
+ * por un byte nulo, el receptor distingue ambos formatos mirando solo el primer byte.
+ *
+ *  +--------+--------+--------------------+-----------------------+
+ *  | 0x00   | códec  | longitud original  | datos (comprimidos o  |
+ *  | 1 byte | 1 byte | 4 bytes big endian | no, según el códec)   |
+ *  +--------+--------+--------------------+-----------------------+
+ */
+
+/* Primer byte de toda trama comprimida */
+#define COMPRESS_FRAME_MARKER 0x00
+
+/* Tamaño de la cabecera de trama */
+#define COMPRESS_FRAME_HEADER_LEN 6
+
+/* Máximo tamaño de una trama: la carga útil máxima de un datagrama UDP sobre IPv4 */
+#define COMPRESS_MAX_FRAME 65507
+
+/* Máximo tamaño de los datos originales de una trama de petición */
+#define COMPRESS_MAX_RAW 32768
+
+/* Token que se añade, tras el nulo del nombre de archivo, para pedir y aceptar la compresión */
+#define COMPRESS_TOKEN "COMP=lz4"
+
+/**
+ * Códecs con los que puede ir codificado el contenido de una trama.
+ */
+enum CompressCodec {
+    CODEC_NONE = 0,     /* Datos sin comprimir (cuando comprimir no los reduce) */
+    CODEC_LZ4 = 1       /* Bloque LZ4 */
+};
+
+/**
+ * @brief   Tamaño máximo que puede ocupar un bloque LZ4 para unos datos de n bytes.
+ *
+ * @param n     Número de bytes de los datos originales.
+ *
+ * @return  Número de bytes que debe tener como mínimo el buffer de salida de lz4_compress.
+ */
+size_t lz4_compress_bound(size_t n);
+
+/**
+ * @brief   Comprime un buffer en formato de bloque LZ4.
+ *
+ * @param src       Datos a comprimir.
+ * @param n         Número de bytes de src.
+ * @param dst       Buffer de salida.
+ * @param capacity  Tamaño de dst.
+ *
+ * @return  Número de bytes escritos en dst; -1 si no caben en capacity.
+ */
+ssize_t lz4_compress(const void *src, size_t n, void *dst, size_t capacity);
+
+/**
+ * @brief   Descomprime un bloque LZ4.
+ *
+ * Valida todos los desplazamientos y longitudes, de forma que un bloque corrupto o malicioso
+ * no puede leer ni escribir fuera de los buffers.
+ *
+ * @param src       Bloque comprimido.
+ * @param n         Número de bytes de src.
+ * @param dst       Buffer de salida.
+ * @param capacity  Tamaño de dst.
+ *
+ * @return  Número de bytes escritos en dst; -1 si el bloque está mal formado o no cabe en capacity.
+ */
+ssize_t lz4_decompress(const void *src, size_t n, void *dst, size_t capacity);
+
+/**
+ * @brief   Codifica unos datos en una trama, comprimiéndolos si eso los reduce.
+ *
+ * @param raw       Datos originales.
+ * @param raw_len   Número de bytes de raw.
+ * @param frame     Buffer en el que escribir la trama.
+ * @param capacity  Tamaño de frame.
+ *
+ * @return  Número de bytes de la trama; -1 si no cabe en capacity.
+ */
+ssize_t compress_frame(const void *raw, size_t raw_len, void *frame, size_t capacity);
+
+/**
+ * @brief   Decodifica una trama y recupera los datos originales.
+ *
+ * @param frame     Trama recibida.
+ * @param frame_len Número de bytes de frame.
+ * @param raw       Buffer en el que escribir los datos originales.
+ * @param capacity  Tamaño de raw.
+ *
+ * @return  Número de bytes de los datos originales; -1 si la trama no es válida o no cabe en capacity.
+ */
+ssize_t decompress_frame(const void *frame, size_t frame_len, void *raw, size_t capacity);
+
+/**
+ * @brief   Indica si un mensaje recibido es una trama comprimida.
+ *
+ * @param buffer    Mensaje recibido.
+ * @param len       Número de bytes del mensaje.
+ *
+ * @return  true si empieza por COMPRESS_FRAME_MARKER y tiene al menos una cabecera completa.
+ */
+bool is_compressed_frame(const void *buffer, size_t len);
+
+#endif /* COMPRESS_H */
@@ -0,0 +1,189 @@
+#include <string.h>
+#include <pthread.h>
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+#include "crc32c.h"
+
+
+#define CRC32C_POLYNOMIAL 0x82f63b78U   /* Polinomio de Castagnoli, en orden de bits invertido */
+
+/* Tablas de slicing-by-8: la k-ésima da el CRC de un byte seguido de k bytes nulos */
+static uint32_t tables[8][256];
+
+/* Implementación elegida (ver choose_implementation) */
+static uint32_t (*update)(uint32_t crc, const uint8_t *data, size_t len) = NULL;
+static const char *implementation = NULL;
+static pthread_once_t chosen = PTHREAD_ONCE_INIT;
+
+
+/**
+ * @brief   Actualiza un CRC (sin invertir) con tablas, 8 bytes por paso.
+ */
+static uint32_t update_slicing_by_8(uint32_t crc, const uint8_t *data, size_t len) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    uint64_t word;
+
+    while (len >= 8) {
+        memcpy(&word, data, sizeof(word));
+        word ^= crc;
+        crc = tables[7][word & 0xff] ^ tables[6][(word >> 8) & 0xff] ^ tables[5][(word >> 16) & 0xff] ^ tables[4][(word >> 24) & 0xff]
+              ^ tables[3][(word >> 32) & 0xff] ^ tables[2][(word >> 40) & 0xff] ^ tables[1][(word >> 48) & 0xff] ^ tables[0][word >> 56];
+        data += 8;
+        len -= 8;
+    }
+#endif
+
+    /* Lo que queda (y todo, en máquinas big endian) byte a byte */
+    while (len--) {
+        crc = tables[0][(crc ^ *data++) & 0xff] ^ (crc >> 8);
+    }
+
+    return crc;
+}
+
+
+#if defined(__x86_64__)
+/**
+ * @brief   Actualiza un CRC (sin invertir) con la instrucción crc32 de SSE4.2, 8 bytes por instrucción.
+ */
+__attribute__((target("sse4.2")))
+static uint32_t update_sse42(uint32_t crc, const uint8_t *data, size_t len) {
+    uint64_t crc64 = crc, word;
+
+    while (len >= 8) {
+        memcpy(&word, data, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+        data += 8;
+        len -= 8;
+    }
+    crc = (uint32_t) crc64;
+
+    while (len--) {
+        crc = _mm_crc32_u8(crc, *data++);
+    }
+
+    return crc;
+}
+#endif
+
+
+/**
+ * @brief   Construye las tablas y elige la implementación según la CPU.
+ */
+static void choose_implementation(void) {
+    uint32_t crc;
+
+    for (uint32_t byte = 0; byte < 256; byte++) {
+        crc = byte;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLYNOMIAL : crc >> 1;
+        }
+        tables[0][byte] = crc;
+    }
+    for (uint32_t byte = 0; byte < 256; byte++) {
+        for (int k = 1; k < 8; k++) {
+            tables[k][byte] = (tables[k - 1][byte] >> 8) ^ tables[0][tables[k - 1][byte] & 0xff];
+        }
+    }
+
+    update = update_slicing_by_8;
+    implementation = "slicing-by-8";
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("sse4.2")) {
+        update = update_sse42;
+        implementation = "sse4.2";
+    }
+#endif
+}
+
+
+/**
+ * @brief   Actualiza un CRC32C con más datos.
+ *
+ * @param crc   CRC de los datos anteriores (0 para empezar).
+ * @param data  Datos a añadir.
+ * @param len   Número de bytes de data.
+ *
+ * @return  CRC de los datos anteriores seguidos de data.
+ */
+uint32_t crc32c(uint32_t crc, const void *data, size_t len) {
+    pthread_once(&chosen, choose_implementation);
+
+    return ~update(~crc, data, len);
+}
+
+
+/**
+ * @brief   Nombre de la implementación que se usa ("sse4.2" o "slicing-by-8").
+ *
+ * @return  Nombre de la implementación.
+ */
+const char *crc32c_implementation(void) {
+    pthread_once(&chosen, choose_implementation);
+
+    return implementation;
+}
+
+
+/**
+ * @brief   Indica si un mensaje empieza por una cabecera de integridad.
+ *
+ * @param message   Mensaje.
+ * @param len       Longitud del mensaje.
+ *
+ * @return  true si tiene cabecera de integridad.
+ */
+bool is_crc_header(const void *message, size_t len) {
+    return len >= CRC_HEADER_LEN && ((const uint8_t *) message)[0] == CRC_HEADER_MARKER;
+}
+
+
+/**
+ * @brief   Escribe la cabecera de integridad de un mensaje.
+ *
+ * @param header    Buffer de CRC_HEADER_LEN bytes para la cabecera.
+ * @param sequence  Número de secuencia.
+ * @param payload   Mensaje al que protege la cabecera.
+ * @param len       Longitud del mensaje.
+ */
+void crc_header_write(void *header, uint32_t sequence, const void *payload, size_t len) {
+    uint8_t *bytes = header;
+    uint32_t crc;
+
+    bytes[0] = CRC_HEADER_MARKER;
+    bytes[1] = sequence >> 24;
+    bytes[2] = sequence >> 16;
+    bytes[3] = sequence >> 8;
+    bytes[4] = sequence;
+
+    crc = crc32c(crc32c(0, bytes + 1, 4), payload, len);
+    bytes[5] = crc >> 24;
+    bytes[6] = crc >> 16;
+    bytes[7] = crc >> 8;
+    bytes[8] = crc;
+}
+
+
+/**
+ * @brief   Comprueba la cabecera de integridad de un mensaje.
+ *
+ * @param header    Cabecera (CRC_HEADER_LEN bytes).
+ * @param payload   Mensaje que la sigue.
+ * @param len       Longitud del mensaje.
+ * @param sequence  Dónde guardar el número de secuencia de la cabecera.
+ *
+ * @return  true si la cabecera es válida y el CRC coincide con el del mensaje; false en caso contrario.
+ */
+bool crc_header_check(const void *header, const void *payload, size_t len, uint32_t *sequence) {
+    const uint8_t *bytes = header;
+    uint32_t crc;
+
+    if (bytes[0] != CRC_HEADER_MARKER) return false;
+
+    *sequence = (uint32_t) bytes[1] << 24 | (uint32_t) bytes[2] << 16 | (uint32_t) bytes[3] << 8 | bytes[4];
+    crc = (uint32_t) bytes[5] << 24 | (uint32_t) bytes[6] << 16 | (uint32_t) bytes[7] << 8 | bytes[8];
+
+    return crc == crc32c(crc32c(0, bytes + 1, 4), payload, len);
+}
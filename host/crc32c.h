@@ -0,0 +1,86 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * CRC32C (Castagnoli) para comprobar la integridad de los datos entre clienteUDP y servidorUDP.
+ *
+ * En x86-64 con SSE4.2 se calcula con la instrucción crc32, 8 bytes por instrucción; si no, con tablas
+ * (slicing-by-8). La implementación se elige la primera vez que se usa, según la CPU.
+ *
+ * Cuando el servidor acepta el token CRC_TOKEN en el intercambio del nombre del archivo, cada petición
+ * y cada respuesta por el socket llevan delante una cabecera de integridad:
+ *
+ *  +--------+--------------------+--------------------+------------------------------+
+ *  | 0x02   | número de secuencia| CRC32C             | mensaje original (cabecera   |
+ *  | 1 byte | 4 bytes big endian | 4 bytes big endian | de operación, texto o trama) |
+ *  +--------+--------------------+--------------------+------------------------------+
+ *
+ * El CRC cubre el número de secuencia y el mensaje. La respuesta repite el número de secuencia de su
+ * petición: así el cliente puede reenviar una petición sin confundir luego una respuesta atrasada con
+ * la de la petición siguiente.
+ */
+
+/* Primer byte de la cabecera de integridad (ningún mensaje de texto, trama comprimida ni cabecera de operación empieza por él) */
+#define CRC_HEADER_MARKER 0x02
+
+/* Tamaño de la cabecera de integridad */
+#define CRC_HEADER_LEN 9
+
+/* Token que se añade, tras el nulo del nombre de archivo, para pedir y aceptar la cabecera de integridad */
+#define CRC_TOKEN "CRC=crc32c"
+
+/**
+ * @brief   Actualiza un CRC32C con más datos.
+ *
+ * @param crc   CRC de los datos anteriores (0 para empezar).
+ * @param data  Datos a añadir.
+ * @param len   Número de bytes de data.
+ *
+ * @return  CRC de los datos anteriores seguidos de data.
+ */
+uint32_t crc32c(uint32_t crc, const void *data, size_t len);
+
+/**
+ * @brief   Nombre de la implementación que se usa ("sse4.2" o "slicing-by-8").
+ *
+ * @return  Nombre de la implementación.
+ */
+const char *crc32c_implementation(void);
+
+/**
+ * @brief   Indica si un mensaje empieza por una cabecera de integridad.
+ *
+ * @param message   Mensaje.
+ * @param len       Longitud del mensaje.
+ *
+ * @return  true si tiene cabecera de integridad.
+ */
+bool is_crc_header(const void *message, size_t len);
+
+/**
+ * @brief   Escribe la cabecera de integridad de un mensaje.
+ *
+ * @param header    Buffer de CRC_HEADER_LEN bytes para la cabecera.
+ * @param sequence  Número de secuencia.
+ * @param payload   Mensaje al que protege la cabecera.
+ * @param len       Longitud del mensaje.
+ */
+void crc_header_write(void *header, uint32_t sequence, const void *payload, size_t len);
+
+/**
+ * @brief   Comprueba la cabecera de integridad de un mensaje.
+ *
+ * @param header    Cabecera (CRC_HEADER_LEN bytes).
+ * @param payload   Mensaje que la sigue.
+ * @param len       Longitud del mensaje.
+ * @param sequence  Dónde guardar el número de secuencia de la cabecera.
+ *
+ * @return  true si la cabecera es válida y el CRC coincide con el del mensaje; false en caso contrario.
+ */
+bool crc_header_check(const void *header, const void *payload, size_t len, uint32_t *sequence);
+
+#endif /* CRC32C_H */
@@ -0,0 +1,365 @@
+#define _GNU_SOURCE     /* Para syscall y sync_file_range */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "filewriter.h"
+
+
+/**
+ * @brief   Duerme en un futex privado del proceso mientras valga expected.
+ */
+static void futex_wait(atomic_uint *word, unsigned expected) {
+    syscall(SYS_futex, (uint32_t *) word, FUTEX_WAIT_PRIVATE, expected, NULL, NULL, 0);
+}
+
+
+/**
+ * @brief   Despierta a quien duerma en un futex privado del proceso.
+ */
+static void futex_wake(atomic_uint *word) {
+    syscall(SYS_futex, (uint32_t *) word, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+
+/**
+ * @brief   Escribe entero un vector de tramos, reintentando las escrituras parciales.
+ *
+ * @return  0 si se escribió todo; errno del fallo en caso contrario.
+ */
+static int write_all(int fd, struct iovec *iov, int count) {
+    ssize_t written;
+
+    while (count > 0) {
+        if ((written = writev(fd, iov, count)) < 0) {
+            if (errno == EINTR) continue;
+            return errno;
+        }
+
+        /* Saltamos los tramos ya escritos y recortamos el primero que quedó a medias */
+        while (count > 0 && (size_t) written >= iov->iov_len) {
+            written -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char *) iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief   Manda a disco un tramo recién escrito y retira de la caché el anterior, que ya debería estar en disco.
+ *
+ * @param writer        Escritor.
+ * @param offset        Desplazamiento del tramo recién escrito.
+ * @param len           Longitud del tramo recién escrito.
+ * @param previous      Desplazamiento del tramo anterior; se actualiza.
+ * @param previous_len  Longitud del tramo anterior; se actualiza.
+ */
+static void write_back(FileWriter *writer, off_t offset, off_t len, off_t *previous, off_t *previous_len) {
+    /* Empezamos a volcar el tramo nuevo sin esperar a que termine */
+    sync_file_range(writer->fd, offset, len, SYNC_FILE_RANGE_WRITE);
+
+    /* El anterior lleva un tramo entero de ventaja: esperamos a que acabe y lo sacamos de la caché */
+    if (*previous_len) {
+        sync_file_range(writer->fd, *previous, *previous_len, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+        posix_fadvise(writer->fd, *previous, *previous_len, POSIX_FADV_DONTNEED);
+    }
+
+    *previous = offset;
+    *previous_len = len;
+}
+
+
+/**
+ * @brief   Hilo escritor: escribe los bloques entregados, de todos los pendientes a la vez, hasta que se cierra.
+ *
+ * @param arg   Escritor (FileWriter *).
+ *
+ * @return  Siempre NULL.
+ */
+static void *writer_thread(void *arg) {
+    FileWriter *writer = arg;
+    struct iovec iov[FILE_WRITER_SLOTS];
+    unsigned released = atomic_load_explicit(&writer->released, memory_order_relaxed);
+    unsigned committed;
+    off_t offset = lseek(writer->fd, 0, SEEK_CUR), previous = 0, previous_len = 0, batch_len;   /* Con FILE_WRITER_APPEND no se empieza en 0 */
+    int count, error;
+
+    for (;;) {
+        committed = atomic_load_explicit(&writer->committed, memory_order_acquire);
+
+        if (committed == released) {
+            /* Al cerrar, el productor fija cuántos bloques habrá entregado en total: terminamos al escribirlos todos */
+            if (atomic_load_explicit(&writer->closing, memory_order_acquire)
+                && released == atomic_load_explicit(&writer->end, memory_order_relaxed)) {
+                break;
+            }
+
+            /* Avisamos de que vamos a dormir y volvemos a mirar, para no perder una entrega que llegue entre medias */
+            atomic_store_explicit(&writer->writer_waiting, 1, memory_order_seq_cst);
+            if (atomic_load_explicit(&writer->committed, memory_order_seq_cst) == released) {
+                futex_wait(&writer->committed, released);
+            }
+            atomic_store_explicit(&writer->writer_waiting, 0, memory_order_relaxed);
+            continue;
+        }
+
+        /* Juntamos en una sola escritura todos los bloques entregados */
+        batch_len = 0;
+        count = 0;
+        for (unsigned i = released; i != committed; i++) {
+            struct FileWriterSlot *slot = &writer->slots[i % FILE_WRITER_SLOTS];
+
+            /* El último bloque puede llegar vacío (ver file_writer_close) */
+            if (slot->len) {
+                iov[count].iov_base = slot->data;
+                iov[count].iov_len = slot->len;
+                batch_len += slot->len;
+                count++;
+            }
+        }
+
+        /* Tras un error ya no se escribe nada más, pero se siguen devolviendo los bloques para que el productor no se bloquee */
+        if (count && !atomic_load_explicit(&writer->error, memory_order_relaxed)) {
+            if ((error = write_all(writer->fd, iov, count))) {
+                atomic_store_explicit(&writer->error, error, memory_order_release);
+            } else {
+                writer->bytes_written += batch_len;
+                writer->write_calls++;
+                if (writer->flags & FILE_WRITER_WRITEBACK) {
+                    write_back(writer, offset, batch_len, &previous, &previous_len);
+                }
+                offset += batch_len;
+            }
+        }
+
+        released = committed;
+        atomic_store_explicit(&writer->released, released, memory_order_seq_cst);
+        if (atomic_load_explicit(&writer->producer_waiting, memory_order_seq_cst)) {
+            futex_wake(&writer->released);
+        }
+    }
+
+    /* El último tramo también sale de la caché al terminar */
+    if ((writer->flags & FILE_WRITER_WRITEBACK) && previous_len && !atomic_load_explicit(&writer->error, memory_order_relaxed)) {
+        sync_file_range(writer->fd, previous, previous_len, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+        posix_fadvise(writer->fd, previous, previous_len, POSIX_FADV_DONTNEED);
+    }
+
+    return NULL;
+}
+
+
+/**
+ * @brief   Entrega al escritor el bloque actual del productor.
+ */
+static void commit_slot(FileWriter *writer) {
+    atomic_store_explicit(&writer->committed, atomic_load_explicit(&writer->committed, memory_order_relaxed) + 1, memory_order_seq_cst);
+    if (atomic_load_explicit(&writer->writer_waiting, memory_order_seq_cst)) {
+        futex_wake(&writer->committed);
+    }
+}
+
+
+/**
+ * @brief   Espera a que el escritor deje como mucho pending bloques entregados sin escribir.
+ *
+ * @return  true si hubo que esperar.
+ */
+static bool wait_for_writer(FileWriter *writer, unsigned committed, unsigned pending) {
+    unsigned released;
+    bool waited = false;
+
+    while (committed - atomic_load_explicit(&writer->released, memory_order_acquire) > pending) {
+        waited = true;
+        atomic_store_explicit(&writer->producer_waiting, 1, memory_order_seq_cst);
+        released = atomic_load_explicit(&writer->released, memory_order_seq_cst);
+        if (committed - released > pending) {
+            futex_wait(&writer->released, released);
+        }
+        atomic_store_explicit(&writer->producer_waiting, 0, memory_order_relaxed);
+    }
+
+    return waited;
+}
+
+
+/**
+ * @brief   Crea (o trunca, salvo con FILE_WRITER_APPEND) un archivo y arranca el hilo que lo escribe.
+ *
+ * @param writer    Escritor a inicializar.
+ * @param path      Ruta del archivo.
+ * @param flags     Opciones (FILE_WRITER_*).
+ *
+ * @return  true si el escritor quedó en marcha; false en caso de error (errno indica el motivo).
+ */
+bool file_writer_open(FileWriter *writer, const char *path, unsigned flags) {
+    sigset_t blocked, previous;
+    int error, i;
+
+    memset(writer, 0, sizeof(FileWriter));
+    writer->flags = flags;
+
+    if ((writer->fd = open(path, O_WRONLY | O_CREAT | (flags & FILE_WRITER_APPEND ? 0 : O_TRUNC) | O_CLOEXEC, 0666)) < 0) {
+        return false;
+    }
+    if ((flags & FILE_WRITER_APPEND) && lseek(writer->fd, 0, SEEK_END) < 0) {
+        error = errno;
+        close(writer->fd);
+        errno = error;
+        return false;
+    }
+    posix_fadvise(writer->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    for (i = 0; i < FILE_WRITER_SLOTS; i++) {
+        if (!(writer->slots[i].data = malloc(FILE_WRITER_SLOT_SIZE))) {
+            error = errno;
+            goto error;
+        }
+    }
+
+    /* El hilo no debe atender las señales del proceso: de eso se encarga el hilo principal */
+    sigfillset(&blocked);
+    pthread_sigmask(SIG_BLOCK, &blocked, &previous);
+    error = pthread_create(&writer->thread, NULL, writer_thread, writer);
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    if (error) {
+        goto error;
+    }
+
+    return true;
+
+error:
+    while (i-- > 0) free(writer->slots[i].data);
+    close(writer->fd);
+    errno = error;
+    return false;
+}
+
+
+/**
+ * @brief   Reserva sitio para escribir hasta len bytes a continuación de lo ya escrito.
+ *
+ * @param writer    Escritor.
+ * @param len       Bytes que se van a escribir (como mucho FILE_WRITER_SLOT_SIZE).
+ *
+ * @return  Dónde escribir los datos; NULL si el escritor falló (errno indica el motivo) o len es demasiado grande.
+ */
+char *file_writer_reserve(FileWriter *writer, size_t len) {
+    unsigned committed = atomic_load_explicit(&writer->committed, memory_order_relaxed);
+    struct FileWriterSlot *slot = &writer->slots[committed % FILE_WRITER_SLOTS];
+    int error;
+
+    if (len > FILE_WRITER_SLOT_SIZE) {
+        errno = EMSGSIZE;
+        return NULL;
+    }
+    if ((error = atomic_load_explicit(&writer->error, memory_order_acquire))) {
+        errno = error;
+        return NULL;
+    }
+
+    if (slot->len + len <= FILE_WRITER_SLOT_SIZE) {
+        return slot->data + slot->len;
+    }
+
+    /* No cabe: entregamos el bloque actual y esperamos a que el siguiente esté libre */
+    commit_slot(writer);
+    committed++;
+    if (wait_for_writer(writer, committed, FILE_WRITER_SLOTS - 1)) {
+        writer->producer_stalls++;
+    }
+
+    slot = &writer->slots[committed % FILE_WRITER_SLOTS];
+    slot->len = 0;
+
+    return slot->data;
+}
+
+
+/**
+ * @brief   Confirma los bytes escritos en el sitio que devolvió file_writer_reserve.
+ *
+ * @param writer    Escritor.
+ * @param len       Bytes escritos (como mucho los reservados).
+ */
+void file_writer_advance(FileWriter *writer, size_t len) {
+    writer->slots[atomic_load_explicit(&writer->committed, memory_order_relaxed) % FILE_WRITER_SLOTS].len += len;
+}
+
+
+/**
+ * @brief   Entrega lo pendiente y espera a que esté escrito y en disco (fdatasync).
+ *
+ * @param writer    Escritor.
+ *
+ * @return  true si todo lo confirmado hasta ahora está en disco; false si hubo algún error (errno indica el motivo).
+ */
+bool file_writer_sync(FileWriter *writer) {
+    unsigned committed = atomic_load_explicit(&writer->committed, memory_order_relaxed);
+    int error;
+
+    /* Entregamos el bloque a medias y empezamos el siguiente, que queda libre al esperar a que se escriba todo */
+    if (writer->slots[committed % FILE_WRITER_SLOTS].len) {
+        commit_slot(writer);
+        committed++;
+    }
+    wait_for_writer(writer, committed, 0);
+    writer->slots[committed % FILE_WRITER_SLOTS].len = 0;
+
+    if ((error = atomic_load_explicit(&writer->error, memory_order_acquire))) {
+        errno = error;
+        return false;
+    }
+
+    return !fdatasync(writer->fd);
+}
+
+
+/**
+ * @brief   Entrega lo pendiente, espera a que se escriba todo y cierra el archivo.
+ *
+ * @param writer    Escritor.
+ *
+ * @return  true si se escribió y cerró todo; false si hubo algún error (errno indica el motivo).
+ */
+bool file_writer_close(FileWriter *writer) {
+    int error;
+
+    /* Entregamos siempre el bloque actual, aunque esté vacío: así el escritor despierta por el cambio de committed */
+    atomic_store_explicit(&writer->end, atomic_load_explicit(&writer->committed, memory_order_relaxed) + 1, memory_order_relaxed);
+    atomic_store_explicit(&writer->closing, true, memory_order_release);
+    commit_slot(writer);
+    pthread_join(writer->thread, NULL);
+
+    for (int i = 0; i < FILE_WRITER_SLOTS; i++) {
+        free(writer->slots[i].data);
+        writer->slots[i].data = NULL;
+    }
+
+    error = atomic_load_explicit(&writer->error, memory_order_acquire);
+    if (close(writer->fd) && !error) {
+        error = errno;
+    }
+    writer->fd = -1;
+
+    if (error) {
+        errno = error;
+        return false;
+    }
+
+    return true;
+}
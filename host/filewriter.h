@@ -0,0 +1,123 @@
+#ifndef FILEWRITER_H
+#define FILEWRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+/*
+ * Escritura de un archivo en segundo plano, para que el disco no frene al hilo que atiende la red.
+ *
+ * El hilo productor va dejando los datos en bloques reutilizables de FILE_WRITER_SLOT_SIZE bytes
+ * (reservando sitio y escribiendo directamente en él, sin copias intermedias) y entrega cada bloque
+ * lleno a un hilo escritor por una cola circular sin cerrojos de un solo productor y un solo
+ * consumidor. El escritor junta todos los bloques pendientes en una sola llamada a writev, de forma
+ * que el archivo se escribe en tramos grandes y secuenciales, y devuelve los bloques al productor.
+ * Quien espera (el productor porque no quedan bloques libres, o el escritor porque no hay ninguno
+ * lleno) duerme en un futex que el otro solo despierta si sabe que hay alguien esperando.
+ *
+ * Con FILE_WRITER_WRITEBACK, además, cada tramo escrito se manda a disco con sync_file_range y,
+ * una vez en disco, se descarta de la caché de páginas con posix_fadvise: la memoria sucia no crece
+ * sin límite y el archivo va llegando al disco (o al servidor de archivos) a ritmo constante, en
+ * lugar de todo de golpe al cerrarlo.
+ *
+ * Con FILE_WRITER_APPEND el archivo no se trunca y los datos se escriben a continuación de lo que ya
+ * tuviera (para reanudar una transferencia). file_writer_sync espera a que todo lo entregado esté
+ * escrito y en disco, para poder anotar hasta dónde llegó el archivo sin riesgo de perderlo.
+ */
+
+/* Tamaño de cada bloque */
+#define FILE_WRITER_SLOT_SIZE (1U << 18)
+
+/* Número de bloques (potencia de 2) */
+#define FILE_WRITER_SLOTS 16
+
+/* Opciones de file_writer_open */
+#define FILE_WRITER_WRITEBACK 0x1   /* Volcar cada tramo con sync_file_range y sacarlo de la caché */
+#define FILE_WRITER_APPEND 0x2      /* No truncar el archivo: escribir tras lo que ya tenga */
+
+/**
+ * Bloque de la cola.
+ */
+struct FileWriterSlot {
+    char *data;         /* FILE_WRITER_SLOT_SIZE bytes */
+    size_t len;         /* Bytes ocupados */
+};
+
+/**
+ * Escritor en segundo plano de un archivo.
+ */
+typedef struct {
+    int fd;                                         /* Archivo de salida */
+    unsigned flags;                                 /* FILE_WRITER_* */
+    struct FileWriterSlot slots[FILE_WRITER_SLOTS]; /* Bloques, que se usan en orden circular */
+    _Alignas(64) atomic_uint committed;             /* Bloques entregados al escritor (solo lo escribe el productor) */
+    _Alignas(64) atomic_uint released;              /* Bloques ya escritos (solo lo escribe el escritor) */
+    atomic_uint writer_waiting;                     /* El escritor está (o va a estar) dormido en committed */
+    atomic_uint producer_waiting;                   /* El productor está (o va a estar) dormido en released */
+    atomic_bool closing;                            /* El productor no entregará más bloques que los que indica end */
+    atomic_uint end;                                /* Bloques entregados en total al cerrar (válido con closing) */
+    atomic_int error;                               /* errno del primer error de escritura (0 si no hubo) */
+    pthread_t thread;                               /* Hilo escritor */
+    /* Estadísticas (el productor solo debe leer las del escritor tras file_writer_close) */
+    uint64_t bytes_written;                         /* Bytes escritos en el archivo */
+    uint64_t write_calls;                           /* Llamadas a writev */
+    uint64_t producer_stalls;                       /* Veces que el productor esperó por un bloque libre */
+} FileWriter;
+
+/**
+ * @brief   Crea (o trunca, salvo con FILE_WRITER_APPEND) un archivo y arranca el hilo que lo escribe.
+ *
+ * @param writer    Escritor a inicializar.
+ * @param path      Ruta del archivo.
+ * @param flags     Opciones (FILE_WRITER_*).
+ *
+ * @return  true si el escritor quedó en marcha; false en caso de error (errno indica el motivo).
+ */
+bool file_writer_open(FileWriter *writer, const char *path, unsigned flags);
+
+/**
+ * @brief   Reserva sitio para escribir hasta len bytes a continuación de lo ya escrito.
+ *
+ * Si no caben en el bloque actual, lo entrega al escritor y pasa al siguiente, esperando a que quede
+ * libre si hace falta. Los bytes escritos no cuentan hasta confirmarlos con file_writer_advance.
+ *
+ * @param writer    Escritor.
+ * @param len       Bytes que se van a escribir (como mucho FILE_WRITER_SLOT_SIZE).
+ *
+ * @return  Dónde escribir los datos; NULL si el escritor falló (errno indica el motivo) o len es demasiado grande.
+ */
+char *file_writer_reserve(FileWriter *writer, size_t len);
+
+/**
+ * @brief   Confirma los bytes escritos en el sitio que devolvió file_writer_reserve.
+ *
+ * @param writer    Escritor.
+ * @param len       Bytes escritos (como mucho los reservados).
+ */
+void file_writer_advance(FileWriter *writer, size_t len);
+
+/**
+ * @brief   Entrega lo pendiente y espera a que esté escrito y en disco (fdatasync).
+ *
+ * El productor puede seguir escribiendo después; el bloque a medias se entrega tal cual, así que
+ * conviene no llamarla a menudo (por ejemplo, una vez por segundo).
+ *
+ * @param writer    Escritor.
+ *
+ * @return  true si todo lo confirmado hasta ahora está en disco; false si hubo algún error (errno indica el motivo).
+ */
+bool file_writer_sync(FileWriter *writer);
+
+/**
+ * @brief   Entrega lo pendiente, espera a que se escriba todo y cierra el archivo.
+ *
+ * @param writer    Escritor.
+ *
+ * @return  true si se escribió y cerró todo; false si hubo algún error (errno indica el motivo).
+ */
+bool file_writer_close(FileWriter *writer);
+
+#endif /* FILEWRITER_H */
@@ -0,0 +1,251 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <locale.h>
+#include <wctype.h>
+
+/*
+ * Generador de las tablas de transform.c.
+ *
+ * Se compila y ejecuta durante la compilación (ver el Makefile) y escribe por la salida estándar
+ * transform_tables.h: las tablas de cambio de caja de todos los puntos de código Unicode, obtenidas de
+ * la tabla de caracteres de la configuración regional C.UTF-8, y las tablas byte a byte de las
+ * transformaciones ASCII. Así el servidor no depende de la configuración regional en la que se ejecute
+ * ni tiene que preparar nada al arrancar.
+ *
+ * Las tablas de puntos de código son de dos niveles: un índice por página de 256 puntos de código que
+ * apunta a una página de diferencias (destino - origen). Las páginas repetidas se guardan una sola vez,
+ * así que la mayor parte del índice apunta a la página de identidad.
+ */
+
+#define CODEPOINTS 0x110000             /* Puntos de código Unicode */
+#define PAGE_BITS 8
+#define PAGE_SIZE (1 << PAGE_BITS)      /* Puntos de código por página */
+#define PAGES (CODEPOINTS / PAGE_SIZE)  /* Entradas de cada índice */
+#define WORD_PAGE_BYTES (PAGE_SIZE / 8) /* Bytes de cada página del mapa de bits de letras */
+
+/**
+ * Conjunto de páginas distintas, compartido por todas las tablas del mismo tipo.
+ */
+struct PagePool {
+    void *pages;            /* Páginas, una tras otra */
+    size_t page_bytes;      /* Tamaño de cada página */
+    size_t count;           /* Páginas guardadas */
+};
+
+/**
+ * @brief   Devuelve el número de una página en el conjunto, añadiéndola si no estaba.
+ *
+ * @param pool  Conjunto de páginas.
+ * @param page  Página a buscar.
+ *
+ * @return  Número de la página en el conjunto.
+ */
+static size_t intern_page(struct PagePool *pool, const void *page) {
+    for (size_t i = 0; i < pool->count; i++) {
+        if (!memcmp((char *) pool->pages + i * pool->page_bytes, page, pool->page_bytes)) return i;
+    }
+
+    if (!(pool->pages = realloc(pool->pages, (pool->count + 1) * pool->page_bytes))) {
+        perror("gentransform");
+        exit(EXIT_FAILURE);
+    }
+    memcpy((char *) pool->pages + pool->count * pool->page_bytes, page, pool->page_bytes);
+
+    return pool->count++;
+}
+
+/**
+ * @brief   Comprueba si un punto de código es un sustituto UTF-16 (no representable en UTF-8).
+ */
+static int is_surrogate(uint32_t c) {
+    return c >= 0xd800 && c <= 0xdfff;
+}
+
+/**
+ * @brief   Mayúscula de un punto de código.
+ */
+static uint32_t map_upper(uint32_t c) {
+    return towupper(c);
+}
+
+/**
+ * @brief   Minúscula de un punto de código.
+ */
+static uint32_t map_lower(uint32_t c) {
+    return towlower(c);
+}
+
+/**
+ * @brief   Forma de título de un punto de código: la mayúscula, salvo en los dígrafos que tienen forma propia.
+ *
+ * Los dígrafos de U+01C4..U+01CC y U+01F1..U+01F3 van en grupos de tres (mayúscula, título, minúscula).
+ */
+static uint32_t map_title(uint32_t c) {
+    if ((c >= 0x01c4 && c <= 0x01cc) || (c >= 0x01f1 && c <= 0x01f3)) {
+        uint32_t first = c <= 0x01cc ? 0x01c4 : 0x01f1;
+
+        return first + (c - first) / 3 * 3 + 1;
+    }
+
+    return towupper(c);
+}
+
+/**
+ * @brief   Plegado de caja simple de un punto de código: la minúscula de su mayúscula (ς y σ, ſ y s...).
+ */
+static uint32_t map_fold(uint32_t c) {
+    return towlower(towupper(c));
+}
+
+/**
+ * @brief   Indica si un punto de código forma parte de una palabra a efectos de la forma de título.
+ *
+ * Además de las letras, el apóstrofo no corta la palabra ("don't" -> "Don't").
+ */
+static int is_word_char(uint32_t c) {
+    return iswalpha(c) || c == 0x27 || c == 0x2019;
+}
+
+/**
+ * @brief   Escribe una tabla de cambio de caja: su índice, con las páginas que use añadidas al conjunto.
+ *
+ * @param name  Nombre de la tabla en transform_tables.h.
+ * @param map   Función que da el destino de cada punto de código.
+ * @param pool  Conjunto de páginas de diferencias.
+ */
+static void emit_case_index(const char *name, uint32_t (*map)(uint32_t), struct PagePool *pool) {
+    int32_t page[PAGE_SIZE];
+
+    printf("static const uint16_t transform_%s_index[TRANSFORM_TABLE_PAGES] = {", name);
+    for (uint32_t p = 0; p < PAGES; p++) {
+        for (uint32_t i = 0; i < PAGE_SIZE; i++) {
+            uint32_t c = (p << PAGE_BITS) | i;
+            uint32_t mapped = is_surrogate(c) ? c : map(c);
+
+            /* Un destino que no se pueda codificar en UTF-8 deja el carácter como está */
+            if (mapped >= CODEPOINTS || is_surrogate(mapped)) mapped = c;
+            page[i] = (int32_t) mapped - (int32_t) c;
+        }
+        printf("%s%zu", p % 32 ? "," : p ? ",\n    " : "\n    ", intern_page(pool, page));
+    }
+    printf("\n};\n\n");
+}
+
+/**
+ * @brief   Escribe una tabla byte a byte de 256 entradas.
+ *
+ * @param name  Nombre de la tabla en transform_tables.h.
+ * @param map   Función que da el destino de cada byte.
+ */
+static void emit_byte_table(const char *name, unsigned (*map)(unsigned)) {
+    printf("static const uint8_t transform_%s_bytes[256] = {", name);
+    for (unsigned b = 0; b < 256; b++) {
+        printf("%s%u", b % 16 ? "," : b ? ",\n    " : "\n    ", map(b));
+    }
+    printf("\n};\n\n");
+}
+
+/**
+ * @brief   Mayúscula ASCII de un byte (el resto de bytes, incluidos los de UTF-8, no cambian).
+ */
+static unsigned ascii_upper(unsigned b) {
+    return b >= 'a' && b <= 'z' ? b - 'a' + 'A' : b;
+}
+
+/**
+ * @brief   Minúscula ASCII de un byte.
+ */
+static unsigned ascii_lower(unsigned b) {
+    return b >= 'A' && b <= 'Z' ? b - 'A' + 'a' : b;
+}
+
+/**
+ * @brief   ROT13 de un byte.
+ */
+static unsigned rot13(unsigned b) {
+    if (b >= 'a' && b <= 'z') return 'a' + (b - 'a' + 13) % 26;
+    if (b >= 'A' && b <= 'Z') return 'A' + (b - 'A' + 13) % 26;
+    return b;
+}
+
+
+int main(void) {
+    struct PagePool deltas = {.page_bytes = PAGE_SIZE * sizeof(int32_t)};
+    struct PagePool words = {.page_bytes = WORD_PAGE_BYTES};
+    uint8_t word_page[WORD_PAGE_BYTES];
+    uint16_t word_index[PAGES];
+
+    if (!setlocale(LC_CTYPE, "C.UTF-8") && !setlocale(LC_CTYPE, "C.utf8")) {
+        fprintf(stderr, "gentransform: la configuración regional C.UTF-8 no está disponible\n");
+        exit(EXIT_FAILURE);
+    }
+
+    printf("/* Generado por gentransform.c a partir de la tabla de caracteres de C.UTF-8: no editar */\n\n");
+    printf("#define TRANSFORM_TABLE_PAGE_BITS %d\n", PAGE_BITS);
+    printf("#define TRANSFORM_TABLE_PAGES %d\n\n", PAGES);
+
+    /* La página de identidad va la primera, de forma que sea la 0 en todos los índices */
+    intern_page(&deltas, (int32_t[PAGE_SIZE]) {0});
+
+    emit_case_index("upper", map_upper, &deltas);
+    emit_case_index("lower", map_lower, &deltas);
+    emit_case_index("title", map_title, &deltas);
+    emit_case_index("fold", map_fold, &deltas);
+
+    printf("static const int32_t transform_delta_pages[%zu][%d] = {\n", deltas.count, PAGE_SIZE);
+    for (size_t p = 0; p < deltas.count; p++) {
+        const int32_t *page = (const int32_t *) deltas.pages + p * PAGE_SIZE;
+
+        printf("    {");
+        for (int i = 0; i < PAGE_SIZE; i++) {
+            printf("%s%d", i ? "," : "", page[i]);
+        }
+        printf("}%s\n", p + 1 < deltas.count ? "," : "");
+    }
+    printf("};\n\n");
+
+    /* Mapa de bits de los caracteres que forman palabras, para la forma de título */
+    for (uint32_t p = 0; p < PAGES; p++) {
+        memset(word_page, 0, sizeof(word_page));
+        for (uint32_t i = 0; i < PAGE_SIZE; i++) {
+            uint32_t c = (p << PAGE_BITS) | i;
+
+            if (!is_surrogate(c) && is_word_char(c)) word_page[i / 8] |= 1 << (i % 8);
+        }
+        word_index[p] = intern_page(&words, word_page);
+    }
+
+    printf("static const uint16_t transform_word_index[TRANSFORM_TABLE_PAGES] = {");
+    for (uint32_t p = 0; p < PAGES; p++) {
+        printf("%s%u", p % 32 ? "," : p ? ",\n    " : "\n    ", word_index[p]);
+    }
+    printf("\n};\n\n");
+
+    printf("static const uint8_t transform_word_pages[%zu][%d] = {\n", words.count, WORD_PAGE_BYTES);
+    for (size_t p = 0; p < words.count; p++) {
+        const uint8_t *page = (const uint8_t *) words.pages + p * WORD_PAGE_BYTES;
+
+        printf("    {");
+        for (int i = 0; i < WORD_PAGE_BYTES; i++) {
+            printf("%s%u", i ? "," : "", page[i]);
+        }
+        printf("}%s\n", p + 1 < words.count ? "," : "");
+    }
+    printf("};\n\n");
+
+    emit_byte_table("ascii_upper", ascii_upper);
+    emit_byte_table("ascii_lower", ascii_lower);
+    emit_byte_table("rot13", rot13);
+
+    free(deltas.pages);
+    free(words.pages);
+
+    if (fflush(stdout) || ferror(stdout)) {
+        perror("gentransform");
+        exit(EXIT_FAILURE);
+    }
+
+    exit(EXIT_SUCCESS);
+}
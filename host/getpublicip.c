@@ -33,6 +33,7 @@ char* getpublicip(char* ip, size_t len) {
     int sockfd;
     char http_request[] = HTTP_REQUEST;
     char input_buffer[BUFFER_LEN] = {0};
+    char *body;
 
     memset(&hints, 0, sizeof(struct addrinfo)); /* Inicializamos a 0 */
     /* Especifica criterios para seleccionar las estructuras de direcciones de socket en la lista que se obtiene con getaddrinfo() */
@@ -61,27 +62,36 @@ char* getpublicip(char* ip, size_t len) {
 
     if (!rp) {
         fprintf(stderr, "No se pudo conectar a %s\n", NODE_NAME);
+        freeaddrinfo(result);
         return NULL;
     }
 
+    freeaddrinfo(result);
+
     /* Ya estamos conectados a ipify.org. Ahora tenemos que enviarle la petición
      * HTTP y procesar la respuesta */
-    if (send(sockfd, http_request, strlen(http_request) + 1, 0) == 0 ) {    /* No se envió ningún byte */
+    if (send(sockfd, http_request, strlen(http_request) + 1, 0) <= 0 ) {    /* No se envió ningún byte */
         perror("No se pudo enviar la petición de http");
+        close(sockfd);
         return NULL;
     }
 
-    if (recv(sockfd, input_buffer, BUFFER_LEN, 0) == 0 ) {      /* No se recibió ningún byte */
+    if (recv(sockfd, input_buffer, BUFFER_LEN - 1, 0) <= 0 ) {      /* No se recibió ningún byte */
         perror("No se pudo recibir la respuesta de http");
+        close(sockfd);
         return NULL;
     }
 
+    close(sockfd);
+
     /* Parsear el input_buffer hasta encontrar dos saltos de línea seguidos */
     /* Buscamos la primera aparición de dos saltos de línea, que indica que inicia el cuerpo del mensaje, que solo
      * contiene nuestra IP externa */
-    strncpy(ip, strstr(input_buffer, "\r\n\r\n") + 4, len);
-
-    freeaddrinfo(result);    
+    if (!(body = strstr(input_buffer, "\r\n\r\n"))) {
+        fprintf(stderr, "Respuesta de %s sin cuerpo\n", NODE_NAME);
+        return NULL;
+    }
+    strncpy(ip, body + 4, len);
 
     return ip;
 }
@@ -0,0 +1,313 @@
+#define _GNU_SOURCE     /* Para MSG_CMSG_CLOEXEC */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#include "handoff.h"
+#include "traffic.h"
+
+
+#define HANDOFF_MAGIC 0x4d415955U   /* "MAYU": cabecera de la sustitución */
+#define HANDOFF_READY 'R'           /* Confirmación del proceso nuevo */
+#define HANDOFF_CHILD_FD 3          /* Descriptor del canal en el proceso nuevo */
+
+/**
+ * Primer mensaje del canal: cuántos sockets le siguen, cada uno en su propio mensaje.
+ */
+struct HandoffHeader {
+    uint32_t magic;
+    uint32_t count;
+};
+
+extern char **environ;
+
+/* Ruta del ejecutable y argumentos con los que relanzarlo (ver handoff_init) */
+static char executable[PATH_MAX];
+static char **arguments = NULL;
+
+/* En el proceso nuevo, canal con el anterior hasta confirmar (-1 si no hay) */
+static int parent_channel = -1;
+
+
+/**
+ * @brief   Envía un socket por el canal.
+ */
+static bool send_socket(int channel, int socket, uint32_t index) {
+    char control[CMSG_SPACE(sizeof(int))] = {0};
+    struct iovec payload = {.iov_base = &index, .iov_len = sizeof(index)};
+    struct msghdr message = {.msg_iov = &payload, .msg_iovlen = 1, .msg_control = control, .msg_controllen = sizeof(control)};
+    struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(header), &socket, sizeof(int));
+
+    return sendmsg(channel, &message, MSG_NOSIGNAL) == sizeof(index);
+}
+
+
+/**
+ * @brief   Recibe un socket por el canal.
+ *
+ * @return  Socket recibido; -1 si no llegó ninguno.
+ */
+static int receive_socket(int channel) {
+    char control[CMSG_SPACE(sizeof(int))];
+    uint32_t index;
+    struct iovec payload = {.iov_base = &index, .iov_len = sizeof(index)};
+    struct msghdr message = {.msg_iov = &payload, .msg_iovlen = 1, .msg_control = control, .msg_controllen = sizeof(control)};
+    struct cmsghdr *header;
+    int socket;
+
+    if (recvmsg(channel, &message, MSG_CMSG_CLOEXEC) != sizeof(index) || !(header = CMSG_FIRSTHDR(&message))
+        || header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS || header->cmsg_len != CMSG_LEN(sizeof(int))) {
+        errno = EPROTO;
+        return -1;
+    }
+    memcpy(&socket, CMSG_DATA(header), sizeof(int));
+
+    return socket;
+}
+
+
+/**
+ * @brief   Construye el entorno del proceso nuevo: el actual más HANDOFF_ENV.
+ *
+ * @return  Entorno (solo hay que liberar el vector y su última variable); NULL si no hay memoria.
+ */
+static char **build_environment(void) {
+    static const char variable[] = HANDOFF_ENV "=";
+    size_t count = 0, kept = 0;
+    char **environment;
+
+    while (environ[count]) count++;
+    if (!(environment = calloc(count + 2, sizeof(char *)))) {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        /* La de una sustitución anterior ya no vale */
+        if (strncmp(environ[i], variable, sizeof(variable) - 1)) environment[kept++] = environ[i];
+    }
+    if (asprintf(&environment[kept], "%s%d", variable, HANDOFF_CHILD_FD) < 0) {
+        free(environment);
+        return NULL;
+    }
+
+    return environment;
+}
+
+
+/**
+ * @brief   Da por fallida una sustitución: termina el proceso nuevo si sigue en marcha y cierra el canal.
+ */
+static void abort_handoff(Handoff *handoff) {
+    int saved_errno = errno;
+
+    kill(handoff->pid, SIGTERM);
+    while (waitpid(handoff->pid, NULL, 0) < 0 && errno == EINTR);
+    if (handoff->channel >= 0) close(handoff->channel);
+
+    handoff->pid = 0;
+    handoff->channel = -1;
+    errno = saved_errno;
+}
+
+
+/**
+ * @brief   Guarda lo necesario para relanzar el programa: la ruta del ejecutable y los argumentos.
+ *
+ * @param argv  Argumentos del programa (deben seguir siendo válidos mientras se use handoff_start).
+ *
+ * @return  true si se pudo leer la ruta del ejecutable; false en caso contrario (errno indica el motivo).
+ */
+bool handoff_init(char **argv) {
+    ssize_t len;
+
+    /* La ruta, no el archivo: si el despliegue lo sustituye, se lanzará el nuevo */
+    if ((len = readlink("/proc/self/exe", executable, sizeof(executable) - 1)) < 0) {
+        return false;
+    }
+    executable[len] = '\0';
+    arguments = argv;
+
+    return true;
+}
+
+
+/**
+ * @brief   Lanza la versión nueva del programa y le pasa los sockets.
+ *
+ * @param handoff   Sustitución a iniciar.
+ * @param sockets   Sockets a pasar.
+ * @param count     Número de sockets.
+ *
+ * @return  true si el proceso nuevo arrancó y tiene los sockets; false en caso contrario (errno indica el motivo).
+ */
+bool handoff_start(Handoff *handoff, const int *sockets, int count) {
+    struct HandoffHeader header = {.magic = HANDOFF_MAGIC, .count = count};
+    char **environment;
+    sigset_t all;
+    int pair[2];
+
+    handoff->pid = 0;
+    handoff->channel = -1;
+
+    if (!arguments) {
+        errno = EINVAL;
+        return false;
+    }
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, pair) < 0) {
+        return false;
+    }
+    if (!(environment = build_environment())) {
+        close(pair[0]);
+        close(pair[1]);
+        return false;
+    }
+
+    handoff->start_ns = traffic_monotonic_ns();
+    if ((handoff->pid = fork()) == 0) {
+        /* Proceso nuevo: tras fork en un proceso con hilos solo se pueden usar funciones seguras en señales.
+         * Se queda solo con la salida estándar y el canal; los sockets le llegarán por este */
+        if (pair[1] == HANDOFF_CHILD_FD ? fcntl(pair[1], F_SETFD, 0) < 0 : dup2(pair[1], HANDOFF_CHILD_FD) < 0) {
+            _exit(127);
+        }
+        syscall(SYS_close_range, HANDOFF_CHILD_FD + 1, ~0U, 0);
+        sigemptyset(&all);
+        sigprocmask(SIG_SETMASK, &all, NULL);
+        execve(executable, arguments, environment);
+        _exit(127);
+    }
+
+    /* Solo la última variable es nuestra; las demás son las del entorno actual */
+    for (size_t i = 0; environment[i]; i++) {
+        if (!environment[i + 1]) free(environment[i]);
+    }
+    free(environment);
+    close(pair[1]);
+
+    if (handoff->pid < 0) {
+        handoff->pid = 0;
+        close(pair[0]);
+        return false;
+    }
+    handoff->channel = pair[0];
+
+    /* El canal guarda los mensajes hasta que el proceso nuevo los lea: no hace falta esperarle */
+    if (send(handoff->channel, &header, sizeof(header), MSG_NOSIGNAL) != sizeof(header)) {
+        abort_handoff(handoff);
+        return false;
+    }
+    for (int i = 0; i < count; i++) {
+        if (!send_socket(handoff->channel, sockets[i], i)) {
+            abort_handoff(handoff);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+/**
+ * @brief   Comprueba si el proceso nuevo ya atiende.
+ *
+ * @param handoff       Sustitución en curso.
+ * @param timeout_ms    Tiempo máximo de espera por la confirmación en milisegundos (0 para no esperar).
+ *
+ * @return  1 si el proceso nuevo ya atiende; 0 si aún no; -1 si la sustitución falló (errno indica el motivo).
+ */
+int handoff_poll(Handoff *handoff, int timeout_ms) {
+    struct pollfd pending = {.fd = handoff->channel, .events = POLLIN};
+    char ready;
+    ssize_t received;
+
+    if (poll(&pending, 1, timeout_ms) > 0) {
+        received = recv(handoff->channel, &ready, sizeof(ready), MSG_DONTWAIT);
+        if (received == sizeof(ready) && ready == HANDOFF_READY) {
+            close(handoff->channel);
+            handoff->channel = -1;
+            return 1;
+        }
+        if (received < 0 && (errno == EAGAIN || errno == EINTR)) {
+            return 0;
+        }
+
+        /* El canal se cerró sin confirmación: el proceso nuevo terminó antes de atender */
+        errno = received < 0 ? errno : ECHILD;
+        abort_handoff(handoff);
+        return -1;
+    }
+
+    if (traffic_monotonic_ns() - handoff->start_ns > HANDOFF_TIMEOUT_MS * 1000000ULL) {
+        errno = ETIMEDOUT;
+        abort_handoff(handoff);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief   En el proceso nuevo, recibe los sockets del anterior.
+ *
+ * @param sockets   Donde guardar los sockets recibidos.
+ * @param max       Capacidad de sockets.
+ *
+ * @return  Número de sockets recibidos; 0 si el proceso no lo lanzó una sustitución; -1 en caso de error.
+ */
+int handoff_receive(int *sockets, int max) {
+    const char *value = getenv(HANDOFF_ENV);
+    struct HandoffHeader header;
+
+    if (!value) {
+        return 0;
+    }
+    parent_channel = atoi(value);
+    unsetenv(HANDOFF_ENV);
+    fcntl(parent_channel, F_SETFD, FD_CLOEXEC);
+
+    if (recv(parent_channel, &header, sizeof(header), 0) != sizeof(header) || header.magic != HANDOFF_MAGIC
+        || header.count == 0 || header.count > (uint32_t) max) {
+        errno = EPROTO;
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < header.count; i++) {
+        if ((sockets[i] = receive_socket(parent_channel)) < 0) {
+            while (i-- > 0) close(sockets[i]);
+            return -1;
+        }
+    }
+
+    return (int) header.count;
+}
+
+
+/**
+ * @brief   En el proceso nuevo, confirma al anterior que ya atiende, para que deje de hacerlo.
+ */
+void handoff_confirm(void) {
+    char ready = HANDOFF_READY;
+
+    if (parent_channel < 0) return;
+
+    if (send(parent_channel, &ready, sizeof(ready), MSG_NOSIGNAL) != sizeof(ready)) {
+        perror("No se pudo confirmar la sustitución al proceso anterior");
+    }
+    close(parent_channel);
+    parent_channel = -1;
+}
@@ -0,0 +1,92 @@
+#ifndef HANDOFF_H
+#define HANDOFF_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Sustitución de un servidor en marcha por una versión nueva sin cerrar sus sockets.
+ *
+ * El proceso en marcha lanza el ejecutable (el mismo archivo, que el despliegue habrá sustituido) con
+ * los mismos argumentos y le pasa sus sockets ya asociados por un par de sockets locales con SCM_RIGHTS.
+ * Mientras el nuevo se prepara, el anterior sigue atendiendo; cuando el nuevo confirma que ya atiende,
+ * el anterior deja de leer, termina lo que tenga en curso y sale sin cerrar (ni borrar) nada que el
+ * nuevo necesite. Como ambos comparten los mismos sockets, los datagramas que esperan en la cola
+ * durante el relevo no se pierden: los lee uno u otro.
+ *
+ * El proceso nuevo sabe que lo es por la variable de entorno HANDOFF_ENV, que indica el descriptor
+ * del canal con el anterior.
+ */
+
+/* Variable de entorno con el descriptor del canal con el proceso anterior */
+#define HANDOFF_ENV "MAYUS_HANDOFF_FD"
+
+/* Tiempo máximo que se espera a que el proceso nuevo confirme que atiende (ms) */
+#define HANDOFF_TIMEOUT_MS 10000
+
+/**
+ * Sustitución en curso, vista desde el proceso anterior.
+ */
+typedef struct {
+    pid_t pid;          /* Proceso nuevo (0 si no hay ninguna sustitución en curso) */
+    int channel;        /* Extremo de este proceso del canal con el nuevo (-1 tras la confirmación) */
+    uint64_t start_ns;  /* Instante en el que se lanzó el proceso nuevo (CLOCK_MONOTONIC) */
+} Handoff;
+
+/**
+ * @brief   Guarda lo necesario para relanzar el programa: la ruta del ejecutable y los argumentos.
+ *
+ * Debe llamarse al arrancar, antes de que el despliegue pueda sustituir el ejecutable.
+ *
+ * @param argv  Argumentos del programa (deben seguir siendo válidos mientras se use handoff_start).
+ *
+ * @return  true si se pudo leer la ruta del ejecutable; false en caso contrario (errno indica el motivo).
+ */
+bool handoff_init(char **argv);
+
+/**
+ * @brief   Lanza la versión nueva del programa y le pasa los sockets.
+ *
+ * El proceso nuevo recibe los sockets en el mismo orden. Este proceso debe seguir atendiendo hasta que
+ * handoff_poll confirme que el nuevo ya lo hace.
+ *
+ * @param handoff   Sustitución a iniciar.
+ * @param sockets   Sockets a pasar.
+ * @param count     Número de sockets.
+ *
+ * @return  true si el proceso nuevo arrancó y tiene los sockets; false en caso contrario (errno indica el motivo).
+ */
+bool handoff_start(Handoff *handoff, const int *sockets, int count);
+
+/**
+ * @brief   Comprueba si el proceso nuevo ya atiende.
+ *
+ * Si el proceso nuevo termina antes de confirmar, o no confirma en HANDOFF_TIMEOUT_MS, se da la sustitución
+ * por fallida (terminándolo si sigue en marcha) y este proceso debe seguir atendiendo.
+ *
+ * @param handoff       Sustitución en curso.
+ * @param timeout_ms    Tiempo máximo de espera por la confirmación en milisegundos (0 para no esperar).
+ *
+ * @return  1 si el proceso nuevo ya atiende; 0 si aún no; -1 si la sustitución falló (errno indica el motivo).
+ */
+int handoff_poll(Handoff *handoff, int timeout_ms);
+
+/**
+ * @brief   En el proceso nuevo, recibe los sockets del anterior.
+ *
+ * @param sockets   Donde guardar los sockets recibidos.
+ * @param max       Capacidad de sockets.
+ *
+ * @return  Número de sockets recibidos; 0 si el proceso no lo lanzó una sustitución; -1 en caso de error.
+ */
+int handoff_receive(int *sockets, int max);
+
+/**
+ * @brief   En el proceso nuevo, confirma al anterior que ya atiende, para que deje de hacerlo.
+ *
+ * No hace nada si el proceso no lo lanzó una sustitución.
+ */
+void handoff_confirm(void);
+
+#endif /* HANDOFF_H */
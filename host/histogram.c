@@ -0,0 +1,113 @@
+#include <string.h>
+
+#include "histogram.h"
+
+
+#define SUB_BUCKET_COUNT (1ULL << HISTOGRAM_SUB_BUCKET_BITS)
+#define SUB_BUCKET_HALF_COUNT (SUB_BUCKET_COUNT / 2)
+#define MAX_VALUE ((1ULL << HISTOGRAM_VALUE_BITS) - 1)
+
+
+/**
+ * @brief   Contador en el que cae un valor.
+ *
+ * La potencia de dos del valor elige la cubeta (la 0 abarca los valores menores que SUB_BUCKET_COUNT
+ * con precisión de 1) y los HISTOGRAM_SUB_BUCKET_BITS bits más altos del valor, la subcubeta. A partir
+ * de la cubeta 1 la mitad inferior de las subcubetas coincidiría con la cubeta anterior, así que cada una
+ * solo ocupa SUB_BUCKET_HALF_COUNT contadores.
+ */
+static inline size_t counts_index(uint64_t value) {
+    int bucket = 64 - __builtin_clzll(value | (SUB_BUCKET_COUNT - 1)) - HISTOGRAM_SUB_BUCKET_BITS;
+    uint64_t sub_bucket = value >> bucket;
+
+    return ((size_t) (bucket + 1) << (HISTOGRAM_SUB_BUCKET_BITS - 1)) + (sub_bucket - SUB_BUCKET_HALF_COUNT);
+}
+
+
+/**
+ * @brief   Mayor valor que cae en un contador.
+ */
+static inline uint64_t highest_value_at(size_t index) {
+    int bucket = (int) (index >> (HISTOGRAM_SUB_BUCKET_BITS - 1)) - 1;
+    uint64_t sub_bucket = (index & (SUB_BUCKET_HALF_COUNT - 1)) + SUB_BUCKET_HALF_COUNT;
+
+    if (bucket < 0) {
+        bucket = 0;
+        sub_bucket -= SUB_BUCKET_HALF_COUNT;
+    }
+
+    return (sub_bucket << bucket) + (1ULL << bucket) - 1;
+}
+
+
+/**
+ * @brief   Deja un histograma vacío.
+ *
+ * @param histogram     Histograma.
+ */
+void histogram_init(Histogram *histogram) {
+    memset(histogram, 0, sizeof(Histogram));
+    histogram->min = UINT64_MAX;
+}
+
+
+/**
+ * @brief   Registra un valor.
+ *
+ * @param histogram     Histograma.
+ * @param value         Valor a registrar.
+ */
+void histogram_record(Histogram *histogram, uint64_t value) {
+    histogram->counts[counts_index(value < MAX_VALUE ? value : MAX_VALUE)]++;
+    histogram->count++;
+    histogram->total += value;
+    if (value < histogram->min) histogram->min = value;
+    if (value > histogram->max) histogram->max = value;
+}
+
+
+/**
+ * @brief   Valor por debajo del cual (o igual al cual) queda un percentil de los valores registrados.
+ *
+ * @param histogram     Histograma.
+ * @param percentile    Percentil (0 a 100; por ejemplo, 99.9).
+ *
+ * @return  Valor del percentil; 0 si el histograma está vacío.
+ */
+uint64_t histogram_percentile(const Histogram *histogram, double percentile) {
+    double exact;
+    uint64_t target, seen = 0;
+    uint64_t value;
+
+    if (!histogram->count) return 0;
+
+    /* Cuántos valores deben quedar por debajo, redondeando hacia arriba (al menos uno) */
+    if (percentile > 100) percentile = 100;
+    exact = percentile / 100 * histogram->count;
+    target = (uint64_t) exact;
+    if (target < exact || target < 1) target++;
+
+    for (size_t i = 0; i < HISTOGRAM_COUNTS; i++) {
+        seen += histogram->counts[i];
+        if (seen >= target) {
+            /* La última cubeta guarda también los valores que se salen del rango: su límite es el máximo */
+            if (i == HISTOGRAM_COUNTS - 1) return histogram->max;
+            value = highest_value_at(i);
+            return value < histogram->max ? value : histogram->max;
+        }
+    }
+
+    return histogram->max;
+}
+
+
+/**
+ * @brief   Media de los valores registrados.
+ *
+ * @param histogram     Histograma.
+ *
+ * @return  Media; 0 si el histograma está vacío.
+ */
+double histogram_mean(const Histogram *histogram) {
+    return histogram->count ? (double) histogram->total / histogram->count : 0;
+}
@@ -0,0 +1,73 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+
+/*
+ * Histograma de rango dinámico alto (HDR) para latencias.
+ *
+ * Los valores se agrupan por potencias de dos y, dentro de cada una, en 2^(HISTOGRAM_SUB_BUCKET_BITS - 1)
+ * cubetas lineales, de forma que cualquier valor se guarda con un error relativo menor que
+ * 1 / 2^(HISTOGRAM_SUB_BUCKET_BITS - 1) (dos cifras significativas), tanto si es de nanosegundos como de
+ * segundos. Registrar un valor es una cuenta de bits y un incremento, sin reservar memoria: se puede hacer
+ * en cada petición. El mínimo, el máximo y la media se guardan aparte y son exactos.
+ */
+
+/* Bits de las cubetas de cada potencia de dos: 256 cubetas, error relativo menor que 1/128 */
+#define HISTOGRAM_SUB_BUCKET_BITS 8
+
+/* Bits del mayor valor que se distingue (2^40 ns son más de 18 minutos); los mayores van a la última cubeta */
+#define HISTOGRAM_VALUE_BITS 40
+
+/* Número de contadores del histograma */
+#define HISTOGRAM_COUNTS ((HISTOGRAM_VALUE_BITS - HISTOGRAM_SUB_BUCKET_BITS + 2) << (HISTOGRAM_SUB_BUCKET_BITS - 1))
+
+/**
+ * Histograma de valores (por ejemplo, latencias en nanosegundos).
+ */
+typedef struct {
+    uint64_t count;                     /* Valores registrados */
+    uint64_t min;                       /* Mínimo exacto (UINT64_MAX si no hay valores) */
+    uint64_t max;                       /* Máximo exacto */
+    uint64_t total;                     /* Suma de los valores, para la media */
+    uint64_t counts[HISTOGRAM_COUNTS];  /* Valores en cada cubeta */
+} Histogram;
+
+/**
+ * @brief   Deja un histograma vacío.
+ *
+ * @param histogram     Histograma.
+ */
+void histogram_init(Histogram *histogram);
+
+/**
+ * @brief   Registra un valor.
+ *
+ * @param histogram     Histograma.
+ * @param value         Valor a registrar.
+ */
+void histogram_record(Histogram *histogram, uint64_t value);
+
+/**
+ * @brief   Valor por debajo del cual (o igual al cual) queda un percentil de los valores registrados.
+ *
+ * Se devuelve el mayor valor de la cubeta en la que cae el percentil (sin pasar del máximo registrado),
+ * de forma que el percentil nunca se subestima.
+ *
+ * @param histogram     Histograma.
+ * @param percentile    Percentil (0 a 100; por ejemplo, 99.9).
+ *
+ * @return  Valor del percentil; 0 si el histograma está vacío.
+ */
+uint64_t histogram_percentile(const Histogram *histogram, double percentile);
+
+/**
+ * @brief   Media de los valores registrados.
+ *
+ * @param histogram     Histograma.
+ *
+ * @return  Media; 0 si el histograma está vacío.
+ */
+double histogram_mean(const Histogram *histogram);
+
+#endif /* HISTOGRAM_H */
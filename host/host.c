@@ -1,3 +1,5 @@
+#define _GNU_SOURCE     /* Para F_SETSIG */
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <sys/types.h>
@@ -5,83 +7,425 @@
 #include <netinet/in.h>
 #include <unistd.h>
 #include <arpa/inet.h>
+#include <sys/un.h>
+#include <sys/stat.h>
 #include <string.h>
 #include <signal.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <pthread.h>
+#include <time.h>
 
 #include "host.h"
 #include "getpublicip.h"
 #include "loging.h"
 #include "getlocalips.h"
+#include "traffic.h"
+#include "probes.h"
 
 #define BUFFER_LEN 2048
 
-/** Variables globales que exportar en el fichero de cabecera para el manejo de señales */
-uint8_t socket_io_pending = 0;
-bool terminate = false;
+/* Señal con la que el núcleo avisa de la actividad en los sockets de los hosts.
+ * Al fijarla explícitamente con F_SETSIG (aunque sea la propia SIGIO), el núcleo indica en si_fd el socket que la originó.
+ * No se encola: varios avisos seguidos pueden llegar como uno solo, por lo que io_pending es solo una pista
+ * y wait_for_host_event comprueba siempre el propio socket antes de dormir. */
+#define HOST_IO_SIGNAL SIGIO
+
+/**
+ * Entrada del registro de contextos de los hosts propios.
+ * Los contextos se reservan de este registro estático y nunca se liberan, de forma que el manejador
+ * de señales (que puede ejecutarse en cualquier hilo y en cualquier momento) siempre accede a memoria válida.
+ */
+struct HostContextSlot {
+    atomic_bool in_use;         /* Vale true si el contexto pertenece a un host abierto */
+    atomic_int fd;              /* Socket del host al que pertenece el contexto */
+    HostContext context;
+};
+
+static struct HostContextSlot host_contexts[HOST_MAX_CONTEXTS];
+
+/* Vale true si llegó al proceso una señal de terminación (SIGINT o SIGTERM) */
+static atomic_bool process_terminating = false;
+
+/* Vale true si se pidió con HOST_UPGRADE_SIGNAL sustituir el proceso por una versión nueva (ver enable_upgrade_requests) */
+static atomic_bool upgrade_requested = false;
 
 
 /**
  * @brief   Maneja las señales que recibe el host
  *
- * Maneja las señales de SIGIO, SIGINT y SIGTERM que puede recibir el servidor durante su ejecución.
- *  - SIGIO: tuvo lugar un evento de I/O en el socket del servidor.
+ * Maneja las señales que puede recibir el proceso durante su ejecución:
+ *  - HOST_IO_SIGNAL (SIGIO): tuvo lugar un evento de I/O en el socket info->si_fd. Si la señal no la
+ *    generó el núcleo para un socket concreto, se avisa a todos los hosts.
  *  - SIGINT, SIGTERM: terminar la ejecución del programa segura.
- * Establece los valores de las variables globales socket_io_pending y terminate apropiadamente.
+ *  - HOST_UPGRADE_SIGNAL (SIGUSR2): sustituir el proceso por una versión nueva. Se avisa a todos los hosts
+ *    como si tuvieran actividad, para que quien espere en wait_for_host_event vuelva y lo vea.
+ * Actualiza los contextos de los hosts afectados. Solo usa operaciones atómicas y funciones
+ * seguras en manejadores de señales (write), por lo que puede ejecutarse en cualquier hilo.
+ *
+ * @param signum    Número de señal recibida.
+ * @param info      Información adicional de la señal.
+ * @param ucontext  Contexto del hilo interrumpido (no se usa).
+ */
+static void signal_handler(int signum, siginfo_t *info, void *ucontext) {
+    static const char termination_message[] = "\n! Recibida señal de terminación\n";
+    int saved_errno = errno;
+    uint64_t one = 1;
+
+    (void) ucontext;
+
+    PROBE2(signal, signum, signum == HOST_IO_SIGNAL && info->si_code > 0 ? info->si_fd : -1);
+
+    if (signum == SIGINT || signum == SIGTERM) {
+        atomic_store(&process_terminating, true);     /* Marca que el programa debe terminar */
+        for (int i = 0; i < HOST_MAX_CONTEXTS; i++) {
+            if (!atomic_load(&host_contexts[i].in_use)) continue;
+            atomic_store(&host_contexts[i].context.terminate, true);
+            /* Despertamos a quien espere por el host; si el eventfd está lleno ya estaba despierto */
+            if (write(host_contexts[i].context.wake_fd, &one, sizeof(one)) < 0) continue;
+        }
+        if (write(STDOUT_FILENO, termination_message, sizeof(termination_message) - 1) < 0) {
+            /* No podemos hacer nada más desde el manejador */
+        }
+    } else if (signum == HOST_UPGRADE_SIGNAL) {
+        atomic_store(&upgrade_requested, true);
+        for (int i = 0; i < HOST_MAX_CONTEXTS; i++) {
+            if (atomic_load(&host_contexts[i].in_use)) atomic_fetch_add(&host_contexts[i].context.io_pending, 1);
+        }
+    } else {
+        for (int i = 0; i < HOST_MAX_CONTEXTS; i++) {
+            if (!atomic_load(&host_contexts[i].in_use)) continue;
+            /* Si la señal no viene de un socket concreto (p. ej. la envió otro proceso), avisamos a todos */
+            if (info->si_code <= 0 || atomic_load(&host_contexts[i].fd) == info->si_fd) {
+                atomic_fetch_add(&host_contexts[i].context.io_pending, 1);    /* Aumentar en 1 el número de eventos de entrada/salida pendientes */
+            }
+        }
+    }
+
+    errno = saved_errno;
+}
+
+
+/**
+ * @brief   Reserva un contexto de eventos para el socket de un host.
+ *
+ * @param socket    Socket del host.
+ *
+ * @return  Contexto reservado, o NULL si ya hay HOST_MAX_CONTEXTS hosts abiertos o no se pudo crear su eventfd.
+ */
+static HostContext *acquire_host_context(int socket) {
+    for (int i = 0; i < HOST_MAX_CONTEXTS; i++) {
+        bool expected = false;
+        HostContext *context = &host_contexts[i].context;
+
+        if (!atomic_compare_exchange_strong(&host_contexts[i].in_use, &expected, true)) continue;
+
+        /* El slot no está en uso, así que el manejador no lo toca mientras lo inicializamos */
+        atomic_store(&host_contexts[i].fd, -1);
+        atomic_store(&context->io_pending, 0);
+        atomic_store(&context->terminate, atomic_load(&process_terminating));
+        if ( (context->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+            atomic_store(&host_contexts[i].in_use, false);
+            return NULL;
+        }
+        atomic_store(&host_contexts[i].fd, socket);
+
+        return context;
+    }
+
+    errno = EMFILE;
+    return NULL;
+}
+
+
+/**
+ * @brief   Devuelve al registro el contexto de eventos de un host.
+ *
+ * @param context   Contexto a liberar.
+ */
+static void release_host_context(HostContext *context) {
+    struct HostContextSlot *slot = (struct HostContextSlot *) ((char *) context - offsetof(struct HostContextSlot, context));
+    int wake_fd = atomic_exchange(&context->wake_fd, -1);
+
+    /* El eventfd se cierra lo último: un manejador de señales que ya viera el slot en uso escribe como mucho
+     * en -1, nunca en un descriptor que se haya reutilizado para otra cosa */
+    atomic_store(&slot->fd, -1);
+    atomic_store(&slot->in_use, false);
+    close(wake_fd);
+}
+
+
+/**
+ * @brief   Instala el manejador de una señal.
  *
- *  @param signum   Número de señal recibida.
+ * @param signum    Señal a manejar.
+ *
+ * @return  0 si se instaló con éxito; -1 en caso de error.
  */
-static void signal_handler(int signum) {
-    printf("\n! Recibida señal %d%s\n", signum, (signum == SIGIO ? " (SIGIO)" : ""));
+static int install_signal_handler(int signum) {
+    struct sigaction action;
+
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = signal_handler;
+    action.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&action.sa_mask);
+
+    return sigaction(signum, &action, NULL);
+}
 
-    switch (signum) {
-        case SIGIO:
-            socket_io_pending++;    /* Aumentar en 1 el número de eventos de entrada/salida pendientes */
+
+/**
+ * Tipos de consultas informativas que se hacen al crear el host.
+ */
+enum LookupKind {
+    LOOKUP_PUBLIC_IP,   /* IP externa, mediante una petición HTTP */
+    LOOKUP_LOCAL_IPV4,  /* IPs v4 de las interfaces locales */
+    LOOKUP_LOCAL_IPV6,  /* IPs v6 de las interfaces locales */
+    LOOKUP_COUNT
+};
+
+struct StartupLookups;
+
+/**
+ * Consulta informativa que se lanza en un hilo propio durante la creación del host.
+ */
+struct StartupLookup {
+    enum LookupKind kind;           /* Qué se consulta */
+    char result[BUFFER_LEN];        /* Resultado en formato textual */
+    bool ok;                        /* Vale true si la consulta tuvo éxito */
+    bool done;                      /* Vale true cuando la consulta terminó (con o sin éxito) */
+    int error;                      /* errno de la consulta fallida */
+    uint64_t elapsed_ns;            /* Lo que tardó la consulta */
+    struct StartupLookups *shared;  /* Estado compartido al que pertenece la consulta */
+};
+
+/**
+ * Estado compartido entre el host y los hilos de las consultas.
+ * Si vence el plazo, wait_host_lookups sigue sin esperar a las consultas pendientes;
+ * la estructura la libera el último que deja de usarla (contador de referencias).
+ */
+struct StartupLookups {
+    pthread_mutex_t mutex;
+    pthread_cond_t finished;        /* Se señala cada vez que termina una consulta */
+    unsigned pending;               /* Consultas sin terminar */
+    unsigned references;            /* Hilos de consulta más el host que aún usan la estructura */
+    uint64_t start_ns;              /* Instante en el que se lanzaron (CLOCK_MONOTONIC) */
+    unsigned deadline_ms;           /* Plazo máximo para recogerlas, desde que se lanzaron */
+    struct timespec deadline;       /* Instante en el que vence el plazo (CLOCK_MONOTONIC) */
+    struct StartupLookup lookups[LOOKUP_COUNT];
+};
+
+
+/**
+ * @brief   Suelta una referencia al estado compartido de las consultas, liberándolo si era la última.
+ *
+ * Debe llamarse con el mutex del estado compartido tomado; lo suelta.
+ *
+ * @param shared    Estado compartido de las consultas.
+ */
+static void release_startup_lookups(struct StartupLookups *shared) {
+    bool last = --shared->references == 0;
+
+    pthread_mutex_unlock(&shared->mutex);
+
+    if (last) {
+        pthread_mutex_destroy(&shared->mutex);
+        pthread_cond_destroy(&shared->finished);
+        free(shared);
+    }
+}
+
+
+/**
+ * @brief   Cuerpo de los hilos que hacen las consultas informativas del host.
+ *
+ * @param arg   Puntero a la struct StartupLookup a resolver.
+ *
+ * @return  NULL.
+ */
+static void *startup_lookup_thread(void *arg) {
+    struct StartupLookup *lookup = (struct StartupLookup *) arg;
+    char result[BUFFER_LEN] = {0};
+    uint64_t start_ns = traffic_monotonic_ns();
+    bool ok = false;
+
+    switch (lookup->kind) {
+        case LOOKUP_PUBLIC_IP:
+            ok = getpublicip(result, BUFFER_LEN) != NULL;
             break;
-        case SIGINT:
-        case SIGTERM:
-            terminate = true;          /* Marca que el programa debe terminar */
+        case LOOKUP_LOCAL_IPV4:
+            ok = get_local_ip_addresses(result, BUFFER_LEN, AF_INET) != NULL;
+            break;
+        case LOOKUP_LOCAL_IPV6:
+            ok = get_local_ip_addresses(result, BUFFER_LEN, AF_INET6) != NULL;
             break;
         default:
             break;
     }
+
+    pthread_mutex_lock(&lookup->shared->mutex);
+    strcpy(lookup->result, result);
+    lookup->ok = ok;
+    lookup->error = errno;
+    lookup->elapsed_ns = traffic_monotonic_ns() - start_ns;
+    lookup->done = true;
+    lookup->shared->pending--;
+    pthread_cond_signal(&lookup->shared->finished);
+    release_startup_lookups(lookup->shared);
+
+    return NULL;
 }
 
 
 /**
- * @brief   Crea un host del propio programa.
+ * @brief   Lanza en segundo plano las consultas informativas del host, con un plazo para recogerlas.
  *
- * Crea un host nuevo con un nuevo socket, y le asigna un puerto.
- * Si el argumento logfile no es NULL, crea también un archivo de log para guardar un registro de actividad.
+ * No espera por ellas: sus resultados los recoge wait_host_lookups.
  *
- * @param domain    Dominio de comunicación. 
- * @param type      Tipo de protocolo usado para el socket.
- * @param protocol  Protocolo particular a usar en el socket. Normalmente solo existe
- *                  un protocolo para la combinación dominio-tipo dada, en cuyo caso se
- *                  puede especificar con un 0.
- * @param port      Número de puerto en el que escuchar (en orden de host).
- * @param logfile   Nombre del archivo en el que guardar el registro de actividad.
+ * @param host          Host en el que guardar el estado de las consultas.
+ * @param deadline_ms   Plazo máximo, desde ahora, hasta el que wait_host_lookups espera por ellas.
+ */
+static void start_startup_lookups(Host *host, unsigned deadline_ms) {
+    struct StartupLookups *shared;
+    pthread_condattr_t condattr;
+    pthread_attr_t thread_attr;
+    pthread_t thread;
+    sigset_t blocked_signals, previous_signals;
+
+    if (!(shared = (struct StartupLookups *) calloc(1, sizeof(struct StartupLookups)))) {
+        log_printf_err(host->log, "Error al reservar memoria para las consultas del host.\n");
+        return;
+    }
+
+    pthread_mutex_init(&shared->mutex, NULL);
+    pthread_condattr_init(&condattr);
+    pthread_condattr_setclock(&condattr, CLOCK_MONOTONIC);    /* El plazo no debe verse afectado por cambios de hora */
+    pthread_cond_init(&shared->finished, &condattr);
+    pthread_condattr_destroy(&condattr);
+    shared->references = 1;
+
+    shared->start_ns = traffic_monotonic_ns();
+    shared->deadline_ms = deadline_ms;
+    clock_gettime(CLOCK_MONOTONIC, &shared->deadline);
+    shared->deadline.tv_sec += deadline_ms / 1000;
+    shared->deadline.tv_nsec += (deadline_ms % 1000) * 1000000L;
+    if (shared->deadline.tv_nsec >= 1000000000L) {
+        shared->deadline.tv_sec++;
+        shared->deadline.tv_nsec -= 1000000000L;
+    }
+
+    /* Los hilos de consulta no deben atender las señales del host, que son para el hilo principal */
+    sigemptyset(&blocked_signals);
+    sigaddset(&blocked_signals, HOST_IO_SIGNAL);
+    sigaddset(&blocked_signals, SIGINT);
+    sigaddset(&blocked_signals, SIGTERM);
+    sigaddset(&blocked_signals, HOST_UPGRADE_SIGNAL);
+    pthread_sigmask(SIG_BLOCK, &blocked_signals, &previous_signals);
+
+    pthread_attr_init(&thread_attr);
+    pthread_attr_setdetachstate(&thread_attr, PTHREAD_CREATE_DETACHED);
+
+    pthread_mutex_lock(&shared->mutex);
+    for (int i = 0; i < LOOKUP_COUNT; i++) {
+        shared->lookups[i] = (struct StartupLookup) {.kind = i, .shared = shared};
+
+        if (pthread_create(&thread, &thread_attr, startup_lookup_thread, &shared->lookups[i])) {
+            shared->lookups[i].done = true;
+            shared->lookups[i].error = errno;
+            continue;
+        }
+        shared->pending++;
+        shared->references++;
+    }
+    pthread_mutex_unlock(&shared->mutex);
+
+    pthread_attr_destroy(&thread_attr);
+    pthread_sigmask(SIG_SETMASK, &previous_signals, NULL);
+
+    host->lookups = shared;
+}
+
+
+/**
+ * @brief   Recoge las consultas informativas del host (IP externa e IPs locales), esperando por ellas como mucho hasta su plazo.
  *
- * @return  Host que guarda toda la información relevante sobre sí mismo con la que
- *          fue creado, y con un socket abierto y conectado por el puerto  especificado.
+ * Los hosts propios las lanzan en segundo plano al crearse, para empezar a atender sin esperar por
+ * ellas; hay que llamar a esta función antes de usar public_ip, local_ips_v4 o local_ips_v6. Espera
+ * como mucho hasta HOST_LOOKUP_DEADLINE_MS desde la creación del host: las consultas que no terminan
+ * para entonces se abandonan (sus hilos siguen hasta terminar, pero su resultado se descarta).
+ * Si ya se recogieron, no hace nada.
+ *
+ * @param host  Host cuyas consultas recoger.
  */
-Host create_own_host(int domain, int type, int protocol, uint16_t port, char* logfile){
-    Host host;
-    char buffer[BUFFER_LEN] = {0};
+void wait_host_lookups(Host* host) {
+    static const char *descriptions[LOOKUP_COUNT] = {"IP externa", "IPs v4 locales", "IPs v6 locales"};
+    char **destinations[LOOKUP_COUNT] = {&host->public_ip, &host->local_ips_v4, &host->local_ips_v6};
+    struct StartupLookups *shared = host->lookups;
+    uint64_t wait_ns = traffic_monotonic_ns();
 
-    memset(&host, 0, sizeof(Host));     /* Inicializamos los campos a 0 */
+    if (!shared) return;
+    host->lookups = NULL;
 
-    host = (Host) {
-        .domain = domain,
-        .type = type,
-        .protocol = protocol,
-        .port = port,
-        .address.sin_family = domain,
-        .address.sin_port = htons(port),
-        .address.sin_addr.s_addr = htonl(INADDR_ANY)    /* Aceptar conexiones desde cualquier IP */
-    };
+    /* Esperamos a que terminen todas las consultas, o a que venza el plazo */
+    pthread_mutex_lock(&shared->mutex);
+    while (shared->pending && pthread_cond_timedwait(&shared->finished, &shared->mutex, &shared->deadline) != ETIMEDOUT);
+
+    /* Guardamos los resultados de las consultas que terminaron; las demás se descartan */
+    for (int i = 0; i < LOOKUP_COUNT; i++) {
+        struct StartupLookup *lookup = &shared->lookups[i];
+
+        if (!lookup->done) {
+            fprintf(stderr, "Consulta de %s del host abandonada tras el plazo de %u ms\n", descriptions[i], shared->deadline_ms);
+            log_printf_err(host->log, "Consulta de %s abandonada tras el plazo de %u ms.\n", descriptions[i], shared->deadline_ms);
+        } else if (!lookup->ok) {
+            fprintf(stderr, "No se pudo completar la consulta de %s del host: %s\n", descriptions[i], strerror(lookup->error));
+            log_printf_err(host->log, "Error en la consulta de %s del host (%.3f ms).\n", descriptions[i], lookup->elapsed_ns / 1e6);
+        } else {
+            *destinations[i] = (char *) calloc(strlen(lookup->result) + 1, sizeof(char));
+            strcpy(*destinations[i], lookup->result);
+            log_printf(host->log, "Consulta de %s del host completada con éxito en %.3f ms: %s.\n", descriptions[i], lookup->elapsed_ns / 1e6, *destinations[i]);
+        }
+    }
+
+    log_printf(host->log, "Consultas informativas del host recogidas %.3f ms después de lanzarlas (%.3f ms de espera).\n",
+               (traffic_monotonic_ns() - shared->start_ns) / 1e6, (traffic_monotonic_ns() - wait_ns) / 1e6);
+
+    release_startup_lookups(shared);
+}
+
+
+/**
+ * @brief   Termina de preparar un host propio con el socket ya asociado a su dirección.
+ *
+ * Parte común de open_own_host y adopt_own_host: reserva el contexto de eventos, configura el aviso
+ * por señal y lanza las consultas informativas.
+ *
+ * @param host      Host con el socket abierto y asociado, y su dirección leída.
+ * @param start_ns  Instante en el que se empezó a crear el host (para los tiempos de arranque).
+ *
+ * @return  Host listo para recibir.
+ */
+static Host finish_own_host(Host host, uint64_t start_ns);
+
+
+/**
+ * @brief   Abre el socket de un host propio ya rellenado con su familia, tipo y dirección.
+ *
+ * Parte común de create_own_host y create_own_unix_host: abre el log, crea y asocia el socket
+ * (y lo pone a escuchar si es SOCK_SEQPACKET), configura el aviso por señal y lanza las consultas informativas.
+ *
+ * @param host      Host con domain, type, protocol, port, address y address_len rellenos.
+ * @param logfile   Nombre del archivo en el que guardar el registro de actividad.
+ *
+ * @return  Host con el socket abierto y listo para recibir.
+ */
+static Host open_own_host(Host host, char* logfile) {
+    uint64_t start_ns = traffic_monotonic_ns();
 
     /* Abrimos el log para escritura.
      * Si no se puede abrir, avisamos y seguimos, ya que no es un error crítico. */
@@ -91,94 +435,280 @@ Host create_own_host(int domain, int type, int protocol, uint16_t port, char* lo
     }        
     log_printf(host.log, "Inicializando host...\n");
 
-    /* Guardar el nombre del equipo en el que se ejecuta el host.
-     * No produce error crítico, por lo que no hay que salir */
-    if (gethostname(buffer, BUFFER_LEN)) {
-        perror("No se pudo obtener el nombre de host del servidor");
-        log_printf_err(host.log, "Error al obtener el nombre de host.\n");
-    } else {
-        host.hostname = (char *) calloc(strlen(buffer) + 1, sizeof(char));
-        strcpy(host.hostname, buffer);
-        log_printf(host.log, "Nombre de host configurado con éxito: %s.\n", host.hostname);
+    /* Lo primero es dejar el socket listo para recibir: las consultas informativas
+     * pueden tardar (la IP externa requiere una petición HTTP) y no deben retrasar el servicio */
+
+    /* Crear el socket del host */
+    if ( (host.socket = socket(host.domain, host.type, host.protocol)) < 0) {
+        log_printf_err(host.log, "Error al crear el socket del host.\n");
+        fail("No se pudo crear el socket");
     }
 
-    /* Guardar la IP externa del host.
-     * Tampoco supone un error crítico. */
-    if (!getpublicip(buffer, BUFFER_LEN)) {
-        perror("No se pudo obtener la IP externa del host");
-        log_printf_err(host.log, "Error al obtener la IP externa del host.\n");
-    } else {
-        host.public_ip = (char *) calloc(strlen(buffer) + 1, sizeof(char));
-        strcpy(host.public_ip, buffer);
-        log_printf(host.log, "IP externa del host configurada con éxito: %s.\n", host.public_ip);
+    /* Los sockets de un grupo SO_REUSEPORT deben activarlo todos antes de asociarse a la dirección */
+    if (host.reuse_port && setsockopt(host.socket, SOL_SOCKET, SO_REUSEPORT, &(int) {1}, sizeof(int)) < 0) {
+        log_printf_err(host.log, "Error al activar SO_REUSEPORT en el socket del host.\n");
+        fail("No se pudo activar SO_REUSEPORT en el socket");
     }
 
-    /* Guardar las IPs v4 locales del host.
-     * Tampoco supone un error crítico. */
-    if (!get_local_ip_addresses(buffer, BUFFER_LEN, AF_INET)) {
-        perror("No se pudieron obtener las IPs v4 locales del host");
-        log_printf_err(host.log, "Error al obtener las IPs v4 locales del host.\n");
-    } else {
-        host.local_ips_v4 = (char *) calloc(strlen(buffer) + 1, sizeof(char));
-        strcpy(host.local_ips_v4, buffer);
-        log_printf(host.log, "IPs v4 locales del host configuradas con éxito: %s.\n", host.local_ips_v4);
+    /* Asignar IPs a las que escuchar y número de puerto por el que escuchar (bind) */
+    if (bind(host.socket, (struct sockaddr *) &host.address, host.address_len) < 0) {
+        log_printf_err(host.log, "Error al asignar la dirección (bind) del socket del host.\n");
+        fail("No se pudo asignar dirección IP");
     }
 
-    /* Guardar las IPs v6 locales del host.
-     * Tampoco supone un error crítico. */
-    if (!get_local_ip_addresses(buffer, BUFFER_LEN, AF_INET6)) {
-        perror("No se pudieron obtener las IPs v6 locales del host");
-        log_printf_err(host.log, "Error al obtener las IPs v6 locales del host.\n");
-    } else {
-        host.local_ips_v6 = (char *) calloc(strlen(buffer) + 1, sizeof(char));
-        strcpy(host.local_ips_v6, buffer);
-        log_printf(host.log, "IPs v6 locales del host configuradas con éxito: %s.\n", host.local_ips_v6);
+    /* Con autobind el nombre lo elige el núcleo: lo leemos para poder describirlo */
+    host.address_len = sizeof(host.address);
+    if (getsockname(host.socket, (struct sockaddr *) &host.address, &host.address_len) < 0) {
+        log_printf_err(host.log, "Error al leer la dirección del socket del host.\n");
+        fail("No se pudo leer la dirección del socket");
     }
 
-    /* Crear el socket del host */
-    if ( (host.socket = socket(domain, type, protocol)) < 0) {
-        log_printf_err(host.log, "Error al crear el socket del host.\n");
-        fail("No se pudo crear el socket");
+    /* Los sockets orientados a conexión con nombre propio esperan a que los clientes se conecten */
+    if (host.type == SOCK_SEQPACKET && host.bound_path && listen(host.socket, SOMAXCONN) < 0) {
+        log_printf_err(host.log, "Error al poner el socket del host a escuchar conexiones.\n");
+        fail("No se pudo poner el socket a escuchar conexiones");
     }
 
-    /* Asignar IPs a las que escuchar y número de puerto por el que escuchar (bind) */
-    if (bind(host.socket, (struct sockaddr *) &host.address, sizeof(struct sockaddr_in)) < 0) {
-        log_printf_err(host.log, "Error al asignar la dirección (bind) del socket del host.\n");
-        fail("No se pudo asignar dirección IP");
+    return finish_own_host(host, start_ns);
+}
+
+
+/**
+ * @brief   Crea un host propio con un socket ya asociado a su dirección, heredado de otro proceso.
+ *
+ * @param socket    Socket heredado.
+ * @param logfile   Nombre del archivo en el que guardar el registro de actividad (se añade al final).
+ *
+ * @return  Host con el socket heredado, listo para recibir.
+ */
+Host adopt_own_host(int socket, char* logfile) {
+    Host host;
+    socklen_t len = sizeof(int);
+    int reuse_port = 0;
+    uint64_t start_ns = traffic_monotonic_ns();
+
+    memset(&host, 0, sizeof(Host));     /* Inicializamos los campos a 0 */
+    host.socket = socket;
+
+    /* El log lo sigue escribiendo el proceso anterior hasta que termina: no lo truncamos */
+    if (logfile) {
+        if ( (host.log = fopen(logfile, "a")) == NULL)
+            perror("No se pudo abrir el log del host");
     }
+    log_printf(host.log, "Inicializando host con un socket heredado...\n");
 
-    /* Configurar el host para enviarse a sí mismo un SIGIO cuando se produzca actividad en el socket, para evitar bloqueos esperando por conexiones */
-    if (fcntl(host.socket, F_SETFL, O_ASYNC | O_NONBLOCK) < 0) {
-        log_printf_err(host.log, "Error al configurar el envío de SIGIO en el socket.\n");
-        fail("No se pudo configurar el envío de SIGIO en el socket");
+    /* Todo lo que sabemos del socket se lo preguntamos al núcleo */
+    if (getsockopt(socket, SOL_SOCKET, SO_DOMAIN, &host.domain, &len) < 0
+        || getsockopt(socket, SOL_SOCKET, SO_TYPE, &host.type, &(socklen_t) {sizeof(int)}) < 0
+        || getsockopt(socket, SOL_SOCKET, SO_PROTOCOL, &host.protocol, &(socklen_t) {sizeof(int)}) < 0
+        || getsockopt(socket, SOL_SOCKET, SO_REUSEPORT, &reuse_port, &(socklen_t) {sizeof(int)}) < 0) {
+        log_printf_err(host.log, "Error al leer la configuración del socket heredado.\n");
+        fail("No se pudo leer la configuración del socket heredado");
     }
-    if (fcntl(host.socket, F_SETOWN, getpid()) < 0) {
-        log_printf_err(host.log, "Error al configurar el autoenvío de señales en el socket.\n");
-        fail("No se pudo configurar el autoenvío de señales en el socket");
+    host.reuse_port = reuse_port;
+
+    host.address_len = sizeof(host.address);
+    if (getsockname(socket, (struct sockaddr *) &host.address, &host.address_len) < 0) {
+        log_printf_err(host.log, "Error al leer la dirección del socket heredado.\n");
+        fail("No se pudo leer la dirección del socket heredado");
     }
 
-    if (signal(SIGIO, signal_handler) == SIG_ERR) {
-        log_printf_err(host.log, "Error al establecer el manejo de la señal SIGIO.\n");
-        fail("No se pudo establecer el manejo de la señal SIGIO");
+    if (host.domain == AF_INET) {
+        host.port = ntohs(((struct sockaddr_in *) &host.address)->sin_port);
+    } else if (host.domain == AF_UNIX) {
+        /* Una ruta del sistema de archivos (no abstracta) pasa a ser nuestra: la borraremos al cerrar */
+        host.bound_path = host.address_len > offsetof(struct sockaddr_un, sun_path) && ((struct sockaddr_un *) &host.address)->sun_path[0];
     }
-    if (signal(SIGINT, signal_handler) == SIG_ERR) {
+
+    return finish_own_host(host, start_ns);
+}
+
+
+static Host finish_own_host(Host host, uint64_t start_ns) {
+    char buffer[BUFFER_LEN] = {0};
+    char address_text[HOST_ADDRESS_STRLEN];
+    uint64_t ready_ns, hostname_ns;
+
+    /* Reservar el contexto de eventos del host */
+    if (!(host.context = acquire_host_context(host.socket))) {
+        log_printf_err(host.log, "Error al reservar el contexto de eventos del host.\n");
+        fail("No se pudo reservar el contexto de eventos del host");
+    }
+
+    if (install_signal_handler(HOST_IO_SIGNAL) < 0) {
+        log_printf_err(host.log, "Error al establecer el manejo de las señales de entrada/salida.\n");
+        fail("No se pudo establecer el manejo de las señales de entrada/salida");
+    }
+    if (install_signal_handler(SIGINT) < 0) {
         log_printf_err(host.log, "Error al establecer el manejo de la señal SIGINT.\n");
         fail("No se pudo establecer el manejo de la señal SIGINT");
     }
-    if (signal(SIGTERM, signal_handler) == SIG_ERR) {
+    if (install_signal_handler(SIGTERM) < 0) {
         log_printf_err(host.log, "Error al establecer el manejo de la señal SIGTERM.\n");
         fail("No se pudo establecer el manejo de la señal SIGTERM");
     }
-    
+
+    /* Configurar el host para enviarse a sí mismo una señal cuando se produzca actividad en el socket, para evitar bloqueos esperando por conexiones.
+     * Con F_SETSIG la señal indica en si_fd de qué socket se trata, lo que permite tener varios hosts en el mismo proceso */
+    if (fcntl(host.socket, F_SETOWN, getpid()) < 0) {
+        log_printf_err(host.log, "Error al configurar el autoenvío de señales en el socket.\n");
+        fail("No se pudo configurar el autoenvío de señales en el socket");
+    }
+    if (fcntl(host.socket, F_SETSIG, HOST_IO_SIGNAL) < 0) {
+        log_printf_err(host.log, "Error al configurar la señal de entrada/salida del socket.\n");
+        fail("No se pudo configurar la señal de entrada/salida del socket");
+    }
+    if (fcntl(host.socket, F_SETFL, O_ASYNC | O_NONBLOCK) < 0) {
+        log_printf_err(host.log, "Error al configurar el envío de SIGIO en el socket.\n");
+        fail("No se pudo configurar el envío de SIGIO en el socket");
+    }
+
+    ready_ns = traffic_monotonic_ns();
+    PROBE3(host_ready, host.socket, host.type, ready_ns - start_ns);
+    describe_address((struct sockaddr *) &host.address, host.address_len, address_text, sizeof(address_text));
+    log_printf(host.log, "Socket listo para recibir en %s (%s) en %.3f ms.\n", address_text, host_transport_name(&host), (ready_ns - start_ns) / 1e6);
+
+    /* Guardar el nombre del equipo en el que se ejecuta el host.
+     * No produce error crítico, por lo que no hay que salir */
+    if (gethostname(buffer, BUFFER_LEN)) {
+        perror("No se pudo obtener el nombre de host del servidor");
+        log_printf_err(host.log, "Error al obtener el nombre de host.\n");
+    } else {
+        host.hostname = (char *) calloc(strlen(buffer) + 1, sizeof(char));
+        strcpy(host.hostname, buffer);
+        log_printf(host.log, "Nombre de host configurado con éxito: %s.\n", host.hostname);
+    }
+    hostname_ns = traffic_monotonic_ns();
+
+    /* Guardar la IP externa y las IPs v4 y v6 locales del host.
+     * Ninguna supone un error crítico ni hace falta para atender, así que se lanzan en paralelo
+     * y no se espera por ellas hasta que se vayan a usar (wait_host_lookups) */
+    start_startup_lookups(&host, HOST_LOOKUP_DEADLINE_MS);
+
+    log_printf(host.log, "Tiempos de arranque: socket listo %.3f ms; nombre de host %.3f ms; total %.3f ms.\n",
+               (ready_ns - start_ns) / 1e6, (hostname_ns - ready_ns) / 1e6, (traffic_monotonic_ns() - start_ns) / 1e6);
 
     printf( "Host creado con éxito.\n"
-            "Hostname: %s; IPs v4 locales:%s; IPs v6 locales: %s; Puerto: %d; IP pública: %s\n\n", host.hostname, host.local_ips_v4, host.local_ips_v6, host.port, host.public_ip);
-    log_printf(host.log, "Host creado con éxito.\tHostname: %s; IPs v4 locales:%s; IPs v6 locales:%s; Puerto: %d; IP pública: %s\n", host.hostname, host.local_ips_v4, host.local_ips_v6, host.port, host.public_ip);
+            "Hostname: %s; Dirección: %s (%s)\n\n", HOST_INFO_TEXT(host.hostname), address_text, host_transport_name(&host));
+    log_printf(host.log, "Host creado con éxito.\tHostname: %s; Dirección: %s (%s)\n", HOST_INFO_TEXT(host.hostname), address_text, host_transport_name(&host));
 
     return host;
 }
 
 
+/**
+ * @brief   Crea un host del propio programa.
+ *
+ * Crea un host nuevo con un nuevo socket, y le asigna un puerto.
+ * Si el argumento logfile no es NULL, crea también un archivo de log para guardar un registro de actividad.
+ * El socket queda asociado y listo para recibir antes de lanzar las consultas informativas
+ * (IP externa e IPs locales), que se hacen en segundo plano: hay que recogerlas con wait_host_lookups
+ * antes de usar public_ip, local_ips_v4 o local_ips_v6.
+ *
+ * @param domain    Dominio de comunicación. 
+ * @param type      Tipo de protocolo usado para el socket.
+ * @param protocol  Protocolo particular a usar en el socket. Normalmente solo existe
+ *                  un protocolo para la combinación dominio-tipo dada, en cuyo caso se
+ *                  puede especificar con un 0.
+ * @param port      Número de puerto en el que escuchar (en orden de host).
+ * @param logfile   Nombre del archivo en el que guardar el registro de actividad.
+ *
+ * @return  Host que guarda toda la información relevante sobre sí mismo con la que
+ *          fue creado, y con un socket abierto y conectado por el puerto  especificado.
+ */
+Host create_own_host(int domain, int type, int protocol, uint16_t port, char* logfile){
+    Host host;
+    struct sockaddr_in *address = (struct sockaddr_in *) &host.address;
+
+    memset(&host, 0, sizeof(Host));     /* Inicializamos los campos a 0 */
+
+    host.domain = domain;
+    host.type = type;
+    host.protocol = protocol;
+    host.port = port;
+
+    address->sin_family = domain;
+    address->sin_port = htons(port);
+    address->sin_addr.s_addr = htonl(INADDR_ANY);   /* Aceptar conexiones desde cualquier IP */
+    host.address_len = sizeof(struct sockaddr_in);
+
+    return open_own_host(host, logfile);
+}
+
+
+/**
+ * @brief   Crea el primer host de un grupo de sockets que comparten dirección (SO_REUSEPORT).
+ *
+ * @param domain    Dominio de comunicación.
+ * @param type      Tipo de protocolo usado para el socket.
+ * @param protocol  Protocolo particular a usar en el socket (normalmente 0).
+ * @param port      Número de puerto en el que escuchar (en orden de host).
+ * @param logfile   Nombre del archivo en el que guardar el registro de actividad.
+ *
+ * @return  Host con el socket abierto y asociado al puerto especificado.
+ */
+Host create_own_reuseport_host(int domain, int type, int protocol, uint16_t port, char* logfile) {
+    Host host;
+    struct sockaddr_in *address = (struct sockaddr_in *) &host.address;
+
+    memset(&host, 0, sizeof(Host));     /* Inicializamos los campos a 0 */
+
+    host.domain = domain;
+    host.type = type;
+    host.protocol = protocol;
+    host.port = port;
+    host.reuse_port = true;
+
+    address->sin_family = domain;
+    address->sin_port = htons(port);
+    address->sin_addr.s_addr = htonl(INADDR_ANY);   /* Aceptar conexiones desde cualquier IP */
+    host.address_len = sizeof(struct sockaddr_in);
+
+    return open_own_host(host, logfile);
+}
+
+
+/**
+ * @brief   Crea un host del propio programa con un socket local (AF_UNIX).
+ *
+ * @param type      Tipo de socket: SOCK_DGRAM o SOCK_SEQPACKET.
+ * @param path      Ruta en la que crear el socket; con NULL el núcleo asigna un nombre abstracto único.
+ * @param logfile   Nombre del archivo en el que guardar el registro de actividad.
+ *
+ * @return  Host con el socket abierto y asociado a la ruta especificada.
+ */
+Host create_own_unix_host(int type, const char* path, char* logfile) {
+    Host host;
+    struct sockaddr_un *address = (struct sockaddr_un *) &host.address;
+    struct stat info;
+
+    memset(&host, 0, sizeof(Host));     /* Inicializamos los campos a 0 */
+
+    host.domain = AF_UNIX;
+    host.type = type;
+    address->sun_family = AF_UNIX;
+
+    if (path) {
+        if (strlen(path) >= sizeof(address->sun_path)) {
+            fprintf(stderr, "La ruta del socket (%s) es demasiado larga\n\n", path);
+            exit(EXIT_FAILURE);
+        }
+        strcpy(address->sun_path, path);
+        host.address_len = offsetof(struct sockaddr_un, sun_path) + strlen(path) + 1;
+
+        /* Un socket que quedó de una ejecución anterior impediría el bind; cualquier otro archivo se respeta */
+        if (!lstat(path, &info) && S_ISSOCK(info.st_mode)) {
+            unlink(path);
+        }
+        host.bound_path = true;
+    } else {
+        host.address_len = sizeof(sa_family_t);     /* Solo la familia: el núcleo asigna un nombre abstracto (autobind) */
+    }
+
+    return open_own_host(host, logfile);
+}
+
+
 /**
  * @brief   Crea un host remoto.
  *
@@ -200,18 +730,32 @@ Host create_remote_host(int domain, int type, int protocol, char* ip, uint16_t p
 
     memset(&remote, 0, sizeof(Host));   /* Inicializamos los campos a 0 */
 
-    remote = (Host) {
-        .domain = domain,
-        .type = type,
-        .protocol = protocol,
-        .port = port,
-        .address.sin_family = domain,
-        .address.sin_port = htons(port)
-    };
+    remote.domain = domain;
+    remote.type = type;
+    remote.protocol = protocol;
+
+    if (domain == AF_UNIX) {
+        struct sockaddr_un *address = (struct sockaddr_un *) &remote.address;
+
+        if (strlen(ip) >= sizeof(address->sun_path)) {
+            fprintf(stderr, "La ruta del socket (%s) es demasiado larga\n\n", ip);
+            exit(EXIT_FAILURE);
+        }
+        address->sun_family = AF_UNIX;
+        strcpy(address->sun_path, ip);
+        remote.address_len = offsetof(struct sockaddr_un, sun_path) + strlen(ip) + 1;
+    } else {
+        struct sockaddr_in *address = (struct sockaddr_in *) &remote.address;
 
-    if (inet_pton(remote.domain, ip, &(remote.address.sin_addr)) != 1) { /* La string no se pudo traducir a una IP válida */
-        fprintf(stderr, "La IP especificada (%s) no es válida\n\n", ip);
-        exit(EXIT_FAILURE);
+        remote.port = port;
+        address->sin_family = domain;
+        address->sin_port = htons(port);
+        remote.address_len = sizeof(struct sockaddr_in);
+
+        if (inet_pton(remote.domain, ip, &(address->sin_addr)) != 1) { /* La string no se pudo traducir a una IP válida */
+            fprintf(stderr, "La IP especificada (%s) no es válida\n\n", ip);
+            exit(EXIT_FAILURE);
+        }
     }
 
     /* Guardar la IP del host remoto en formato textual */
@@ -242,11 +786,24 @@ void close_host(Host* host) {
         }
     }
 
+    if (host->context) release_host_context(host->context);
+
+    /* Borrar el socket que creamos en el sistema de archivos */
+    if (host->bound_path) {
+        unlink(((struct sockaddr_un *) &host->address)->sun_path);
+    }
+
+    /* Las consultas sin recoger se abandonan: sus hilos liberan el estado compartido al terminar */
+    if (host->lookups) {
+        pthread_mutex_lock(&host->lookups->mutex);
+        release_startup_lookups(host->lookups);
+    }
+
     if (host->hostname) free(host->hostname);
     if (host->public_ip) free(host->public_ip);
     if (host->local_ips_v4) free(host->local_ips_v4);
     if (host->local_ips_v6) free(host->local_ips_v6);
-    if (host->log) fclose(host->log);
+    if (host->log && !host->borrowed_log) fclose(host->log);
 
     /* Limpiar la estructura poniendo todos los campos a 0 */
     memset(host, 0, sizeof(Host));
@@ -254,3 +811,459 @@ void close_host(Host* host) {
 
     return;
 }
+
+
+/**
+ * @brief   Indica si el host debe terminar.
+ *
+ * @param host  Host a consultar.
+ *
+ * @return  true si llegó una señal de terminación (SIGINT o SIGTERM) al proceso o se pidió
+ *          la terminación del host con request_host_termination; false en otro caso.
+ */
+bool is_host_terminating(const Host* host) {
+    if (atomic_load(&process_terminating)) return true;
+
+    return host->context && atomic_load(&host->context->terminate);
+}
+
+
+/**
+ * @brief   Pide que el host termine.
+ *
+ * Marca el host para terminar y despierta a quien esté esperando en wait_for_host_event.
+ *
+ * @param host  Host que debe terminar.
+ */
+void request_host_termination(Host* host) {
+    uint64_t one = 1;
+
+    if (!host->context) return;
+
+    atomic_store(&host->context->terminate, true);
+    if (write(host->context->wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        log_printf_err(host->log, "Error al despertar al host para terminar.\n");
+    }
+}
+
+
+/**
+ * @brief   Permite pedir con HOST_UPGRADE_SIGNAL (SIGUSR2) que el proceso se sustituya por una versión nueva.
+ *
+ * @return  0 si se instaló el manejador; -1 en caso de error.
+ */
+int enable_upgrade_requests(void) {
+    return install_signal_handler(HOST_UPGRADE_SIGNAL);
+}
+
+
+/**
+ * @brief   Indica si se pidió sustituir el proceso y, si es así, olvida la petición.
+ *
+ * @return  true si llegó HOST_UPGRADE_SIGNAL desde la última consulta.
+ */
+bool take_upgrade_request(void) {
+    /* La lectura sola es más barata que el intercambio, y casi nunca hay petición */
+    return atomic_load(&upgrade_requested) && atomic_exchange(&upgrade_requested, false);
+}
+
+
+/**
+ * @brief   Espera a que el proceso reciba una petición: terminar (SIGINT o SIGTERM) o sustituirse (HOST_UPGRADE_SIGNAL).
+ *
+ * Las señales se bloquean mientras se comprueba si ya había llegado alguna y se desbloquean al empezar a
+ * esperar (ppoll), de forma que una que llegue entre medias no se pierde.
+ *
+ * @param timeout_ms    Tiempo máximo de espera en milisegundos (-1 para esperar indefinidamente).
+ *
+ * @return  1 si hay una petición pendiente; 0 si venció el tiempo máximo.
+ */
+int wait_for_process_request(int timeout_ms) {
+    sigset_t blocked, previous;
+    struct timespec timeout = {.tv_sec = timeout_ms / 1000, .tv_nsec = (timeout_ms % 1000) * 1000000L};
+    int pending;
+
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGINT);
+    sigaddset(&blocked, SIGTERM);
+    sigaddset(&blocked, HOST_UPGRADE_SIGNAL);
+    pthread_sigmask(SIG_BLOCK, &blocked, &previous);
+
+    if (!(pending = atomic_load(&process_terminating) || atomic_load(&upgrade_requested))) {
+        ppoll(NULL, 0, timeout_ms < 0 ? NULL : &timeout, &previous);
+        pending = atomic_load(&process_terminating) || atomic_load(&upgrade_requested);
+    }
+
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+    return pending;
+}
+
+
+/**
+ * @brief   Devuelve el número de eventos de entrada/salida pendientes en el socket del host.
+ *
+ * @param host  Host a consultar.
+ *
+ * @return  Número de eventos pendientes de manejar.
+ */
+unsigned get_pending_io(const Host* host) {
+    return host->context ? atomic_load(&host->context->io_pending) : 0;
+}
+
+
+/**
+ * @brief   Marca como manejado un evento de entrada/salida del host.
+ *
+ * Nunca baja de 0, aunque se llame más veces que eventos se recibieron.
+ *
+ * @param host  Host en el que se manejó el evento.
+ */
+void consume_pending_io(Host* host) {
+    unsigned pending;
+
+    if (!host->context) return;
+
+    pending = atomic_load(&host->context->io_pending);
+    while (pending && !atomic_compare_exchange_weak(&host->context->io_pending, &pending, pending - 1));
+}
+
+
+/**
+ * @brief   Marca como manejados todos los eventos de entrada/salida del host.
+ *
+ * @param host  Host cuyo socket se vació.
+ */
+void clear_pending_io(Host* host) {
+    if (host->context) atomic_store(&host->context->io_pending, 0);
+}
+
+
+/**
+ * @brief   Descarta lo que haya en la cola de errores de un socket (MSG_ERRQUEUE), sin bloquear.
+ *
+ * @param socket    Socket a vaciar.
+ *
+ * @return  true si había algo en la cola; false en otro caso.
+ */
+static bool drain_error_queue(int socket) {
+    char control[256];
+    struct msghdr message;
+    bool drained = false;
+
+    while (true) {
+        message = (struct msghdr) {.msg_control = control, .msg_controllen = sizeof(control)};
+        if (recvmsg(socket, &message, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) break;
+        drained = true;
+    }
+
+    return drained;
+}
+
+
+/**
+ * @brief   Espera a que haya actividad en el host.
+ *
+ * Vuelve en cuanto el socket tenga datos que leer, se pida la terminación del host, llegue una señal
+ * o pase el tiempo máximo. Si ya había eventos pendientes o se pidió la terminación, vuelve inmediatamente.
+ * Espera con poll sobre el propio socket y el eventfd del contexto en lugar de con pause, de forma que
+ * un aviso que llegue justo antes de empezar a esperar no se pierde, y se puede usar desde cualquier hilo.
+ * Lo que quede en la cola de errores del socket (p. ej. marcas de envío sin leer) se descarta en lugar de
+ * tratarse como actividad, para no volver en bucle sin esperar.
+ *
+ * @param host          Host por el que esperar.
+ * @param timeout_ms    Tiempo máximo de espera en milisegundos (-1 para esperar indefinidamente).
+ *
+ * @return  1 si hay actividad o se pidió la terminación; 0 si venció el tiempo máximo o la interrumpió una señal.
+ */
+int wait_for_host_event(Host* host, int timeout_ms) {
+    struct pollfd fds[2] = {
+        {.fd = host->socket, .events = POLLIN},
+        {.fd = host->context ? host->context->wake_fd : -1, .events = POLLIN}
+    };
+    uint64_t deadline_ns = timeout_ms > 0 ? traffic_monotonic_ns() + timeout_ms * 1000000ULL : 0;
+    uint64_t now_ns;
+    int ready;
+
+    if (is_host_terminating(host) || get_pending_io(host)) return 1;
+
+    while ( (ready = poll(fds, 2, timeout_ms)) > 0) {
+        /* POLLERR sin datos suele ser una marca de tiempo de envío (TIMESTAMP_TX) que nadie leyó: poll volvería
+         * inmediatamente mientras siga en la cola de errores, así que la vaciamos y seguimos esperando.
+         * Si la cola estaba vacía, el error es del propio socket y lo verá quien lea de él */
+        if (fds[1].revents || !(fds[0].revents & POLLERR) || (fds[0].revents & POLLIN) || !drain_error_queue(host->socket)) return 1;
+
+        if (timeout_ms > 0) {
+            if ( (now_ns = traffic_monotonic_ns()) >= deadline_ns) return 0;
+            timeout_ms = (int) ((deadline_ns - now_ns + 999999) / 1000000);
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief   Indica si la dirección de un host pertenece a esta misma máquina.
+ *
+ * Lo comprueba pidiendo al núcleo asociar un socket temporal a esa dirección (con puerto 0, para no
+ * interferir con el del host), lo que solo es posible con las direcciones de loopback y las asignadas
+ * a alguna interfaz local.
+ *
+ * @param host  Host (normalmente remoto) a comprobar.
+ *
+ * @return  true si la dirección del host es local; false en otro caso.
+ */
+bool is_local_host(const Host* host) {
+    struct sockaddr_in probe_address;
+    int probe;
+    bool local;
+
+    if (host->address.ss_family == AF_UNIX) {
+        return true;    /* Los sockets locales solo existen en esta máquina */
+    }
+    if (host->address.ss_family != AF_INET) {
+        return false;
+    }
+
+    if ((probe = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
+        return false;
+    }
+
+    memcpy(&probe_address, &host->address, sizeof(probe_address));
+    probe_address.sin_port = 0;
+    local = !bind(probe, (struct sockaddr *) &probe_address, sizeof(probe_address));
+
+    close(probe);
+
+    return local;
+}
+
+
+/**
+ * @brief   Configura el socket de un host propio para avisar de su actividad con HOST_IO_SIGNAL.
+ *
+ * @param host  Host cuyo socket configurar.
+ *
+ * @return  0 si se configuró; -1 en caso de error.
+ */
+static int enable_io_signal(Host* host) {
+    if (fcntl(host->socket, F_SETOWN, getpid()) < 0 || fcntl(host->socket, F_SETSIG, HOST_IO_SIGNAL) < 0
+        || fcntl(host->socket, F_SETFL, O_ASYNC | O_NONBLOCK) < 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief   Conecta el socket de un host propio con un host remoto.
+ *
+ * @param local     Host propio.
+ * @param remote    Host remoto con el que conectar.
+ *
+ * @return  0 si se conectó; -1 en caso de error (con errno).
+ */
+int connect_host(Host* local, const Host* remote) {
+    struct pollfd pending = {.fd = local->socket, .events = POLLOUT};
+    socklen_t error_len = sizeof(int);
+    int error = 0;
+
+    if (!connect(local->socket, (const struct sockaddr *) &remote->address, remote->address_len)) {
+        return 0;
+    }
+    if (errno != EINPROGRESS && errno != EAGAIN) {
+        return -1;
+    }
+
+    /* Socket no bloqueante: esperamos a que la conexión se complete (o falle) */
+    while (poll(&pending, 1, -1) < 0) {
+        if (errno != EINTR) return -1;
+    }
+    if (getsockopt(local->socket, SOL_SOCKET, SO_ERROR, &error, &error_len) < 0) {
+        return -1;
+    }
+    if (error) {
+        errno = error;
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief   Acepta una conexión pendiente en un host que escucha (SOCK_SEQPACKET).
+ *
+ * @param listener      Host que escucha conexiones.
+ * @param connection    Host en el que guardar la conexión aceptada.
+ *
+ * @return  0 si se aceptó una conexión; -1 si no había ninguna pendiente (EAGAIN) o hubo un error.
+ */
+int accept_host(Host* listener, Host* connection) {
+    memset(connection, 0, sizeof(Host));
+
+    connection->domain = listener->domain;
+    connection->type = listener->type;
+    connection->protocol = listener->protocol;
+    connection->log = listener->log;
+    connection->borrowed_log = true;
+    connection->address_len = sizeof(connection->address);
+
+    if ((connection->socket = accept4(listener->socket, (struct sockaddr *) &connection->address, &connection->address_len, SOCK_CLOEXEC)) < 0) {
+        connection->socket = -1;
+        return -1;
+    }
+
+    if (!(connection->context = acquire_host_context(connection->socket)) || enable_io_signal(connection) < 0) {
+        int saved_errno = errno;
+
+        log_printf_err(listener->log, "Error al preparar la conexión aceptada.\n");
+        close_host(connection);
+        errno = saved_errno;
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief   Añade un socket más al grupo de un host creado con create_own_reuseport_host.
+ *
+ * @param first     Primer host del grupo.
+ * @param sibling   Host en el que guardar el nuevo socket.
+ * @param existing  Socket del grupo ya asociado que adoptar (p. ej. heredado de otro proceso), o -1 para crear uno.
+ *
+ * @return  0 si se creó el socket; -1 en caso de error (con errno).
+ */
+int add_reuseport_host(const Host* first, Host* sibling, int existing) {
+    int saved_errno;
+
+    memset(sibling, 0, sizeof(Host));
+
+    sibling->domain = first->domain;
+    sibling->type = first->type;
+    sibling->protocol = first->protocol;
+    sibling->port = first->port;
+    sibling->address = first->address;
+    sibling->address_len = first->address_len;
+    sibling->log = first->log;
+    sibling->borrowed_log = true;
+    sibling->reuse_port = true;
+
+    if (existing >= 0) {
+        sibling->socket = existing;
+    } else if ((sibling->socket = socket(sibling->domain, sibling->type | SOCK_CLOEXEC, sibling->protocol)) < 0) {
+        return -1;
+    }
+
+    if ((existing < 0 && (setsockopt(sibling->socket, SOL_SOCKET, SO_REUSEPORT, &(int) {1}, sizeof(int)) < 0
+                        || bind(sibling->socket, (struct sockaddr *) &sibling->address, sibling->address_len) < 0))
+        || !(sibling->context = acquire_host_context(sibling->socket)) || enable_io_signal(sibling) < 0) {
+        saved_errno = errno;
+        log_printf_err(first->log, "Error al añadir un socket al grupo SO_REUSEPORT.\n");
+        close_host(sibling);
+        errno = saved_errno;
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief   Obtiene el tamaño real del siguiente datagrama del socket sin sacarlo de la cola (MSG_PEEK | MSG_TRUNC).
+ *
+ * @param host  Host por cuyo socket se va a recibir (datagramas o SOCK_SEQPACKET).
+ *
+ * @return  Bytes del datagrama; -1 si no hay ninguno pendiente (EAGAIN) o hubo un error.
+ */
+ssize_t peek_datagram_size(Host* host) {
+    char byte;
+
+    /* Con MSG_TRUNC el núcleo devuelve la longitud real aunque el buffer sea menor */
+    return recv(host->socket, &byte, sizeof(byte), MSG_PEEK | MSG_TRUNC | MSG_DONTWAIT);
+}
+
+
+/**
+ * @brief   Indica si un texto de la línea de comandos es la ruta de un socket local (AF_UNIX).
+ *
+ * @param text  Texto a comprobar (el que se pasaría como IP o puerto).
+ *
+ * @return  true si contiene alguna '/' (p. ej. "/tmp/mayus.sock" o "./mayus.sock").
+ */
+bool is_unix_socket_path(const char* text) {
+    return text && strchr(text, '/');
+}
+
+
+/**
+ * @brief   Describe una dirección en formato textual, sea cual sea su familia.
+ *
+ * @param address   Dirección a describir.
+ * @param len       Longitud válida de la dirección.
+ * @param buffer    Buffer en el que escribir la descripción (HOST_ADDRESS_STRLEN bytes bastan).
+ * @param size      Tamaño del buffer.
+ *
+ * @return  buffer.
+ */
+char* describe_address(const struct sockaddr* address, socklen_t len, char* buffer, size_t size) {
+    char ip[INET6_ADDRSTRLEN];
+
+    switch (len >= sizeof(sa_family_t) ? address->sa_family : AF_UNSPEC) {
+        case AF_INET: {
+            const struct sockaddr_in *inet = (const struct sockaddr_in *) address;
+
+            inet_ntop(AF_INET, &inet->sin_addr, ip, sizeof(ip));
+            snprintf(buffer, size, "%s:%u", ip, ntohs(inet->sin_port));
+            break;
+        }
+
+        case AF_INET6: {
+            const struct sockaddr_in6 *inet6 = (const struct sockaddr_in6 *) address;
+
+            inet_ntop(AF_INET6, &inet6->sin6_addr, ip, sizeof(ip));
+            snprintf(buffer, size, "[%s]:%u", ip, ntohs(inet6->sin6_port));
+            break;
+        }
+
+        case AF_UNIX: {
+            const struct sockaddr_un *local = (const struct sockaddr_un *) address;
+            size_t path_len = len - offsetof(struct sockaddr_un, sun_path);
+
+            if (len <= offsetof(struct sockaddr_un, sun_path)) {
+                snprintf(buffer, size, "(sin nombre)");
+            } else if (local->sun_path[0] == '\0') {
+                /* Nombre abstracto: no acaba en nulo y puede contener cualquier byte */
+                snprintf(buffer, size, "@%.*s", (int) strnlen(local->sun_path + 1, path_len - 1), local->sun_path + 1);
+            } else {
+                snprintf(buffer, size, "%.*s", (int) strnlen(local->sun_path, path_len), local->sun_path);
+            }
+            break;
+        }
+
+        default:
+            snprintf(buffer, size, "(dirección desconocida)");
+    }
+
+    return buffer;
+}
+
+
+/**
+ * @brief   Nombre del transporte de un host, para los mensajes ("UDP", "unix/datagramas" o "unix/seqpacket").
+ *
+ * @param host  Host a describir.
+ *
+ * @return  String estática con el nombre.
+ */
+const char* host_transport_name(const Host* host) {
+    if (host->domain == AF_UNIX) {
+        return host->type == SOCK_SEQPACKET ? "unix/seqpacket" : "unix/datagramas";
+    }
+
+    return "UDP";
+}
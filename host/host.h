@@ -4,9 +4,50 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <netinet/in.h>
+#include <sys/un.h>
 #include <stdio.h>
 #include <errno.h>
 #include <unistd.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <signal.h>
+
+/* Plazo máximo (en milisegundos), desde que se crea el host propio, para recoger las consultas
+ * informativas (IP externa e IPs locales). El socket ya está listo antes de empezarlas. */
+#ifndef HOST_LOOKUP_DEADLINE_MS
+#define HOST_LOOKUP_DEADLINE_MS 1500
+#endif
+
+/* Señal con la que se pide sustituir el proceso por una versión nueva (ver enable_upgrade_requests) */
+#define HOST_UPGRADE_SIGNAL SIGUSR2
+
+/* Máximo número de hosts propios que pueden existir a la vez en un proceso */
+#define HOST_MAX_CONTEXTS 256
+
+/* Texto de un dato informativo del host (IP externa, IPs locales, nombre) que puede faltar si su consulta falló */
+#define HOST_INFO_TEXT(info) ((info) ? (info) : "desconocida")
+
+/* Tamaño suficiente para la descripción textual de cualquier dirección (ver describe_address) */
+#define HOST_ADDRESS_STRLEN (sizeof(((struct sockaddr_un *) 0)->sun_path) + 48)
+
+/**
+ * Contexto de eventos de un host propio.
+ * Lo actualiza el manejador de señales y lo consultan los bucles del programa, por lo que todos
+ * sus campos son atómicos. Es una entrada de un registro estático de HOST_MAX_CONTEXTS contextos
+ * que nunca se libera: todas las copias de un Host comparten el mismo contexto, y el manejador
+ * de señales siempre accede a memoria válida.
+ */
+typedef struct {
+    atomic_uint io_pending;     /* Número de eventos de entrada/salida pendientes de manejar en el socket del host.
+                                 * Su uso permite que el host no se quede bloqueado en el proceso de espera de señales,
+                                 * pero que aún así pueda pausarse para no gastar recursos de forma innecesaria */
+    atomic_bool terminate;      /* Vale true si se pidió que el host termine (señal SIGINT o SIGTERM, o request_host_termination) */
+    atomic_int wake_fd;         /* eventfd con el que se despierta a quien espera en wait_for_host_event al pedir la terminación */
+} HostContext;
+
+/* Consultas informativas en curso de un host (opaca, ver wait_host_lookups) */
+struct StartupLookups;
 
 /**
  * Estructura que contiene toda la información relevante 
@@ -17,29 +58,29 @@ typedef struct {
     int domain;     /* Dominio de comunicación. Especifica la familia de protocolos que se usan para la comunicación */
     int type;       /* Tipo de protocolo usado para el socket */
     int protocol;   /* Protocolo particular usado en el socket */
-    uint16_t port;  /* Puerto en el que el servidor escucha peticiones (en orden de host) */
+    uint16_t port;  /* Puerto en el que el servidor escucha peticiones (en orden de host; 0 en AF_UNIX) */
     char* hostname; /* Nombre del equipo en el que está ejecutándose el servidor */
     char* public_ip;       /* IP externa del servidor (en formato textual) */
     char* local_ips_v4;       /* IPs v4 locales del host (en formato textual, separadas por ", ") */
     char* local_ips_v6;       /* IPs v6 locales del host (en formato textual, separadas por ", ") */
-    struct sockaddr_in address;  /* Estructura con el dominio de comunicación, IPs a las que atender
-                                           y puerto al que está asociado el socket */
+    struct StartupLookups* lookups;     /* Consultas de public_ip y local_ips_* aún sin recoger (NULL si ya se recogieron) */
+    struct sockaddr_storage address;    /* Dirección del host: IP y puerto (AF_INET) o ruta (AF_UNIX) */
+    socklen_t address_len;              /* Longitud válida de address */
     FILE* log;      /* Archivo en el que guardar el registro de actividad del servidor */
+    HostContext* context;   /* Estado de eventos del host (NULL en los hosts remotos) */
+    bool bound_path;        /* El host creó su socket en el sistema de archivos y debe borrarlo al cerrarse */
+    bool borrowed_log;      /* El log pertenece a otro host (conexiones aceptadas) y no se cierra con este */
+    bool reuse_port;        /* El socket comparte su dirección con otros del mismo proceso (SO_REUSEPORT) */
 } Host;
 
-/** 
- * Variables globales para el manejo de señales.
- */
-extern uint8_t socket_io_pending;   /* Contiene el número de eventos de entrada/salida pendientes de manejar en el socket del host. 
-                                     * Su uso permite que el host no se quede bloqueado en el proceso de espera de señales, pero que aún así pueda pausarse
-                                     * para no gastar recursos de forma innecesaria */
-extern bool terminate;           /* Vale true si llegó una señal de terminación (SIGINT o SIGTERM). En este caso se espera que el proceso termine limpiamente. */
-
 /**
  * @brief   Crea un host del propio programa.
  *
  * Crea un host nuevo con un nuevo socket, y le asigna un puerto.
  * Si el argumento logfile no es NULL, crea también un archivo de log para guardar un registro de actividad.
+ * El socket queda asociado y listo para recibir antes de lanzar las consultas informativas
+ * (IP externa e IPs locales), que se hacen en segundo plano: hay que recogerlas con wait_host_lookups
+ * antes de usar public_ip, local_ips_v4 o local_ips_v6.
  *
  * @param domain    Dominio de comunicación. 
  * @param type      Tipo de protocolo usado para el socket.
@@ -54,6 +95,68 @@ extern bool terminate;           /* Vale true si llegó una señal de terminaci
  */
 Host create_own_host(int domain, int type, int protocol, uint16_t port, char* logfile);
 
+/**
+ * @brief   Crea el primer host de un grupo de sockets que comparten dirección (SO_REUSEPORT).
+ *
+ * Igual que create_own_host, pero activando SO_REUSEPORT antes del bind, de forma que se puedan
+ * asociar más sockets a la misma dirección con add_reuseport_host. El núcleo reparte entonces los
+ * datagramas entrantes entre todos los sockets del grupo (por defecto, según un resumen del origen).
+ *
+ * @param domain    Dominio de comunicación.
+ * @param type      Tipo de protocolo usado para el socket.
+ * @param protocol  Protocolo particular a usar en el socket (normalmente 0).
+ * @param port      Número de puerto en el que escuchar (en orden de host).
+ * @param logfile   Nombre del archivo en el que guardar el registro de actividad.
+ *
+ * @return  Host con el socket abierto y asociado al puerto especificado.
+ */
+Host create_own_reuseport_host(int domain, int type, int protocol, uint16_t port, char* logfile);
+
+/**
+ * @brief   Añade un socket más al grupo de un host creado con create_own_reuseport_host.
+ *
+ * El host nuevo tiene la misma dirección, su propio contexto de eventos y el log del primero.
+ * No repite las consultas informativas, por lo que no tiene nombre de host ni IPs.
+ *
+ * @param first     Primer host del grupo.
+ * @param sibling   Host en el que guardar el nuevo socket.
+ * @param existing  Socket del grupo ya asociado que adoptar (p. ej. heredado de otro proceso), o -1 para crear uno.
+ *
+ * @return  0 si se creó el socket; -1 en caso de error (con errno).
+ */
+int add_reuseport_host(const Host* first, Host* sibling, int existing);
+
+/**
+ * @brief   Crea un host propio con un socket ya asociado a su dirección, heredado de otro proceso.
+ *
+ * Se usa al sustituir un servidor en marcha por una versión nueva (ver handoff.h): el socket, y con él
+ * los datagramas que ya esperan en su cola, pasa al proceso nuevo sin cerrarse nunca. La familia, el tipo
+ * y la dirección se leen del propio socket. El log se abre para añadir al final, no se trunca.
+ *
+ * @param socket    Socket heredado.
+ * @param logfile   Nombre del archivo en el que guardar el registro de actividad.
+ *
+ * @return  Host con el socket heredado, listo para recibir.
+ */
+Host adopt_own_host(int socket, char* logfile);
+
+/**
+ * @brief   Crea un host del propio programa con un socket local (AF_UNIX).
+ *
+ * Igual que create_own_host, pero asociando el socket a una ruta del sistema de archivos en lugar
+ * de a un puerto. Si en la ruta ya había un socket (de una ejecución anterior), se sustituye.
+ * Con SOCK_SEQPACKET y una ruta, el socket queda además escuchando conexiones (ver accept_host);
+ * sin ruta, queda listo para conectarse a otro (ver connect_host).
+ *
+ * @param type      Tipo de socket: SOCK_DGRAM o SOCK_SEQPACKET.
+ * @param path      Ruta en la que crear el socket; con NULL el núcleo asigna un nombre abstracto
+ *                  único (lo que necesita un cliente de datagramas para poder recibir respuestas).
+ * @param logfile   Nombre del archivo en el que guardar el registro de actividad.
+ *
+ * @return  Host con el socket abierto y asociado a la ruta especificada.
+ */
+Host create_own_unix_host(int type, const char* path, char* logfile);
+
 
 /**
  * @brief   Crea un host remoto.
@@ -66,13 +169,25 @@ Host create_own_host(int domain, int type, int protocol, uint16_t port, char* lo
  * @param protocol  Protocolo particular a usar en el socket. Normalmente solo existe
  *                  un protocolo para la combinación dominio-tipo dada, en cuyo caso se
  *                  puede especificar con un 0.
- * @param ip        IP del host remoto (en formato textual).
- * @param port      Número de puerto en el que escucha el host remoto (en orden de host).
+ * @param ip        IP del host remoto (en formato textual), o ruta de su socket si domain es AF_UNIX.
+ * @param port      Número de puerto en el que escucha el host remoto (en orden de host; se ignora en AF_UNIX).
  *
  * @return  Host con toda la información relevante y disponible sobre el host remoto.
  */
 Host create_remote_host(int domain, int type, int protocol, char* ip, uint16_t port);
 
+/**
+ * @brief   Recoge las consultas informativas del host (IP externa e IPs locales), esperando por ellas como mucho hasta su plazo.
+ *
+ * Los hosts propios las lanzan en segundo plano al crearse, para empezar a atender sin esperar por
+ * ellas; hay que llamar a esta función antes de usar public_ip, local_ips_v4 o local_ips_v6. Espera
+ * como mucho hasta HOST_LOOKUP_DEADLINE_MS desde la creación del host: las consultas que no terminan
+ * para entonces se abandonan. Si ya se recogieron, no hace nada.
+ *
+ * @param host  Host cuyas consultas recoger.
+ */
+void wait_host_lookups(Host* host);
+
 
 /**
  * @brief   Cierra el host.
@@ -84,5 +199,177 @@ Host create_remote_host(int domain, int type, int protocol, char* ip, uint16_t p
  */
 void close_host(Host* host);
 
+/**
+ * @brief   Conecta el socket de un host propio con un host remoto.
+ *
+ * Es obligatorio con SOCK_SEQPACKET antes de intercambiar datos; con datagramas fija el destino
+ * por defecto. El socket conserva O_NONBLOCK, así que se espera a que la conexión se complete.
+ *
+ * @param local     Host propio.
+ * @param remote    Host remoto con el que conectar.
+ *
+ * @return  0 si se conectó; -1 en caso de error (con errno).
+ */
+int connect_host(Host* local, const Host* remote);
+
+/**
+ * @brief   Acepta una conexión pendiente en un host que escucha (SOCK_SEQPACKET).
+ *
+ * La conexión es un host propio más, con su socket no bloqueante, su aviso por señal y su
+ * contexto de eventos, que comparte el log del host que escucha.
+ *
+ * @param listener      Host que escucha conexiones.
+ * @param connection    Host en el que guardar la conexión aceptada.
+ *
+ * @return  0 si se aceptó una conexión; -1 si no había ninguna pendiente (EAGAIN) o hubo un error.
+ */
+int accept_host(Host* listener, Host* connection);
+
+/**
+ * @brief   Obtiene el tamaño real del siguiente datagrama del socket sin sacarlo de la cola (MSG_PEEK | MSG_TRUNC).
+ *
+ * Sirve para leerlo entero: en UDP, lo que no cabe en el buffer de recvfrom se pierde.
+ *
+ * @param host  Host por cuyo socket se va a recibir (datagramas o SOCK_SEQPACKET).
+ *
+ * @return  Bytes del datagrama; -1 si no hay ninguno pendiente (EAGAIN) o hubo un error.
+ */
+ssize_t peek_datagram_size(Host* host);
+
+/**
+ * @brief   Indica si un texto de la línea de comandos es la ruta de un socket local (AF_UNIX).
+ *
+ * @param text  Texto a comprobar (el que se pasaría como IP o puerto).
+ *
+ * @return  true si contiene alguna '/' (p. ej. "/tmp/mayus.sock" o "./mayus.sock").
+ */
+bool is_unix_socket_path(const char* text);
+
+/**
+ * @brief   Describe una dirección en formato textual, sea cual sea su familia.
+ *
+ * Sustituye a inet_ntoa: da "IP:puerto" para AF_INET y AF_INET6, y la ruta del socket para AF_UNIX
+ * ("@nombre" si es abstracta o "(sin nombre)" si no tiene).
+ *
+ * @param address   Dirección a describir.
+ * @param len       Longitud válida de la dirección.
+ * @param buffer    Buffer en el que escribir la descripción (HOST_ADDRESS_STRLEN bytes bastan).
+ * @param size      Tamaño del buffer.
+ *
+ * @return  buffer.
+ */
+char* describe_address(const struct sockaddr* address, socklen_t len, char* buffer, size_t size);
+
+/**
+ * @brief   Nombre del transporte de un host, para los mensajes ("UDP", "unix/datagramas" o "unix/seqpacket").
+ *
+ * @param host  Host a describir.
+ *
+ * @return  String estática con el nombre.
+ */
+const char* host_transport_name(const Host* host);
+
+
+/**
+ * @brief   Indica si el host debe terminar.
+ *
+ * @param host  Host a consultar.
+ *
+ * @return  true si llegó una señal de terminación (SIGINT o SIGTERM) al proceso o se pidió
+ *          la terminación del host con request_host_termination; false en otro caso.
+ */
+bool is_host_terminating(const Host* host);
+
+/**
+ * @brief   Pide que el host termine.
+ *
+ * Marca el host para terminar y despierta a quien esté esperando en wait_for_host_event.
+ *
+ * @param host  Host que debe terminar.
+ */
+void request_host_termination(Host* host);
+
+/**
+ * @brief   Permite pedir con HOST_UPGRADE_SIGNAL (SIGUSR2) que el proceso se sustituya por una versión nueva.
+ *
+ * Sin llamarla, la señal conserva su acción por defecto (terminar el proceso).
+ *
+ * @return  0 si se instaló el manejador; -1 en caso de error.
+ */
+int enable_upgrade_requests(void);
+
+/**
+ * @brief   Indica si se pidió sustituir el proceso y, si es así, olvida la petición.
+ *
+ * @return  true si llegó HOST_UPGRADE_SIGNAL desde la última consulta.
+ */
+bool take_upgrade_request(void);
+
+/**
+ * @brief   Espera a que el proceso reciba una petición: terminar (SIGINT o SIGTERM) o sustituirse (HOST_UPGRADE_SIGNAL).
+ *
+ * Para el hilo principal cuando el trabajo lo hacen otros hilos. No pierde las señales que lleguen justo antes de esperar.
+ *
+ * @param timeout_ms    Tiempo máximo de espera en milisegundos (-1 para esperar indefinidamente).
+ *
+ * @return  1 si hay una petición pendiente; 0 si venció el tiempo máximo.
+ */
+int wait_for_process_request(int timeout_ms);
+
+/**
+ * @brief   Devuelve el número de eventos de entrada/salida pendientes en el socket del host.
+ *
+ * @param host  Host a consultar.
+ *
+ * @return  Número de eventos pendientes de manejar.
+ */
+unsigned get_pending_io(const Host* host);
+
+/**
+ * @brief   Marca como manejado un evento de entrada/salida del host.
+ *
+ * Nunca baja de 0, aunque se llame más veces que eventos se recibieron.
+ *
+ * @param host  Host en el que se manejó el evento.
+ */
+void consume_pending_io(Host* host);
+
+/**
+ * @brief   Marca como manejados todos los eventos de entrada/salida del host.
+ *
+ * Se usa cuando el socket ya no tiene datos pendientes (EAGAIN).
+ *
+ * @param host  Host cuyo socket se vació.
+ */
+void clear_pending_io(Host* host);
+
+/**
+ * @brief   Espera a que haya actividad en el host.
+ *
+ * Vuelve en cuanto el socket tenga datos que leer, se pida la terminación del host, llegue una señal
+ * o pase el tiempo máximo. Si ya había eventos pendientes o se pidió la terminación, vuelve inmediatamente.
+ * No pierde eventos aunque lleguen justo antes de empezar a esperar, y se puede usar desde cualquier hilo.
+ * Lo que quede en la cola de errores del socket (p. ej. marcas de envío sin leer) se descarta en lugar de
+ * tratarse como actividad, para no volver en bucle sin esperar.
+ *
+ * @param host          Host por el que esperar.
+ * @param timeout_ms    Tiempo máximo de espera en milisegundos (-1 para esperar indefinidamente).
+ *
+ * @return  1 si hay actividad o se pidió la terminación; 0 si venció el tiempo máximo o la interrumpió una señal.
+ */
+int wait_for_host_event(Host* host, int timeout_ms);
+
+/**
+ * @brief   Indica si la dirección de un host pertenece a esta misma máquina.
+ *
+ * Lo comprueba pidiendo al núcleo asociar un socket temporal a esa dirección, lo que solo
+ * es posible con las direcciones de loopback y las asignadas a alguna interfaz local.
+ *
+ * @param host  Host (normalmente remoto) a comprobar.
+ *
+ * @return  true si la dirección del host es local; false en otro caso.
+ */
+bool is_local_host(const Host* host);
+
 #endif  /* HOST_H */
 
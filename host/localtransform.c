@@ -0,0 +1,214 @@
+#define _GNU_SOURCE     /* Para memrchr */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "localtransform.h"
+
+
+/**
+ * Trabajo compartido por los hilos que transforman un archivo.
+ */
+struct LocalTransformJob {
+    const char *input;          /* Archivo de entrada, proyectado en memoria */
+    size_t input_len;
+    int output_fd;
+    enum TransformOp op;
+    size_t chunk_size;
+    pthread_mutex_t lock;       /* Protege lo que sigue */
+    pthread_cond_t placed;      /* Un fragmento fijó su desplazamiento en la salida */
+    size_t next_input;          /* Inicio del siguiente fragmento por repartir */
+    uint64_t next_chunk;        /* Número del siguiente fragmento por repartir */
+    uint64_t placed_chunks;     /* Fragmentos con su desplazamiento en la salida ya fijado */
+    uint64_t next_output;       /* Desplazamiento en la salida del siguiente fragmento por fijar */
+    int error;                  /* errno del primer error (0 si no hubo) */
+};
+
+
+/**
+ * @brief   Fin del fragmento que empieza en start: tras el último salto de línea que quepa en chunk_size bytes
+ *          o, si no hay, tras el último espacio, o al menos en el límite de un carácter UTF-8.
+ *
+ * Cortar tras un salto de línea o un espacio no cambia el resultado de ninguna operación (tampoco el de la
+ * forma de título, que depende de si el carácter anterior era parte de una palabra).
+ */
+static size_t chunk_end(const char *input, size_t len, size_t start, size_t chunk_size) {
+    size_t end = start + chunk_size;
+    const char *cut;
+
+    if (end >= len) return len;
+
+    if ((cut = memrchr(input + start, '\n', chunk_size)) || (cut = memrchr(input + start, ' ', chunk_size))) {
+        return cut - input + 1;
+    }
+
+    /* Una sola palabra más larga que el fragmento: al menos no partimos un carácter */
+    while (end > start && (input[end] & 0xc0) == 0x80) end--;
+
+    return end > start ? end : start + chunk_size;
+}
+
+
+/**
+ * @brief   Escribe entero un buffer en un desplazamiento del archivo, reintentando las escrituras parciales.
+ *
+ * @return  0 si se escribió todo; errno del fallo en caso contrario.
+ */
+static int pwrite_all(int fd, const char *data, size_t len, uint64_t offset) {
+    ssize_t written;
+
+    while (len) {
+        if ((written = pwrite(fd, data, len, offset)) < 0) {
+            if (errno == EINTR) continue;
+            return errno;
+        }
+        data += written;
+        len -= written;
+        offset += written;
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief   Hilo que transforma fragmentos hasta que no quedan.
+ */
+static void *transform_chunks(void *arg) {
+    struct LocalTransformJob *job = arg;
+    char *output = NULL, *grown;
+    size_t capacity = 0, needed, start, end;
+    ssize_t output_len;
+    uint64_t chunk, offset;
+    int error;
+
+    for (;;) {
+        /* Tomamos el siguiente fragmento */
+        pthread_mutex_lock(&job->lock);
+        if (job->error || job->next_input >= job->input_len) {
+            pthread_mutex_unlock(&job->lock);
+            break;
+        }
+        start = job->next_input;
+        end = job->next_input = chunk_end(job->input, job->input_len, start, job->chunk_size);
+        chunk = job->next_chunk++;
+        pthread_mutex_unlock(&job->lock);
+
+        /* Lo transformamos; si el resultado no cabe (más bytes por carácter), agrandamos el buffer */
+        error = 0;
+        needed = 2 * (end - start);
+        for (;;) {
+            if (capacity < needed) {
+                if (!(grown = realloc(output, needed))) {
+                    error = ENOMEM;
+                    break;
+                }
+                output = grown;
+                capacity = needed;
+            }
+            if ((output_len = transform_text(job->op, job->input + start, end - start, output, capacity)) >= 0) break;
+            if (needed >= 4 * (end - start)) {
+                error = EINVAL;     /* Ningún carácter pasa de 1 a más de 4 bytes: la operación no existe */
+                break;
+            }
+            needed *= 2;
+        }
+        if (error) output_len = 0;
+
+        /* Su sitio en la salida es justo tras el fragmento anterior: esperamos a que este haya fijado el suyo */
+        pthread_mutex_lock(&job->lock);
+        while (job->placed_chunks != chunk) {
+            pthread_cond_wait(&job->placed, &job->lock);
+        }
+        offset = job->next_output;
+        job->next_output += output_len;
+        job->placed_chunks++;
+        if (error && !job->error) job->error = error;
+        pthread_cond_broadcast(&job->placed);
+        pthread_mutex_unlock(&job->lock);
+
+        /* Con el desplazamiento fijado, la escritura no depende de nadie */
+        if (!error && (error = pwrite_all(job->output_fd, output, output_len, offset))) {
+            pthread_mutex_lock(&job->lock);
+            if (!job->error) job->error = error;
+            pthread_mutex_unlock(&job->lock);
+        }
+    }
+
+    free(output);
+
+    return NULL;
+}
+
+
+/**
+ * @brief   Transforma un archivo entero en otro con varios hilos.
+ *
+ * @param input_fd      Archivo de entrada (abierto para lectura).
+ * @param output_fd     Archivo de salida (abierto para escritura y vacío).
+ * @param op            Operación a aplicar.
+ * @param threads       Hilos que usar (al menos 1; no se usan más que fragmentos haya).
+ * @param chunk_size    Tamaño objetivo de cada fragmento (0 para LOCAL_TRANSFORM_CHUNK_SIZE).
+ * @param stats         Dónde guardar el resultado.
+ *
+ * @return  true si se transformó entero; false en caso de error (errno indica el motivo).
+ */
+bool local_transform_file(int input_fd, int output_fd, enum TransformOp op, unsigned threads, size_t chunk_size, LocalTransformStats *stats) {
+    struct LocalTransformJob job = {
+        .output_fd = output_fd,
+        .op = op,
+        .chunk_size = chunk_size ? chunk_size : LOCAL_TRANSFORM_CHUNK_SIZE
+    };
+    struct stat input_stat;
+    pthread_t *helpers;
+    unsigned started = 0;
+    void *input;
+
+    memset(stats, 0, sizeof(*stats));
+
+    if (fstat(input_fd, &input_stat)) return false;
+    if (!input_stat.st_size) return true;     /* mmap no admite longitud 0: no hay nada que transformar */
+
+    job.input_len = input_stat.st_size;
+    if ((input = mmap(NULL, job.input_len, PROT_READ, MAP_PRIVATE, input_fd, 0)) == MAP_FAILED) return false;
+    job.input = input;
+    posix_madvise(input, job.input_len, POSIX_MADV_SEQUENTIAL);
+
+    /* No tiene sentido arrancar más hilos que fragmentos */
+    if (threads > (job.input_len + job.chunk_size - 1) / job.chunk_size) threads = (job.input_len + job.chunk_size - 1) / job.chunk_size;
+    if (!threads) threads = 1;
+
+    pthread_mutex_init(&job.lock, NULL);
+    pthread_cond_init(&job.placed, NULL);
+
+    /* Este hilo también trabaja; si no se pueden crear todos los demás, se sigue con los que haya */
+    if ((helpers = malloc(threads * sizeof(pthread_t)))) {
+        while (started < threads - 1 && !pthread_create(&helpers[started], NULL, transform_chunks, &job)) started++;
+    }
+    transform_chunks(&job);
+    for (unsigned i = 0; i < started; i++) {
+        pthread_join(helpers[i], NULL);
+    }
+    free(helpers);
+
+    pthread_cond_destroy(&job.placed);
+    pthread_mutex_destroy(&job.lock);
+    munmap(input, job.input_len);
+
+    stats->input_bytes = job.input_len;
+    stats->output_bytes = job.next_output;
+    stats->chunks = job.next_chunk;
+    stats->threads = started + 1;
+
+    if (job.error) {
+        errno = job.error;
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,51 @@
+#ifndef LOCALTRANSFORM_H
+#define LOCALTRANSFORM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "transform.h"
+
+/*
+ * Transformación de un archivo en esta máquina, sin servidor, con varios hilos.
+ *
+ * El archivo de entrada se proyecta en memoria con mmap y se reparte en fragmentos de unos
+ * LOCAL_TRANSFORM_CHUNK_SIZE bytes que acaban en un salto de línea (o, si no hay ninguno, en un
+ * espacio o al menos en el límite de un carácter UTF-8), de forma que cada fragmento se transforma
+ * con transform_text, la misma función que usa servidorUDP, igual que si fuera solo.
+ *
+ * Cada hilo toma el siguiente fragmento, lo transforma en su propio buffer y, como el resultado puede
+ * ocupar más o menos bytes que el original, espera a que el fragmento anterior haya fijado dónde
+ * empieza en el archivo de salida: así cada uno sabe su desplazamiento en cuanto se conoce el tamaño
+ * de los anteriores, y los hilos escriben a la vez con pwrite, cada uno en su sitio.
+ */
+
+/* Tamaño objetivo de cada fragmento */
+#define LOCAL_TRANSFORM_CHUNK_SIZE (1U << 20)
+
+/**
+ * Resultado de la transformación de un archivo.
+ */
+typedef struct {
+    uint64_t input_bytes;   /* Bytes del archivo de entrada */
+    uint64_t output_bytes;  /* Bytes escritos en el archivo de salida */
+    uint64_t chunks;        /* Fragmentos en que se repartió */
+    unsigned threads;       /* Hilos que lo transformaron */
+} LocalTransformStats;
+
+/**
+ * @brief   Transforma un archivo entero en otro con varios hilos.
+ *
+ * @param input_fd      Archivo de entrada (abierto para lectura).
+ * @param output_fd     Archivo de salida (abierto para escritura y vacío).
+ * @param op            Operación a aplicar.
+ * @param threads       Hilos que usar (al menos 1; no se usan más que fragmentos haya).
+ * @param chunk_size    Tamaño objetivo de cada fragmento (0 para LOCAL_TRANSFORM_CHUNK_SIZE).
+ * @param stats         Dónde guardar el resultado.
+ *
+ * @return  true si se transformó entero; false en caso de error (errno indica el motivo).
+ */
+bool local_transform_file(int input_fd, int output_fd, enum TransformOp op, unsigned threads, size_t chunk_size, LocalTransformStats *stats);
+
+#endif /* LOCALTRANSFORM_H */
@@ -9,8 +9,8 @@
 
 #define BUFFER_LEN 128
 
-/* String global en memoria estática a devolver por la función identify */
-char identify_buffer[BUFFER_LEN];
+/* String en memoria estática a devolver por la función identify (una por hilo, para que los hilos puedan registrar a la vez) */
+static _Thread_local char identify_buffer[BUFFER_LEN];
 
 /**
  * @brief   Devuelve una string formateada para identificar cuándo se produce un evento.
@@ -22,14 +22,14 @@ char identify_buffer[BUFFER_LEN];
  */
 char* identify(void) {
     struct timeval current_time;
-    struct tm* timestamp;
+    struct tm timestamp;
     
     if (gettimeofday(&current_time, NULL) == -1)
         perror("No se pudo obtener el tiempo");
 
-    timestamp = localtime(&(current_time.tv_sec));
+    localtime_r(&(current_time.tv_sec), &timestamp);
 
-    strftime(identify_buffer, BUFFER_LEN, ANSI_COLOR_CYAN "[%a, %d %b %Y, %H:%M:%S.", timestamp);
+    strftime(identify_buffer, BUFFER_LEN, ANSI_COLOR_CYAN "[%a, %d %b %Y, %H:%M:%S.", &timestamp);
     sprintf(identify_buffer + strlen(identify_buffer), "%06lu; PID=%d]" ANSI_COLOR_RESET, current_time.tv_usec, getpid());   /* Añadimos al final los microsegundos y el PID */
     
     return identify_buffer;
@@ -0,0 +1,230 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <linux/if_packet.h>
+#include <linux/if_ether.h>
+#include <linux/filter.h>
+
+#include "packetring.h"
+
+
+#define UDP_HEADER_LEN 8
+#define BPF_ACCEPT_LEN 0x40000  /* Bytes de cada paquete que conserva el filtro (todos, en la práctica) */
+
+
+/**
+ * @brief   Asocia al socket del anillo el filtro que deja pasar solo los datagramas UDP al puerto dado.
+ *
+ * Con un socket AF_PACKET de tipo SOCK_DGRAM el filtro ve el paquete desde la cabecera IP. Se descartan
+ * las copias de salida (que en loopback duplicarían cada paquete) y los fragmentos que no son el primero.
+ *
+ * @param socket    Socket AF_PACKET.
+ * @param port      Puerto UDP de destino (en orden de host).
+ *
+ * @return  0 si se asoció; -1 en caso de error.
+ */
+static int attach_port_filter(int socket, uint16_t port) {
+    struct sock_filter code[] = {
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_PKTTYPE),    /* Tipo de paquete */
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, PACKET_OUTGOING, 8, 0),         /* Copia de salida: descartar */
+        BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 9),                              /* Protocolo IP */
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_UDP, 0, 6),
+        BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 6),                              /* Desplazamiento de fragmento */
+        BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, 0x1fff, 4, 0),
+        BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 0),                             /* X = longitud de la cabecera IP */
+        BPF_STMT(BPF_LD | BPF_H | BPF_IND, 2),                              /* Puerto UDP de destino */
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, port, 0, 1),
+        BPF_STMT(BPF_RET | BPF_K, BPF_ACCEPT_LEN),
+        BPF_STMT(BPF_RET | BPF_K, 0)
+    };
+    struct sock_fprog program = {.len = sizeof(code) / sizeof(code[0]), .filter = code};
+
+    return setsockopt(socket, SOL_SOCKET, SO_ATTACH_FILTER, &program, sizeof(program));
+}
+
+
+/**
+ * @brief   Abre un anillo de recepción en una interfaz, filtrado a un puerto UDP de destino.
+ *
+ * @param ring          Anillo a inicializar.
+ * @param interface     Nombre de la interfaz (p. ej. "lo" o "eth0").
+ * @param port          Puerto UDP de destino de los datagramas a capturar (en orden de host).
+ *
+ * @return  true si el anillo quedó listo; false si falló (errno indica el motivo; EPERM sin CAP_NET_RAW).
+ */
+bool packet_ring_open(PacketRing *ring, const char *interface, uint16_t port) {
+    int version = TPACKET_V3;
+    struct tpacket_req3 request;
+    struct sockaddr_ll address;
+    int saved_errno;
+
+    memset(ring, 0, sizeof(PacketRing));
+    ring->socket = -1;
+    ring->block_size = PACKET_RING_BLOCK_SIZE;
+    ring->block_count = PACKET_RING_BLOCKS;
+    ring->port = port;
+
+    memset(&address, 0, sizeof(address));
+    address.sll_family = AF_PACKET;
+    address.sll_protocol = htons(ETH_P_IP);
+    if (!(address.sll_ifindex = (int) if_nametoindex(interface))) {
+        return false;   /* errno = ENODEV */
+    }
+
+    /* Sin protocolo el socket no recibe nada hasta el bind, así que el filtro está puesto antes del primer paquete */
+    if ((ring->socket = socket(AF_PACKET, SOCK_DGRAM | SOCK_CLOEXEC, 0)) < 0) {
+        return false;
+    }
+
+    if (attach_port_filter(ring->socket, port) < 0
+        || setsockopt(ring->socket, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0) {
+        goto error;
+    }
+
+    memset(&request, 0, sizeof(request));
+    request.tp_block_size = ring->block_size;
+    request.tp_block_nr = ring->block_count;
+    request.tp_frame_size = PACKET_RING_FRAME_SIZE;
+    request.tp_frame_nr = ring->block_size / PACKET_RING_FRAME_SIZE * ring->block_count;
+    request.tp_retire_blk_tov = PACKET_RING_BLOCK_TIMEOUT_MS;
+    if (setsockopt(ring->socket, SOL_PACKET, PACKET_RX_RING, &request, sizeof(request)) < 0) {
+        goto error;
+    }
+
+    ring->map_len = (size_t) ring->block_size * ring->block_count;
+    ring->map = mmap(NULL, ring->map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->socket, 0);
+    if (ring->map == MAP_FAILED) {
+        ring->map = NULL;
+        goto error;
+    }
+
+    if (bind(ring->socket, (struct sockaddr *) &address, sizeof(address)) < 0) {
+        goto error;
+    }
+
+    return true;
+
+error:
+    saved_errno = errno;
+    packet_ring_close(ring);
+    errno = saved_errno;
+    return false;
+}
+
+
+/**
+ * @brief   Entrega los datagramas del siguiente bloque del anillo, esperando a que haya uno si hace falta.
+ *
+ * @param ring          Anillo abierto.
+ * @param timeout_ms    Tiempo máximo de espera si no hay ningún bloque listo (-1 sin límite).
+ * @param handler       Función a la que entregar cada datagrama.
+ * @param context       Contexto para handler.
+ *
+ * @return  Número de datagramas entregados (0 si venció la espera o la interrumpió una señal); -1 si hubo un error.
+ */
+int packet_ring_poll(PacketRing *ring, int timeout_ms, PacketRingHandler handler, void *context) {
+    struct tpacket_block_desc *block = (struct tpacket_block_desc *) (ring->map + (size_t) ring->current_block * ring->block_size);
+    struct pollfd pending = {.fd = ring->socket, .events = POLLIN | POLLERR};
+    const struct tpacket3_hdr *packet;
+    int delivered = 0;
+
+    /* El núcleo marca el bloque con TP_STATUS_USER cuando lo entrega; hasta entonces, esperamos en el socket */
+    if (!(__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER)) {
+        if (poll(&pending, 1, timeout_ms) < 0) {
+            return errno == EINTR ? 0 : -1;
+        }
+        if (!(__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER)) {
+            return 0;
+        }
+    }
+
+    packet = (const struct tpacket3_hdr *) ((uint8_t *) block + block->hdr.bh1.offset_to_first_pkt);
+    for (uint32_t i = 0; i < block->hdr.bh1.num_pkts; i++) {
+        const uint8_t *ip = (const uint8_t *) packet + packet->tp_net;
+        size_t ip_header_len = (ip[0] & 0x0f) * 4;
+        size_t udp_len, captured_len;
+
+        /* El filtro ya garantiza que es UDP al puerto pedido; solo falta comprobar que las cabeceras caben */
+        if (packet->tp_snaplen >= ip_header_len + UDP_HEADER_LEN) {
+            udp_len = (ip[ip_header_len + 4] << 8) | ip[ip_header_len + 5];
+            if (udp_len >= UDP_HEADER_LEN) {
+                captured_len = packet->tp_snaplen - ip_header_len - UDP_HEADER_LEN;
+                if (captured_len > udp_len - UDP_HEADER_LEN) captured_len = udp_len - UDP_HEADER_LEN;
+
+                handler(context, (const char *) ip + ip_header_len + UDP_HEADER_LEN, captured_len, udp_len - UDP_HEADER_LEN,
+                        (uint64_t) packet->tp_sec * 1000000000ULL + packet->tp_nsec);
+                delivered++;
+            }
+        }
+
+        packet = (const struct tpacket3_hdr *) ((const uint8_t *) packet + packet->tp_next_offset);
+    }
+
+    /* Devolvemos el bloque al núcleo y pasamos al siguiente */
+    __atomic_store_n(&block->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+    ring->current_block = (ring->current_block + 1) % ring->block_count;
+
+    return delivered;
+}
+
+
+/**
+ * @brief   Actualiza los contadores de paquetes y descartes del núcleo (kernel_packets y kernel_drops).
+ *
+ * @param ring  Anillo abierto.
+ *
+ * @return  true si se pudieron leer; false en caso contrario.
+ */
+bool packet_ring_update_stats(PacketRing *ring) {
+    struct tpacket_stats_v3 stats;
+    socklen_t stats_len = sizeof(stats);
+
+    /* El núcleo pone a cero sus contadores en cada lectura, así que los vamos acumulando */
+    if (getsockopt(ring->socket, SOL_PACKET, PACKET_STATISTICS, &stats, &stats_len) < 0) {
+        return false;
+    }
+
+    ring->kernel_packets += stats.tp_packets;
+    ring->kernel_drops += stats.tp_drops;
+
+    return true;
+}
+
+
+/**
+ * @brief   Cierra el anillo y libera su proyección.
+ *
+ * @param ring  Anillo a cerrar.
+ */
+void packet_ring_close(PacketRing *ring) {
+    if (ring->map) munmap(ring->map, ring->map_len);
+    if (ring->socket >= 0) close(ring->socket);
+
+    ring->map = NULL;
+    ring->socket = -1;
+}
+
+
+/**
+ * @brief   Hace que el socket de un host descarte todo lo que recibe.
+ *
+ * @param host  Host cuyo socket silenciar.
+ *
+ * @return  0 si se aplicó; -1 en caso de error.
+ */
+int discard_host_input(Host *host) {
+    struct sock_filter code[] = {
+        BPF_STMT(BPF_RET | BPF_K, 0)
+    };
+    struct sock_fprog program = {.len = 1, .filter = code};
+
+    return setsockopt(host->socket, SOL_SOCKET, SO_ATTACH_FILTER, &program, sizeof(program));
+}
@@ -0,0 +1,116 @@
+#ifndef PACKETRING_H
+#define PACKETRING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "host.h"
+
+/*
+ * Recepción de datagramas UDP mediante un anillo TPACKET_V3 compartido con el núcleo.
+ *
+ * Un socket AF_PACKET con PACKET_RX_RING deja cada paquete capturado directamente en una zona de
+ * memoria proyectada en el proceso, agrupado en bloques: el programa recorre cada bloque en su sitio
+ * (sin copiarlo ni hacer una llamada al sistema por paquete) y lo devuelve al núcleo al terminar.
+ * Un filtro BPF asociado al socket deja pasar solo los datagramas UDP dirigidos al puerto pedido,
+ * de forma que el resto del tráfico de la interfaz ni siquiera llega al anillo.
+ *
+ * Requiere CAP_NET_RAW. En la interfaz de loopback el núcleo ve cada paquete dos veces (al salir y
+ * al entrar); el filtro descarta la copia de salida para no contarlos dos veces.
+ */
+
+/* Tamaño de cada bloque del anillo (múltiplo del tamaño de página) */
+#define PACKET_RING_BLOCK_SIZE (1U << 18)
+
+/* Número de bloques del anillo */
+#define PACKET_RING_BLOCKS 64
+
+/* Tamaño de trama nominal: TPACKET_V3 empaqueta los paquetes sin huecos, pero el núcleo lo pide */
+#define PACKET_RING_FRAME_SIZE 2048
+
+/* Tiempo máximo que el núcleo retiene un bloque a medio llenar antes de entregarlo (ms) */
+#define PACKET_RING_BLOCK_TIMEOUT_MS 10
+
+/**
+ * Anillo de recepción TPACKET_V3.
+ */
+typedef struct {
+    int socket;                 /* Socket AF_PACKET */
+    uint8_t *map;               /* Bloques del anillo proyectados en memoria */
+    size_t map_len;             /* Tamaño de la proyección */
+    unsigned block_size;        /* Tamaño de cada bloque */
+    unsigned block_count;       /* Número de bloques */
+    unsigned current_block;     /* Siguiente bloque que se espera recibir del núcleo */
+    uint16_t port;              /* Puerto UDP de destino que deja pasar el filtro (en orden de host) */
+    uint64_t kernel_packets;    /* Paquetes que el núcleo pasó por el filtro (PACKET_STATISTICS) */
+    uint64_t kernel_drops;      /* Paquetes descartados por no haber bloques libres */
+} PacketRing;
+
+/**
+ * @brief   Función a la que se entrega cada datagrama leído del anillo.
+ *
+ * @param context       Contexto pasado a packet_ring_poll.
+ * @param payload       Carga útil UDP (apunta al interior del anillo: solo es válida durante la llamada).
+ * @param captured_len  Bytes de carga útil disponibles en payload.
+ * @param wire_len      Longitud real de la carga útil según la cabecera UDP.
+ * @param arrival_ns    Marca de tiempo de llegada del núcleo (CLOCK_REALTIME).
+ */
+typedef void (*PacketRingHandler)(void *context, const char *payload, size_t captured_len, size_t wire_len, uint64_t arrival_ns);
+
+/**
+ * @brief   Abre un anillo de recepción en una interfaz, filtrado a un puerto UDP de destino.
+ *
+ * @param ring          Anillo a inicializar.
+ * @param interface     Nombre de la interfaz (p. ej. "lo" o "eth0").
+ * @param port          Puerto UDP de destino de los datagramas a capturar (en orden de host).
+ *
+ * @return  true si el anillo quedó listo; false si falló (errno indica el motivo; EPERM sin CAP_NET_RAW).
+ */
+bool packet_ring_open(PacketRing *ring, const char *interface, uint16_t port);
+
+/**
+ * @brief   Entrega los datagramas del siguiente bloque del anillo, esperando a que haya uno si hace falta.
+ *
+ * Recorre el bloque en su sitio, llama a handler para cada datagrama UDP válido y devuelve el bloque
+ * al núcleo. Se procesa como mucho un bloque por llamada.
+ *
+ * @param ring          Anillo abierto.
+ * @param timeout_ms    Tiempo máximo de espera si no hay ningún bloque listo (-1 sin límite).
+ * @param handler       Función a la que entregar cada datagrama.
+ * @param context       Contexto para handler.
+ *
+ * @return  Número de datagramas entregados (0 si venció la espera o la interrumpió una señal); -1 si hubo un error.
+ */
+int packet_ring_poll(PacketRing *ring, int timeout_ms, PacketRingHandler handler, void *context);
+
+/**
+ * @brief   Actualiza los contadores de paquetes y descartes del núcleo (kernel_packets y kernel_drops).
+ *
+ * @param ring  Anillo abierto.
+ *
+ * @return  true si se pudieron leer; false en caso contrario.
+ */
+bool packet_ring_update_stats(PacketRing *ring);
+
+/**
+ * @brief   Cierra el anillo y libera su proyección.
+ *
+ * @param ring  Anillo a cerrar.
+ */
+void packet_ring_close(PacketRing *ring);
+
+/**
+ * @brief   Hace que el socket de un host descarte todo lo que recibe.
+ *
+ * El socket sigue ocupando el puerto, de forma que el núcleo no responde a los emisores con
+ * ICMP de puerto inalcanzable, pero los datagramas no se acumulan en su cola mientras el programa
+ * los lee del anillo.
+ *
+ * @param host  Host cuyo socket silenciar.
+ *
+ * @return  0 si se aplicó; -1 en caso de error.
+ */
+int discard_host_input(Host *host);
+
+#endif /* PACKETRING_H */
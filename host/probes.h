@@ -0,0 +1,103 @@
+#ifndef PROBES_H
+#define PROBES_H
+
+/*
+ * Puntos de traza estáticos (USDT) del proveedor "mayus".
+ *
+ * Cada punto deja en el código una sola instrucción nop y, en la sección .note.stapsdt del ejecutable,
+ * su dirección y dónde están sus argumentos. Mientras nadie lo traza no cuesta nada más; bpftrace o perf
+ * lo activan en caliente sustituyendo el nop por un punto de ruptura (ver los guiones de trazas/).
+ *
+ * Si el sistema tiene <sys/sdt.h> (systemtap-sdt-dev) se usa esa cabecera. Si no, en x86-64 se generan
+ * las mismas notas directamente; en otras arquitecturas los puntos no hacen nada. Con -DPROBES_DISABLED
+ * tampoco hacen nada en ningún caso.
+ *
+ * Los argumentos deben ser enteros (hasta 8 bytes): es lo único que las herramientas leen sin ambigüedad.
+ */
+
+/* Motivos de descarte de una petición (argumento de request_drop) */
+#define PROBE_DROP_RATE_LIMIT 1     /* Cliente por encima de su límite de peticiones */
+#define PROBE_DROP_TRUNCATED 2      /* Datagrama más grande que el buffer */
+#define PROBE_DROP_INVALID 3        /* Operación o trama no válida, o respuesta que no cabe */
+#define PROBE_DROP_CHECKSUM 4       /* CRC32C de la cabecera de integridad erróneo */
+
+/* Tipos de sesión (argumento de session_open y session_close) */
+#define PROBE_SESSION_SHM 1         /* Canal de memoria compartida */
+#define PROBE_SESSION_CONNECTION 2  /* Conexión SOCK_SEQPACKET */
+
+#if !defined(PROBES_DISABLED) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define PROBES_SYS_SDT
+#endif
+#endif
+
+#if defined(PROBES_DISABLED) || !(defined(PROBES_SYS_SDT) || (defined(__x86_64__) && defined(__GNUC__)))
+
+/* Sin trazas: los argumentos se descartan sin evaluarlos, pero cuentan como usados */
+#define PROBE0(name) do {} while (0)
+#define PROBE1(name, a1) do { (void) sizeof(a1); } while (0)
+#define PROBE2(name, a1, a2) do { (void) sizeof(a1); (void) sizeof(a2); } while (0)
+#define PROBE3(name, a1, a2, a3) do { (void) sizeof(a1); (void) sizeof(a2); (void) sizeof(a3); } while (0)
+#define PROBE4(name, a1, a2, a3, a4) do { (void) sizeof(a1); (void) sizeof(a2); (void) sizeof(a3); (void) sizeof(a4); } while (0)
+
+#elif defined(PROBES_SYS_SDT)
+
+#include <sys/sdt.h>
+
+#define PROBE0(name) DTRACE_PROBE(mayus, name)
+#define PROBE1(name, a1) DTRACE_PROBE1(mayus, name, a1)
+#define PROBE2(name, a1, a2) DTRACE_PROBE2(mayus, name, a1, a2)
+#define PROBE3(name, a1, a2, a3) DTRACE_PROBE3(mayus, name, a1, a2, a3)
+#define PROBE4(name, a1, a2, a3, a4) DTRACE_PROBE4(mayus, name, a1, a2, a3, a4)
+
+#elif defined(__x86_64__) && defined(__GNUC__)
+
+/*
+ * Nota stapsdt versión 3 (el formato de <sys/sdt.h>): dirección del nop, de .stapsdt.base (para corregir
+ * el desplazamiento con el que se cargue el ejecutable) y del semáforo (no usamos), seguidas del proveedor,
+ * el nombre y los argumentos. Cada argumento se describe como "tamaño@operando", con el tamaño negativo
+ * si el tipo tiene signo; el operando lo escribe el compilador donde tenga el valor en ese momento.
+ */
+#define PROBE_SIGNED(x) ((__typeof__((x) + 0)) -1 < (__typeof__((x) + 0)) 1)
+#define PROBE_OPERAND(n, x) [probe_size##n] "n" ((PROBE_SIGNED(x) ? 1 : -1) * (int) sizeof((x) + 0)), [probe_arg##n] "nor" ((x) + 0)
+#define PROBE_ARG(n) "%n[probe_size" #n "]@%[probe_arg" #n "]"
+
+#define PROBE_NOTE(name, args) \
+    "990:\tnop\n" \
+    "\t.pushsection .note.stapsdt,\"?\",\"note\"\n" \
+    "\t.balign 4\n" \
+    "\t.4byte 992f-991f, 994f-993f, 3\n" \
+    "991:\t.asciz \"stapsdt\"\n" \
+    "992:\t.balign 4\n" \
+    "993:\t.8byte 990b\n" \
+    "\t.8byte _.stapsdt.base\n" \
+    "\t.8byte 0\n" \
+    "\t.asciz \"mayus\"\n" \
+    "\t.asciz \"" #name "\"\n" \
+    "\t.asciz \"" args "\"\n" \
+    "994:\t.balign 4\n" \
+    "\t.popsection\n" \
+    "\t.ifndef _.stapsdt.base\n" \
+    "\t.pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n" \
+    "\t.weak _.stapsdt.base\n" \
+    "\t.hidden _.stapsdt.base\n" \
+    "_.stapsdt.base:\t.space 1\n" \
+    "\t.size _.stapsdt.base, 1\n" \
+    "\t.popsection\n" \
+    "\t.endif\n"
+
+#define PROBE0(name) __asm__ __volatile__ (PROBE_NOTE(name, ""))
+#define PROBE1(name, a1) \
+    __asm__ __volatile__ (PROBE_NOTE(name, PROBE_ARG(1)) :: PROBE_OPERAND(1, a1))
+#define PROBE2(name, a1, a2) \
+    __asm__ __volatile__ (PROBE_NOTE(name, PROBE_ARG(1) " " PROBE_ARG(2)) :: PROBE_OPERAND(1, a1), PROBE_OPERAND(2, a2))
+#define PROBE3(name, a1, a2, a3) \
+    __asm__ __volatile__ (PROBE_NOTE(name, PROBE_ARG(1) " " PROBE_ARG(2) " " PROBE_ARG(3)) \
+                          :: PROBE_OPERAND(1, a1), PROBE_OPERAND(2, a2), PROBE_OPERAND(3, a3))
+#define PROBE4(name, a1, a2, a3, a4) \
+    __asm__ __volatile__ (PROBE_NOTE(name, PROBE_ARG(1) " " PROBE_ARG(2) " " PROBE_ARG(3) " " PROBE_ARG(4)) \
+                          :: PROBE_OPERAND(1, a1), PROBE_OPERAND(2, a2), PROBE_OPERAND(3, a3), PROBE_OPERAND(4, a4))
+
+#endif
+
+#endif /* PROBES_H */
@@ -0,0 +1,326 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/un.h>
+#include <sys/random.h>
+
+#include "ratelimit.h"
+#include "host.h"
+
+
+#define TOKEN_UNIT 1000000000ULL    /* Milmillonésimas de ficha por ficha: fichas * ns * (peticiones / s) sin divisiones */
+#define MAX_RATE 1000000000ULL      /* Máximo ritmo y ráfaga admitidos, para que las cuentas no desborden */
+#define TABLE_MASK (RATE_LIMIT_TABLE_SIZE - 1)
+#define TABLE_MAX_LOAD (RATE_LIMIT_TABLE_SIZE / 4 * 3)
+#define TABLE_LOW_LOAD (RATE_LIMIT_TABLE_SIZE / 2)   /* Ocupación a la que se baja al hacer sitio */
+
+
+/**
+ * @brief   Resumen FNV-1a de 64 bits de unos bytes.
+ */
+static uint64_t fnv1a(const void *data, size_t len, uint64_t hash) {
+    const uint8_t *bytes = data;
+
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+
+/**
+ * @brief   Posición inicial de una clave en la tabla (con la semilla del limitador, para que no se puedan
+ *          elegir de antemano direcciones que caigan todas en la misma racha).
+ */
+static inline size_t home_slot(const RateLimiter *limiter, const RateLimitKey *key) {
+    uint64_t hash = fnv1a(key, sizeof(RateLimitKey), 0xcbf29ce484222325ULL ^ limiter->seed);
+
+    return (hash ^ (hash >> 32)) & TABLE_MASK;
+}
+
+
+/**
+ * @brief   Construye la clave de una dirección de origen.
+ */
+static void make_key(RateLimitKey *key, const struct sockaddr *address, socklen_t address_len) {
+    memset(key, 0, sizeof(RateLimitKey));
+    key->family = address_len >= sizeof(sa_family_t) ? address->sa_family : AF_UNSPEC;
+
+    switch (key->family) {
+        case AF_INET: {
+            const struct sockaddr_in *inet = (const struct sockaddr_in *) address;
+
+            key->port = inet->sin_port;
+            memcpy(key->address, &inet->sin_addr, sizeof(inet->sin_addr));
+            break;
+        }
+
+        case AF_INET6: {
+            const struct sockaddr_in6 *inet6 = (const struct sockaddr_in6 *) address;
+
+            key->port = inet6->sin6_port;
+            memcpy(key->address, &inet6->sin6_addr, sizeof(inet6->sin6_addr));
+            break;
+        }
+
+        case AF_UNIX: {
+            /* Las rutas pueden ocupar más de 100 bytes: guardamos solo su resumen (los clientes sin nombre comparten cubo) */
+            uint64_t digest = 0;
+
+            if (address_len > offsetof(struct sockaddr_un, sun_path)) {
+                digest = fnv1a(((const struct sockaddr_un *) address)->sun_path, address_len - offsetof(struct sockaddr_un, sun_path), 0xcbf29ce484222325ULL);
+            }
+            memcpy(key->address, &digest, sizeof(digest));
+            break;
+        }
+    }
+}
+
+
+/**
+ * @brief   Vacía una entrada de la tabla, moviendo hacia atrás las siguientes de su racha para no dejar huecos en el sondeo.
+ */
+static void remove_entry(RateLimiter *limiter, size_t hole) {
+    RateLimitEntry *entries = limiter->entries;
+    size_t next = hole, home;
+
+    for (;;) {
+        next = (next + 1) & TABLE_MASK;
+        if (!entries[next].used) break;
+
+        /* La entrada puede ocupar el hueco si su posición inicial no está entre el hueco (excluido) y ella (incluida) */
+        home = home_slot(limiter, &entries[next].key);
+        if (hole <= next ? (home <= hole || home > next) : (home <= hole && home > next)) {
+            entries[hole] = entries[next];
+            hole = next;
+        }
+    }
+
+    entries[hole].used = 0;
+    limiter->count--;
+}
+
+
+/**
+ * @brief   Retira un cliente de la tabla, conservando en el total sus descartes.
+ */
+static void evict_entry(RateLimiter *limiter, size_t slot) {
+    limiter->evicted++;
+    limiter->evicted_dropped += limiter->entries[slot].dropped;
+    remove_entry(limiter, slot);
+}
+
+
+/**
+ * @brief   Compara dos instantes para qsort.
+ */
+static int compare_ns(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+
+    return (x > y) - (x < y);
+}
+
+
+/**
+ * @brief   Hace sitio en la tabla: retira a los clientes inactivos y, si con eso no baja a la mitad, a los que
+ *          llevan más tiempo sin enviar nada hasta bajar a ella. Así cada llamada deja sitio para muchos clientes
+ *          nuevos, y el coste de recorrer la tabla se reparte entre todos ellos.
+ */
+static void make_room(RateLimiter *limiter, uint64_t now_ns) {
+    RateLimitEntry *entries = limiter->entries;
+    uint64_t cutoff_ns = now_ns > limiter->idle_ns ? now_ns - limiter->idle_ns : 0;
+    size_t len = 0;
+
+    /* Instante más reciente que se retira: el de los inactivos o, si quedarían demasiados, el del último de los más antiguos que sobran */
+    for (size_t i = 0; i < RATE_LIMIT_TABLE_SIZE; i++) {
+        if (entries[i].used) limiter->ages[len++] = entries[i].last_ns;
+    }
+    qsort(limiter->ages, len, sizeof(uint64_t), compare_ns);
+    if (len > TABLE_LOW_LOAD && limiter->ages[len - TABLE_LOW_LOAD - 1] > cutoff_ns) {
+        cutoff_ns = limiter->ages[len - TABLE_LOW_LOAD - 1];
+    }
+
+    for (size_t i = 0; i < RATE_LIMIT_TABLE_SIZE; i++) {
+        /* Al retirar una entrada otra puede ocupar su sitio: volvemos a mirar la misma posición */
+        while (entries[i].used && entries[i].last_ns <= cutoff_ns) {
+            evict_entry(limiter, i);
+        }
+    }
+}
+
+
+/**
+ * @brief   Busca el cubo de un cliente, creándolo (lleno) si no estaba.
+ */
+static RateLimitEntry *find_entry(RateLimiter *limiter, const RateLimitKey *key, uint64_t now_ns) {
+    RateLimitEntry *entries = limiter->entries;
+    size_t slot = home_slot(limiter, key);
+
+    while (entries[slot].used) {
+        if (!memcmp(&entries[slot].key, key, sizeof(RateLimitKey))) return &entries[slot];
+        slot = (slot + 1) & TABLE_MASK;
+    }
+
+    /* Cliente nuevo: si la tabla está demasiado llena, hacemos sitio y buscamos otra vez el hueco (las entradas se movieron) */
+    if (limiter->count >= TABLE_MAX_LOAD) {
+        make_room(limiter, now_ns);
+        for (slot = home_slot(limiter, key); entries[slot].used; slot = (slot + 1) & TABLE_MASK);
+    }
+
+    entries[slot] = (RateLimitEntry) {.key = *key, .used = 1, .tokens = limiter->burst * TOKEN_UNIT, .last_ns = now_ns};
+    limiter->count++;
+
+    return &entries[slot];
+}
+
+
+/**
+ * @brief   Inicializa un limitador.
+ *
+ * @param limiter   Limitador a inicializar.
+ * @param rate      Peticiones por segundo que se admiten de cada cliente (mayor que 0).
+ * @param burst     Peticiones seguidas que se admiten de un cliente con el cubo lleno (mayor que 0).
+ *
+ * @return  true si se inicializó; false si no hubo memoria para la tabla.
+ */
+bool rate_limiter_init(RateLimiter *limiter, uint64_t rate, uint64_t burst) {
+    memset(limiter, 0, sizeof(RateLimiter));
+
+    limiter->rate = rate < 1 ? 1 : rate > MAX_RATE ? MAX_RATE : rate;
+    limiter->burst = burst < 1 ? 1 : burst > MAX_RATE ? MAX_RATE : burst;
+    limiter->fill_ns = limiter->burst * TOKEN_UNIT / limiter->rate;
+    limiter->idle_ns = limiter->fill_ns > RATE_LIMIT_IDLE_NS ? limiter->fill_ns : RATE_LIMIT_IDLE_NS;
+    if (getrandom(&limiter->seed, sizeof(limiter->seed), GRND_NONBLOCK) != sizeof(limiter->seed)) {
+        limiter->seed = ((uint64_t) getpid() << 32) ^ (uint64_t) time(NULL);
+    }
+
+    limiter->entries = calloc(RATE_LIMIT_TABLE_SIZE, sizeof(RateLimitEntry));
+    limiter->ages = malloc(RATE_LIMIT_TABLE_SIZE * sizeof(uint64_t));
+    if (!limiter->entries || !limiter->ages) {
+        rate_limiter_free(limiter);
+        return false;
+    }
+
+    return true;
+}
+
+
+/**
+ * @brief   Decide si se admite una petición de un cliente, gastando una de sus fichas.
+ *
+ * @param limiter       Limitador.
+ * @param address       Dirección de origen de la petición.
+ * @param address_len   Longitud de address.
+ * @param now_ns        Instante actual (CLOCK_MONOTONIC).
+ *
+ * @return  true si se admite; false si el cliente superó su límite y la petición debe descartarse.
+ */
+bool rate_limiter_admit(RateLimiter *limiter, const struct sockaddr *address, socklen_t address_len, uint64_t now_ns) {
+    RateLimitKey key;
+    RateLimitEntry *entry;
+    uint64_t elapsed_ns;
+
+    make_key(&key, address, address_len);
+    entry = find_entry(limiter, &key, now_ns);
+
+    /* Rellenamos el cubo con lo que corresponde al tiempo transcurrido; más allá de fill_ns ya estaría lleno */
+    elapsed_ns = now_ns > entry->last_ns ? now_ns - entry->last_ns : 0;
+    if (elapsed_ns > limiter->fill_ns) elapsed_ns = limiter->fill_ns;
+    entry->tokens += elapsed_ns * limiter->rate;
+    if (entry->tokens > limiter->burst * TOKEN_UNIT) entry->tokens = limiter->burst * TOKEN_UNIT;
+    entry->last_ns = now_ns;
+
+    if (entry->tokens < TOKEN_UNIT) {
+        entry->dropped++;
+        limiter->dropped++;
+        return false;
+    }
+
+    entry->tokens -= TOKEN_UNIT;
+    entry->passed++;
+    limiter->passed++;
+
+    return true;
+}
+
+
+/**
+ * @brief   Obtiene los clientes con más peticiones descartadas, de más a menos.
+ *
+ * @param limiter   Limitador.
+ * @param top       Donde guardar punteros a sus entradas.
+ * @param max       Número máximo de entradas a devolver.
+ *
+ * @return  Número de entradas guardadas en top (solo clientes con algún descarte).
+ */
+size_t rate_limiter_top_droppers(const RateLimiter *limiter, const RateLimitEntry **top, size_t max) {
+    size_t found = 0, pos;
+
+    for (size_t i = 0; i < RATE_LIMIT_TABLE_SIZE; i++) {
+        const RateLimitEntry *entry = &limiter->entries[i];
+
+        if (!entry->used || !entry->dropped) continue;
+
+        /* Inserción ordenada en la lista (es corta) */
+        for (pos = found; pos > 0 && top[pos - 1]->dropped < entry->dropped; pos--) {
+            if (pos < max) top[pos] = top[pos - 1];
+        }
+        if (pos < max) {
+            top[pos] = entry;
+            if (found < max) found++;
+        }
+    }
+
+    return found;
+}
+
+
+/**
+ * @brief   Describe la clave de un cliente como texto ("ip:puerto", "[ipv6]:puerto" o "socket local #resumen").
+ *
+ * @param key       Clave.
+ * @param buffer    Buffer de salida.
+ * @param size      Tamaño de buffer (basta con HOST_ADDRESS_STRLEN).
+ *
+ * @return  buffer.
+ */
+char *rate_limit_key_describe(const RateLimitKey *key, char *buffer, size_t size) {
+    uint64_t digest;
+
+    if (key->family == AF_INET) {
+        struct sockaddr_in inet = {.sin_family = AF_INET, .sin_port = key->port};
+
+        memcpy(&inet.sin_addr, key->address, sizeof(inet.sin_addr));
+        return describe_address((struct sockaddr *) &inet, sizeof(inet), buffer, size);
+    }
+
+    if (key->family == AF_INET6) {
+        struct sockaddr_in6 inet6 = {.sin6_family = AF_INET6, .sin6_port = key->port};
+
+        memcpy(&inet6.sin6_addr, key->address, sizeof(inet6.sin6_addr));
+        return describe_address((struct sockaddr *) &inet6, sizeof(inet6), buffer, size);
+    }
+
+    memcpy(&digest, key->address, sizeof(digest));
+    snprintf(buffer, size, "socket local #%016llx", (unsigned long long) digest);
+
+    return buffer;
+}
+
+
+/**
+ * @brief   Libera la tabla de un limitador.
+ *
+ * @param limiter   Limitador.
+ */
+void rate_limiter_free(RateLimiter *limiter) {
+    free(limiter->entries);
+    free(limiter->ages);
+    limiter->entries = NULL;
+    limiter->ages = NULL;
+}
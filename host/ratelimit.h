@@ -0,0 +1,122 @@
+#ifndef RATELIMIT_H
+#define RATELIMIT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/socket.h>
+
+/*
+ * Control de admisión por cliente con cubos de fichas (token buckets).
+ *
+ * Cada dirección de origen (IP y puerto, o socket local) tiene un cubo con capacidad para `burst`
+ * peticiones que se rellena a `rate` peticiones por segundo; cada petición gasta una ficha, y las
+ * que llegan con el cubo vacío se descartan. Así un cliente que inunda el servidor solo consume
+ * su parte, y los demás siguen siendo atendidos con la latencia de siempre.
+ *
+ * Los cubos viven en una tabla hash compacta de direccionamiento abierto (sondeo lineal) de
+ * RATE_LIMIT_TABLE_SIZE entradas, con una semilla aleatoria en el resumen de las claves. Cuando se
+ * llena más de 3/4 se retiran de una vez los clientes inactivos (los que llevan sin enviar nada al
+ * menos lo que tarda su cubo en llenarse, de forma que al olvidarlos no se les regala ninguna ficha)
+ * y, si aun así sigue más llena que la mitad, los que llevan más tiempo sin enviar nada hasta bajar
+ * a ella. La tabla no es segura entre hilos: la usa solo el hilo que lee el socket.
+ */
+
+/* Entradas de la tabla (potencia de 2) */
+#define RATE_LIMIT_TABLE_SIZE 4096
+
+/* Tiempo mínimo de inactividad para retirar a un cliente de la tabla (ns) */
+#define RATE_LIMIT_IDLE_NS 10000000000ULL
+
+/**
+ * Clave de un cliente: su dirección normalizada (AF_INET o AF_INET6), o un resumen de la ruta de su socket (AF_UNIX).
+ */
+typedef struct {
+    uint16_t family;        /* Familia de la dirección */
+    uint16_t port;          /* Puerto (en orden de red) */
+    uint8_t address[16];    /* IPv4 (4 bytes), IPv6 (16) o resumen de la ruta del socket local (8) */
+} RateLimitKey;
+
+/**
+ * Cubo de un cliente.
+ */
+typedef struct {
+    RateLimitKey key;
+    uint32_t used;          /* La entrada está ocupada */
+    uint64_t tokens;        /* Fichas disponibles, en milmillonésimas de ficha */
+    uint64_t last_ns;       /* Instante de la última petición (CLOCK_MONOTONIC) */
+    uint64_t passed;        /* Peticiones admitidas */
+    uint64_t dropped;       /* Peticiones descartadas */
+} RateLimitEntry;
+
+/**
+ * Limitador de peticiones por cliente.
+ */
+typedef struct {
+    uint64_t rate;              /* Peticiones por segundo de cada cliente */
+    uint64_t burst;             /* Capacidad del cubo (ráfaga máxima) */
+    uint64_t fill_ns;           /* Tiempo que tarda un cubo vacío en llenarse */
+    uint64_t idle_ns;           /* Inactividad tras la que un cliente puede retirarse de la tabla */
+    uint64_t seed;              /* Semilla del resumen de las claves */
+    RateLimitEntry *entries;    /* Tabla de RATE_LIMIT_TABLE_SIZE entradas */
+    uint64_t *ages;             /* Espacio para ordenar los instantes de la tabla al hacer sitio */
+    unsigned count;             /* Entradas ocupadas */
+    uint64_t passed;            /* Peticiones admitidas en total */
+    uint64_t dropped;           /* Peticiones descartadas en total */
+    uint64_t evicted;           /* Clientes retirados de la tabla */
+    uint64_t evicted_dropped;   /* Peticiones descartadas de los clientes ya retirados */
+} RateLimiter;
+
+/**
+ * @brief   Inicializa un limitador.
+ *
+ * @param limiter   Limitador a inicializar.
+ * @param rate      Peticiones por segundo que se admiten de cada cliente (mayor que 0).
+ * @param burst     Peticiones seguidas que se admiten de un cliente con el cubo lleno (mayor que 0).
+ *
+ * @return  true si se inicializó; false si no hubo memoria para la tabla.
+ */
+bool rate_limiter_init(RateLimiter *limiter, uint64_t rate, uint64_t burst);
+
+/**
+ * @brief   Decide si se admite una petición de un cliente, gastando una de sus fichas.
+ *
+ * @param limiter       Limitador.
+ * @param address       Dirección de origen de la petición.
+ * @param address_len   Longitud de address.
+ * @param now_ns        Instante actual (CLOCK_MONOTONIC).
+ *
+ * @return  true si se admite; false si el cliente superó su límite y la petición debe descartarse.
+ */
+bool rate_limiter_admit(RateLimiter *limiter, const struct sockaddr *address, socklen_t address_len, uint64_t now_ns);
+
+/**
+ * @brief   Obtiene los clientes con más peticiones descartadas, de más a menos.
+ *
+ * @param limiter   Limitador.
+ * @param top       Donde guardar punteros a sus entradas.
+ * @param max       Número máximo de entradas a devolver.
+ *
+ * @return  Número de entradas guardadas en top (solo clientes con algún descarte).
+ */
+size_t rate_limiter_top_droppers(const RateLimiter *limiter, const RateLimitEntry **top, size_t max);
+
+/**
+ * @brief   Describe la clave de un cliente como texto ("ip:puerto", "[ipv6]:puerto" o "socket local #resumen").
+ *
+ * @param key       Clave.
+ * @param buffer    Buffer de salida.
+ * @param size      Tamaño de buffer (basta con HOST_ADDRESS_STRLEN).
+ *
+ * @return  buffer.
+ */
+char *rate_limit_key_describe(const RateLimitKey *key, char *buffer, size_t size);
+
+/**
+ * @brief   Libera la tabla de un limitador.
+ *
+ * @param limiter   Limitador.
+ */
+void rate_limiter_free(RateLimiter *limiter);
+
+#endif /* RATELIMIT_H */
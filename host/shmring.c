@@ -0,0 +1,497 @@
+#define _GNU_SOURCE     /* Para syscall */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/random.h>
+#include <linux/futex.h>
+
+#include "shmring.h"
+
+
+#define SHM_MAGIC 0x4d594853    /* "SHYM" */
+#define SHM_VERSION 2
+#define SHM_NAME_PREFIX "/mayus-"
+#define SHM_ALIGN 64            /* Tamaño de línea de caché: separa los campos de productor y consumidor */
+
+#define SHM_CLOSED_CREATOR 1U
+#define SHM_CLOSED_ATTACHER 2U
+
+/**
+ * Cabecera del segmento compartido. Le siguen las dos colas: primero la que va del creador al que
+ * se une y después la del sentido contrario.
+ */
+struct ShmSegment {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t nonce;
+    uint32_t ring_capacity;
+    atomic_uint closed;         /* Extremos que cerraron el canal (SHM_CLOSED_*) */
+    atomic_uint attached;       /* Vale 1 en cuanto alguien se une al canal: solo se admite uno */
+};
+
+/**
+ * Cola circular de un solo productor y un solo consumidor. Le siguen los datos (ring_capacity bytes).
+ * head y tail cuentan bytes escritos y leídos (módulo 2^32); la cola tiene head - tail bytes ocupados.
+ */
+struct ShmRing {
+    _Alignas(SHM_ALIGN) atomic_uint head;       /* Solo lo escribe el productor */
+    _Alignas(SHM_ALIGN) atomic_uint tail;       /* Solo lo escribe el consumidor */
+    _Alignas(SHM_ALIGN) atomic_uint data_seq;   /* Futex: el productor lo incrementa al publicar un mensaje */
+    atomic_uint space_seq;                      /* Futex: el consumidor lo incrementa al liberar espacio */
+    atomic_uint consumer_waiting;               /* El consumidor está (o va a estar) dormido en data_seq */
+    atomic_uint producer_waiting;               /* El productor está (o va a estar) dormido en space_seq */
+};
+
+
+/**
+ * @brief   Redondea hacia arriba a múltiplo de SHM_ALIGN.
+ */
+static inline size_t align_up(size_t n) {
+    return (n + SHM_ALIGN - 1) & ~(size_t) (SHM_ALIGN - 1);
+}
+
+
+/**
+ * @brief   Tamaño que ocupa en el segmento una cola de la capacidad dada.
+ */
+static inline size_t ring_footprint(uint32_t capacity) {
+    return align_up(sizeof(struct ShmRing) + capacity);
+}
+
+
+/**
+ * @brief   Tamaño total del segmento para colas de la capacidad dada.
+ */
+static inline size_t segment_size(uint32_t capacity) {
+    return align_up(sizeof(struct ShmSegment)) + 2 * ring_footprint(capacity);
+}
+
+
+/**
+ * @brief   Datos de una cola (justo detrás de su cabecera).
+ */
+static inline unsigned char *ring_data(struct ShmRing *ring) {
+    return (unsigned char *) (ring + 1);
+}
+
+
+/**
+ * @brief   Asigna las colas de envío y recepción de un extremo según su papel.
+ */
+static void bind_rings(ShmChannel *channel) {
+    unsigned char *first = (unsigned char *) channel->segment + align_up(sizeof(struct ShmSegment));
+    struct ShmRing *to_attacher = (struct ShmRing *) first;
+    struct ShmRing *to_creator = (struct ShmRing *) (first + ring_footprint(channel->capacity));
+
+    channel->tx = channel->creator ? to_attacher : to_creator;
+    channel->rx = channel->creator ? to_creator : to_attacher;
+}
+
+
+/**
+ * @brief   Duerme en un futex compartido mientras valga expected, como mucho timeout_ms.
+ */
+static void futex_wait(atomic_uint *word, unsigned expected, int timeout_ms) {
+    struct timespec timeout = {.tv_sec = timeout_ms / 1000, .tv_nsec = (timeout_ms % 1000) * 1000000L};
+
+    /* Sin FUTEX_PRIVATE_FLAG: el futex está en memoria compartida entre procesos */
+    syscall(SYS_futex, (uint32_t *) word, FUTEX_WAIT, expected, timeout_ms < 0 ? NULL : &timeout, NULL, 0);
+}
+
+
+/**
+ * @brief   Despierta a quien duerma en un futex compartido.
+ */
+static void futex_wake(atomic_uint *word) {
+    syscall(SYS_futex, (uint32_t *) word, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+
+/**
+ * @brief   Milisegundos que quedan hasta un instante de CLOCK_MONOTONIC (-1 si no hay plazo).
+ */
+static int remaining_ms(const struct timespec *deadline, bool has_deadline) {
+    struct timespec now;
+    long long ms;
+
+    if (!has_deadline) {
+        return -1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    ms = (deadline->tv_sec - now.tv_sec) * 1000LL + (deadline->tv_nsec - now.tv_nsec) / 1000000;
+
+    return ms > 0 ? (int) ms : 0;
+}
+
+
+/**
+ * @brief   Indica si el otro extremo cerró el canal.
+ */
+static bool peer_closed(const ShmChannel *channel) {
+    return atomic_load(&channel->segment->closed) & (channel->creator ? SHM_CLOSED_ATTACHER : SHM_CLOSED_CREATOR);
+}
+
+
+/**
+ * @brief   Copia datos a la cola a partir de una posición, dando la vuelta al final si hace falta.
+ */
+static void ring_write(struct ShmRing *ring, uint32_t capacity, uint32_t position, const void *src, size_t len) {
+    uint32_t offset = position & (capacity - 1);
+    size_t first = len < capacity - offset ? len : capacity - offset;
+
+    memcpy(ring_data(ring) + offset, src, first);
+    memcpy(ring_data(ring), (const unsigned char *) src + first, len - first);
+}
+
+
+/**
+ * @brief   Copia datos de la cola a partir de una posición, dando la vuelta al final si hace falta.
+ */
+static void ring_read(struct ShmRing *ring, uint32_t capacity, uint32_t position, void *dst, size_t len) {
+    uint32_t offset = position & (capacity - 1);
+    size_t first = len < capacity - offset ? len : capacity - offset;
+
+    memcpy(dst, ring_data(ring) + offset, first);
+    memcpy((unsigned char *) dst + first, ring_data(ring), len - first);
+}
+
+
+/**
+ * @brief   Crea un canal de memoria compartida nuevo.
+ *
+ * @param channel       Extremo a inicializar.
+ * @param ring_capacity Capacidad de cada cola en bytes (se redondea a potencia de 2).
+ *
+ * @return  true si se creó el canal; false si falló (errno indica el motivo).
+ */
+bool shm_channel_create(ShmChannel *channel, size_t ring_capacity) {
+    uint32_t capacity = SHM_ALIGN;
+    int fd;
+
+    while (capacity < ring_capacity && capacity < (1U << 30)) {
+        capacity <<= 1;
+    }
+
+    memset(channel, 0, sizeof(ShmChannel));
+    channel->creator = true;
+    if (getrandom(&channel->nonce, sizeof(channel->nonce), 0) != sizeof(channel->nonce)) {
+        channel->nonce = ((uint64_t) getpid() << 32) ^ (uint64_t) time(NULL);
+    }
+    snprintf(channel->name, sizeof(channel->name), SHM_NAME_PREFIX "%d-%016" PRIx64, getpid(), channel->nonce);
+
+    if ((fd = shm_open(channel->name, O_CREAT | O_EXCL | O_RDWR, 0600)) < 0) {
+        return false;
+    }
+
+    channel->mapping_len = segment_size(capacity);
+    if (ftruncate(fd, channel->mapping_len) < 0
+        || (channel->segment = mmap(NULL, channel->mapping_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        int saved_errno = errno;
+
+        close(fd);
+        shm_unlink(channel->name);
+        errno = saved_errno;
+        return false;
+    }
+    close(fd);
+    channel->linked = true;
+
+    /* ftruncate deja el segmento a cero, así que las colas ya están vacías */
+    channel->segment->version = SHM_VERSION;
+    channel->segment->nonce = channel->nonce;
+    channel->segment->ring_capacity = capacity;
+    atomic_store(&channel->segment->closed, 0);
+    atomic_store(&channel->segment->attached, 0);
+    atomic_thread_fence(memory_order_release);
+    channel->segment->magic = SHM_MAGIC;
+
+    channel->capacity = capacity;
+    bind_rings(channel);
+
+    return true;
+}
+
+
+/**
+ * @brief   Se une a un canal creado por otro proceso a partir de su token de negociación.
+ *
+ * @param channel   Extremo a inicializar.
+ * @param token     Token recibido ("SHM=<nombre>:<nonce>").
+ *
+ * @return  true si se unió al canal; false si el token no es válido o el segmento no existe.
+ */
+bool shm_channel_attach(ShmChannel *channel, const char *token) {
+    const char *name = token + strlen(SHM_TOKEN_PREFIX);
+    const char *separator;
+    struct stat info;
+    char *end;
+    int fd;
+
+    memset(channel, 0, sizeof(ShmChannel));
+
+    /* Solo se abren segmentos con nuestro prefijo y sin más barras en el nombre */
+    if (strncmp(token, SHM_TOKEN_PREFIX, strlen(SHM_TOKEN_PREFIX)) || strncmp(name, SHM_NAME_PREFIX, strlen(SHM_NAME_PREFIX))
+        || !(separator = strchr(name, ':')) || (size_t) (separator - name) >= sizeof(channel->name)
+        || memchr(name + 1, '/', separator - name - 1)) {
+        errno = EINVAL;
+        return false;
+    }
+
+    memcpy(channel->name, name, separator - name);
+    errno = 0;
+    channel->nonce = strtoull(separator + 1, &end, 16);
+    if (errno || end == separator + 1 || *end) {
+        errno = EINVAL;
+        return false;
+    }
+
+    if ((fd = shm_open(channel->name, O_RDWR, 0)) < 0) {
+        return false;
+    }
+
+    if (fstat(fd, &info) < 0 || info.st_uid != geteuid() || (size_t) info.st_size < align_up(sizeof(struct ShmSegment))) {
+        close(fd);
+        errno = EACCES;
+        return false;
+    }
+
+    channel->mapping_len = info.st_size;
+    channel->segment = mmap(NULL, channel->mapping_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (channel->segment == MAP_FAILED) {
+        channel->segment = NULL;
+        return false;
+    }
+
+    if (channel->segment->magic != SHM_MAGIC || channel->segment->version != SHM_VERSION || channel->segment->nonce != channel->nonce
+        || channel->segment->ring_capacity < SHM_ALIGN || (channel->segment->ring_capacity & (channel->segment->ring_capacity - 1))
+        || channel->segment->ring_capacity > (1U << 30) || segment_size(channel->segment->ring_capacity) != channel->mapping_len) {
+        munmap(channel->segment, channel->mapping_len);
+        channel->segment = NULL;
+        errno = EPROTO;
+        return false;
+    }
+
+    /* Las colas son de un solo consumidor: si el token llega dos veces (una petición reenviada), la segunda se rechaza */
+    if (atomic_exchange(&channel->segment->attached, 1)) {
+        munmap(channel->segment, channel->mapping_len);
+        channel->segment = NULL;
+        errno = EBUSY;
+        return false;
+    }
+
+    channel->creator = false;
+    channel->capacity = channel->segment->ring_capacity;
+    bind_rings(channel);
+
+    return true;
+}
+
+
+/**
+ * @brief   Escribe el token con el que se anuncia un canal al otro extremo.
+ *
+ * @param channel   Canal a anunciar.
+ * @param token     Buffer de al menos SHM_TOKEN_MAX bytes.
+ */
+void shm_channel_token(const ShmChannel *channel, char *token) {
+    snprintf(token, SHM_TOKEN_MAX, SHM_TOKEN_PREFIX "%s:%" PRIx64, channel->name, channel->nonce);
+}
+
+
+/**
+ * @brief   Borra el nombre del segmento, de forma que desaparezca al cerrarse ambos extremos.
+ *
+ * @param channel   Canal cuyo nombre borrar.
+ */
+void shm_channel_unlink(ShmChannel *channel) {
+    if (channel->creator && channel->linked) {
+        shm_unlink(channel->name);
+        channel->linked = false;
+    }
+}
+
+
+/**
+ * @brief   Cierra un extremo del canal.
+ *
+ * @param channel   Extremo a cerrar.
+ */
+void shm_channel_close(ShmChannel *channel) {
+    if (!channel->segment) {
+        return;
+    }
+
+    atomic_fetch_or(&channel->segment->closed, channel->creator ? SHM_CLOSED_CREATOR : SHM_CLOSED_ATTACHER);
+
+    /* Despertamos al otro extremo esté esperando datos o espacio */
+    atomic_fetch_add(&channel->tx->data_seq, 1);
+    futex_wake(&channel->tx->data_seq);
+    atomic_fetch_add(&channel->rx->space_seq, 1);
+    futex_wake(&channel->rx->space_seq);
+
+    shm_channel_unlink(channel);
+    munmap(channel->segment, channel->mapping_len);
+    channel->segment = NULL;
+}
+
+
+/**
+ * @brief   Envía un mensaje por el canal.
+ *
+ * @param channel       Extremo por el que enviar.
+ * @param buffer        Mensaje.
+ * @param len           Longitud del mensaje.
+ * @param timeout_ms    Tiempo máximo de espera si la cola está llena (-1 para esperar indefinidamente).
+ *
+ * @return  0 si se envió; -1 si falló (errno a ETIMEDOUT, EPIPE o EMSGSIZE).
+ */
+int shm_send(ShmChannel *channel, const void *buffer, size_t len, int timeout_ms) {
+    struct ShmRing *ring = channel->tx;
+    uint32_t capacity = channel->capacity;
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t record_len = (uint32_t) len;
+    struct timespec deadline;
+    unsigned seq;
+
+    if (len > capacity - sizeof(record_len)) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+
+    if (timeout_ms >= 0) {
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
+
+    /* Esperamos a que haya espacio para la longitud y el mensaje */
+    while (capacity - (head - atomic_load(&ring->tail)) < sizeof(record_len) + len) {
+        if (peer_closed(channel)) {
+            errno = EPIPE;
+            return -1;
+        }
+        if (timeout_ms >= 0 && !remaining_ms(&deadline, true)) {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+
+        seq = atomic_load(&ring->space_seq);
+        atomic_store(&ring->producer_waiting, 1);
+        if (capacity - (head - atomic_load(&ring->tail)) < sizeof(record_len) + len && !peer_closed(channel)) {
+            futex_wait(&ring->space_seq, seq, remaining_ms(&deadline, timeout_ms >= 0));
+        }
+        atomic_store(&ring->producer_waiting, 0);
+    }
+
+    if (peer_closed(channel)) {
+        errno = EPIPE;
+        return -1;
+    }
+
+    ring_write(ring, capacity, head, &record_len, sizeof(record_len));
+    ring_write(ring, capacity, head + sizeof(record_len), buffer, len);
+
+    /* Publicamos el mensaje y solo hacemos la llamada al sistema si el consumidor duerme */
+    atomic_store(&ring->head, head + sizeof(record_len) + (uint32_t) len);
+    atomic_fetch_add(&ring->data_seq, 1);
+    if (atomic_load(&ring->consumer_waiting)) {
+        futex_wake(&ring->data_seq);
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief   Recibe un mensaje del canal.
+ *
+ * @param channel       Extremo por el que recibir.
+ * @param buffer        Buffer en el que guardar el mensaje.
+ * @param capacity      Tamaño del buffer.
+ * @param timeout_ms    Tiempo máximo de espera si la cola está vacía (-1 para esperar indefinidamente).
+ *
+ * @return  Longitud del mensaje recibido; -1 si falló (errno a ETIMEDOUT, EPIPE, EMSGSIZE o EPROTO).
+ */
+ssize_t shm_recv(ShmChannel *channel, void *buffer, size_t capacity, int timeout_ms) {
+    struct ShmRing *ring = channel->rx;
+    uint32_t ring_capacity = channel->capacity;
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint32_t used, record_len;
+    struct timespec deadline;
+    unsigned seq;
+
+    if (timeout_ms >= 0) {
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
+
+    /* Esperamos a que haya algún mensaje */
+    while (atomic_load(&ring->head) == tail) {
+        if (peer_closed(channel)) {
+            errno = EPIPE;
+            return -1;
+        }
+        if (timeout_ms >= 0 && !remaining_ms(&deadline, true)) {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+
+        seq = atomic_load(&ring->data_seq);
+        atomic_store(&ring->consumer_waiting, 1);
+        if (atomic_load(&ring->head) == tail && !peer_closed(channel)) {
+            futex_wait(&ring->data_seq, seq, remaining_ms(&deadline, timeout_ms >= 0));
+        }
+        atomic_store(&ring->consumer_waiting, 0);
+    }
+
+    /* La cola está en memoria que controla el otro proceso: no nos fiamos de sus índices ni longitudes */
+    used = atomic_load(&ring->head) - tail;
+    if (used < sizeof(record_len) || used > ring_capacity) {
+        errno = EPROTO;
+        return -1;
+    }
+    ring_read(ring, ring_capacity, tail, &record_len, sizeof(record_len));
+    if (record_len > used - sizeof(record_len)) {
+        errno = EPROTO;
+        return -1;
+    }
+
+    if (record_len <= capacity) {
+        ring_read(ring, ring_capacity, tail + sizeof(record_len), buffer, record_len);
+    }
+
+    /* Liberamos el espacio y solo hacemos la llamada al sistema si el productor duerme */
+    atomic_store(&ring->tail, tail + sizeof(record_len) + record_len);
+    atomic_fetch_add(&ring->space_seq, 1);
+    if (atomic_load(&ring->producer_waiting)) {
+        futex_wake(&ring->space_seq);
+    }
+
+    if (record_len > capacity) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+
+    return record_len;
+}
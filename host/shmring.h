@@ -0,0 +1,129 @@
+#ifndef SHMRING_H
+#define SHMRING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+/*
+ * Transporte por memoria compartida entre un cliente y un servidor de la misma máquina.
+ *
+ * Un canal es un segmento de memoria compartida POSIX con dos colas circulares de un solo productor
+ * y un solo consumidor: una en cada sentido. Cada mensaje va precedido de su longitud (4 bytes), y
+ * quien espera (porque la cola está vacía o llena) duerme en un futex del propio segmento, al que
+ * el otro extremo solo despierta si sabe que hay alguien esperando.
+ *
+ * El cliente crea el canal y lo anuncia al servidor por el socket con el token
+ * "SHM=<nombre>:<nonce>"; el servidor lo abre, comprueba el nonce y responde con el mismo token.
+ */
+
+/* Capacidad por defecto de cada cola del canal (potencia de 2) */
+#define SHM_RING_CAPACITY (1U << 20)
+
+/* Prefijo del token con el que se negocia el canal */
+#define SHM_TOKEN_PREFIX "SHM="
+
+/* Longitud máxima del token de negociación (incluido el nulo) */
+#define SHM_TOKEN_MAX 96
+
+/* Longitud máxima del nombre del segmento (incluido el nulo) */
+#define SHM_NAME_MAX 64
+
+struct ShmSegment;
+struct ShmRing;
+
+/**
+ * Extremo de un canal de memoria compartida.
+ */
+typedef struct {
+    struct ShmSegment *segment;     /* Segmento proyectado en memoria */
+    size_t mapping_len;             /* Tamaño de la proyección */
+    struct ShmRing *tx;             /* Cola por la que este extremo envía */
+    struct ShmRing *rx;             /* Cola por la que este extremo recibe */
+    uint32_t capacity;              /* Capacidad de cada cola, validada al crear o unirse al canal */
+    bool creator;                   /* true en el extremo que creó el canal (el cliente) */
+    bool linked;                    /* true mientras el nombre del segmento siga existiendo en el sistema */
+    char name[SHM_NAME_MAX];        /* Nombre del segmento */
+    uint64_t nonce;                 /* Valor aleatorio que identifica al canal */
+} ShmChannel;
+
+/**
+ * @brief   Crea un canal de memoria compartida nuevo.
+ *
+ * @param channel       Extremo a inicializar.
+ * @param ring_capacity Capacidad de cada cola en bytes (se redondea a potencia de 2).
+ *
+ * @return  true si se creó el canal; false si falló (errno indica el motivo).
+ */
+bool shm_channel_create(ShmChannel *channel, size_t ring_capacity);
+
+/**
+ * @brief   Se une a un canal creado por otro proceso a partir de su token de negociación.
+ *
+ * Valida el nombre, el tamaño y la cabecera del segmento, y que el nonce coincida con el del token,
+ * de forma que un token recibido de un host remoto no puede hacer que se abra un segmento ajeno.
+ * Solo se admite un extremo unido por canal: un segundo intento falla con EBUSY.
+ *
+ * @param channel   Extremo a inicializar.
+ * @param token     Token recibido ("SHM=<nombre>:<nonce>").
+ *
+ * @return  true si se unió al canal; false si el token no es válido o el segmento no existe.
+ */
+bool shm_channel_attach(ShmChannel *channel, const char *token);
+
+/**
+ * @brief   Escribe el token con el que se anuncia un canal al otro extremo.
+ *
+ * @param channel   Canal a anunciar.
+ * @param token     Buffer de al menos SHM_TOKEN_MAX bytes.
+ */
+void shm_channel_token(const ShmChannel *channel, char *token);
+
+/**
+ * @brief   Borra el nombre del segmento, de forma que desaparezca al cerrarse ambos extremos.
+ *
+ * Se llama en cuanto el otro extremo se unió, para que no queden segmentos huérfanos
+ * aunque alguno de los procesos muera.
+ *
+ * @param channel   Canal cuyo nombre borrar.
+ */
+void shm_channel_unlink(ShmChannel *channel);
+
+/**
+ * @brief   Cierra un extremo del canal.
+ *
+ * Avisa al otro extremo (que recibirá EPIPE en cuanto vacíe su cola) y libera la proyección.
+ *
+ * @param channel   Extremo a cerrar.
+ */
+void shm_channel_close(ShmChannel *channel);
+
+/**
+ * @brief   Envía un mensaje por el canal.
+ *
+ * @param channel       Extremo por el que enviar.
+ * @param buffer        Mensaje.
+ * @param len           Longitud del mensaje.
+ * @param timeout_ms    Tiempo máximo de espera si la cola está llena (-1 para esperar indefinidamente).
+ *
+ * @return  0 si se envió; -1 si falló, con errno a ETIMEDOUT (venció el plazo), EPIPE (el otro extremo
+ *          cerró el canal) o EMSGSIZE (el mensaje no cabe en la cola).
+ */
+int shm_send(ShmChannel *channel, const void *buffer, size_t len, int timeout_ms);
+
+/**
+ * @brief   Recibe un mensaje del canal.
+ *
+ * @param channel       Extremo por el que recibir.
+ * @param buffer        Buffer en el que guardar el mensaje.
+ * @param capacity      Tamaño del buffer.
+ * @param timeout_ms    Tiempo máximo de espera si la cola está vacía (-1 para esperar indefinidamente).
+ *
+ * @return  Longitud del mensaje recibido; -1 si falló, con errno a ETIMEDOUT (venció el plazo), EPIPE
+ *          (el otro extremo cerró el canal), EMSGSIZE (el mensaje no cabe en el buffer; se descarta)
+ *          o EPROTO (el estado de la cola es incoherente).
+ */
+ssize_t shm_recv(ShmChannel *channel, void *buffer, size_t capacity, int timeout_ms);
+
+#endif /* SHMRING_H */
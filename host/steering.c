@@ -0,0 +1,201 @@
+#define _GNU_SOURCE     /* Para pthread_setaffinity_np y CPU_SET */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/filter.h>
+#include <linux/mempolicy.h>
+
+#include "steering.h"
+#include "loging.h"
+
+
+/**
+ * @brief   Interpreta una lista de CPUs ("0-3,8,10-11").
+ *
+ * @param text  Lista a interpretar.
+ * @param cpus  Donde guardar las CPUs, en el orden de la lista.
+ * @param max   Capacidad de cpus.
+ *
+ * @return  Número de CPUs leídas; -1 si la lista no es válida o tiene más de max CPUs.
+ */
+int parse_cpu_list(const char *text, int *cpus, int max) {
+    const char *cursor = text;
+    char *end;
+    long first, last;
+    int count = 0;
+
+    do {
+        first = strtol(cursor, &end, 10);
+        if (end == cursor || first < 0 || first >= CPU_SETSIZE) return -1;
+        last = first;
+
+        if (*end == '-') {
+            cursor = end + 1;
+            last = strtol(cursor, &end, 10);
+            if (end == cursor || last < first || last >= CPU_SETSIZE) return -1;
+        }
+        if (*end && *end != ',') return -1;
+
+        for (long cpu = first; cpu <= last; cpu++) {
+            if (count == max) return -1;
+            cpus[count++] = (int) cpu;
+        }
+
+        cursor = end + 1;
+    } while (*end);
+
+    return count;
+}
+
+
+/**
+ * @brief   Instala en un grupo SO_REUSEPORT el programa que envía cada datagrama al socket de la CPU que lo recibió.
+ *
+ * @param host      Cualquier socket del grupo (ya con todos los sockets creados).
+ * @param cpus      CPU de cada socket del grupo.
+ * @param count     Número de sockets del grupo.
+ *
+ * @return  true si se instaló; false en caso contrario (errno indica el motivo).
+ */
+bool attach_cpu_steering(Host *host, const int *cpus, int count) {
+    struct sock_filter code[2 * STEERING_MAX_CPUS + 3];
+    struct sock_fprog program = {.filter = code};
+    int len = 0;
+
+    if (count <= 0 || count > STEERING_MAX_CPUS) {
+        errno = EINVAL;
+        return false;
+    }
+
+    /* A = CPU que procesa el paquete; el valor devuelto es el índice del socket en el grupo */
+    code[len++] = (struct sock_filter) BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_CPU);
+    for (int i = 0; i < count; i++) {
+        code[len++] = (struct sock_filter) BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, cpus[i], 0, 1);
+        code[len++] = (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, i);
+    }
+
+    /* CPU sin trabajador propio: repartimos por el número de CPU, para que cada una vaya siempre al mismo */
+    code[len++] = (struct sock_filter) BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, count);
+    code[len++] = (struct sock_filter) BPF_STMT(BPF_RET | BPF_A, 0);
+    program.len = len;
+
+    return !setsockopt(host->socket, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &program, sizeof(program));
+}
+
+
+/**
+ * @brief   Prepara el socket de un trabajador: sin aviso por señal (el trabajador espera en el propio socket) y con SO_INCOMING_CPU.
+ *
+ * @param host  Socket del trabajador.
+ * @param cpu   CPU del trabajador.
+ */
+void prepare_worker_socket(Host *host, int cpu) {
+    /* Sin O_ASYNC: cada datagrama haría saltar una señal en el hilo principal, en otra CPU */
+    if (fcntl(host->socket, F_SETFL, O_NONBLOCK) < 0) {
+        log_printf_err(host->log, "Error al desactivar el envío de señales en el socket.\n");
+        fail("No se pudo desactivar el envío de señales en el socket");
+    }
+
+    if (setsockopt(host->socket, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu)) < 0) {
+        perror("No se pudo activar SO_INCOMING_CPU en el socket");
+        log_printf_err(host->log, "Error al activar SO_INCOMING_CPU (CPU %d).\n", cpu);
+    }
+}
+
+
+/**
+ * @brief   Fija el hilo llamante a una CPU.
+ *
+ * @param cpu   CPU.
+ *
+ * @return  0 si se fijó; un código de error en caso contrario.
+ */
+int pin_thread_to_cpu(int cpu) {
+    cpu_set_t cpus;
+
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+}
+
+
+/**
+ * @brief   Nodo NUMA de una CPU.
+ *
+ * El núcleo lo indica con una entrada "node<N>" en el directorio de la CPU en sysfs.
+ *
+ * @param cpu   CPU.
+ *
+ * @return  Número de nodo; -1 si no se conoce (núcleo sin NUMA).
+ */
+int cpu_numa_node(int cpu) {
+    char path[64];
+    DIR *directory;
+    struct dirent *entry;
+    int node = -1;
+
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+    if (!(directory = opendir(path))) {
+        return -1;
+    }
+
+    while ((entry = readdir(directory))) {
+        if (!strncmp(entry->d_name, "node", 4) && sscanf(entry->d_name + 4, "%d", &node) == 1) break;
+        node = -1;
+    }
+    closedir(directory);
+
+    return node;
+}
+
+
+/**
+ * @brief   Reserva memoria en el nodo NUMA de una CPU.
+ *
+ * Se liga la reserva al nodo con mbind (MPOL_PREFERRED, para no fallar si el nodo se queda sin memoria)
+ * antes de tocar ninguna página, de forma que todas se asignan ya en el nodo.
+ *
+ * @param size  Bytes a reservar.
+ * @param cpu   CPU en cuyo nodo reservar.
+ *
+ * @return  Memoria reservada; NULL si no hay memoria.
+ */
+void *alloc_on_cpu_node(size_t size, int cpu) {
+    unsigned long nodes[16] = {0};
+    void *memory;
+    int node = cpu_numa_node(cpu);
+
+    if ((memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED) {
+        return NULL;
+    }
+
+    if (node >= 0 && node < (int) (sizeof(nodes) * 8)) {
+        nodes[node / (sizeof(unsigned long) * 8)] |= 1UL << (node % (sizeof(unsigned long) * 8));
+        /* Si falla (núcleo sin NUMA), la memoria queda donde la primera escritura la ponga: el hilo ya fijado a su CPU */
+        syscall(SYS_mbind, memory, size, MPOL_PREFERRED, nodes, sizeof(nodes) * 8 + 1, 0);
+    }
+
+    return memory;
+}
+
+
+/**
+ * @brief   Libera la memoria de alloc_on_cpu_node.
+ *
+ * @param memory    Memoria a liberar.
+ * @param size      Bytes que se reservaron.
+ */
+void free_on_cpu_node(void *memory, size_t size) {
+    if (memory) munmap(memory, size);
+}
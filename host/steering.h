@@ -0,0 +1,98 @@
+#ifndef STEERING_H
+#define STEERING_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "host.h"
+
+/*
+ * Reparto de los datagramas entre trabajadores fijados a CPUs.
+ *
+ * Cada trabajador tiene su propio socket de un grupo SO_REUSEPORT y su hilo fijado a una CPU. Para
+ * que cada datagrama se procese en la misma CPU en la que lo recibió la cola de la tarjeta de red
+ * (y no rebote entre las cachés de varios núcleos), se instala en el grupo un programa BPF clásico
+ * (SO_ATTACH_REUSEPORT_CBPF) que elige el socket según la CPU que está procesando el paquete. Si el
+ * núcleo no lo admite, queda SO_INCOMING_CPU en cada socket, que solo es una preferencia.
+ *
+ * La memoria de cada trabajador (su pila, donde viven los buffers de las peticiones, y su estado) se
+ * reserva en el nodo NUMA de su CPU.
+ */
+
+/* Máximo número de CPUs en una lista */
+#define STEERING_MAX_CPUS 256
+
+/**
+ * @brief   Interpreta una lista de CPUs ("0-3,8,10-11").
+ *
+ * @param text  Lista a interpretar.
+ * @param cpus  Donde guardar las CPUs, en el orden de la lista.
+ * @param max   Capacidad de cpus.
+ *
+ * @return  Número de CPUs leídas; -1 si la lista no es válida o tiene más de max CPUs.
+ */
+int parse_cpu_list(const char *text, int *cpus, int max);
+
+/**
+ * @brief   Instala en un grupo SO_REUSEPORT el programa que envía cada datagrama al socket de la CPU que lo recibió.
+ *
+ * El socket i del grupo (en orden de creación) debe ser el del trabajador de cpus[i]. Los datagramas que
+ * lleguen por una CPU sin trabajador se reparten entre todos según el número de CPU.
+ *
+ * @param host      Cualquier socket del grupo (ya con todos los sockets creados).
+ * @param cpus      CPU de cada socket del grupo.
+ * @param count     Número de sockets del grupo.
+ *
+ * @return  true si se instaló; false en caso contrario (errno indica el motivo).
+ */
+bool attach_cpu_steering(Host *host, const int *cpus, int count);
+
+/**
+ * @brief   Prepara el socket de un trabajador: sin aviso por señal (el trabajador espera en el propio socket) y con SO_INCOMING_CPU.
+ *
+ * El fallo de SO_INCOMING_CPU no es crítico: se avisa y se sigue.
+ *
+ * @param host  Socket del trabajador.
+ * @param cpu   CPU del trabajador.
+ */
+void prepare_worker_socket(Host *host, int cpu);
+
+/**
+ * @brief   Fija el hilo llamante a una CPU.
+ *
+ * @param cpu   CPU.
+ *
+ * @return  0 si se fijó; un código de error en caso contrario.
+ */
+int pin_thread_to_cpu(int cpu);
+
+/**
+ * @brief   Nodo NUMA de una CPU.
+ *
+ * @param cpu   CPU.
+ *
+ * @return  Número de nodo; -1 si no se conoce (núcleo sin NUMA).
+ */
+int cpu_numa_node(int cpu);
+
+/**
+ * @brief   Reserva memoria en el nodo NUMA de una CPU.
+ *
+ * La memoria llega a cero. Si no se puede ligar al nodo, se reserva igualmente donde diga el núcleo.
+ *
+ * @param size  Bytes a reservar.
+ * @param cpu   CPU en cuyo nodo reservar.
+ *
+ * @return  Memoria reservada; NULL si no hay memoria.
+ */
+void *alloc_on_cpu_node(size_t size, int cpu);
+
+/**
+ * @brief   Libera la memoria de alloc_on_cpu_node.
+ *
+ * @param memory    Memoria a liberar.
+ * @param size      Bytes que se reservaron.
+ */
+void free_on_cpu_node(void *memory, size_t size);
+
+#endif /* STEERING_H */
@@ -0,0 +1,170 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <linux/net_tstamp.h>
+#include <linux/errqueue.h>
+
+#include "timestamps.h"
+#include "loging.h"
+
+
+/**
+ * @brief   Activa las marcas de tiempo del núcleo en el socket del host.
+ *
+ * @param host  Host en cuyo socket activar las marcas de tiempo.
+ * @param modes Combinación de valores de enum TimestampMode.
+ *
+ * @return  0 si se activaron; -1 en caso de error (y errno indica el motivo).
+ */
+int enable_kernel_timestamps(Host *host, int modes) {
+    int flags = SOF_TIMESTAMPING_SOFTWARE;
+    int enable = 1;
+
+    if (modes & TIMESTAMP_RX) flags |= SOF_TIMESTAMPING_RX_SOFTWARE;
+    /* OPT_TSONLY: en la cola de errores solo se deja la marca, no una copia del datagrama enviado */
+    if (modes & TIMESTAMP_TX) flags |= SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_OPT_TSONLY;
+
+    if (setsockopt(host->socket, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) == 0) {
+        log_printf(host->log, "Marcas de tiempo del núcleo activadas con SO_TIMESTAMPING (%s%s).\n",
+                   modes & TIMESTAMP_RX ? "recepción " : "", modes & TIMESTAMP_TX ? "envío" : "");
+        return 0;
+    }
+
+    /* Núcleos antiguos: solo podemos ofrecer la marca de recepción */
+    if (!(modes & TIMESTAMP_TX) && setsockopt(host->socket, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable)) == 0) {
+        log_printf(host->log, "Marcas de tiempo del núcleo activadas con SO_TIMESTAMPNS (recepción).\n");
+        return 0;
+    }
+
+    log_printf_err(host->log, "No se pudieron activar las marcas de tiempo del núcleo: %s.\n", strerror(errno));
+    return -1;
+}
+
+
+/**
+ * @brief   Extrae la marca de tiempo de los mensajes de control de un msghdr.
+ *
+ * @param message   Mensaje recibido, con msg_control apuntando a un buffer de al menos TIMESTAMP_CONTROL_LEN bytes.
+ * @param kernel_ts Marca de tiempo encontrada (CLOCK_REALTIME).
+ *
+ * @return  true si el mensaje llevaba marca de tiempo; false en otro caso.
+ */
+bool timestamp_from_message(struct msghdr *message, struct timespec *kernel_ts) {
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(message); cmsg; cmsg = CMSG_NXTHDR(message, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET) continue;
+
+        if (cmsg->cmsg_type == SCM_TIMESTAMPING) {
+            /* ts[0] es la marca software; ts[2] la hardware, que no pedimos */
+            struct scm_timestamping timestamps;
+
+            memcpy(&timestamps, CMSG_DATA(cmsg), sizeof(timestamps));
+            if (timestamps.ts[0].tv_sec == 0 && timestamps.ts[0].tv_nsec == 0) continue;
+            *kernel_ts = timestamps.ts[0];
+            return true;
+        }
+
+        if (cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+            memcpy(kernel_ts, CMSG_DATA(cmsg), sizeof(struct timespec));
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+/**
+ * @brief   Recibe un datagrama junto con la marca de tiempo de su llegada al núcleo.
+ *
+ * @param host      Host por cuyo socket recibir.
+ * @param buffer    Buffer en el que guardar el datagrama.
+ * @param len       Tamaño de buffer.
+ * @param flags     Flags de recvmsg.
+ * @param address   Dirección del remitente (puede ser NULL).
+ * @param address_len   Tamaño de address; se actualiza con el tamaño real (puede ser NULL si address es NULL).
+ * @param kernel_ts Marca de tiempo de llegada (CLOCK_REALTIME); se pone a cero si no está disponible.
+ *
+ * @return  Número de bytes recibidos, o -1 en caso de error (como recvfrom).
+ */
+ssize_t recvfrom_timestamped(Host *host, void *buffer, size_t len, int flags, struct sockaddr *address, socklen_t *address_len, struct timespec *kernel_ts) {
+    struct iovec iov = {.iov_base = buffer, .iov_len = len};
+
+    return recvmsg_timestamped(host, &iov, 1, flags, address, address_len, kernel_ts);
+}
+
+
+/**
+ * @brief   Recibe un datagrama repartido en varios buffers junto con la marca de tiempo de su llegada al núcleo.
+ *
+ * @param host      Host por cuyo socket recibir.
+ * @param iov       Buffers en los que guardar el datagrama.
+ * @param iov_count Número de buffers.
+ * @param flags     Flags de recvmsg.
+ * @param address   Dirección del remitente (puede ser NULL).
+ * @param address_len   Tamaño de address; se actualiza con el tamaño real (puede ser NULL si address es NULL).
+ * @param kernel_ts Marca de tiempo de llegada (CLOCK_REALTIME); se pone a cero si no está disponible.
+ *
+ * @return  Número de bytes recibidos, o -1 en caso de error (como recvmsg).
+ */
+ssize_t recvmsg_timestamped(Host *host, struct iovec *iov, size_t iov_count, int flags, struct sockaddr *address, socklen_t *address_len, struct timespec *kernel_ts) {
+    char control[TIMESTAMP_CONTROL_LEN];
+    struct msghdr message = {
+        .msg_name = address,
+        .msg_namelen = address_len ? *address_len : 0,
+        .msg_iov = iov,
+        .msg_iovlen = iov_count,
+        .msg_control = control,
+        .msg_controllen = sizeof(control)
+    };
+    ssize_t received;
+
+    memset(kernel_ts, 0, sizeof(struct timespec));
+
+    if ( (received = recvmsg(host->socket, &message, flags)) < 0) return received;
+
+    if (address_len) *address_len = message.msg_namelen;
+
+    timestamp_from_message(&message, kernel_ts);
+
+    return received;
+}
+
+
+/**
+ * @brief   Lee la marca de tiempo de envío del último datagrama enviado.
+ *
+ * @param host      Host de cuyo socket leer la marca.
+ * @param kernel_ts Marca de tiempo de envío (CLOCK_REALTIME).
+ *
+ * @return  true si había alguna marca de envío; false en otro caso.
+ */
+bool read_tx_timestamp(Host *host, struct timespec *kernel_ts) {
+    char control[TIMESTAMP_CONTROL_LEN];
+    struct msghdr message;
+    bool found = false;
+
+    /* Puede haber varias marcas acumuladas (p. ej. si alguna petición no obtuvo respuesta); nos quedamos con la última */
+    while (true) {
+        message = (struct msghdr) {.msg_control = control, .msg_controllen = sizeof(control)};
+
+        if (recvmsg(host->socket, &message, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) break;
+
+        found = timestamp_from_message(&message, kernel_ts) || found;
+    }
+
+    return found;
+}
+
+
+/**
+ * @brief   Convierte una marca de tiempo a nanosegundos.
+ *
+ * @param ts    Marca de tiempo.
+ *
+ * @return  Nanosegundos representados por ts.
+ */
+uint64_t timespec_to_ns(const struct timespec *ts) {
+    return (uint64_t) ts->tv_sec * 1000000000ULL + ts->tv_nsec;
+}
@@ -0,0 +1,106 @@
+#ifndef TIMESTAMPS_H
+#define TIMESTAMPS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/socket.h>
+
+#include "host.h"
+
+/**
+ * Tipos de marcas de tiempo del núcleo que se pueden pedir para el socket de un host.
+ */
+enum TimestampMode {
+    TIMESTAMP_RX = 1,   /* Marca de tiempo del instante en que el núcleo recibió cada datagrama */
+    TIMESTAMP_TX = 2    /* Marca de tiempo del instante en que el núcleo entregó cada datagrama al dispositivo */
+};
+
+/* Tamaño del buffer de mensajes de control necesario para recibir una marca de tiempo */
+#define TIMESTAMP_CONTROL_LEN 256
+
+/**
+ * @brief   Activa las marcas de tiempo del núcleo en el socket del host.
+ *
+ * Intenta usar SO_TIMESTAMPING (con marcas software de recepción y, si se piden, de envío);
+ * si el núcleo no lo admite y solo se piden marcas de recepción, recurre a SO_TIMESTAMPNS.
+ * No supone un error crítico: si no se pueden activar, las funciones de lectura simplemente
+ * no devuelven marca.
+ *
+ * @param host  Host en cuyo socket activar las marcas de tiempo.
+ * @param modes Combinación de valores de enum TimestampMode.
+ *
+ * @return  0 si se activaron; -1 en caso de error (y errno indica el motivo).
+ */
+int enable_kernel_timestamps(Host *host, int modes);
+
+/**
+ * @brief   Recibe un datagrama junto con la marca de tiempo de su llegada al núcleo.
+ *
+ * Equivale a recvfrom, pero usa recvmsg para leer también los mensajes de control con la marca de tiempo.
+ *
+ * @param host      Host por cuyo socket recibir.
+ * @param buffer    Buffer en el que guardar el datagrama.
+ * @param len       Tamaño de buffer.
+ * @param flags     Flags de recvmsg.
+ * @param address   Dirección del remitente (puede ser NULL).
+ * @param address_len   Tamaño de address; se actualiza con el tamaño real (puede ser NULL si address es NULL).
+ * @param kernel_ts Marca de tiempo de llegada (CLOCK_REALTIME); se pone a cero si no está disponible.
+ *
+ * @return  Número de bytes recibidos, o -1 en caso de error (como recvfrom).
+ */
+ssize_t recvfrom_timestamped(Host *host, void *buffer, size_t len, int flags, struct sockaddr *address, socklen_t *address_len, struct timespec *kernel_ts);
+
+/**
+ * @brief   Recibe un datagrama repartido en varios buffers junto con la marca de tiempo de su llegada al núcleo.
+ *
+ * Como recvfrom_timestamped, pero el datagrama se reparte en orden entre los buffers de iov (por ejemplo,
+ * una cabecera y el buffer en el que debe quedar el resto, sin copiarlo después).
+ *
+ * @param host      Host por cuyo socket recibir.
+ * @param iov       Buffers en los que guardar el datagrama.
+ * @param iov_count Número de buffers.
+ * @param flags     Flags de recvmsg.
+ * @param address   Dirección del remitente (puede ser NULL).
+ * @param address_len   Tamaño de address; se actualiza con el tamaño real (puede ser NULL si address es NULL).
+ * @param kernel_ts Marca de tiempo de llegada (CLOCK_REALTIME); se pone a cero si no está disponible.
+ *
+ * @return  Número de bytes recibidos, o -1 en caso de error (como recvmsg).
+ */
+ssize_t recvmsg_timestamped(Host *host, struct iovec *iov, size_t iov_count, int flags, struct sockaddr *address, socklen_t *address_len, struct timespec *kernel_ts);
+
+/**
+ * @brief   Lee la marca de tiempo de envío del último datagrama enviado.
+ *
+ * Vacía la cola de errores del socket, en la que el núcleo deja las marcas de envío
+ * cuando se activó TIMESTAMP_TX, y devuelve la más reciente.
+ *
+ * @param host      Host de cuyo socket leer la marca.
+ * @param kernel_ts Marca de tiempo de envío (CLOCK_REALTIME).
+ *
+ * @return  true si había alguna marca de envío; false en otro caso.
+ */
+bool read_tx_timestamp(Host *host, struct timespec *kernel_ts);
+
+/**
+ * @brief   Extrae la marca de tiempo de los mensajes de control de un msghdr.
+ *
+ * Sirve para los mensajes recibidos con recvmsg o recvmmsg sobre un socket con marcas de tiempo activadas.
+ *
+ * @param message   Mensaje recibido, con msg_control apuntando a un buffer de al menos TIMESTAMP_CONTROL_LEN bytes.
+ * @param kernel_ts Marca de tiempo encontrada (CLOCK_REALTIME).
+ *
+ * @return  true si el mensaje llevaba marca de tiempo; false en otro caso.
+ */
+bool timestamp_from_message(struct msghdr *message, struct timespec *kernel_ts);
+
+/**
+ * @brief   Convierte una marca de tiempo a nanosegundos.
+ *
+ * @param ts    Marca de tiempo.
+ *
+ * @return  Nanosegundos representados por ts.
+ */
+uint64_t timespec_to_ns(const struct timespec *ts);
+
+#endif /* TIMESTAMPS_H */
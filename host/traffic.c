@@ -0,0 +1,92 @@
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <endian.h>
+
+#include "traffic.h"
+
+
+/**
+ * @brief   Devuelve el instante actual de CLOCK_REALTIME en nanosegundos.
+ *
+ * @return  Nanosegundos transcurridos desde la época Unix.
+ */
+uint64_t traffic_realtime_ns(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+
+/**
+ * @brief   Devuelve el instante actual de CLOCK_MONOTONIC en nanosegundos.
+ *
+ * @return  Nanosegundos transcurridos desde un instante arbitrario fijo.
+ */
+uint64_t traffic_monotonic_ns(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+
+/**
+ * @brief   Escribe la cabecera de tráfico al principio de un buffer.
+ *
+ * @param buffer    Buffer en el que escribir; debe tener al menos TRAFFIC_HEADER_LEN bytes.
+ * @param stream    Identificador del flujo.
+ * @param seq       Número de secuencia del paquete.
+ * @param tx_ns     Instante de envío en nanosegundos (CLOCK_REALTIME).
+ */
+void traffic_header_write(void *buffer, uint32_t stream, uint64_t seq, uint64_t tx_ns) {
+    uint32_t magic_be = htobe32(TRAFFIC_MAGIC);
+    uint32_t stream_be = htobe32(stream);
+    uint64_t seq_be = htobe64(seq);
+    uint64_t tx_ns_be = htobe64(tx_ns);
+    char *out = (char *) buffer;
+
+    /* Copiamos campo a campo con memcpy porque el buffer no tiene por qué estar alineado */
+    memcpy(out, &magic_be, sizeof(magic_be));
+    memcpy(out + 4, &stream_be, sizeof(stream_be));
+    memcpy(out + 8, &seq_be, sizeof(seq_be));
+    memcpy(out + 16, &tx_ns_be, sizeof(tx_ns_be));
+}
+
+
+/**
+ * @brief   Lee la cabecera de tráfico del principio de un buffer.
+ *
+ * @param buffer    Buffer con el paquete recibido.
+ * @param len       Número de bytes válidos en buffer.
+ * @param header    Estructura en la que guardar la cabecera leída (en orden de host).
+ *
+ * @return  true si el paquete es lo bastante largo y lleva el número mágico; false en otro caso.
+ */
+bool traffic_header_read(const void *buffer, size_t len, TrafficHeader *header) {
+    const char *in = (const char *) buffer;
+    uint32_t magic_be, stream_be;
+    uint64_t seq_be, tx_ns_be;
+
+    if (len < TRAFFIC_HEADER_LEN) return false;
+
+    memcpy(&magic_be, in, sizeof(magic_be));
+    if (be32toh(magic_be) != TRAFFIC_MAGIC) return false;
+
+    memcpy(&stream_be, in + 4, sizeof(stream_be));
+    memcpy(&seq_be, in + 8, sizeof(seq_be));
+    memcpy(&tx_ns_be, in + 16, sizeof(tx_ns_be));
+
+    *header = (TrafficHeader) {
+        .magic = TRAFFIC_MAGIC,
+        .stream = be32toh(stream_be),
+        .seq = be64toh(seq_be),
+        .tx_ns = be64toh(tx_ns_be)
+    };
+
+    return true;
+}
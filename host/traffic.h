@@ -0,0 +1,66 @@
+#ifndef TRAFFIC_H
+#define TRAFFIC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/* Número mágico con el que empiezan los paquetes de tráfico generados ("RP3T") */
+#define TRAFFIC_MAGIC 0x52503354
+
+/**
+ * Cabecera que el generador de tráfico estampa al principio de cada paquete.
+ * En la red viaja en orden de red (big endian); esta estructura la contiene ya
+ * traducida a orden de host.
+ */
+typedef struct {
+    uint32_t magic;     /* Siempre TRAFFIC_MAGIC */
+    uint32_t stream;    /* Identificador del flujo (hilo emisor) al que pertenece el paquete */
+    uint64_t seq;       /* Número de secuencia del paquete dentro de su flujo, empezando en 0 */
+    uint64_t tx_ns;     /* Instante de envío (CLOCK_REALTIME, en nanosegundos) */
+} TrafficHeader;
+
+/* Tamaño que ocupa la cabecera en la red: es el tamaño mínimo de un paquete de tráfico */
+#define TRAFFIC_HEADER_LEN 24
+
+/**
+ * @brief   Devuelve el instante actual de CLOCK_REALTIME en nanosegundos.
+ *
+ * Es el reloj con el que se estampan los paquetes, para poder comparar los instantes
+ * de envío y de recepción aunque emisor y receptor sean procesos distintos.
+ *
+ * @return  Nanosegundos transcurridos desde la época Unix.
+ */
+uint64_t traffic_realtime_ns(void);
+
+/**
+ * @brief   Devuelve el instante actual de CLOCK_MONOTONIC en nanosegundos.
+ *
+ * Se usa para medir intervalos y para el ritmo de envío, ya que no sufre saltos.
+ *
+ * @return  Nanosegundos transcurridos desde un instante arbitrario fijo.
+ */
+uint64_t traffic_monotonic_ns(void);
+
+/**
+ * @brief   Escribe la cabecera de tráfico al principio de un buffer.
+ *
+ * @param buffer    Buffer en el que escribir; debe tener al menos TRAFFIC_HEADER_LEN bytes.
+ * @param stream    Identificador del flujo.
+ * @param seq       Número de secuencia del paquete.
+ * @param tx_ns     Instante de envío en nanosegundos (CLOCK_REALTIME).
+ */
+void traffic_header_write(void *buffer, uint32_t stream, uint64_t seq, uint64_t tx_ns);
+
+/**
+ * @brief   Lee la cabecera de tráfico del principio de un buffer.
+ *
+ * @param buffer    Buffer con el paquete recibido.
+ * @param len       Número de bytes válidos en buffer.
+ * @param header    Estructura en la que guardar la cabecera leída (en orden de host).
+ *
+ * @return  true si el paquete es lo bastante largo y lleva el número mágico; false en otro caso.
+ */
+bool traffic_header_read(const void *buffer, size_t len, TrafficHeader *header);
+
+#endif /* TRAFFIC_H */
@@ -0,0 +1,293 @@
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include "transform.h"
+#include "transform_tables.h"
+
+
+/**
+ * Entrada de la tabla de operaciones.
+ */
+struct TransformOperation {
+    const char *name;       /* Nombre en la línea de comandos */
+    ssize_t (*apply)(const struct TransformOperation *operation, const uint8_t *source, size_t len, uint8_t *destination, size_t capacity);
+    const uint16_t *index;  /* Tabla de puntos de código (operaciones Unicode) */
+    const uint8_t *bytes;   /* Tabla de bytes (operaciones ASCII) */
+};
+
+
+/**
+ * @brief   Destino de un punto de código según una tabla de cambio de caja.
+ */
+static inline uint32_t lookup_codepoint(const uint16_t *index, uint32_t c) {
+    return c + transform_delta_pages[index[c >> TRANSFORM_TABLE_PAGE_BITS]][c & ((1U << TRANSFORM_TABLE_PAGE_BITS) - 1)];
+}
+
+
+/**
+ * @brief   Indica si un punto de código forma parte de una palabra (para la forma de título).
+ */
+static inline bool is_word_codepoint(uint32_t c) {
+    uint32_t offset = c & ((1U << TRANSFORM_TABLE_PAGE_BITS) - 1);
+
+    return transform_word_pages[transform_word_index[c >> TRANSFORM_TABLE_PAGE_BITS]][offset / 8] & (1U << (offset % 8));
+}
+
+
+/**
+ * @brief   Decodifica la secuencia UTF-8 que empieza en source.
+ *
+ * Rechaza las secuencias truncadas, las formas sobrelargas, los sustitutos y lo que pasa de U+10FFFF.
+ *
+ * @param source    Texto.
+ * @param len       Bytes disponibles en source (al menos 1).
+ * @param c         Donde guardar el punto de código.
+ *
+ * @return  Longitud de la secuencia; 0 si no es válida.
+ */
+static inline size_t decode_utf8(const uint8_t *source, size_t len, uint32_t *c) {
+    uint8_t lead = source[0];
+    size_t n;
+    uint32_t min;
+
+    if (lead < 0x80) {
+        *c = lead;
+        return 1;
+    } else if (lead >= 0xc2 && lead <= 0xdf) {
+        n = 2, min = 0x80, *c = lead & 0x1f;
+    } else if (lead >= 0xe0 && lead <= 0xef) {
+        n = 3, min = 0x800, *c = lead & 0x0f;
+    } else if (lead >= 0xf0 && lead <= 0xf4) {
+        n = 4, min = 0x10000, *c = lead & 0x07;
+    } else {
+        return 0;
+    }
+
+    if (len < n) return 0;
+    for (size_t i = 1; i < n; i++) {
+        if ((source[i] & 0xc0) != 0x80) return 0;
+        *c = (*c << 6) | (source[i] & 0x3f);
+    }
+    if (*c < min || *c > 0x10ffff || (*c >= 0xd800 && *c <= 0xdfff)) return 0;
+
+    return n;
+}
+
+
+/**
+ * @brief   Codifica un punto de código en UTF-8 a continuación de lo ya escrito.
+ *
+ * @param c         Punto de código.
+ * @param dst       Buffer de salida.
+ * @param written   Bytes ya escritos en dst; se actualiza.
+ * @param capacity  Tamaño de dst.
+ *
+ * @return  true si cupo; false en caso contrario.
+ */
+static inline bool put_utf8(uint32_t c, uint8_t *dst, size_t *written, size_t capacity) {
+    uint8_t *out = dst + *written;
+
+    if (c < 0x80) {
+        if (*written + 1 > capacity) return false;
+        out[0] = c;
+        *written += 1;
+    } else if (c < 0x800) {
+        if (*written + 2 > capacity) return false;
+        out[0] = 0xc0 | (c >> 6);
+        out[1] = 0x80 | (c & 0x3f);
+        *written += 2;
+    } else if (c < 0x10000) {
+        if (*written + 3 > capacity) return false;
+        out[0] = 0xe0 | (c >> 12);
+        out[1] = 0x80 | ((c >> 6) & 0x3f);
+        out[2] = 0x80 | (c & 0x3f);
+        *written += 3;
+    } else {
+        if (*written + 4 > capacity) return false;
+        out[0] = 0xf0 | (c >> 18);
+        out[1] = 0x80 | ((c >> 12) & 0x3f);
+        out[2] = 0x80 | ((c >> 6) & 0x3f);
+        out[3] = 0x80 | (c & 0x3f);
+        *written += 4;
+    }
+
+    return true;
+}
+
+
+/**
+ * @brief   Aplica una tabla de cambio de caja a cada punto de código del texto.
+ */
+static ssize_t map_codepoints(const struct TransformOperation *operation, const uint8_t *source, size_t len, uint8_t *destination, size_t capacity) {
+    size_t i = 0, written = 0, n;
+    uint32_t c;
+
+    while (i < len) {
+        if (!(n = decode_utf8(source + i, len - i, &c))) {
+            /* Byte que no empieza una secuencia válida: se copia sin tocar */
+            if (written + 1 > capacity) return -1;
+            destination[written++] = source[i++];
+            continue;
+        }
+        if (!put_utf8(lookup_codepoint(operation->index, c), destination, &written, capacity)) return -1;
+        i += n;
+    }
+
+    return written;
+}
+
+
+/**
+ * @brief   Forma de título: la primera letra de cada palabra con la tabla de título, las demás en minúscula.
+ */
+static ssize_t map_title(const struct TransformOperation *operation, const uint8_t *source, size_t len, uint8_t *destination, size_t capacity) {
+    size_t i = 0, written = 0, n;
+    uint32_t c;
+    bool in_word = false;
+
+    while (i < len) {
+        if (!(n = decode_utf8(source + i, len - i, &c))) {
+            if (written + 1 > capacity) return -1;
+            destination[written++] = source[i++];
+            in_word = false;
+            continue;
+        }
+        if (!put_utf8(lookup_codepoint(in_word ? transform_lower_index : operation->index, c), destination, &written, capacity)) return -1;
+        in_word = is_word_codepoint(c);
+        i += n;
+    }
+
+    return written;
+}
+
+
+/**
+ * @brief   Aplica una tabla de 256 bytes byte a byte (los bytes de UTF-8 fuera de ASCII no cambian).
+ */
+static ssize_t map_bytes(const struct TransformOperation *operation, const uint8_t *source, size_t len, uint8_t *destination, size_t capacity) {
+    if (len > capacity) return -1;
+
+    for (size_t i = 0; i < len; i++) {
+        destination[i] = operation->bytes[source[i]];
+    }
+
+    return len;
+}
+
+
+/* Tabla de operaciones, indexada por el código de operación */
+static const struct TransformOperation operations[TRANSFORM_COUNT] = {
+        [TRANSFORM_UPPER] = {"mayusculas", map_codepoints, transform_upper_index, NULL},
+        [TRANSFORM_LOWER] = {"minusculas", map_codepoints, transform_lower_index, NULL},
+        [TRANSFORM_TITLE] = {"titulo", map_title, transform_title_index, NULL},
+        [TRANSFORM_FOLD] = {"plegado", map_codepoints, transform_fold_index, NULL},
+        [TRANSFORM_ASCII_UPPER] = {"mayusculas-ascii", map_bytes, NULL, transform_ascii_upper_bytes},
+        [TRANSFORM_ASCII_LOWER] = {"minusculas-ascii", map_bytes, NULL, transform_ascii_lower_bytes},
+        [TRANSFORM_ROT13] = {"rot13", map_bytes, NULL, transform_rot13_bytes}
+};
+
+
+/**
+ * @brief   Aplica una operación a un texto UTF-8.
+ *
+ * @param op            Operación a aplicar.
+ * @param source        Texto a transformar.
+ * @param len           Número de bytes de source.
+ * @param destination   Buffer en el que escribir el resultado (sin nulo final).
+ * @param capacity      Tamaño de destination.
+ *
+ * @return  Número de bytes escritos en destination; -1 si la operación no existe o el resultado no cabe en capacity.
+ */
+ssize_t transform_text(enum TransformOp op, const char *source, size_t len, char *destination, size_t capacity) {
+    if ((unsigned) op >= TRANSFORM_COUNT) return -1;
+
+    return operations[op].apply(&operations[op], (const uint8_t *) source, len, (uint8_t *) destination, capacity);
+}
+
+
+/**
+ * @brief   Nombre de una operación, tal como se da en la línea de comandos.
+ *
+ * @param op    Operación.
+ *
+ * @return  Nombre de la operación; "desconocida" si no existe.
+ */
+const char *transform_name(enum TransformOp op) {
+    return (unsigned) op < TRANSFORM_COUNT ? operations[op].name : "desconocida";
+}
+
+
+/**
+ * @brief   Busca una operación por su nombre.
+ *
+ * @param name  Nombre de la operación.
+ *
+ * @return  Código de la operación; -1 si no hay ninguna con ese nombre.
+ */
+int transform_from_name(const char *name) {
+    for (int op = 0; op < TRANSFORM_COUNT; op++) {
+        if (!strcmp(name, operations[op].name)) return op;
+    }
+
+    return -1;
+}
+
+
+/**
+ * @brief   Lista los nombres de todas las operaciones, separados por comas.
+ *
+ * @return  String estática con los nombres.
+ */
+const char *transform_names(void) {
+    static char names[256];
+
+    if (!names[0]) {
+        for (int op = 0; op < TRANSFORM_COUNT; op++) {
+            if (op) strcat(names, ", ");
+            strcat(names, operations[op].name);
+        }
+    }
+
+    return names;
+}
+
+
+/**
+ * @brief   Escribe la cabecera de operación de una petición.
+ *
+ * @param buffer    Buffer de al menos TRANSFORM_HEADER_LEN bytes.
+ * @param op        Operación a pedir.
+ *
+ * @return  Número de bytes escritos: 0 con TRANSFORM_DEFAULT, que no lleva cabecera.
+ */
+size_t transform_header_write(void *buffer, enum TransformOp op) {
+    if (op == TRANSFORM_DEFAULT) return 0;
+
+    ((uint8_t *) buffer)[0] = TRANSFORM_HEADER_MARKER;
+    ((uint8_t *) buffer)[1] = op;
+
+    return TRANSFORM_HEADER_LEN;
+}
+
+
+/**
+ * @brief   Lee la cabecera de operación de una petición, si la tiene, y la salta.
+ *
+ * @param message   Petición; si tiene cabecera, se avanza tras ella.
+ * @param len       Longitud de la petición; si tiene cabecera, se descuenta.
+ *
+ * @return  Código de la operación (TRANSFORM_DEFAULT sin cabecera); -1 si la operación no existe.
+ */
+int transform_header_parse(char **message, size_t *len) {
+    uint8_t op;
+
+    if (*len < TRANSFORM_HEADER_LEN || (uint8_t) (*message)[0] != TRANSFORM_HEADER_MARKER) return TRANSFORM_DEFAULT;
+
+    op = (*message)[1];
+    *message += TRANSFORM_HEADER_LEN;
+    *len -= TRANSFORM_HEADER_LEN;
+
+    return op < TRANSFORM_COUNT ? op : -1;
+}
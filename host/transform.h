@@ -0,0 +1,112 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Transformaciones de texto que sirve servidorUDP.
+ *
+ * Cada operación se aplica sobre texto UTF-8 con tablas precalculadas al compilar (ver gentransform.c):
+ * las de cambio de caja dan el destino de cada punto de código Unicode, y las ASCII el de cada byte.
+ * Se despachan por una tabla de funciones indexada por el código de operación, sin nada que preparar
+ * por petición. Las secuencias UTF-8 no válidas se copian tal cual.
+ *
+ * La operación va en una cabecera delante de la petición (sea texto o trama comprimida):
+ *
+ *  +--------+-----------+---------------------+
+ *  | 0x01   | operación | petición original   |
+ *  | 1 byte | 1 byte    |                     |
+ *  +--------+-----------+---------------------+
+ *
+ * Las peticiones sin cabecera se pasan a mayúsculas, como en el protocolo original, así que la
+ * cabecera solo se añade con las demás operaciones.
+ */
+
+/* Primer byte de la cabecera de operación (ningún mensaje de texto ni trama comprimida empieza por él) */
+#define TRANSFORM_HEADER_MARKER 0x01
+
+/* Tamaño de la cabecera de operación */
+#define TRANSFORM_HEADER_LEN 2
+
+/* Primer byte de la respuesta con la que el servidor rechaza una petición cuyo resultado no cabe en un datagrama;
+ * le sigue el motivo, en texto terminado en nulo (ninguna respuesta de texto ni trama comprimida empieza por él) */
+#define TRANSFORM_ERROR_MARKER 0x03
+
+/**
+ * Códigos de operación (son los que viajan en la cabecera: no cambiar sus valores).
+ */
+enum TransformOp {
+    TRANSFORM_UPPER = 0,        /* Mayúsculas (Unicode) */
+    TRANSFORM_LOWER = 1,        /* Minúsculas (Unicode) */
+    TRANSFORM_TITLE = 2,        /* Forma de título: primera letra de cada palabra en mayúscula, el resto en minúscula */
+    TRANSFORM_FOLD = 3,         /* Plegado de caja, para comparar sin distinguir mayúsculas */
+    TRANSFORM_ASCII_UPPER = 4,  /* Mayúsculas solo de las letras ASCII */
+    TRANSFORM_ASCII_LOWER = 5,  /* Minúsculas solo de las letras ASCII */
+    TRANSFORM_ROT13 = 6,        /* ROT13 de las letras ASCII */
+    TRANSFORM_COUNT
+};
+
+/* Operación de las peticiones sin cabecera */
+#define TRANSFORM_DEFAULT TRANSFORM_UPPER
+
+/**
+ * @brief   Aplica una operación a un texto UTF-8.
+ *
+ * @param op            Operación a aplicar.
+ * @param source        Texto a transformar.
+ * @param len           Número de bytes de source.
+ * @param destination   Buffer en el que escribir el resultado (sin nulo final).
+ * @param capacity      Tamaño de destination.
+ *
+ * @return  Número de bytes escritos en destination; -1 si la operación no existe o el resultado no cabe en capacity.
+ */
+ssize_t transform_text(enum TransformOp op, const char *source, size_t len, char *destination, size_t capacity);
+
+/**
+ * @brief   Nombre de una operación, tal como se da en la línea de comandos.
+ *
+ * @param op    Operación.
+ *
+ * @return  Nombre de la operación; "desconocida" si no existe.
+ */
+const char *transform_name(enum TransformOp op);
+
+/**
+ * @brief   Busca una operación por su nombre.
+ *
+ * @param name  Nombre de la operación.
+ *
+ * @return  Código de la operación; -1 si no hay ninguna con ese nombre.
+ */
+int transform_from_name(const char *name);
+
+/**
+ * @brief   Lista los nombres de todas las operaciones, separados por comas.
+ *
+ * @return  String estática con los nombres.
+ */
+const char *transform_names(void);
+
+/**
+ * @brief   Escribe la cabecera de operación de una petición.
+ *
+ * @param buffer    Buffer de al menos TRANSFORM_HEADER_LEN bytes.
+ * @param op        Operación a pedir.
+ *
+ * @return  Número de bytes escritos: 0 con TRANSFORM_DEFAULT, que no lleva cabecera.
+ */
+size_t transform_header_write(void *buffer, enum TransformOp op);
+
+/**
+ * @brief   Lee la cabecera de operación de una petición, si la tiene, y la salta.
+ *
+ * @param message   Petición; si tiene cabecera, se avanza tras ella.
+ * @param len       Longitud de la petición; si tiene cabecera, se descuenta.
+ *
+ * @return  Código de la operación (TRANSFORM_DEFAULT sin cabecera); -1 si la operación no existe.
+ */
+int transform_header_parse(char **message, size_t *len);
+
+#endif /* TRANSFORM_H */
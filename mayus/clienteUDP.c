@@ -5,12 +5,35 @@
 #include <string.h>
 #include <stdbool.h>
 #include <arpa/inet.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <inttypes.h>
 
 #include "host.h"
 #include "loging.h"
+#include "timestamps.h"
+#include "traffic.h"
+#include "busypoll.h"
+#include "compress.h"
+#include "shmring.h"
+#include "transform.h"
+#include "filewriter.h"
+#include "probes.h"
+#include "histogram.h"
+#include "crc32c.h"
+#include "checkpoint.h"
+#include "localtransform.h"
 
 
-#define DEFAULT_MAX_BYTES_RECV 2048
+#define DEFAULT_MAX_BYTES_RECV 65536    /* Cabe cualquier datagrama UDP, incluidas las tramas comprimidas */
+
+#define DEFAULT_BATCH_BYTES 16384       /* Bytes de líneas que se agrupan en cada trama comprimida */
+
+#define SHM_POLL_MS 100     /* Cada cuánto se comprueba si hay que terminar mientras se espera en el canal de memoria compartida */
 
 #define DEFAULT_INPUT_FILE_NAME "leeme.txt"
 
@@ -22,6 +45,48 @@
 
 #define DEFAULT_LOG_FILE "clienteUDP.log"
 
+#define DEFAULT_SPINS_BEFORE_SLEEP 1000000    /* Sondeos vacíos seguidos antes de dormir en modo de espera activa */
+
+#define DEFAULT_RETRANSMIT_MS 200   /* Espera por una respuesta antes de reenviar la petición (con CRC32C) */
+
+#define MAX_RETRANSMITS 10          /* Reenvíos seguidos de una misma petición antes de dar al servidor por perdido */
+
+#define DEFAULT_CHECKPOINT_S 5      /* Cada cuántos segundos se guarda el punto de control de la transferencia */
+
+#define DEFAULT_BATCH_CONCURRENCY 16    /* Archivos del lote que se transforman a la vez */
+
+#define MAX_BATCH_CONCURRENCY 256   /* El hueco de cada archivo va en los 8 bits bajos del número de secuencia */
+
+
+/**
+ * Qué se informa de la transferencia del archivo.
+ */
+struct ReportConfig {
+    bool quiet;             /* No mostrar cada línea (o lote) enviada y recibida */
+    unsigned progress_s;    /* Cada cuántos segundos mostrar el progreso (0 para no mostrarlo) */
+    char *json_file;        /* Archivo en el que escribir el informe en JSON ("-" para stdout, NULL para no escribirlo) */
+    FILE *json_stdout;      /* Con json_file "-", la salida estándar original, reservada para el informe JSON */
+};
+
+
+/**
+ * Comprobación de integridad de los datos (ver crc32c.h).
+ */
+struct IntegrityConfig {
+    bool enabled;               /* Pedir al servidor la cabecera de integridad y comprobar el archivo de salida */
+    unsigned retransmit_ms;     /* Espera por una respuesta antes de reenviar la petición (0 para no reenviar por tiempo) */
+};
+
+
+/**
+ * Lote de archivos que transformar a la vez (ver handle_batch).
+ */
+struct BatchConfig {
+    char **paths;           /* Archivos, directorios o listas (@lista) que forman el lote (NULL si no hay lote) */
+    size_t path_count;      /* Número de rutas de paths */
+    unsigned concurrency;   /* Archivos del lote en curso a la vez (hilos con --local; 0 para el valor por defecto) */
+};
+
 
 /**
  * Estructura de datos para pasar a la función process_args.
@@ -31,9 +96,131 @@
 struct Arguments {
     char *input_file_name;
     uint16_t local_port;
-    char *server_ip;
+    char *local_path;       /* Ruta del socket local (AF_UNIX); NULL para usar un nombre asignado por el núcleo */
+    char *server_ip;        /* IP del servidor, o ruta de su socket si contiene alguna '/' */
     uint16_t server_port;
+    bool seqpacket;         /* Usar SOCK_SEQPACKET en lugar de datagramas (solo con sockets locales) */
+    bool connected;         /* Conectar el socket de datagramas al servidor */
     char *logfile;
+    SpinConfig spin;
+    bool compress;
+    bool shared_memory;
+    enum TransformOp transform;     /* Operación que se pide al servidor */
+    bool writeback;                 /* Volcar el archivo de salida a disco por tramos mientras se escribe */
+    struct ReportConfig report;
+    struct IntegrityConfig integrity;
+    unsigned checkpoint_s;          /* Cada cuántos segundos guardar el punto de control (0 para no guardarlo ni reanudar) */
+    struct BatchConfig batch;
+    bool local;                     /* Transformar en esta máquina, sin servidor */
+};
+
+/**
+ * Estadísticas del tiempo de ida y vuelta (RTT) de las peticiones al servidor.
+ */
+struct RttStats {
+    uint64_t kernel_samples;    /* Cuántos se midieron con marcas de tiempo del núcleo en ambos extremos */
+    Histogram histogram;        /* RTTs medidos, en nanosegundos (cuántos, mínimo, máximo, media y percentiles) */
+};
+
+/**
+ * Progreso de la transferencia de las líneas del archivo.
+ */
+struct TransferStats {
+    uint64_t start_ns;          /* Inicio del envío de las líneas (CLOCK_MONOTONIC) */
+    uint64_t end_ns;            /* Fin del envío de las líneas (CLOCK_MONOTONIC) */
+    uint64_t requests;          /* Peticiones enviadas */
+    uint64_t replies;           /* Peticiones respondidas */
+    uint64_t lines;             /* Líneas respondidas */
+    uint64_t bytes;             /* Bytes de texto de las líneas respondidas */
+    uint64_t retransmits;       /* Peticiones reenviadas por no recibir una respuesta válida */
+    uint64_t checksum_errors;   /* Respuestas descartadas por CRC32C erróneo */
+    uint64_t stale_replies;     /* Respuestas atrasadas (de una petición ya respondida) descartadas */
+    bool file_checked;          /* Se comprobó el CRC32C del archivo de salida */
+    uint32_t received_crc;      /* CRC32C de los datos entregados al escritor */
+    uint32_t written_crc;       /* CRC32C del archivo de salida, leído de disco al terminar */
+    bool resumed;               /* La transferencia se reanudó desde un punto de control */
+    uint64_t resumed_offset;    /* Byte del archivo de entrada desde el que se reanudó */
+    uint64_t checkpoints;       /* Puntos de control guardados */
+    uint64_t files;             /* Archivos del lote transformados */
+    uint64_t files_failed;      /* Archivos del lote que no se pudieron transformar */
+    uint64_t files_skipped;     /* Archivos del lote que no se transforman porque ya son su propia salida */
+    uint64_t last_report_ns;    /* Instante del último informe de progreso */
+    uint64_t last_lines;        /* Líneas respondidas en el último informe de progreso */
+    uint64_t last_bytes;        /* Bytes respondidos en el último informe de progreso */
+};
+
+/**
+ * Archivos del lote, en el orden en que se transforman.
+ */
+struct BatchQueue {
+    char **files;       /* Rutas de los archivos */
+    size_t count;       /* Número de archivos */
+    size_t capacity;    /* Tamaño de files */
+    size_t next;        /* Siguiente archivo que empezar */
+    enum TransformOp transform; /* Operación del lote, con la que se calcula el nombre de la salida de cada archivo */
+    size_t skipped;     /* Archivos que no se añadieron porque ya son su propia salida */
+};
+
+/**
+ * Archivos pequeños de un lote local, que se reparten enteros entre los hilos (ver handle_local).
+ */
+struct LocalBatch {
+    FILE *log;                      /* Registro del cliente (NULL si no hay) */
+    char **files;                   /* Archivos a transformar */
+    size_t count;                   /* Número de archivos */
+    enum TransformOp transform;     /* Operación a aplicar */
+    bool quiet;                     /* No mostrar el resultado de cada archivo */
+    pthread_mutex_t lock;           /* Protege lo que sigue */
+    size_t next;                    /* Siguiente archivo por repartir */
+    struct TransferStats *transfer; /* Archivos y bytes transformados */
+    uint64_t output_bytes;          /* Bytes escritos en las salidas */
+    uint64_t chunks;                /* Fragmentos transformados */
+};
+
+/**
+ * Qué espera cada hueco del lote.
+ */
+enum BatchState {
+    BATCH_IDLE,     /* Nada: no quedan archivos */
+    BATCH_NAME,     /* La respuesta al nombre del archivo */
+    BATCH_LINE      /* La respuesta a una línea */
+};
+
+/**
+ * Hueco del lote: un archivo en curso, con su única petición pendiente.
+ */
+struct BatchSlot {
+    unsigned index;             /* Posición del hueco (bits bajos del número de secuencia) */
+    enum BatchState state;
+    const char *input_name;     /* Archivo de entrada */
+    FILE *input;
+    char *output_name;          /* Archivo de salida (NULL hasta que responde al nombre) */
+    FILE *output;
+    char *line;                 /* Línea en curso (de getline) */
+    size_t line_capacity;
+    char request[COMPRESS_MAX_FRAME - CRC_HEADER_LEN];  /* Petición pendiente: cabe en un datagrama UDP con la cabecera de integridad */
+    size_t request_len;
+    size_t line_offset;         /* Dónde empieza la línea en request (tras la cabecera de operación) */
+    uint8_t header[CRC_HEADER_LEN];     /* Cabecera de integridad de la petición */
+    uint32_t generation;        /* Peticiones enviadas desde el hueco (bits altos del número de secuencia) */
+    uint32_t sequence;          /* Número de secuencia de la petición pendiente */
+    uint64_t sent_ns;           /* Último envío de la petición (CLOCK_MONOTONIC) */
+    uint64_t deadline_ns;       /* Cuándo reenviarla si no llega la respuesta (UINT64_MAX para no reenviarla) */
+    unsigned retransmits;       /* Reenvíos seguidos de la petición */
+};
+
+/**
+ * Lo que comparten todos los huecos del lote.
+ */
+struct BatchContext {
+    Host *local_client;
+    const struct sockaddr *destination;     /* Dirección de cada envío (NULL con el socket conectado) */
+    socklen_t destination_len;
+    enum TransformOp transform;
+    unsigned retransmit_ms;
+    struct BatchQueue *queue;
+    struct RttStats *rtt_stats;
+    struct TransferStats *transfer;
 };
 
 /**
@@ -48,6 +235,25 @@ enum Option {
     OPT_SERVER_PORT = 'p',
     OPT_LOG_FILE_NAME = 'l',
     OPT_NO_LOG = 'n',
+    OPT_SPIN = 's',
+    OPT_BUSY_POLL = 'b',
+    OPT_CPU = 'c',
+    OPT_SPINS_BEFORE_SLEEP = 'w',
+    OPT_COMPRESS = 'z',
+    OPT_UDP_ONLY = 'u',
+    OPT_SEQPACKET = 'q',
+    OPT_TRANSFORM = 't',
+    OPT_WRITEBACK = 'd',
+    OPT_CONNECTED = 'k',
+    OPT_QUIET = 'm',
+    OPT_PROGRESS = 'g',
+    OPT_JSON = 'j',
+    OPT_NO_CHECKSUM = 'x',
+    OPT_RETRANSMIT = 'r',
+    OPT_CHECKPOINT = 'e',
+    OPT_BATCH = 'a',
+    OPT_CONCURRENCY = 'y',
+    OPT_LOCAL = 'v',
     OPT_HELP = 'h'
 };
 
@@ -84,241 +290,2080 @@ static void print_help(char *exe_name);
  */
 static uint16_t getPortOrFail(char **argv, int pos);
 
-/**
- * @brief   Maneja el intercambio de datos con el servidor.
- *
- * Abre el archivo input_file_name, lo lee línea a línea, envía cada línea
- * al servidor para que este las pase a mayúsculas, y las escribe en un fichero
- * con el mismo nombre que input_file_name pero todo también en mayúsculas.
- *
- * @param local_client      Cliente que intercambia datos.
- * @param remote_server     Servidor con el que intercambiar datos.
- * @param input_file_name   Nombre del archivo de texto a transformar a mayúsculas.
- */
-void handle_data(Host *local_client, Host *remote_server, char *input_file_name);
+/**
+ * @brief   Obtiene un número no negativo de los argumentos del programa.
+ *
+ * @param argv  Lista con los argumentos del programa.
+ * @param pos   Posición en argv en la que se encuentra la string que se quiere interpretar.
+ *
+ * @return  Número leído de los argumentos del programa; falla si no es un número no negativo.
+ */
+static long getNonNegativeNumberOrFail(char **argv, int pos);
+
+/**
+ * @brief   Maneja el intercambio de datos con el servidor.
+ *
+ * Abre el archivo input_file_name, lo lee línea a línea, envía cada línea
+ * al servidor para que este las pase a mayúsculas (u otra operación, con transform), y las escribe
+ * en un fichero con el mismo nombre que input_file_name pero transformado de la misma forma.
+ * Las operaciones distintas de las mayúsculas se piden con una cabecera delante de cada petición.
+ *
+ * Si se pide compresión y el servidor la acepta en el intercambio del nombre del archivo,
+ * las líneas se agrupan en lotes de hasta DEFAULT_BATCH_BYTES bytes que viajan, en ambos
+ * sentidos, como tramas comprimidas.
+ *
+ * Si el servidor está en la misma máquina, se le ofrece además un canal de memoria compartida;
+ * si lo acepta, las peticiones y respuestas posteriores al nombre del archivo van por él en lugar
+ * de por el socket.
+ *
+ * El archivo de salida lo escribe un hilo aparte (ver filewriter.h): las respuestas se reciben o
+ * descomprimen directamente en sus bloques, y el disco no frena el intercambio con el servidor.
+ *
+ * El RTT de cada petición se guarda en un histograma; al terminar se informa de sus percentiles y del
+ * ritmo de la transferencia (ver report_transfer).
+ *
+ * Si se pide integridad y el servidor la acepta, cada petición y cada respuesta por el socket llevan
+ * una cabecera con número de secuencia y CRC32C (ver crc32c.h). Una respuesta con CRC erróneo provoca
+ * el reenvío inmediato de la petición, y la falta de respuesta, el reenvío tras integrity->retransmit_ms;
+ * las respuestas atrasadas se reconocen por su número de secuencia y se descartan. Al terminar se
+ * comprueba además que el CRC32C del archivo de salida, leído de disco, coincide con el de los datos
+ * recibidos.
+ *
+ * Cada checkpoint_s segundos se guarda un punto de control (ver checkpoint.h) con lo ya respondido. Si
+ * al empezar hay uno del mismo archivo de entrada y operación, la transferencia se reanuda desde él: se
+ * salta esa parte de la entrada y se recorta la salida a lo anotado. Al terminar bien, se borra.
+ *
+ * @param local_client      Cliente que intercambia datos.
+ * @param remote_server     Servidor con el que intercambiar datos.
+ * @param input_file_name   Nombre del archivo de texto a transformar a mayúsculas.
+ * @param spin              Configuración del modo de espera activa; si está activo, las respuestas
+ *                          se esperan sondeando el socket en lugar de durmiendo.
+ * @param compress          Pedir al servidor que los datos viajen comprimidos.
+ * @param shared_memory     Ofrecer un canal de memoria compartida si el servidor es local.
+ * @param transform         Operación que pedir al servidor.
+ * @param writeback         Volcar el archivo de salida a disco por tramos (sync_file_range) y sacarlo de la caché.
+ * @param connected         El socket del cliente está conectado al servidor: se envía y recibe sin direcciones.
+ * @param report            Qué se informa de la transferencia (líneas, progreso e informe JSON).
+ * @param integrity         Comprobación de integridad de los datos (CRC32C y reenvíos).
+ * @param checkpoint_s      Cada cuántos segundos guardar el punto de control (0 para no guardarlo ni reanudar).
+ */
+void handle_data(Host *local_client, Host *remote_server, char *input_file_name, const SpinConfig *spin, bool compress, bool shared_memory, enum TransformOp transform, bool writeback,
+                 bool connected, const struct ReportConfig *report, const struct IntegrityConfig *integrity, unsigned checkpoint_s);
+
+/**
+ * @brief   Transforma un lote de archivos a la vez por un mismo socket.
+ *
+ * Cada archivo del lote se transforma como con handle_data (nombre y después línea a línea, sin
+ * compresión ni memoria compartida), pero hasta batch->concurrency archivos van a la vez, cada uno
+ * en un hueco con una única petición pendiente. Todas las peticiones llevan la cabecera de integridad
+ * (ver crc32c.h): su número de secuencia lleva en los 8 bits bajos el hueco del archivo y en el resto
+ * un contador, y como el servidor lo repite en la respuesta, esta dice a qué archivo pertenece sin que
+ * el servidor guarde ningún estado. Una petición sin respuesta válida se reenvía tras
+ * integrity->retransmit_ms; tras MAX_RETRANSMITS reenvíos seguidos se abandona el archivo y el hueco
+ * pasa al siguiente.
+ *
+ * El archivo de salida de cada uno se crea en el mismo directorio que el de entrada.
+ *
+ * @param local_client  Cliente que intercambia datos.
+ * @param remote_server Servidor con el que intercambiar datos.
+ * @param batch         Archivos del lote y cuántos transformar a la vez.
+ * @param transform     Operación que pedir al servidor.
+ * @param connected     El socket del cliente está conectado al servidor: se envía y recibe sin direcciones.
+ * @param report        Qué se informa de la transferencia (progreso e informe JSON).
+ * @param integrity     Espera antes de reenviar una petición.
+ *
+ * @return  true si se transformaron todos los archivos; false si alguno falló o se pidió terminar antes.
+ */
+bool handle_batch(Host *local_client, Host *remote_server, const struct BatchConfig *batch, enum TransformOp transform, bool connected,
+                  const struct ReportConfig *report, const struct IntegrityConfig *integrity);
+
+/**
+ * @brief   Transforma archivos en esta máquina, sin servidor.
+ *
+ * Cada archivo (input_file_name o, si hay lote, los del lote) se transforma con varios hilos y la misma
+ * función que usa el servidor (ver localtransform.h), y su salida se crea en el mismo directorio con el
+ * nombre transformado, como en un lote. En un lote, los archivos menores que LOCAL_TRANSFORM_CHUNK_SIZE
+ * (un solo fragmento) se reparten enteros entre los hilos, uno por hilo. Sirve de referencia para medir
+ * lo que cuesta la red.
+ *
+ * @param log               Registro del cliente (NULL si no hay).
+ * @param input_file_name   Archivo a transformar si no hay lote.
+ * @param batch             Archivos del lote (sin rutas si no hay lote) y número de hilos.
+ * @param transform         Operación a aplicar.
+ * @param report            Qué se informa de la transformación (cada archivo e informe JSON).
+ *
+ * @return  true si se transformaron todos los archivos; false si alguno falló.
+ */
+bool handle_local(FILE *log, char *input_file_name, const struct BatchConfig *batch, enum TransformOp transform, const struct ReportConfig *report);
+
+/**
+ * @brief   Transforma un archivo en esta máquina y crea su salida junto a él.
+ *
+ * @param log           Registro del cliente (NULL si no hay).
+ * @param input_name    Archivo de entrada.
+ * @param transform     Operación a aplicar.
+ * @param threads       Hilos que usar.
+ * @param stats         Dónde guardar el resultado.
+ *
+ * @return  true si se transformó; false en caso contrario (ya informado).
+ */
+static bool transform_local_file(FILE *log, const char *input_name, enum TransformOp transform, unsigned threads, LocalTransformStats *stats);
+
+/**
+ * @brief   Hilo que transforma, cada uno con un solo hilo, archivos de un lote local hasta que no quedan.
+ *
+ * Un archivo menor que LOCAL_TRANSFORM_CHUNK_SIZE es un solo fragmento: repartirlo entre varios hilos no
+ * serviría de nada, así que lo que se reparte son los archivos.
+ *
+ * @param arg   Lote (struct LocalBatch).
+ *
+ * @return  NULL.
+ */
+static void *transform_local_batch(void *arg);
+
+/**
+ * @brief   Anota en un lote local el resultado de un archivo y, si no se pidió silencio, lo muestra.
+ *
+ * @param batch         Lote.
+ * @param input_name    Archivo transformado.
+ * @param done          Si se transformó.
+ * @param stats         Resultado de la transformación.
+ */
+static void local_file_done(struct LocalBatch *batch, const char *input_name, bool done, const LocalTransformStats *stats);
+
+/**
+ * @brief   Añade a la cola del lote los archivos de una ruta.
+ *
+ * La ruta puede ser un archivo, un directorio (se añaden sus archivos normales, en orden alfabético y
+ * sin los puntos de control) o "@lista", un archivo con una ruta por línea ("@-" para la entrada estándar;
+ * se ignoran las líneas vacías y las que empiezan por '#'). No se añaden (y se cuentan en queue->skipped)
+ * los archivos cuyo nombre no cambia con la operación del lote, como las salidas de una ejecución anterior
+ * en el mismo directorio: su salida sería el propio archivo.
+ *
+ * @param path      Ruta.
+ * @param queue     Cola del lote.
+ *
+ * @return  true si se pudo leer; false en caso contrario (errno indica el motivo).
+ */
+static bool collect_batch_files(const char *path, struct BatchQueue *queue);
+
+/**
+ * @brief   Añade un archivo al final de la cola del lote.
+ *
+ * @param queue     Cola del lote.
+ * @param file      Ruta del archivo (reservada con malloc; la cola pasa a ser su dueña).
+ *
+ * @return  true si se añadió; false si no hay memoria.
+ */
+static bool batch_queue_add(struct BatchQueue *queue, char *file);
+
+/**
+ * @brief   Indica si un archivo sería su propia salida: su nombre no cambia al aplicarle la operación.
+ *
+ * @param path      Ruta del archivo.
+ * @param transform Operación a aplicar.
+ *
+ * @return  true si el nombre transformado es el mismo; false en otro caso.
+ */
+static bool is_own_output(const char *path, enum TransformOp transform);
+
+/**
+ * @brief   Compara dos nombres de archivo para qsort.
+ */
+static int compare_names(const void *a, const void *b);
+
+/**
+ * @brief   Empieza en un hueco el siguiente archivo de la cola: lo abre y envía su nombre.
+ *
+ * Los archivos que no se pueden abrir se cuentan como fallidos y se pasa al siguiente.
+ *
+ * @param context   Estado del lote.
+ * @param slot      Hueco libre.
+ *
+ * @return  true si empezó un archivo; false si no quedan (el hueco queda libre).
+ */
+static bool batch_start_file(struct BatchContext *context, struct BatchSlot *slot);
+
+/**
+ * @brief   Envía la petición preparada en un hueco con un número de secuencia nuevo.
+ *
+ * @param context       Estado del lote.
+ * @param slot          Hueco con la petición en slot->request.
+ * @param request_len   Longitud de la petición.
+ */
+static void batch_send(struct BatchContext *context, struct BatchSlot *slot, size_t request_len);
+
+/**
+ * @brief   Envía (o reenvía) la petición pendiente de un hueco y fija su plazo de respuesta.
+ *
+ * Si la cola de envío del socket está llena, la petición se da por perdida: la reenviará su plazo.
+ *
+ * @param context   Estado del lote.
+ * @param slot      Hueco con una petición pendiente.
+ */
+static void batch_transmit(struct BatchContext *context, struct BatchSlot *slot);
+
+/**
+ * @brief   Reenvía la petición de un hueco cuyo plazo venció, o abandona su archivo si ya se reenvió demasiadas veces.
+ *
+ * @param context   Estado del lote.
+ * @param slot      Hueco con una petición pendiente.
+ *
+ * @return  true si el hueco sigue ocupado; false si quedó libre.
+ */
+static bool batch_retransmit(struct BatchContext *context, struct BatchSlot *slot);
+
+/**
+ * @brief   Atiende la respuesta a la petición pendiente de un hueco y envía la siguiente.
+ *
+ * La respuesta al nombre crea el archivo de salida; la respuesta a una línea se escribe en él. Después
+ * se envía la siguiente línea o, al final del archivo, se empieza el siguiente de la cola.
+ *
+ * @param context   Estado del lote.
+ * @param slot      Hueco al que pertenece la respuesta.
+ * @param reply     Respuesta (terminada en nulo).
+ *
+ * @return  true si el hueco sigue ocupado; false si quedó libre.
+ */
+static bool batch_handle_reply(struct BatchContext *context, struct BatchSlot *slot, const char *reply);
+
+/**
+ * @brief   Cierra los archivos de un hueco, lo cuenta como transformado o fallido y deja el hueco libre.
+ *
+ * @param context   Estado del lote.
+ * @param slot      Hueco ocupado.
+ * @param completed El archivo se transformó entero.
+ */
+static void batch_finish_file(struct BatchContext *context, struct BatchSlot *slot, bool completed);
+
+/**
+ * @brief   Añade un token de negociación a un mensaje, tras su último nulo.
+ *
+ * @param message   Mensaje (nombre del archivo y tokens ya añadidos, cada uno terminado en nulo).
+ * @param len       Longitud actual del mensaje.
+ * @param capacity  Tamaño del buffer del mensaje.
+ * @param token     Token a añadir.
+ *
+ * @return  Nueva longitud del mensaje; falla si el token no cabe.
+ */
+static size_t append_token(char *message, size_t len, size_t capacity, const char *token);
+
+/**
+ * @brief   Indica si la respuesta del servidor al nombre del archivo repite un token (es decir, lo acepta).
+ *
+ * @param reply     Respuesta recibida.
+ * @param len       Longitud de la respuesta.
+ * @param token     Token a buscar.
+ *
+ * @return  true si el token aparece tras el nombre del archivo en mayúsculas.
+ */
+static bool reply_has_token(const char *reply, size_t len, const char *token);
+
+/**
+ * @brief   Envía una petición por el canal de memoria compartida y espera su respuesta.
+ *
+ * @param local_client  Cliente (para saber si se pidió la terminación).
+ * @param channel       Canal de memoria compartida.
+ * @param payload       Petición.
+ * @param payload_len   Longitud de la petición.
+ * @param recv_buffer   Buffer de DEFAULT_MAX_BYTES_RECV bytes para la respuesta.
+ *
+ * @return  Longitud de la respuesta; -1 si se pidió la terminación mientras se esperaba. Falla si el
+ *          servidor cierra el canal.
+ */
+static ssize_t shm_exchange(Host *local_client, ShmChannel *channel, const char *payload, size_t payload_len, char *recv_buffer);
+
+/**
+ * @brief   Calcula el CRC32C del principio de un archivo.
+ *
+ * @param path      Ruta del archivo.
+ * @param len       Bytes del principio del archivo que cubrir (UINT64_MAX para el archivo entero).
+ * @param crc       Dónde guardar el CRC.
+ *
+ * @return  true si se pudo leer hasta len bytes o el final del archivo; false en caso contrario (errno indica el motivo).
+ */
+static bool file_crc32c(const char *path, uint64_t len, uint32_t *crc);
+
+/**
+ * @brief   Prepara el archivo de salida para reanudar la transferencia desde un punto de control.
+ *
+ * Comprueba que el archivo de salida tiene al menos lo anotado y, si se pide, que su CRC32C coincide
+ * con el anotado; después lo recorta a lo anotado (lo que hubiera después no llegó a confirmarse).
+ *
+ * @param local_client      Cliente (para su registro).
+ * @param output_file_name  Archivo de salida.
+ * @param saved             Punto de control guardado.
+ * @param check_crc         Comprobar el CRC32C de lo ya escrito.
+ *
+ * @return  true si se puede reanudar; false si hay que empezar de cero.
+ */
+static bool resume_output(Host *local_client, const char *output_file_name, const Checkpoint *saved, bool check_crc);
+
+/**
+ * @brief   Manda a disco el archivo de salida y guarda el punto de control.
+ *
+ * Un fallo no interrumpe la transferencia: se registra y se conserva el punto de control anterior.
+ *
+ * @param local_client  Cliente (para su registro).
+ * @param writer        Escritor del archivo de salida.
+ * @param path          Ruta del punto de control.
+ * @param checkpoint    Punto de control (se actualiza su CRC32C con el de transfer).
+ * @param transfer      Progreso de la transferencia (se cuenta el punto de control).
+ */
+static void save_checkpoint(Host *local_client, FileWriter *writer, const char *path, Checkpoint *checkpoint, struct TransferStats *transfer);
+
+/**
+ * @brief   Calcula y registra el RTT de una petición.
+ *
+ * Usa las marcas de tiempo del núcleo de envío de la petición y de llegada de la respuesta
+ * si están disponibles, de forma que el RTT no incluya el tiempo que la respuesta pasó en la
+ * cola del socket ni el de planificación del cliente. Si falta alguna, usa los instantes
+ * medidos en espacio de usuario.
+ *
+ * @param stats         Estadísticas de RTT a actualizar.
+ * @param user_tx_ns    Instante (CLOCK_REALTIME) justo antes de enviar la petición.
+ * @param kernel_tx_ts  Marca de tiempo del núcleo de envío de la petición (a cero si no hay).
+ * @param kernel_rx_ts  Marca de tiempo del núcleo de llegada de la respuesta (a cero si no hay).
+ *
+ * @return  RTT medido en nanosegundos.
+ */
+static uint64_t account_rtt(struct RttStats *stats, uint64_t user_tx_ns, const struct timespec *kernel_tx_ts, const struct timespec *kernel_rx_ts);
+
+/**
+ * @brief   Tiempo hasta el próximo informe de progreso, para no esperar más que eso por una respuesta.
+ *
+ * @param report    Qué se informa de la transferencia.
+ * @param transfer  Progreso de la transferencia.
+ *
+ * @return  Milisegundos hasta el próximo informe; -1 si no se informa del progreso.
+ */
+static int progress_wait_ms(const struct ReportConfig *report, const struct TransferStats *transfer);
+
+/**
+ * @brief   Muestra el progreso de la transferencia si toca.
+ *
+ * Muestra las líneas y bytes respondidos, el ritmo desde el informe anterior, las peticiones que esperan
+ * respuesta y las reenviadas.
+ *
+ * @param report    Qué se informa de la transferencia.
+ * @param transfer  Progreso de la transferencia (se anota el informe).
+ */
+static void report_progress(const struct ReportConfig *report, struct TransferStats *transfer);
+
+/**
+ * @brief   Informa del resultado de la transferencia: RTT (con percentiles) y ritmo.
+ *
+ * El informe se muestra como tabla y, si se pidió, se escribe también en JSON.
+ *
+ * @param log               Registro del cliente (NULL si no hay).
+ * @param input_file_name   Archivo transferido.
+ * @param report            Qué se informa de la transferencia.
+ * @param transfer          Progreso de la transferencia.
+ * @param rtt_stats         RTTs medidos.
+ */
+static void report_transfer(FILE *log, const char *input_file_name, const struct ReportConfig *report, const struct TransferStats *transfer,
+                            const struct RttStats *rtt_stats);
+
+/**
+ * @brief   Escribe una cadena en JSON, entre comillas y con los caracteres especiales escapados.
+ *
+ * @param json      Archivo en el que escribir.
+ * @param text      Cadena a escribir.
+ */
+static void print_json_string(FILE *json, const char *text);
+
+
+int main(int argc, char **argv) {
+    Host local_client, remote_server;
+
+    /* Inicializamos los parámetros a sus valores por defecto */
+    struct Arguments args = {
+            .input_file_name= DEFAULT_INPUT_FILE_NAME,
+            .local_port=DEFAULT_LOCAL_PORT,
+            .server_ip= DEFAULT_SERVER_IP,
+            .server_port= DEFAULT_SERVER_PORT,
+            .logfile= DEFAULT_LOG_FILE,
+            .spin = {
+                    .enabled = false,
+                    .busy_poll_us = 0,
+                    .cpu = -1,
+                    .spins_before_sleep = DEFAULT_SPINS_BEFORE_SLEEP
+            },
+            .compress = false,
+            .shared_memory = true,
+            .transform = TRANSFORM_DEFAULT,
+            .writeback = false,
+            .connected = false,
+            .report = {
+                    .quiet = false,
+                    .progress_s = 0,
+                    .json_file = NULL,
+                    .json_stdout = NULL
+            },
+            .integrity = {
+                    .enabled = true,
+                    .retransmit_ms = DEFAULT_RETRANSMIT_MS
+            },
+            .checkpoint_s = DEFAULT_CHECKPOINT_S,
+            .batch = {
+                    .paths = NULL,
+                    .path_count = 0,
+                    .concurrency = 0
+            },
+            .local = false
+    };
+    bool completed = true;
+
+    set_colors();
+
+    /* Recogemos los parámetros recibidos en la línea de comandos */
+    process_args(&args, argc, argv);
+
+    /* Con "-j -" la salida estándar queda solo para el informe JSON: todo lo demás (también lo que muestra
+     * la biblioteca de hosts) pasa a la salida de errores */
+    if (args.report.json_file && !strcmp(args.report.json_file, "-")) {
+        int json_fd = dup(STDOUT_FILENO);
+
+        if (json_fd < 0 || !(args.report.json_stdout = fdopen(json_fd, "w")) || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+            fail("ERROR: No se pudo reservar la salida estándar para el informe JSON");
+        }
+    }
+
+    /* Sin servidor no hace falta ningún socket: solo el registro */
+    if (args.local) {
+        FILE *log = NULL;
+
+        if (!args.batch.concurrency) args.batch.concurrency = (unsigned) sysconf(_SC_NPROCESSORS_ONLN);
+        if (args.logfile && !(log = fopen(args.logfile, "w"))) {
+            perror("No se pudo crear el log del cliente");
+        }
+
+        completed = handle_local(log, args.input_file_name, &args.batch, args.transform, &args.report);
+
+        if (log) fclose(log);
+        free(args.batch.paths);
+        exit(completed ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+    if (!args.batch.concurrency) args.batch.concurrency = DEFAULT_BATCH_CONCURRENCY;
+
+    if (is_unix_socket_path(args.server_ip)) {
+        int type = args.seqpacket ? SOCK_SEQPACKET : SOCK_DGRAM;
+
+        /* Con un servidor local el puerto de origen no tiene sentido: si no se dio una ruta, el núcleo asigna un nombre.
+         * Con SOCK_SEQPACKET el cliente solo se conecta, así que no necesita ruta propia */
+        local_client = create_own_unix_host(type, args.seqpacket ? NULL : args.local_path, args.logfile);
+        remote_server = create_remote_host(AF_UNIX, type, 0, args.server_ip, 0);
+
+        if (args.seqpacket && connect_host(&local_client, &remote_server) < 0) {
+            log_printf_err(local_client.log, "Error al conectar con el servidor.\n");
+            fail("No se pudo conectar con el servidor");
+        }
+    } else {
+        if (args.seqpacket || args.local_path) {
+            fprintf(stderr, "ERROR: Las rutas de origen y la opción --seqpacket solo se admiten con un servidor local (ruta de socket)\n");
+            exit(EXIT_FAILURE);
+        }
+
+        local_client = create_own_host(AF_INET, SOCK_DGRAM, 0, args.local_port, args.logfile);
+        remote_server = create_remote_host(AF_INET, SOCK_DGRAM, 0, args.server_ip, args.server_port);
+    }
+
+    /* Un socket de datagramas conectado solo acepta datagramas del servidor, y un ICMP de puerto inalcanzable
+     * hace fallar la siguiente operación (ECONNREFUSED) en lugar de dejar al cliente esperando una respuesta */
+    if (args.connected && !args.seqpacket && connect_host(&local_client, &remote_server) < 0) {
+        log_printf_err(local_client.log, "Error al conectar el socket con el servidor.\n");
+        fail("No se pudo conectar el socket con el servidor");
+    }
+
+    if (args.batch.paths) {
+        completed = handle_batch(&local_client, &remote_server, &args.batch, args.transform, args.connected || args.seqpacket, &args.report, &args.integrity);
+    } else {
+        handle_data(&local_client, &remote_server, args.input_file_name, &args.spin, args.compress, args.shared_memory, args.transform, args.writeback,
+                    args.connected || args.seqpacket, &args.report, &args.integrity, args.checkpoint_s);
+    }
+
+    printf("\nCerrando el cliente y saliendo...\n");
+
+    close_host(&local_client);
+    close_host(&remote_server);
+    free(args.batch.paths);
+
+    exit(completed ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+
+void handle_data(Host *local_client, Host *remote_server, char *input_file_name, const SpinConfig *spin, bool compress, bool shared_memory, enum TransformOp transform, bool writeback,
+                 bool connected, const struct ReportConfig *report, const struct IntegrityConfig *integrity, unsigned checkpoint_s) {
+    ssize_t sent_bytes = 0, recv_bytes = 0;
+    FILE *fp_input;
+    FileWriter writer;                          /* Hilo que escribe el archivo de salida */
+    char recv_buffer[DEFAULT_MAX_BYTES_RECV + 1];   /* Buffer de recepción */
+    char *reply_buffer;                         /* Dónde se recibe cada respuesta (sin compresión, en el bloque del escritor) */
+    char *output;
+    char *send_buffer = NULL;  /* Buffer de envío */
+    size_t buffer_size = 0; /* Necesitamos una variable con el tamaño del buffer para getline */
+    char batch[COMPRESS_MAX_RAW];               /* Lote de líneas a comprimir */
+    char frame[COMPRESS_MAX_FRAME];             /* Trama comprimida a enviar */
+    const char *payload;
+    size_t payload_len, batch_len, batch_lines, line_len = 0;
+    size_t header_len;                          /* Longitud de la cabecera de operación (0 con las mayúsculas) */
+    struct stat input_stat, output_stat;
+    ssize_t line_read, frame_len, reply_len;
+    bool pending_line = false;  /* Hay una línea leída que no cupo en el lote anterior */
+    uint64_t raw_sent = 0, wire_sent = 0, raw_received = 0, wire_received = 0;
+    struct sockaddr_storage reply_address;      /* Remitente de cada respuesta (no se usa, pero recvfrom lo pide) */
+    socklen_t reply_address_len;
+    const struct sockaddr *destination;         /* Dirección de cada envío (NULL con el socket conectado) */
+    socklen_t destination_len;
+    struct sockaddr *source;                    /* Dónde guardar el remitente de cada respuesta (NULL con el socket conectado) */
+    socklen_t *source_len;
+    char address_text[HOST_ADDRESS_STRLEN];
+    bool received_flag;
+    struct RttStats rtt_stats = {0};
+    struct TransferStats transfer = {0};
+    uint64_t request_lines, request_bytes;     /* Líneas y bytes de texto de la petición en curso */
+    struct timespec kernel_tx_ts, kernel_rx_ts;
+    uint64_t user_tx_ns, rtt_ns;
+    SpinStats spin_stats;
+    uint64_t poll_start;
+    ShmChannel channel;
+    char shm_token[SHM_TOKEN_MAX];
+    bool use_shm = false;
+    char *output_file_name;
+    uint8_t request_header[CRC_HEADER_LEN], reply_header[CRC_HEADER_LEN];   /* Cabeceras de integridad */
+    struct iovec request_iov[2], reply_iov[2];  /* Cabecera de integridad y mensaje (sin integridad, solo el mensaje) */
+    struct msghdr request_message;
+    size_t first_iov;
+    uint32_t sequence = 0, reply_sequence;
+    uint64_t retransmit_deadline_ns, now_ns;
+    unsigned request_retransmits;
+    int wait_ms;
+    bool checksummed = false, send_request;
+    char *checkpoint_path = NULL;               /* Punto de control (NULL si no se guarda) */
+    Checkpoint checkpoint = {0}, saved;
+    uint64_t request_input_bytes;               /* Bytes del archivo de entrada que cubre la petición en curso */
+    uint64_t next_checkpoint_ns = 0;
+    unsigned writer_flags = writeback ? FILE_WRITER_WRITEBACK : 0;
+
+    /* Con el socket conectado no se pasan direcciones: el núcleo usa la ruta que guardó al conectar
+     * y no hay que leer el remitente de cada respuesta (solo puede ser el servidor) */
+    destination = connected ? NULL : (const struct sockaddr *) &remote_server->address;
+    destination_len = connected ? 0 : remote_server->address_len;
+    source = connected ? NULL : (struct sockaddr *) &reply_address;
+    source_len = connected ? NULL : &reply_address_len;
+
+    /* Apertura de los archivos */
+    if (!(fp_input = fopen(input_file_name, "r"))) {
+        fail("ERROR: Error en la apertura del archivo de lectura");
+    }
+    posix_fadvise(fileno(fp_input), 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    wait_host_lookups(local_client);
+    log_and_stdout_printf(local_client->log, "IPs v4 del cliente local     : %s\n", HOST_INFO_TEXT(local_client->local_ips_v4));
+    log_and_stdout_printf(local_client->log, "IPs v6 del cliente local     : %s\n", HOST_INFO_TEXT(local_client->local_ips_v6));
+    log_and_stdout_printf(local_client->log, "Dirección del cliente local  : %s %s\n",
+                          describe_address((struct sockaddr *) &local_client->address, local_client->address_len, address_text, sizeof(address_text)),
+                          host_transport_name(local_client));
+    log_and_stdout_printf(local_client->log, "IP pública del cliente local : %s\n", HOST_INFO_TEXT(local_client->public_ip));
+
+    log_and_stdout_printf(local_client->log, "---------------------\n");
+
+    describe_address((struct sockaddr *) &remote_server->address, remote_server->address_len, address_text, sizeof(address_text));
+    log_and_stdout_printf(local_client->log, "Servidor remoto              : %s %s\n", address_text, host_transport_name(remote_server));
+
+    log_and_stdout_printf(local_client->log, "---------------------\n");
+
+    /* Marcas de tiempo del núcleo de envío y de llegada, para medir el RTT real de cada petición */
+    enable_kernel_timestamps(local_client, TIMESTAMP_RX | TIMESTAMP_TX);
+
+    if (spin->enabled) {
+        /* Modo de baja latencia: las respuestas se esperan sondeando el socket sin dormir */
+        configure_spin_mode(local_client, spin, &spin_stats);
+    }
+
+    /* Enviamos el nombre del archivo */
+    printf("Se procede a enviar el archivo: %s al servidor en: %s\n", input_file_name, address_text);
+
+    /* Si el servidor está en esta máquina le ofrecemos un canal de memoria compartida */
+    if (shared_memory && is_local_host(remote_server)) {
+        if (shm_channel_create(&channel, SHM_RING_CAPACITY)) {
+            shm_channel_token(&channel, shm_token);
+            use_shm = true;
+        } else {
+            perror("No se pudo crear el canal de memoria compartida");
+            log_printf_err(local_client->log, "Error al crear el canal de memoria compartida; se usará UDP.\n");
+        }
+    }
+
+    printf("\nEnviando el nombre del archivo (<<%s>>)%s%s%s\n", input_file_name, compress ? " y pidiendo compresión" : "",
+           integrity->enabled ? " e integridad (CRC32C)" : "", use_shm ? " y ofreciendo memoria compartida" : "");
+    log_and_stdout_printf(local_client->log, "Operación pedida al servidor : %s\n", transform_name(transform));
+
+    /* Todas las peticiones, incluida esta, llevan delante la cabecera de operación (salvo con las mayúsculas) */
+    header_len = transform_header_write(frame, transform);
+
+    /* Las peticiones de compresión y de canal van como tokens tras el nulo del nombre; un servidor que no las admita las ignora */
+    payload_len = append_token(frame, header_len, sizeof(frame), input_file_name);
+    if (compress) {
+        payload_len = append_token(frame, payload_len, sizeof(frame), COMPRESS_TOKEN);
+    }
+    if (integrity->enabled) {
+        payload_len = append_token(frame, payload_len, sizeof(frame), CRC_TOKEN);
+    }
+    if (use_shm) {
+        payload_len = append_token(frame, payload_len, sizeof(frame), shm_token);
+    }
+    payload = frame;
+
+    /* Con integridad, también el nombre lleva la cabecera (y la respuesta, la suya) y se reenvía si la respuesta
+     * no llega a tiempo, como las peticiones de líneas; sin ella, se espera sin reenviar */
+    if (integrity->enabled) {
+        crc_header_write(request_header, ++sequence, payload, payload_len);
+    }
+    first_iov = integrity->enabled ? 0 : 1;
+    request_iov[0] = (struct iovec) {.iov_base = request_header, .iov_len = CRC_HEADER_LEN};
+    request_iov[1] = (struct iovec) {.iov_base = (void *) payload, .iov_len = payload_len};
+    reply_iov[0] = (struct iovec) {.iov_base = reply_header, .iov_len = CRC_HEADER_LEN};
+    reply_iov[1] = (struct iovec) {.iov_base = recv_buffer, .iov_len = DEFAULT_MAX_BYTES_RECV};
+    request_message = (struct msghdr) {
+        .msg_name = (void *) destination,
+        .msg_namelen = destination_len,
+        .msg_iov = request_iov + first_iov,
+        .msg_iovlen = 2 - first_iov
+    };
+
+    request_retransmits = 0;
+    send_request = true;
+    received_flag = false;
+    while (!received_flag) {
+        if (send_request) {
+            /* MSG_NOSIGNAL: si el servidor cerró la conexión SOCK_SEQPACKET, que sendmsg falle en lugar de recibir SIGPIPE */
+            sent_bytes = sendmsg(local_client->socket, &request_message, MSG_NOSIGNAL);
+            if (sent_bytes < 0) {
+                if (errno == ECONNREFUSED) {
+                    fail("ERROR: El servidor no escucha en esa dirección (puerto inalcanzable)");
+                }
+                fail("ERROR: No se pudo enviar el mensaje");
+            }
+            if (request_retransmits == 0) {
+                printf("Esperando respuesta del servidor...\n");
+            }
+            retransmit_deadline_ns = integrity->enabled && integrity->retransmit_ms ? traffic_monotonic_ns() + integrity->retransmit_ms * 1000000ULL : 0;
+            send_request = false;
+        }
+
+        /* No esperamos más de lo que falte para reenviar el nombre */
+        wait_ms = -1;
+        if (retransmit_deadline_ns) {
+            now_ns = traffic_monotonic_ns();
+            wait_ms = now_ns >= retransmit_deadline_ns ? 0 : (int) ((retransmit_deadline_ns - now_ns + 999999) / 1000000);
+        }
+
+        if (!spin->enabled && !get_pending_io(local_client)) {
+            /* Pausamos la ejecución hasta que haya actividad en el socket, se pida la terminación o toque reenviar */
+            wait_for_host_event(local_client, wait_ms);
+        }
+        if (is_host_terminating(local_client)) {
+            if (use_shm) {
+                shm_channel_close(&channel);
+            }
+            if (fclose(fp_input)) {
+                fail("ERROR: No se pudo cerrar el archivo de lectura");
+            }
+            return;
+        }
+
+        poll_start = read_cycle_counter();
+        reply_address_len = sizeof(reply_address);
+        recv_bytes = recvmsg_timestamped(local_client, reply_iov + first_iov, 2 - first_iov, /*flags*/ 0, source, source_len, &kernel_rx_ts);
+        if (recv_bytes == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                /* Hemos marcado al socket con O_NONBLOCK; no hay conexiones pendientes, así que lo registramos y continuamos */
+                clear_pending_io(local_client);
+                if (retransmit_deadline_ns && traffic_monotonic_ns() >= retransmit_deadline_ns) {
+                    /* Sin respuesta a tiempo: se perdió el nombre o su respuesta */
+                    log_printf_err(local_client->log, "Sin respuesta al nombre del archivo en %u ms; se reenvía.\n", integrity->retransmit_ms);
+                    send_request = true;
+                } else {
+                    if (spin->enabled) spin_idle_poll(local_client, spin, &spin_stats, poll_start, wait_ms);
+                    continue;
+                }
+            } else {
+                if (errno == ECONNREFUSED) {
+                    fail("ERROR: El servidor no escucha en esa dirección (puerto inalcanzable)");
+                }
+                if (fclose(fp_input)) {
+                    fail("ERROR: No se pudo cerrar el archivo de lectura");
+                }
+                fail("ERROR: No se pudo recibir el mensaje");
+            }
+        } else {
+            if (recv_bytes == 0 && local_client->type == SOCK_SEQPACKET) {
+                fail("ERROR: El servidor cerró la conexión");
+            }
+            consume_pending_io(local_client);
+            if (spin->enabled) spin_useful_poll(&spin_stats);
+
+            if (!integrity->enabled) {
+                received_flag = true;
+            } else if (recv_bytes < CRC_HEADER_LEN
+                       || !crc_header_check(reply_header, recv_buffer, recv_bytes - CRC_HEADER_LEN, &reply_sequence)) {
+                /* Respuesta dañada, o de un servidor que no admite la cabecera: reenviamos el nombre */
+                transfer.checksum_errors++;
+                log_printf_err(local_client->log, "Respuesta al nombre del archivo de %zd bytes con CRC32C erróneo; se reenvía.\n", recv_bytes);
+                send_request = true;
+            } else if (reply_sequence != sequence) {
+                transfer.stale_replies++;
+            } else {
+                recv_bytes -= CRC_HEADER_LEN;
+                received_flag = true;
+            }
+        }
+
+        if (send_request) {
+            if (++request_retransmits > MAX_RETRANSMITS) {
+                errno = ETIMEDOUT;
+                fail("ERROR: El servidor no responde bien al nombre del archivo tras varios reenvíos");
+            }
+            transfer.retransmits++;
+        }
+    }
+
+    recv_buffer[recv_bytes] = '\0';
+    printf("Recibido: <<%s>>\n", recv_buffer);
+
+    /* El servidor acepta cada propuesta repitiendo su token tras el nombre en mayúsculas */
+    if (compress) {
+        compress = reply_has_token(recv_buffer, recv_bytes, COMPRESS_TOKEN);
+        log_and_stdout_printf(local_client->log, "%s\n", compress ? "Compresión aceptada por el servidor: las líneas se envían en lotes comprimidos"
+                                                                  : "El servidor no admite compresión: las líneas se envían sin comprimir");
+    }
+    if (use_shm) {
+        use_shm = reply_has_token(recv_buffer, recv_bytes, shm_token);
+        if (use_shm) {
+            /* El servidor ya lo tiene abierto: borramos el nombre para que no quede huérfano si alguno muere */
+            shm_channel_unlink(&channel);
+        } else {
+            shm_channel_close(&channel);
+        }
+        log_and_stdout_printf(local_client->log, "%s\n", use_shm ? "Canal de memoria compartida aceptado por el servidor: las líneas no pasan por el socket"
+                                                                 : "El servidor no admite memoria compartida: las líneas se envían por el socket");
+    }
+    if (integrity->enabled) {
+        /* Por memoria compartida no hay red que pueda corromper ni perder nada: la cabecera solo se usa por el socket */
+        checksummed = !use_shm && reply_has_token(recv_buffer, recv_bytes, CRC_TOKEN);
+        log_and_stdout_printf(local_client->log, "%s (CRC32C con %s)\n",
+                              checksummed ? "Integridad aceptada por el servidor: cada petición y respuesta lleva su CRC32C y se reenvía si no llega bien"
+                                          : use_shm ? "Por memoria compartida las líneas no llevan CRC32C; se comprueba el del archivo de salida"
+                                                    : "El servidor no admite integridad: solo se comprueba el CRC32C del archivo de salida",
+                              crc32c_implementation());
+    }
+
+    /* Recibido el nombre del archivo en mayúsculas */
+    /* Con otras operaciones puede quedar igual (p. ej. en minúsculas): no abrimos para escritura el archivo que estamos leyendo */
+    if (!stat(recv_buffer, &output_stat) && !fstat(fileno(fp_input), &input_stat)
+        && output_stat.st_dev == input_stat.st_dev && output_stat.st_ino == input_stat.st_ino) {
+        errno = EEXIST;
+        fail("ERROR: El archivo de salida sería el mismo que el de entrada");
+    }
+
+    /* Abrimos en modo escritura el archivo (recv_buffer se reutiliza después: guardamos su nombre para comprobarlo al final) */
+    if (!(output_file_name = strdup(recv_buffer))) {
+        fail("ERROR: No se pudo reservar memoria");
+    }
+
+    /* Si quedó un punto de control de este mismo archivo y operación, seguimos desde él */
+    if (checkpoint_s) {
+        if (!(checkpoint_path = malloc(strlen(output_file_name) + sizeof(CHECKPOINT_SUFFIX)))) {
+            fail("ERROR: No se pudo reservar memoria");
+        }
+        strcpy(checkpoint_path, output_file_name);
+        strcat(checkpoint_path, CHECKPOINT_SUFFIX);
+
+        if (fstat(fileno(fp_input), &input_stat)) {
+            fail("ERROR: No se pudo consultar el archivo de lectura");
+        }
+        checkpoint_set_input(&checkpoint, &input_stat);
+        checkpoint.transform = transform;
+
+        if (checkpoint_load(checkpoint_path, &saved) && checkpoint_same_input(&saved, &checkpoint)
+            && resume_output(local_client, output_file_name, &saved, integrity->enabled)) {
+            if (fseeko(fp_input, (off_t) saved.input_offset, SEEK_SET)) {
+                fail("ERROR: No se pudo saltar la parte ya transformada del archivo de lectura");
+            }
+            checkpoint.input_offset = saved.input_offset;
+            checkpoint.output_len = saved.output_len;
+            transfer.received_crc = saved.output_crc;
+            transfer.resumed = true;
+            transfer.resumed_offset = saved.input_offset;
+            writer_flags |= FILE_WRITER_APPEND;
+            log_and_stdout_printf(local_client->log, "Reanudando desde el punto de control: byte %" PRIu64 " de %" PRIu64 " de la entrada, %" PRIu64 " bytes ya en la salida\n",
+                                  saved.input_offset, saved.input_size, saved.output_len);
+        }
+    }
+
+    if (!file_writer_open(&writer, output_file_name, writer_flags)) {
+        fail("ERROR: Error en la apertura del archivo de escritura");
+    }
+
+
+    histogram_init(&rtt_stats.histogram);
+    transfer.start_ns = transfer.last_report_ns = traffic_monotonic_ns();
+    next_checkpoint_ns = transfer.start_ns + checkpoint_s * 1000000000ULL;
+
+    /* Procesamiento y envÍo del archivo */
+    while (!feof(fp_input)) {
+        if (compress) {
+            /* Agrupamos líneas en un lote hasta llenarlo; la que no cabe queda pendiente para el siguiente */
+            batch_len = batch_lines = 0;
+            while (pending_line || (line_read = getline(&send_buffer, &buffer_size, fp_input)) != EOF) {
+                if (!pending_line) line_len = line_read;
+                if (batch_len && batch_len + line_len > DEFAULT_BATCH_BYTES) {
+                    pending_line = true;
+                    break;
+                }
+                if (line_len > sizeof(batch)) {
+                    fail("ERROR: Línea demasiado larga para enviarla en una trama comprimida");
+                }
+                memcpy(batch + batch_len, send_buffer, line_len);
+                batch_len += line_len;
+                batch_lines++;
+                pending_line = false;
+            }
+
+            if (!batch_len) {
+                break;
+            }
+
+            /* La cabecera de operación va delante de la trama, que se comprime a continuación */
+            frame_len = compress_frame(batch, batch_len, frame + header_len, sizeof(frame) - header_len);
+            if (frame_len < 0) {
+                fail("ERROR: No se pudo comprimir el lote de líneas");
+            }
+            payload = frame;
+            payload_len = header_len + frame_len;
+            raw_sent += batch_len;
+            wire_sent += payload_len;
+            request_lines = batch_lines;
+            request_bytes = request_input_bytes = batch_len;
+
+            if (!report->quiet) printf("\nEnviando lote: %zu líneas, %zu bytes (%zu comprimidos)\n", batch_lines, batch_len, payload_len);
+        } else {
+            /* Leemos hasta que lo que devuelve getline es EOF */
+            if ((line_read = getline(&send_buffer, &buffer_size, fp_input)) == EOF) {
+                // Salimos del bucle. No hace falta avisar al servidor, porque no había ninguna conexión establecida.
+                break;
+            }
+            payload = send_buffer;
+            payload_len = strlen(send_buffer) + 1;
+            request_lines = 1;
+            request_bytes = payload_len - 1;
+            request_input_bytes = line_read;
+            if (header_len) {
+                /* Copiamos la línea tras la cabecera de operación */
+                if (header_len + payload_len > sizeof(frame)) {
+                    fail("ERROR: Línea demasiado larga para enviarla en un datagrama");
+                }
+                memcpy(frame + header_len, send_buffer, payload_len);
+                payload = frame;
+                payload_len += header_len;
+            }
+
+            /* Enviamos la línea */
+            if (!report->quiet) printf("\nEnviando: <<%s>>\n", send_buffer);
+        }
+
+        /* Sin compresión la respuesta se recibe directamente en el bloque del escritor; comprimida, se descomprime en él después */
+        if (!(reply_buffer = compress ? recv_buffer : file_writer_reserve(&writer, DEFAULT_MAX_BYTES_RECV + 1))) {
+            fail("ERROR: No se pudo escribir el archivo de escritura");
+        }
+
+        transfer.requests++;
+        if (use_shm) {
+            /* Por el canal de memoria compartida no hay marcas de tiempo del núcleo: el RTT se mide en espacio de usuario */
+            user_tx_ns = traffic_realtime_ns();
+            PROBE2(client_send, -1, payload_len);
+            memset(&kernel_tx_ts, 0, sizeof(kernel_tx_ts));
+            memset(&kernel_rx_ts, 0, sizeof(kernel_rx_ts));
+            /* Con el servidor respondiendo, shm_exchange no vuelve a mirar la terminación: la miramos antes de cada petición */
+            if (is_host_terminating(local_client) || (recv_bytes = shm_exchange(local_client, &channel, payload, payload_len, reply_buffer)) < 0) {
+                shm_channel_close(&channel);
+                if (checkpoint_path) {
+                    save_checkpoint(local_client, &writer, checkpoint_path, &checkpoint, &transfer);
+                    free(checkpoint_path);
+                }
+                if (fclose(fp_input)) {
+                    fail("ERROR: No se pudo cerrar el archivo de lectura");
+                }
+                if (!file_writer_close(&writer)) {
+                    fail("ERROR: No se pudo cerrar el archivo de escritura");
+                }
+                if (send_buffer) {
+                    free(send_buffer);
+                }
+                free(output_file_name);
+                return;
+            }
+        } else {
+            /* Con integridad, la cabecera va delante de la petición y de la respuesta sin copiarlas: sendmsg y recvmsg con dos buffers */
+            if (checksummed) {
+                crc_header_write(request_header, ++sequence, payload, payload_len);
+            }
+            first_iov = checksummed ? 0 : 1;
+            request_iov[0] = (struct iovec) {.iov_base = request_header, .iov_len = CRC_HEADER_LEN};
+            request_iov[1] = (struct iovec) {.iov_base = (void *) payload, .iov_len = payload_len};
+            reply_iov[0] = (struct iovec) {.iov_base = reply_header, .iov_len = CRC_HEADER_LEN};
+            reply_iov[1] = (struct iovec) {.iov_base = reply_buffer, .iov_len = DEFAULT_MAX_BYTES_RECV};
+            request_message = (struct msghdr) {
+                .msg_name = (void *) destination,
+                .msg_namelen = destination_len,
+                .msg_iov = request_iov + first_iov,
+                .msg_iovlen = 2 - first_iov
+            };
+
+            request_retransmits = 0;
+            send_request = true;
+            received_flag = false;
+            while (!received_flag) {
+                if (send_request) {
+                    user_tx_ns = traffic_realtime_ns();
+                    PROBE2(client_send, local_client->socket, payload_len);
+                    /* MSG_NOSIGNAL: si el servidor cerró la conexión SOCK_SEQPACKET, que falle en lugar de recibir SIGPIPE */
+                    sent_bytes = sendmsg(local_client->socket, &request_message, MSG_NOSIGNAL);
+                    if (sent_bytes < 0) {
+                        if (errno == ECONNREFUSED) {
+                            fail("ERROR: El servidor no escucha en esa dirección (puerto inalcanzable)");
+                        }
+                        if (fclose(fp_input)) {
+                            fail("ERROR: No se pudo cerrar el archivo de lectura");
+                        }
+                        if (!file_writer_close(&writer)) {
+                            fail("ERROR: No se pudo cerrar el archivo de escritura");
+                        }
+                        if (send_buffer) {
+                            free(send_buffer);
+                        }
+
+                        fail("ERROR: No se pudo enviar el mensaje");
+                    }
+                    /* La marca de envío se lee ya: si se quedara en la cola de errores, poll no dejaría de avisar (POLLERR)
+                     * mientras esperamos la respuesta. Si el núcleo aún no la generó, se usa la medida en espacio de usuario */
+                    if (!read_tx_timestamp(local_client, &kernel_tx_ts)) {
+                        memset(&kernel_tx_ts, 0, sizeof(kernel_tx_ts));
+                    }
+                    /* Solo con integridad se reenvía: el número de secuencia permite descartar después la respuesta repetida */
+                    retransmit_deadline_ns = checksummed && integrity->retransmit_ms ? traffic_monotonic_ns() + integrity->retransmit_ms * 1000000ULL : 0;
+                    send_request = false;
+                }
+
+                /* No esperamos más de lo que falte para informar del progreso ni para reenviar la petición */
+                wait_ms = progress_wait_ms(report, &transfer);
+                if (retransmit_deadline_ns) {
+                    now_ns = traffic_monotonic_ns();
+                    if (now_ns >= retransmit_deadline_ns) {
+                        wait_ms = 0;
+                    } else if (wait_ms < 0 || (retransmit_deadline_ns - now_ns + 999999) / 1000000 < (uint64_t) wait_ms) {
+                        wait_ms = (int) ((retransmit_deadline_ns - now_ns + 999999) / 1000000);
+                    }
+                }
+
+                if (!spin->enabled && !get_pending_io(local_client)) {
+                    /* Pausamos la ejecución hasta que haya actividad en el socket, se pida la terminación, toque informar del progreso o reenviar */
+                    wait_for_host_event(local_client, wait_ms);
+                }
+                report_progress(report, &transfer);
+
+                if (is_host_terminating(local_client)) {
+                    /* Lo respondido hasta ahora queda anotado para reanudar desde ahí */
+                    if (checkpoint_path) {
+                        save_checkpoint(local_client, &writer, checkpoint_path, &checkpoint, &transfer);
+                        free(checkpoint_path);
+                    }
+                    if (fclose(fp_input)) {
+                        fail("ERROR: No se pudo cerrar el archivo de lectura");
+                    }
+                    if (!file_writer_close(&writer)) {
+                        fail("ERROR: No se pudo cerrar el archivo de escritura");
+                    }
+                    if (send_buffer) {
+                        free(send_buffer);
+                    }
+                    free(output_file_name);
+                    return;
+                }
+
+                poll_start = read_cycle_counter();
+                reply_address_len = sizeof(reply_address);
+                recv_bytes = recvmsg_timestamped(local_client, reply_iov + first_iov, 2 - first_iov, /*flags*/ 0, source, source_len, &kernel_rx_ts);
+
+                if (recv_bytes == -1) {
+                    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                        /* Hemos marcado al socket con O_NONBLOCK; no hay conexiones pendientes, así que lo registramos y continuamos */
+                        clear_pending_io(local_client);
+                        if (retransmit_deadline_ns && traffic_monotonic_ns() >= retransmit_deadline_ns) {
+                            /* Sin respuesta a tiempo: se perdió la petición o su respuesta */
+                            log_printf_err(local_client->log, "Sin respuesta a la petición %u en %u ms; se reenvía.\n", sequence, integrity->retransmit_ms);
+                            send_request = true;
+                        } else {
+                            PROBE1(client_eagain, local_client->socket);
+                            if (spin->enabled) spin_idle_poll(local_client, spin, &spin_stats, poll_start, wait_ms);
+                            continue;
+                        }
+                    } else {
+                        if (errno == ECONNREFUSED) {
+                            fail("ERROR: El servidor no escucha en esa dirección (puerto inalcanzable)");
+                        }
+                        if (fclose(fp_input)) {
+                            fail("ERROR: No se pudo cerrar el archivo de lectura");
+                        }
+                        if (!file_writer_close(&writer)) {
+                            fail("ERROR: No se pudo cerrar el archivo de escritura");
+                        }
+                        if (send_buffer) {
+                            free(send_buffer);
+                        }
+
+                        fail("ERROR: No se pudo recibir el mensaje");
+                    }
+                } else {
+                    if (recv_bytes == 0 && local_client->type == SOCK_SEQPACKET) {
+                        fail("ERROR: El servidor cerró la conexión");
+                    }
+                    consume_pending_io(local_client);
+                    if (spin->enabled) spin_useful_poll(&spin_stats);
+
+                    if (!checksummed) {
+                        received_flag = true;
+                    } else if (recv_bytes < CRC_HEADER_LEN
+                               || !crc_header_check(reply_header, reply_buffer, recv_bytes - CRC_HEADER_LEN, &reply_sequence)) {
+                        /* Respuesta dañada: no sabemos de qué petición es, así que reenviamos la actual */
+                        transfer.checksum_errors++;
+                        log_printf_err(local_client->log, "Respuesta de %zd bytes con CRC32C erróneo; se reenvía la petición %u.\n", recv_bytes, sequence);
+                        send_request = true;
+                    } else if (reply_sequence != sequence) {
+                        /* Respuesta repetida de una petición reenviada que ya se respondió */
+                        transfer.stale_replies++;
+                    } else {
+                        recv_bytes -= CRC_HEADER_LEN;
+                        received_flag = true;
+                    }
+                }
+
+                if (send_request) {
+                    if (++request_retransmits > MAX_RETRANSMITS) {
+                        errno = ETIMEDOUT;
+                        fail("ERROR: El servidor no responde bien a la petición tras varios reenvíos");
+                    }
+                    transfer.retransmits++;
+                }
+            }
+        }
+
+        if (recv_bytes > 0 && reply_buffer[0] == TRANSFORM_ERROR_MARKER) {
+            /* El servidor no puede responder a esta petición: reenviarla o seguir esperando no serviría de nada */
+            reply_buffer[recv_bytes] = '\0';
+            log_printf_err(local_client->log, "El servidor rechazó la petición: %s.\n", reply_buffer + 1);
+            errno = EMSGSIZE;
+            fail("ERROR: El resultado de una petición no cabe en un datagrama");
+        }
+
+        rtt_ns = account_rtt(&rtt_stats, user_tx_ns, &kernel_tx_ts, &kernel_rx_ts);
+        PROBE2(client_reply, recv_bytes, rtt_ns);
+        transfer.replies++;
+        transfer.lines += request_lines;
+        transfer.bytes += request_bytes;
+
+        if (compress) {
+            if (!(output = file_writer_reserve(&writer, DEFAULT_MAX_BYTES_RECV))) {
+                fail("ERROR: No se pudo escribir el archivo de escritura");
+            }
+            reply_len = decompress_frame(recv_buffer, recv_bytes, output, DEFAULT_MAX_BYTES_RECV);
+            if (reply_len < 0) {
+                fail("ERROR: El servidor respondió con una trama comprimida no válida");
+            }
+            raw_received += reply_len;
+            wire_received += recv_bytes;
+            if (integrity->enabled) transfer.received_crc = crc32c(transfer.received_crc, output, reply_len);
+
+            if (!report->quiet) printf("Recibido lote: %zd bytes (%zd comprimidos) (RTT: %.3f µs)\n", reply_len, recv_bytes, rtt_ns / 1e3);
+            file_writer_advance(&writer, reply_len);
+        } else {
+            reply_buffer[recv_bytes] = '\0';
+            if (!report->quiet) printf("Recibido: <<%s>> (RTT: %.3f µs)\n", reply_buffer, rtt_ns / 1e3);
+            reply_len = strlen(reply_buffer);
+            if (integrity->enabled) transfer.received_crc = crc32c(transfer.received_crc, reply_buffer, reply_len);
+            file_writer_advance(&writer, reply_len);
+        }
+
+        checkpoint.input_offset += request_input_bytes;
+        checkpoint.output_len += reply_len;
+        if (checkpoint_path && traffic_monotonic_ns() >= next_checkpoint_ns) {
+            save_checkpoint(local_client, &writer, checkpoint_path, &checkpoint, &transfer);
+            next_checkpoint_ns = traffic_monotonic_ns() + checkpoint_s * 1000000000ULL;
+        }
+
+        report_progress(report, &transfer);
+    }
+    transfer.end_ns = traffic_monotonic_ns();
+
+    if (compress && raw_sent) {
+        log_and_stdout_printf(local_client->log, "Enviado (original / red)     : %" PRIu64 " / %" PRIu64 " bytes (%.1f%%)\n", raw_sent, wire_sent, 100.0 * wire_sent / raw_sent);
+        log_and_stdout_printf(local_client->log, "Recibido (original / red)    : %" PRIu64 " / %" PRIu64 " bytes (%.1f%%)\n", raw_received, wire_received,
+                              raw_received ? 100.0 * wire_received / raw_received : 0);
+    }
+
+    if (spin->enabled) {
+        report_spin_stats(local_client, &spin_stats);
+    }
+
+    /* Cerramos el canal y los archivos al salir */
+    if (use_shm) {
+        shm_channel_close(&channel);
+    }
+
+    if (fclose(fp_input)) {
+        fail("ERROR: No se pudo cerrar el archivo de lectura");
+    }
+
+    if (!file_writer_close(&writer)) {
+        fail("ERROR: No se pudo cerrar el archivo de escritura");
+    }
+    log_and_stdout_printf(local_client->log, "Archivo de salida            : %" PRIu64 " bytes en %" PRIu64 " escrituras (%" PRIu64 " esperas por bloques libres)\n",
+                          writer.bytes_written, writer.write_calls, writer.producer_stalls);
+
+    /* Lo que llegó a disco debe coincidir con lo que se recibió: lo comprobamos releyendo el archivo */
+    if (integrity->enabled) {
+        if (!file_crc32c(output_file_name, UINT64_MAX, &transfer.written_crc)) {
+            fail("ERROR: No se pudo leer el archivo de salida para comprobar su CRC32C");
+        }
+        transfer.file_checked = true;
+    }
+
+    /* Al final, para que el JSON por la salida estándar no quede mezclado con el resto del informe */
+    report_transfer(local_client->log, input_file_name, report, &transfer, &rtt_stats);
+
+    if (transfer.file_checked && transfer.written_crc != transfer.received_crc) {
+        log_printf_err(local_client->log, "El CRC32C del archivo de salida (%08x) no coincide con el de los datos recibidos (%08x).\n",
+                       transfer.written_crc, transfer.received_crc);
+        errno = EIO;
+        fail("ERROR: El archivo de salida no coincide con los datos recibidos");
+    }
+
+    /* Transferencia completa: ya no hay nada que reanudar */
+    if (checkpoint_path) {
+        if (unlink(checkpoint_path) && errno != ENOENT) {
+            perror("No se pudo borrar el punto de control");
+        }
+        free(checkpoint_path);
+    }
+
+    if (send_buffer) {
+        free(send_buffer);
+    }
+    free(output_file_name);
+
+    return;
+}
+
+
+bool handle_batch(Host *local_client, Host *remote_server, const struct BatchConfig *batch, enum TransformOp transform, bool connected,
+                  const struct ReportConfig *report, const struct IntegrityConfig *integrity) {
+    struct BatchQueue queue = {.transform = transform};
+    struct BatchSlot *slots;
+    struct BatchSlot *slot;
+    unsigned active = 0, slot_count, slot_index;
+    char reply_buffer[DEFAULT_MAX_BYTES_RECV + 1];
+    uint8_t reply_header[CRC_HEADER_LEN];
+    struct iovec reply_iov[2] = {
+        {.iov_base = reply_header, .iov_len = CRC_HEADER_LEN},
+        {.iov_base = reply_buffer, .iov_len = DEFAULT_MAX_BYTES_RECV}
+    };
+    struct msghdr reply_message = {.msg_iov = reply_iov, .msg_iovlen = 2};
+    ssize_t recv_bytes;
+    uint32_t reply_sequence;
+    uint64_t now_ns, earliest_ns;
+    struct RttStats rtt_stats = {0};
+    struct TransferStats transfer = {0};
+    struct BatchContext context = {
+        .local_client = local_client,
+        .destination = connected ? NULL : (const struct sockaddr *) &remote_server->address,
+        .destination_len = connected ? 0 : remote_server->address_len,
+        .transform = transform,
+        .retransmit_ms = integrity->retransmit_ms,
+        .queue = &queue,
+        .rtt_stats = &rtt_stats,
+        .transfer = &transfer
+    };
+    char address_text[HOST_ADDRESS_STRLEN];
+    int wait_ms;
+
+    for (size_t i = 0; i < batch->path_count; i++) {
+        if (!collect_batch_files(batch->paths[i], &queue)) {
+            log_printf_err(local_client->log, "Error al leer %s.\n", batch->paths[i]);
+            fail("ERROR: No se pudo leer la lista de archivos del lote");
+        }
+    }
+
+    describe_address((struct sockaddr *) &remote_server->address, remote_server->address_len, address_text, sizeof(address_text));
+    log_and_stdout_printf(local_client->log, "Servidor remoto              : %s %s\n", address_text, host_transport_name(remote_server));
+    log_and_stdout_printf(local_client->log, "Lote                         : %zu archivos, hasta %u a la vez (%s)\n",
+                          queue.count, batch->concurrency, transform_name(transform));
+    transfer.files_skipped = queue.skipped;
+
+    /* No tiene sentido abrir más huecos que archivos */
+    slot_count = queue.count < batch->concurrency ? (unsigned) queue.count : batch->concurrency;
+    if (!(slots = calloc(slot_count ? slot_count : 1, sizeof(struct BatchSlot)))) {
+        fail("ERROR: No se pudo reservar memoria");
+    }
+
+    histogram_init(&rtt_stats.histogram);
+    transfer.start_ns = transfer.last_report_ns = traffic_monotonic_ns();
+
+    for (unsigned i = 0; i < slot_count; i++) {
+        slots[i].index = i;
+        if (batch_start_file(&context, &slots[i])) active++;
+    }
+
+    while (active && !is_host_terminating(local_client)) {
+        /* No esperamos más de lo que falte para informar del progreso ni para el primer reenvío */
+        wait_ms = progress_wait_ms(report, &transfer);
+        if (context.retransmit_ms) {
+            earliest_ns = UINT64_MAX;
+            for (unsigned i = 0; i < slot_count; i++) {
+                if (slots[i].state != BATCH_IDLE && slots[i].deadline_ns < earliest_ns) earliest_ns = slots[i].deadline_ns;
+            }
+            now_ns = traffic_monotonic_ns();
+            if (earliest_ns != UINT64_MAX) {
+                int deadline_ms = earliest_ns <= now_ns ? 0 : (int) ((earliest_ns - now_ns + 999999) / 1000000);
+
+                if (wait_ms < 0 || deadline_ms < wait_ms) wait_ms = deadline_ms;
+            }
+        }
+        if (!get_pending_io(local_client)) {
+            wait_for_host_event(local_client, wait_ms);
+        }
+        report_progress(report, &transfer);
+
+        /* Atendemos todas las respuestas que hayan llegado */
+        for (;;) {
+            recv_bytes = recvmsg(local_client->socket, &reply_message, 0);
+            if (recv_bytes < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    clear_pending_io(local_client);
+                    break;
+                }
+                if (errno == ECONNREFUSED) {
+                    fail("ERROR: El servidor no escucha en esa dirección (puerto inalcanzable)");
+                }
+                fail("ERROR: No se pudo recibir el mensaje");
+            }
+            if (recv_bytes == 0 && local_client->type == SOCK_SEQPACKET) {
+                fail("ERROR: El servidor cerró la conexión");
+            }
+            consume_pending_io(local_client);
+
+            if (recv_bytes < CRC_HEADER_LEN || !crc_header_check(reply_header, reply_buffer, recv_bytes - CRC_HEADER_LEN, &reply_sequence)) {
+                /* No sabemos de qué hueco es: lo reenviará su plazo */
+                transfer.checksum_errors++;
+                continue;
+            }
+
+            /* El hueco va en los bits bajos del número de secuencia; si no es su petición en curso, es una respuesta repetida */
+            slot_index = reply_sequence % MAX_BATCH_CONCURRENCY;
+            if (slot_index >= slot_count || slots[slot_index].state == BATCH_IDLE || slots[slot_index].sequence != reply_sequence) {
+                transfer.stale_replies++;
+                continue;
+            }
+            slot = &slots[slot_index];
+
+            recv_bytes -= CRC_HEADER_LEN;
+            reply_buffer[recv_bytes] = '\0';
+            histogram_record(&rtt_stats.histogram, traffic_monotonic_ns() - slot->sent_ns);
+            transfer.replies++;
+
+            if (!batch_handle_reply(&context, slot, reply_buffer)) active--;
+        }
+
+        /* Reenviamos las peticiones cuyo plazo venció */
+        if (context.retransmit_ms) {
+            now_ns = traffic_monotonic_ns();
+            for (unsigned i = 0; i < slot_count; i++) {
+                if (slots[i].state != BATCH_IDLE && now_ns >= slots[i].deadline_ns && !batch_retransmit(&context, &slots[i])) active--;
+            }
+        }
+    }
+    transfer.end_ns = traffic_monotonic_ns();
+
+    /* Si se pidió terminar, los archivos a medias se cierran tal cual */
+    for (unsigned i = 0; i < slot_count; i++) {
+        if (slots[i].state != BATCH_IDLE) batch_finish_file(&context, &slots[i], false);
+        free(slots[i].line);
+    }
+
+    report_transfer(local_client->log, batch->paths[0], report, &transfer, &rtt_stats);
+
+    free(slots);
+    for (size_t i = 0; i < queue.count; i++) free(queue.files[i]);
+    free(queue.files);
+
+    return !transfer.files_failed && transfer.files == queue.count;
+}
+
+
+bool handle_local(FILE *log, char *input_file_name, const struct BatchConfig *batch, enum TransformOp transform, const struct ReportConfig *report) {
+    struct BatchQueue queue = {.transform = transform};
+    struct TransferStats transfer = {0};
+    struct RttStats rtt_stats = {0};
+    struct LocalBatch small = {
+        .log = log,
+        .transform = transform,
+        .quiet = report->quiet,
+        .transfer = &transfer
+    };
+    LocalTransformStats stats;
+    struct stat input_stat;
+    pthread_t *helpers = NULL;
+    unsigned started = 0, threads;
+    char *file;
+    double duration_s;
+
+    if (batch->paths) {
+        for (size_t i = 0; i < batch->path_count; i++) {
+            if (!collect_batch_files(batch->paths[i], &queue)) {
+                log_printf_err(log, "Error al leer %s.\n", batch->paths[i]);
+                fail("ERROR: No se pudo leer la lista de archivos del lote");
+            }
+        }
+    } else if (!(file = strdup(input_file_name)) || !batch_queue_add(&queue, file)) {
+        fail("ERROR: No se pudo reservar memoria");
+    }
+
+    log_and_stdout_printf(log, "Transformación local         : %zu archivos con hasta %u hilos (%s)\n", queue.count, batch->concurrency, transform_name(transform));
+    transfer.files_skipped = queue.skipped;
+
+    histogram_init(&rtt_stats.histogram);
+    transfer.start_ns = traffic_monotonic_ns();
+    pthread_mutex_init(&small.lock, NULL);
+    if (!(small.files = malloc((queue.count ? queue.count : 1) * sizeof(char *)))) {
+        fail("ERROR: No se pudo reservar memoria");
+    }
+
+    /* Los archivos grandes, uno tras otro y repartidos en fragmentos entre todos los hilos; los pequeños
+     * (un solo fragmento) se apartan para repartirlos enteros después */
+    for (size_t i = 0; i < queue.count; i++) {
+        if (queue.count > 1 && !stat(queue.files[i], &input_stat) && input_stat.st_size < LOCAL_TRANSFORM_CHUNK_SIZE) {
+            small.files[small.count++] = queue.files[i];
+            continue;
+        }
+        local_file_done(&small, queue.files[i], transform_local_file(log, queue.files[i], transform, batch->concurrency, &stats), &stats);
+    }
+
+    /* Este hilo también trabaja; si no se pueden crear todos los demás, se sigue con los que haya */
+    threads = small.count < batch->concurrency ? (unsigned) small.count : batch->concurrency;
+    if (threads > 1 && (helpers = malloc((threads - 1) * sizeof(pthread_t)))) {
+        while (started < threads - 1 && !pthread_create(&helpers[started], NULL, transform_local_batch, &small)) started++;
+    }
+    transform_local_batch(&small);
+    for (unsigned i = 0; i < started; i++) {
+        pthread_join(helpers[i], NULL);
+    }
+    free(helpers);
+    transfer.end_ns = traffic_monotonic_ns();
+
+    duration_s = (transfer.end_ns - transfer.start_ns) / 1e9;
+    log_and_stdout_printf(log, "\n---------------------\n");
+    log_and_stdout_printf(log, "Entrada / salida             : %" PRIu64 " / %" PRIu64 " bytes en %" PRIu64 " fragmentos\n", transfer.bytes, small.output_bytes, small.chunks);
+    log_and_stdout_printf(log, "Ritmo                        : %.3f s (%.2f MB/s)\n", duration_s, duration_s > 0 ? transfer.bytes / 1e6 / duration_s : 0);
+
+    /* Mismo informe (y mismo JSON) que con el servidor, para comparar: sin peticiones ni RTT */
+    report_transfer(log, batch->paths ? batch->paths[0] : input_file_name, report, &transfer, &rtt_stats);
+
+    pthread_mutex_destroy(&small.lock);
+    free(small.files);
+    for (size_t i = 0; i < queue.count; i++) free(queue.files[i]);
+    free(queue.files);
+
+    return !transfer.files_failed;
+}
+
+
+static void *transform_local_batch(void *arg) {
+    struct LocalBatch *batch = arg;
+    LocalTransformStats stats;
+    size_t i;
+
+    for (;;) {
+        pthread_mutex_lock(&batch->lock);
+        i = batch->next < batch->count ? batch->next++ : batch->count;
+        pthread_mutex_unlock(&batch->lock);
+        if (i == batch->count) break;
+
+        local_file_done(batch, batch->files[i], transform_local_file(batch->log, batch->files[i], batch->transform, 1, &stats), &stats);
+    }
+
+    return NULL;
+}
+
+
+static void local_file_done(struct LocalBatch *batch, const char *input_name, bool done, const LocalTransformStats *stats) {
+    pthread_mutex_lock(&batch->lock);
+    if (done) {
+        batch->transfer->files++;
+        batch->transfer->bytes += stats->input_bytes;
+        batch->output_bytes += stats->output_bytes;
+        batch->chunks += stats->chunks;
+        if (!batch->quiet) {
+            printf("%s: %" PRIu64 " bytes -> %" PRIu64 " bytes (%" PRIu64 " fragmentos, %u hilos)\n", input_name, stats->input_bytes, stats->output_bytes, stats->chunks, stats->threads);
+        }
+    } else {
+        batch->transfer->files_failed++;
+    }
+    pthread_mutex_unlock(&batch->lock);
+}
+
+
+static bool transform_local_file(FILE *log, const char *input_name, enum TransformOp transform, unsigned threads, LocalTransformStats *stats) {
+    const char *base_name = strrchr(input_name, '/') ? strrchr(input_name, '/') + 1 : input_name;
+    size_t dir_len = base_name - input_name;
+    char output_name[dir_len + 4 * strlen(base_name) + 1];     /* Ningún carácter pasa de 1 a más de 4 bytes */
+    ssize_t name_len;
+    struct stat input_stat, output_stat;
+    int input_fd, output_fd;
+    bool done;
+
+    if ((input_fd = open(input_name, O_RDONLY | O_CLOEXEC)) < 0 || fstat(input_fd, &input_stat)) {
+        perror("No se pudo abrir un archivo de entrada");
+        log_printf_err(log, "Error al abrir %s.\n", input_name);
+        if (input_fd >= 0) close(input_fd);
+        return false;
+    }
+
+    /* El nombre de la salida es el de la entrada transformado, en el mismo directorio (como el que devuelve el servidor en un lote) */
+    memcpy(output_name, input_name, dir_len);
+    name_len = transform_text(transform, base_name, strlen(base_name), output_name + dir_len, sizeof(output_name) - dir_len - 1);
+    output_name[dir_len + (name_len > 0 ? name_len : 0)] = '\0';
+
+    if (name_len <= 0 || (!stat(output_name, &output_stat) && output_stat.st_dev == input_stat.st_dev && output_stat.st_ino == input_stat.st_ino)) {
+        log_printf_err(log, "La salida de %s sería el mismo archivo; se salta.\n", input_name);
+        close(input_fd);
+        return false;
+    }
+
+    if ((output_fd = open(output_name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666)) < 0) {
+        perror("No se pudo crear un archivo de salida");
+        log_printf_err(log, "Error al crear %s.\n", output_name);
+        close(input_fd);
+        return false;
+    }
+
+    done = local_transform_file(input_fd, output_fd, transform, threads, 0, stats);
+    if (!done) {
+        perror("No se pudo transformar un archivo");
+        log_printf_err(log, "Error al transformar %s en %s.\n", input_name, output_name);
+    }
+
+    close(input_fd);
+    if (close(output_fd) && done) {
+        perror("No se pudo cerrar un archivo de salida");
+        log_printf_err(log, "Error al cerrar %s.\n", output_name);
+        done = false;
+    }
+
+    return done;
+}
+
+
+static int compare_names(const void *a, const void *b) {
+    return strcmp(*(char *const *) a, *(char *const *) b);
+}
+
+
+static bool collect_batch_files(const char *path, struct BatchQueue *queue) {
+    struct stat path_stat;
+    DIR *dir = NULL;
+    struct dirent *entry;
+    FILE *manifest = NULL;
+    char *line = NULL, *file;
+    size_t line_capacity = 0, len, first = queue->count;
+    ssize_t line_len;
+    bool ok = true;
+
+    if (path[0] == '@') {
+        /* Lista de archivos: una ruta por línea ("@-" para leerla de la entrada estándar) */
+        if (!(manifest = strcmp(path + 1, "-") ? fopen(path + 1, "r") : stdin)) return false;
+    } else if (stat(path, &path_stat)) {
+        return false;
+    } else if (S_ISDIR(path_stat.st_mode)) {
+        if (!(dir = opendir(path))) return false;
+    } else if (is_own_output(path, queue->transform)) {
+        queue->skipped++;
+        return true;
+    } else {
+        return (file = strdup(path)) && batch_queue_add(queue, file);
+    }
+
+    for (;;) {
+        if (dir) {
+            if (!(entry = readdir(dir))) break;
+            /* Solo archivos normales, sin los puntos de control de otras transferencias */
+            len = strlen(entry->d_name);
+            if (len >= strlen(CHECKPOINT_SUFFIX) && !strcmp(entry->d_name + len - strlen(CHECKPOINT_SUFFIX), CHECKPOINT_SUFFIX)) continue;
+            if (!(file = malloc(strlen(path) + len + 2))) {
+                ok = false;
+                break;
+            }
+            sprintf(file, "%s/%s", path, entry->d_name);
+            if (stat(file, &path_stat) || !S_ISREG(path_stat.st_mode)) {
+                free(file);
+                continue;
+            }
+        } else {
+            /* Se ignoran las líneas vacías y las que empiezan por '#' */
+            if ((line_len = getline(&line, &line_capacity, manifest)) == EOF) break;
+            while (line_len && (line[line_len - 1] == '\n' || line[line_len - 1] == '\r')) line[--line_len] = '\0';
+            if (!line_len || line[0] == '#') continue;
+            if (!(file = strdup(line))) {
+                ok = false;
+                break;
+            }
+        }
+
+        if (is_own_output(file, queue->transform)) {
+            free(file);
+            queue->skipped++;
+            continue;
+        }
+        if (!batch_queue_add(queue, file)) {
+            free(file);
+            ok = false;
+            break;
+        }
+    }
+
+    if (dir) {
+        closedir(dir);
+        /* readdir no da ningún orden: los ordenamos para que el lote sea reproducible */
+        qsort(queue->files + first, queue->count - first, sizeof(char *), compare_names);
+    } else {
+        ok = ok && !ferror(manifest);
+        free(line);
+        if (manifest != stdin) fclose(manifest);
+    }
+
+    return ok;
+}
+
+
+static bool batch_queue_add(struct BatchQueue *queue, char *file) {
+    char **files;
+
+    if (queue->count == queue->capacity) {
+        queue->capacity = queue->capacity ? 2 * queue->capacity : 64;
+        if (!(files = realloc(queue->files, queue->capacity * sizeof(char *)))) return false;
+        queue->files = files;
+    }
+    queue->files[queue->count++] = file;
+
+    return true;
+}
+
+
+static bool is_own_output(const char *path, enum TransformOp transform) {
+    const char *base_name = strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+    size_t len = strlen(base_name);
+    char output_name[4 * len + 1];     /* Ningún carácter pasa de 1 a más de 4 bytes */
+    ssize_t name_len = transform_text(transform, base_name, len, output_name, sizeof(output_name));
+
+    return name_len == (ssize_t) len && !memcmp(output_name, base_name, len);
+}
+
+
+static bool batch_start_file(struct BatchContext *context, struct BatchSlot *slot) {
+    const char *input_name, *base_name;
+    size_t header_len, name_len;
+
+    while (context->queue->next < context->queue->count) {
+        input_name = context->queue->files[context->queue->next++];
+
+        if (!(slot->input = fopen(input_name, "r"))) {
+            perror("No se pudo abrir un archivo del lote");
+            log_printf_err(context->local_client->log, "Error al abrir %s; se salta.\n", input_name);
+            context->transfer->files_failed++;
+            continue;
+        }
+
+        /* Al servidor solo le pedimos el nombre sin directorios: la salida va al mismo directorio que la entrada */
+        base_name = strrchr(input_name, '/') ? strrchr(input_name, '/') + 1 : input_name;
+        header_len = transform_header_write(slot->request, context->transform);
+        name_len = strlen(base_name) + 1;
+        if (header_len + name_len > sizeof(slot->request)) {
+            log_printf_err(context->local_client->log, "Nombre de archivo demasiado largo (%s); se salta.\n", input_name);
+            fclose(slot->input);
+            context->transfer->files_failed++;
+            continue;
+        }
+        memcpy(slot->request + header_len, base_name, name_len);
+
+        slot->input_name = input_name;
+        slot->state = BATCH_NAME;
+        batch_send(context, slot, header_len + name_len);
+        return true;
+    }
+
+    slot->state = BATCH_IDLE;
+    return false;
+}
+
+
+static void batch_send(struct BatchContext *context, struct BatchSlot *slot, size_t request_len) {
+    /* El número de secuencia lleva el hueco en sus bits bajos: así la respuesta dice a qué archivo pertenece */
+    slot->generation++;
+    slot->sequence = slot->generation * MAX_BATCH_CONCURRENCY + slot->index;
+    slot->request_len = request_len;
+    slot->retransmits = 0;
+    crc_header_write(slot->header, slot->sequence, slot->request, request_len);
+
+    context->transfer->requests++;
+    batch_transmit(context, slot);
+}
+
+
+static void batch_transmit(struct BatchContext *context, struct BatchSlot *slot) {
+    struct iovec iov[2] = {
+        {.iov_base = slot->header, .iov_len = CRC_HEADER_LEN},
+        {.iov_base = slot->request, .iov_len = slot->request_len}
+    };
+    struct msghdr message = {
+        .msg_name = (void *) context->destination,
+        .msg_namelen = context->destination_len,
+        .msg_iov = iov,
+        .msg_iovlen = 2
+    };
+
+    slot->sent_ns = traffic_monotonic_ns();
+    slot->deadline_ns = context->retransmit_ms ? slot->sent_ns + context->retransmit_ms * 1000000ULL : UINT64_MAX;
+
+    /* Con muchas peticiones a la vez la cola de envío puede llenarse: la petición se da por perdida y la reenvía su plazo */
+    if (sendmsg(context->local_client->socket, &message, MSG_NOSIGNAL) < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != ENOBUFS) {
+        if (errno == ECONNREFUSED) {
+            fail("ERROR: El servidor no escucha en esa dirección (puerto inalcanzable)");
+        }
+        fail("ERROR: No se pudo enviar el mensaje");
+    }
+}
+
+
+static bool batch_retransmit(struct BatchContext *context, struct BatchSlot *slot) {
+    if (++slot->retransmits > MAX_RETRANSMITS) {
+        /* Si nunca ha respondido no tiene sentido seguir con el resto del lote */
+        if (!context->transfer->replies) {
+            errno = ETIMEDOUT;
+            fail("ERROR: El servidor no responde");
+        }
+        log_printf_err(context->local_client->log, "El servidor no responde a las peticiones de %s; se abandona.\n", slot->input_name);
+        batch_finish_file(context, slot, false);
+        return batch_start_file(context, slot);
+    }
+
+    context->transfer->retransmits++;
+    batch_transmit(context, slot);
+    return true;
+}
+
+
+static bool batch_handle_reply(struct BatchContext *context, struct BatchSlot *slot, const char *reply) {
+    struct stat input_stat, output_stat;
+    const char *base_name;
+    size_t header_len, dir_len, line_len;
+    ssize_t line_read;
+
+    if (reply[0] == TRANSFORM_ERROR_MARKER) {
+        log_printf_err(context->local_client->log, "El servidor rechazó una petición de %s: %s; se abandona.\n", slot->input_name, reply + 1);
+        batch_finish_file(context, slot, false);
+        return batch_start_file(context, slot);
+    }
+
+    if (slot->state == BATCH_NAME) {
+        /* La respuesta es el nombre del archivo de salida, en el directorio del de entrada */
+        base_name = strrchr(slot->input_name, '/');
+        dir_len = base_name ? (size_t) (base_name - slot->input_name) + 1 : 0;
+        if (!(slot->output_name = malloc(dir_len + strlen(reply) + 1))) {
+            fail("ERROR: No se pudo reservar memoria");
+        }
+        memcpy(slot->output_name, slot->input_name, dir_len);
+        strcpy(slot->output_name + dir_len, reply);
+
+        /* Como con un solo archivo: no abrimos para escritura el que estamos leyendo */
+        if (!stat(slot->output_name, &output_stat) && !fstat(fileno(slot->input), &input_stat)
+            && output_stat.st_dev == input_stat.st_dev && output_stat.st_ino == input_stat.st_ino) {
+            log_printf_err(context->local_client->log, "La salida de %s sería el mismo archivo; se salta.\n", slot->input_name);
+            batch_finish_file(context, slot, false);
+            return batch_start_file(context, slot);
+        }
+        if (!(slot->output = fopen(slot->output_name, "w"))) {
+            perror("No se pudo crear un archivo de salida del lote");
+            log_printf_err(context->local_client->log, "Error al crear %s; se salta.\n", slot->output_name);
+            batch_finish_file(context, slot, false);
+            return batch_start_file(context, slot);
+        }
+        slot->state = BATCH_LINE;
+    } else {
+        /* Respuesta a una línea: sin el nulo final */
+        line_len = strlen(reply);
+        if (fwrite(reply, 1, line_len, slot->output) != line_len) {
+            perror("No se pudo escribir un archivo de salida del lote");
+            log_printf_err(context->local_client->log, "Error al escribir %s; se abandona.\n", slot->output_name);
+            batch_finish_file(context, slot, false);
+            return batch_start_file(context, slot);
+        }
+        context->transfer->lines++;
+        context->transfer->bytes += slot->request_len - slot->line_offset - 1;
+    }
+
+    /* Siguiente línea del archivo o, si se acabó, siguiente archivo */
+    if ((line_read = getline(&slot->line, &slot->line_capacity, slot->input)) == EOF) {
+        batch_finish_file(context, slot, true);
+        return batch_start_file(context, slot);
+    }
+    header_len = transform_header_write(slot->request, context->transform);
+    if (header_len + line_read + 1 > sizeof(slot->request)) {
+        log_printf_err(context->local_client->log, "Línea demasiado larga para enviarla en un datagrama en %s; se abandona.\n", slot->input_name);
+        batch_finish_file(context, slot, false);
+        return batch_start_file(context, slot);
+    }
+    memcpy(slot->request + header_len, slot->line, line_read + 1);
+    slot->line_offset = header_len;
+    batch_send(context, slot, header_len + strlen(slot->line) + 1);
+
+    return true;
+}
+
 
+static void batch_finish_file(struct BatchContext *context, struct BatchSlot *slot, bool completed) {
+    fclose(slot->input);
+    slot->input = NULL;
 
-int main(int argc, char **argv) {
-    Host local_client, remote_server;
+    if (slot->output && fclose(slot->output)) {
+        perror("No se pudo cerrar un archivo de salida del lote");
+        log_printf_err(context->local_client->log, "Error al cerrar %s.\n", slot->output_name);
+        completed = false;
+    }
+    slot->output = NULL;
 
-    /* Inicializamos los parámetros a sus valores por defecto */
-    struct Arguments args = {
-            .input_file_name= DEFAULT_INPUT_FILE_NAME,
-            .local_port=DEFAULT_LOCAL_PORT,
-            .server_ip= DEFAULT_SERVER_IP,
-            .server_port= DEFAULT_SERVER_PORT,
-            .logfile= DEFAULT_LOG_FILE,
-    };
+    if (completed) {
+        context->transfer->files++;
+    } else {
+        context->transfer->files_failed++;
+    }
 
-    set_colors();
+    free(slot->output_name);
+    slot->output_name = NULL;
+    slot->state = BATCH_IDLE;
+}
 
-    /* Recogemos los parámetros recibidos en la línea de comandos */
-    process_args(&args, argc, argv);
 
-    local_client = create_own_host(AF_INET, SOCK_DGRAM, 0, args.local_port, args.logfile);
+static bool file_crc32c(const char *path, uint64_t len, uint32_t *crc) {
+    char buffer[DEFAULT_MAX_BYTES_RECV];
+    ssize_t read_bytes;
+    int fd, saved_errno;
 
-    remote_server = create_remote_host(AF_INET, SOCK_DGRAM, 0, args.server_ip, args.server_port);
+    if ((fd = open(path, O_RDONLY)) < 0) return false;
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
 
-    handle_data(&local_client, &remote_server, args.input_file_name);
+    *crc = 0;
+    while (len && (read_bytes = read(fd, buffer, len < sizeof(buffer) ? len : sizeof(buffer))) != 0) {
+        if (read_bytes < 0) {
+            if (errno == EINTR) continue;
+            saved_errno = errno;
+            close(fd);
+            errno = saved_errno;
+            return false;
+        }
+        *crc = crc32c(*crc, buffer, read_bytes);
+        len -= read_bytes;
+    }
 
-    printf("\nCerrando el cliente y saliendo...\n");
+    return !close(fd);
+}
 
-    close_host(&local_client);
-    close_host(&remote_server);
 
-    exit(EXIT_SUCCESS);
+static bool resume_output(Host *local_client, const char *output_file_name, const Checkpoint *saved, bool check_crc) {
+    struct stat output_stat;
+    uint32_t crc;
+
+    if (stat(output_file_name, &output_stat) || (uint64_t) output_stat.st_size < saved->output_len) {
+        log_and_stdout_printf(local_client->log, "El archivo de salida es más corto que su punto de control: se empieza de cero\n");
+        return false;
+    }
+    if (check_crc && (!file_crc32c(output_file_name, saved->output_len, &crc) || crc != saved->output_crc)) {
+        log_and_stdout_printf(local_client->log, "El CRC32C del archivo de salida no coincide con su punto de control: se empieza de cero\n");
+        return false;
+    }
+    if (truncate(output_file_name, (off_t) saved->output_len)) {
+        perror("No se pudo recortar el archivo de salida");
+        log_printf_err(local_client->log, "Error al recortar el archivo de salida para reanudar; se empieza de cero.\n");
+        return false;
+    }
+
+    return true;
 }
 
 
-void handle_data(Host *local_client, Host *remote_server, char *input_file_name) {
-    ssize_t sent_bytes = 0, recv_bytes = 0;
-    FILE *fp_input;
-    FILE *fp_output;
-    char recv_buffer[DEFAULT_MAX_BYTES_RECV];   /* Buffer de recepción */
-    char *send_buffer = NULL;  /* Buffer de envío */
-    size_t buffer_size = 0; /* Necesitamos una variable con el tamaño del buffer para getline */
-    socklen_t socket_addr_len = sizeof(struct sockaddr_in);
-    bool received_flag;
+static void save_checkpoint(Host *local_client, FileWriter *writer, const char *path, Checkpoint *checkpoint, struct TransferStats *transfer) {
+    checkpoint->output_crc = transfer->received_crc;
 
-    /* Apertura de los archivos */
-    if (!(fp_input = fopen(input_file_name, "r"))) {
-        fail("ERROR: Error en la apertura del archivo de lectura");
+    /* Primero los datos y después la anotación: el punto de control nunca apunta más allá de lo que está en disco */
+    if (!file_writer_sync(writer) || !checkpoint_save(path, checkpoint)) {
+        perror("No se pudo guardar el punto de control");
+        log_printf_err(local_client->log, "Error al guardar el punto de control %s; se conserva el anterior.\n", path);
+        return;
     }
 
-    log_and_stdout_printf(local_client->log, "IPs v4 del cliente local     : %s\n", local_client->local_ips_v4);
-    log_and_stdout_printf(local_client->log, "IPs v6 del cliente local     : %s\n", local_client->local_ips_v6);
-    log_and_stdout_printf(local_client->log, "Puerto del cliente local     : %d UDP\n", local_client->port);
-    log_and_stdout_printf(local_client->log, "IP pública del cliente local : %s\n", local_client->public_ip);
+    transfer->checkpoints++;
+}
 
-    log_and_stdout_printf(local_client->log, "---------------------\n");
 
-    log_and_stdout_printf(local_client->log, "IP del servidor remoto       : %s\n", inet_ntoa(remote_server->address.sin_addr));
-    log_and_stdout_printf(local_client->log, "Puerto del servidor remoto   : %d UDP\n", ntohs(remote_server->address.sin_port));
+static uint64_t account_rtt(struct RttStats *stats, uint64_t user_tx_ns, const struct timespec *kernel_tx_ts, const struct timespec *kernel_rx_ts) {
+    uint64_t tx_ns = user_tx_ns;
+    uint64_t rx_ns = traffic_realtime_ns();
+    uint64_t rtt_ns;
 
-    log_and_stdout_printf(local_client->log, "---------------------\n");
+    if (kernel_tx_ts->tv_sec) tx_ns = timespec_to_ns(kernel_tx_ts);
+    if (kernel_rx_ts->tv_sec) rx_ns = timespec_to_ns(kernel_rx_ts);
 
-    /* Enviamos el nombre del archivo */
-    printf("Se procede a enviar el archivo: %s al servidor con IP: %s y puerto: %d\n", input_file_name, inet_ntoa(remote_server->address.sin_addr), remote_server->port);
+    rtt_ns = rx_ns > tx_ns ? rx_ns - tx_ns : 0;
 
-    printf("\nEnviando el nombre del archivo (<<%s>>)\n", input_file_name);
+    if (kernel_tx_ts->tv_sec && kernel_rx_ts->tv_sec) stats->kernel_samples++;
+    histogram_record(&stats->histogram, rtt_ns);
 
-    sent_bytes = sendto(local_client->socket, input_file_name, strlen(input_file_name) + 1, /*flags*/ 0, (struct sockaddr *) &(remote_server->address), socket_addr_len);
-    if (sent_bytes < 0) {
-        fail("ERROR: No se pudo enviar el mensaje");
-    }
+    return rtt_ns;
+}
 
-    printf("Esperando respuesta del servidor...\n");
 
-    /* Esperamos a recibir la línea */
-    received_flag = false;
-    while (!received_flag) {
-        if (!socket_io_pending) {
-            /* Pausamos la ejecución hasta recibir una señal de I/O o de terminación */
-            pause();
-        }
-        if (terminate) {
-            if (fclose(fp_input)) {
-                fail("ERROR: No se pudo cerrar el archivo de lectura");
-            }
-            return;
-        }
+static int progress_wait_ms(const struct ReportConfig *report, const struct TransferStats *transfer) {
+    uint64_t next_ns, now_ns;
 
-        recv_bytes = recvfrom(local_client->socket, recv_buffer, DEFAULT_MAX_BYTES_RECV, /*flags*/ 0, (struct sockaddr *) &(remote_server->address), &socket_addr_len);
-        if (recv_bytes == -1) {
-            if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                /* Hemos marcado al socket con O_NONBLOCK; no hay conexiones pendientes, así que lo registramos y continuamos */
-                socket_io_pending = 0;
-                continue;
-            }
-            if (fclose(fp_input)) {
-                fail("ERROR: No se pudo cerrar el archivo de lectura");
-            }
-            fail("ERROR: No se pudo recibir el mensaje");
-        }
-        socket_io_pending--;
-        received_flag = true;
-    }
+    if (!report->progress_s) return -1;
 
-    printf("Recibido: <<%s>>\n", recv_buffer);
+    next_ns = transfer->last_report_ns + report->progress_s * 1000000000ULL;
+    now_ns = traffic_monotonic_ns();
 
-    /* Recibido el nombre del archivo en mayúsculas */
-    /* Abrimos en modo escritura el archivo */
-    if (!(fp_output = fopen(recv_buffer, "w"))) {
-        fail("ERROR: Error en la apertura del archivo de escritura");
-    }
+    /* Redondeamos hacia arriba para no despertar justo antes de que toque */
+    return now_ns >= next_ns ? 0 : (int) ((next_ns - now_ns + 999999) / 1000000);
+}
 
 
-    /* Procesamiento y envÍo del archivo */
-    while (!feof(fp_input)) {
-        /* Leemos hasta que lo que devuelve getline es EOF */
-        if (getline(&send_buffer, &buffer_size, fp_input) == EOF) {
-            // Salimos del bucle. No hace falta avisar al servidor, porque no había ninguna conexión establecida.
-            break;
-        }
+static void report_progress(const struct ReportConfig *report, struct TransferStats *transfer) {
+    uint64_t now_ns;
+    double interval_s;
 
-        /* Enviamos la línea */
-        printf("\nEnviando: <<%s>>\n", send_buffer);
+    if (!report->progress_s) return;
 
-        sent_bytes = sendto(local_client->socket, send_buffer, strlen(send_buffer) + 1, 0, (struct sockaddr *) &(remote_server->address), socket_addr_len);
-        if (sent_bytes < 0) {
-            if (fclose(fp_input)) {
-                fail("ERROR: No se pudo cerrar el archivo de lectura");
-            }
-            if (fclose(fp_output)) {
-                fail("ERROR: No se pudo cerrar el archivo de escritura");
-            }
-            if (send_buffer) {
-                free(send_buffer);
-            }
+    now_ns = traffic_monotonic_ns();
+    if (now_ns - transfer->last_report_ns < report->progress_s * 1000000000ULL) return;
+
+    interval_s = (now_ns - transfer->last_report_ns) / 1e9;
+    printf("[Progreso] %.1f s: %" PRIu64 " líneas (%.0f líneas/s), %.2f MB (%.2f MB/s), %" PRIu64 " pendientes, %" PRIu64 " retransmisiones\n",
+           (now_ns - transfer->start_ns) / 1e9, transfer->lines, (transfer->lines - transfer->last_lines) / interval_s,
+           transfer->bytes / 1e6, (transfer->bytes - transfer->last_bytes) / 1e6 / interval_s,
+           transfer->requests - transfer->replies, transfer->retransmits);
+    fflush(stdout);
 
-            fail("ERROR: No se pudo enviar el mensaje");
+    transfer->last_report_ns = now_ns;
+    transfer->last_lines = transfer->lines;
+    transfer->last_bytes = transfer->bytes;
+}
+
+
+static void report_transfer(FILE *log, const char *input_file_name, const struct ReportConfig *report, const struct TransferStats *transfer,
+                            const struct RttStats *rtt_stats) {
+    static const double percentiles[] = {50, 90, 99, 99.9, 99.99};
+    static const char *const percentile_keys[] = {"p50", "p90", "p99", "p99_9", "p99_99"};
+    const Histogram *rtt = &rtt_stats->histogram;
+    double duration_s = (transfer->end_ns - transfer->start_ns) / 1e9;
+    FILE *json;
+
+    if (rtt->count) {
+        log_and_stdout_printf(log, "\n---------------------\n");
+        log_and_stdout_printf(log, "Peticiones                   : %" PRIu64 " (%" PRIu64 " con marcas de tiempo del núcleo)\n", rtt->count, rtt_stats->kernel_samples);
+        log_and_stdout_printf(log, "RTT                          : mínimo %.3f µs, medio %.3f µs, máximo %.3f µs\n",
+                              rtt->min / 1e3, histogram_mean(rtt) / 1e3, rtt->max / 1e3);
+        log_and_stdout_printf(log, "RTT (percentiles)            : p50 %.3f µs, p90 %.3f µs, p99 %.3f µs, p99.9 %.3f µs, p99.99 %.3f µs\n",
+                              histogram_percentile(rtt, 50) / 1e3, histogram_percentile(rtt, 90) / 1e3, histogram_percentile(rtt, 99) / 1e3,
+                              histogram_percentile(rtt, 99.9) / 1e3, histogram_percentile(rtt, 99.99) / 1e3);
+        log_and_stdout_printf(log, "Líneas                       : %" PRIu64 " en %.3f s (%.0f líneas/s, %.2f MB/s), %" PRIu64 " retransmisiones\n",
+                              transfer->lines, duration_s, transfer->lines / duration_s, transfer->bytes / 1e6 / duration_s, transfer->retransmits);
+    }
+    if (transfer->checksum_errors || transfer->stale_replies) {
+        log_and_stdout_printf(log, "Respuestas descartadas       : %" PRIu64 " con CRC32C erróneo, %" PRIu64 " repetidas\n", transfer->checksum_errors, transfer->stale_replies);
+    }
+    if (transfer->resumed || transfer->checkpoints) {
+        if (transfer->resumed) {
+            log_and_stdout_printf(log, "Puntos de control            : %" PRIu64 " guardados (reanudada desde el byte %" PRIu64 " de la entrada)\n",
+                                  transfer->checkpoints, transfer->resumed_offset);
+        } else {
+            log_and_stdout_printf(log, "Puntos de control            : %" PRIu64 " guardados\n", transfer->checkpoints);
         }
+    }
+    if (transfer->files || transfer->files_failed || transfer->files_skipped) {
+        log_and_stdout_printf(log, "Archivos                     : %" PRIu64 " transformados, %" PRIu64 " con error, %" PRIu64 " saltados por ser ya su propia salida (%.0f archivos/s)\n",
+                              transfer->files, transfer->files_failed, transfer->files_skipped, duration_s > 0 ? transfer->files / duration_s : 0);
+    }
+    if (transfer->file_checked) {
+        log_and_stdout_printf(log, "CRC32C del archivo de salida : %08x (%s con los datos recibidos)\n", transfer->written_crc,
+                              transfer->written_crc == transfer->received_crc ? "coincide" : "NO coincide");
+    }
 
-        /* Esperamos a recibir la línea */
-        received_flag = false;
-        while (!received_flag) {
-            if (!socket_io_pending) {
-                /* Pausamos la ejecución hasta recibir una señal de I/O o de terminación */    /* Pausamos la ejecución hasta recibir una señal de I/O o de terminación */
-                pause();
-            }
+    if (!report->json_file) return;
 
-            if (terminate) {
-                if (fclose(fp_input)) {
-                    fail("ERROR: No se pudo cerrar el archivo de lectura");
-                }
-                if (fclose(fp_output)) {
-                    fail("ERROR: No se pudo cerrar el archivo de escritura");
-                }
-                if (send_buffer) {
-                    free(send_buffer);
-                }
-                return;
-            }
+    if (report->json_stdout) {
+        json = report->json_stdout;
+    } else if (!(json = fopen(report->json_file, "w"))) {
+        perror("No se pudo crear el archivo del informe JSON");
+        log_printf_err(log, "Error al crear el archivo del informe JSON %s.\n", report->json_file);
+        return;
+    }
 
-            recv_bytes = recvfrom(local_client->socket, recv_buffer, DEFAULT_MAX_BYTES_RECV, /*flags*/ 0, (struct sockaddr *) &(remote_server->address), &socket_addr_len);
+    fprintf(json, "{\n  \"file\": ");
+    print_json_string(json, input_file_name);
+    fprintf(json, ",\n  \"duration_s\": %.6f,\n  \"requests\": %" PRIu64 ",\n  \"replies\": %" PRIu64 ",\n  \"lines\": %" PRIu64 ",\n  \"bytes\": %" PRIu64 ",\n"
+                  "  \"lines_per_s\": %.3f,\n  \"mb_per_s\": %.6f,\n  \"retransmits\": %" PRIu64 ",\n  \"checksum_errors\": %" PRIu64 ",\n"
+                  "  \"stale_replies\": %" PRIu64 ",\n  \"checkpoints\": %" PRIu64 ",\n  \"resumed_from\": %" PRIu64 ",\n  \"kernel_samples\": %" PRIu64 ",\n",
+            duration_s, transfer->requests, transfer->replies, transfer->lines, transfer->bytes,
+            duration_s > 0 ? transfer->lines / duration_s : 0, duration_s > 0 ? transfer->bytes / 1e6 / duration_s : 0,
+            transfer->retransmits, transfer->checksum_errors, transfer->stale_replies, transfer->checkpoints, transfer->resumed_offset,
+            rtt_stats->kernel_samples);
+    if (transfer->files || transfer->files_failed || transfer->files_skipped) {
+        fprintf(json, "  \"files\": %" PRIu64 ",\n  \"files_failed\": %" PRIu64 ",\n  \"files_skipped\": %" PRIu64 ",\n", transfer->files, transfer->files_failed, transfer->files_skipped);
+    }
+    if (transfer->file_checked) {
+        fprintf(json, "  \"file_crc32c\": {\"received\": \"%08x\", \"written\": \"%08x\", \"match\": %s},\n",
+                transfer->received_crc, transfer->written_crc, transfer->written_crc == transfer->received_crc ? "true" : "false");
+    }
+    fprintf(json, "  \"rtt_us\": {\"samples\": %" PRIu64 ", \"min\": %.3f, \"mean\": %.3f, \"max\": %.3f",
+            rtt->count, rtt->count ? rtt->min / 1e3 : 0, histogram_mean(rtt) / 1e3, rtt->max / 1e3);
+    for (size_t i = 0; i < sizeof(percentiles) / sizeof(percentiles[0]); i++) {
+        fprintf(json, ", \"%s\": %.3f", percentile_keys[i], histogram_percentile(rtt, percentiles[i]) / 1e3);
+    }
+    fprintf(json, "}\n}\n");
 
-            if (recv_bytes == -1) {
-                if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                    /* Hemos marcado al socket con O_NONBLOCK; no hay conexiones pendientes, así que lo registramos y continuamos */
-                    socket_io_pending = 0;
-                    continue;
-                }
-                if (fclose(fp_input)) {
-                    fail("ERROR: No se pudo cerrar el archivo de lectura");
-                }
-                if (fclose(fp_output)) {
-                    fail("ERROR: No se pudo cerrar el archivo de escritura");
-                }
-                if (send_buffer) {
-                    free(send_buffer);
-                }
+    if (json == report->json_stdout) {
+        fflush(json);
+    } else {
+        fclose(json);
+    }
+}
 
-                fail("ERROR: No se pudo recibir el mensaje");
-            }
-            socket_io_pending--;
-            received_flag = true;
+
+static void print_json_string(FILE *json, const char *text) {
+    fputc('"', json);
+    for (const unsigned char *c = (const unsigned char *) text; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(json, "\\%c", *c);
+        } else if (*c < 0x20) {
+            fprintf(json, "\\u%04x", *c);
+        } else {
+            fputc(*c, json);
         }
+    }
+    fputc('"', json);
+}
+
 
-        printf("Recibido: <<%s>>\n", recv_buffer);
-        fprintf(fp_output, "%s", recv_buffer);
+static size_t append_token(char *message, size_t len, size_t capacity, const char *token) {
+    if (len + strlen(token) + 1 > capacity) {
+        fail("ERROR: El nombre del archivo es demasiado largo");
     }
 
-    /* Cerramos los archivos al salir */
+    memcpy(message + len, token, strlen(token) + 1);
 
-    if (fclose(fp_input)) {
-        fail("ERROR: No se pudo cerrar el archivo de lectura");
+    return len + strlen(token) + 1;
+}
+
+
+static bool reply_has_token(const char *reply, size_t len, const char *token) {
+    for (const char *current = reply + strlen(reply) + 1; current < reply + len; current += strlen(current) + 1) {
+        if (!strcmp(current, token)) {
+            return true;
+        }
     }
 
-    if (fclose(fp_output)) {
-        fail("ERROR: No se pudo cerrar el archivo de escritura");
+    return false;
+}
+
+
+static ssize_t shm_exchange(Host *local_client, ShmChannel *channel, const char *payload, size_t payload_len, char *recv_buffer) {
+    ssize_t recv_bytes;
+
+    /* Esperamos con un plazo corto para poder atender la terminación aunque el servidor no responda */
+    while (shm_send(channel, payload, payload_len, SHM_POLL_MS) < 0) {
+        if (errno != ETIMEDOUT) {
+            fail("ERROR: No se pudo enviar el mensaje por memoria compartida");
+        }
+        if (is_host_terminating(local_client)) {
+            return -1;
+        }
     }
 
-    if (send_buffer) {
-        free(send_buffer);
+    while ((recv_bytes = shm_recv(channel, recv_buffer, DEFAULT_MAX_BYTES_RECV, SHM_POLL_MS)) < 0) {
+        if (errno != ETIMEDOUT) {
+            fail("ERROR: No se pudo recibir el mensaje por memoria compartida");
+        }
+        if (is_host_terminating(local_client)) {
+            return -1;
+        }
     }
 
-    return;
+    return recv_bytes;
 }
 
 
 static void print_help(char *exe_name) {
     /** Cabecera y modo de ejecución **/
-    printf("Uso: %s [-f] <file> [-o] <puerto_origen> [-i] <ip> [-p] <puerto_remoto> [-l <log> | --no-log] [-h]\n\n", exe_name);
+    printf("Uso: %s [-f] <file> [-o] <puerto_origen> [-i] <ip> [-p] <puerto_remoto> [-l <log> | --no-log] [-s [-b <µs>] [-c <cpu>] [-w <sondeos>]] [-z] [-u] [-t <operación>] [-d] [-k] [-m] [-g <s>] [-j <json>] [-x] [-r <ms>] [-e <s>] [-h]\n", exe_name);
+    printf("  o bien: %s [-f] <file> -v [-y <hilos>] [-t <operación>] [-j <json>] [-m], o %s -v -a <ruta> [-a ...] [...]: sin servidor\n", exe_name, exe_name);
+    printf("  o bien: %s -a <archivo|directorio|@lista> [-a ...] [-y <n>] -o <puerto_origen> -i <ip> -p <puerto_remoto> [...opciones]\n", exe_name);
+    printf("  o bien: %s [-f] <file> [[-o] <ruta_origen>] [-i] <ruta_servidor> [-q] [...opciones]\n\n", exe_name);
 
     /** Lista de opciones de uso **/
     printf(" Opción\t\tOpción larga\t\tSignificado\n");
 
     printf(" -f <file>\t--file <file>\t\tNombre del fichero que convertir a mayúsculas.\n");
-    printf(" -o <puerto_origen>\t--origen <puerto_origen>\t\tPuerto local desde el que se conectará con el servidor.\n");
-    printf(" -i <ip>\t--ip <ip>\t\tDirección IP del servidor al que conectarse, o \"localhost\" si el servidor se ejecuta en el mismo host que el cliente.\n");
-    printf(" -p <puerto_remoto>\t--puerto <puerto_remoto>\t\tPuerto en el que escucha el servidor al que conectarse.\n");
+    printf(" -o <puerto_origen>\t--origen <puerto_origen>\t\tPuerto local desde el que se conectará con el servidor (o ruta del socket local).\n");
+    printf(" -i <ip>\t--ip <ip>\t\tDirección IP del servidor al que conectarse, o \"localhost\" si el servidor se ejecuta en el mismo host que el cliente, o ruta de su socket local (AF_UNIX).\n");
+    printf(" -p <puerto_remoto>\t--puerto <puerto_remoto>\t\tPuerto en el que escucha el servidor al que conectarse (no hace falta con sockets locales).\n");
+    printf(" -q\t\t--seqpacket\t\tCon un servidor local, conectarse por SOCK_SEQPACKET en lugar de enviar datagramas.\n");
 
     printf(" -l <log>\t--log <log>\t\tNombre del archivo en el que guardar el registro de actividad del servidor.\n");
     printf(" -n\t\t--no-log\t\tNo crear archivo de registro de actividad.\n");
+    printf(" -s\t\t--spin\t\t\tModo de baja latencia: esperar las respuestas sondeando el socket en lugar de durmiendo.\n");
+    printf(" -b <µs>\t--busy-poll <µs>\tActivar SO_BUSY_POLL en el socket con ese presupuesto en microsegundos (requiere -s).\n");
+    printf(" -c <cpu>\t--cpu <cpu>\t\tFijar el cliente a la CPU indicada (requiere -s).\n");
+    printf(" -w <sondeos>\t--espera <sondeos>\tSondeos vacíos seguidos antes de dormir hasta que llegue la respuesta; 0 para no dormir nunca (requiere -s).\n");
+    printf(" -z\t\t--comprimir\t\tPedir al servidor que las líneas viajen en lotes comprimidos (LZ4); si no lo admite, se envían sin comprimir.\n");
+    printf(" -u\t\t--udp\t\t\tUsar siempre UDP, sin ofrecer memoria compartida aunque el servidor esté en la misma máquina.\n");
+    printf(" -t <operación>\t--transformacion <operación>\tOperación que aplica el servidor al archivo (por defecto, %s): %s.\n", transform_name(TRANSFORM_DEFAULT), transform_names());
+    printf(" -d\t\t--volcado\t\tVolcar el archivo de salida a disco por tramos mientras se escribe (sync_file_range) y sacarlo de la caché de páginas.\n");
+    printf(" -k\t\t--conectado\t\tConectar el socket al servidor: envío y recepción sin direcciones, solo se aceptan sus respuestas y, si no escucha, se falla enseguida.\n");
+    printf(" -m\t\t--silencio\t\tNo mostrar cada línea (o lote) enviada y recibida; solo el progreso (con -g) y el informe final.\n");
+    printf(" -g <s>\t\t--progreso <s>\t\tMostrar cada <s> segundos el progreso: líneas y MB por segundo, peticiones pendientes y retransmisiones.\n");
+    printf(" -j <json>\t--json <json>\t\tEscribir también el informe final (RTT con percentiles y ritmo) en JSON en el archivo dado (\"-\" para la salida estándar, y entonces todo lo demás se muestra por la de errores).\n");
+    printf(" -x\t\t--sin-crc\t\tNo pedir al servidor el CRC32C de cada petición y respuesta ni comprobar el del archivo de salida.\n");
+    printf(" -r <ms>\t--reintento <ms>\tCon CRC32C, reenviar la petición si no llega su respuesta en <ms> milisegundos (por defecto, %u; 0 para no reenviar).\n", DEFAULT_RETRANSMIT_MS);
+    printf(" -e <s>\t\t--punto-control <s>\tGuardar cada <s> segundos hasta dónde se ha transformado el archivo, para reanudar si se interrumpe (por defecto, %u; 0 para no guardarlo ni reanudar).\n", DEFAULT_CHECKPOINT_S);
+    printf(" -a <ruta>\t--lote <ruta>\t\tTransformar un lote de archivos por el mismo socket: un archivo, los de un directorio o los de una lista (@lista, una ruta por línea; @- para la entrada estándar). Puede repetirse.\n");
+    printf(" -y <n>\t\t--concurrencia <n>\tArchivos del lote que se transforman a la vez (por defecto, %u; como mucho, %d); con -v, hilos que lo transforman.\n", DEFAULT_BATCH_CONCURRENCY, MAX_BATCH_CONCURRENCY);
+    printf(" -v\t\t--local\t\t\tTransformar en esta máquina, sin servidor: el archivo se reparte en fragmentos que transforman varios hilos (tantos como CPUs, o los de -y).\n");
     printf(" -h\t\t--help\t\t\tMostrar este texto de ayuda y salir.\n");
 
     /** Consideraciones adicionales **/
     printf("\nPueden especificarse los parámetros <file>, <puerto_origen>, <ip> y <puerto_remoto> sin escribir las opciones '-f', '-o' '-i' ni '-p', siempre y cuando estos sean los cuatro parámetros que se pasan a la función, respectivamente.\n");
+    printf("\nUna IP o un puerto que contenga alguna '/' se toma como la ruta de un socket local (AF_UNIX): así se evita la pila IP cuando cliente y servidor están en la misma máquina.\n");
+    printf("\nSi el servidor está en la misma máquina, se le ofrece un canal de memoria compartida para las líneas; si no lo acepta (o con -u), se usa el socket.\n");
+    printf("\nSi el servidor lo admite, cada petición y respuesta por el socket lleva un CRC32C; una respuesta dañada o perdida se pide de nuevo (hasta %d veces seguidas).\n", MAX_RETRANSMITS);
+    printf("\nSi una transferencia se interrumpe, basta con repetir la orden: se reanuda desde el último punto de control (<salida>%s), siempre que el archivo de entrada y la operación sean los mismos.\n", CHECKPOINT_SUFFIX);
+    printf("\nEn un lote, cada archivo se transforma línea a línea, sin compresión ni memoria compartida, y su salida se crea en su mismo directorio (se saltan los que ya serían su propia salida, como las de una ejecución anterior); si alguno falla, el resto sigue y el cliente termina con error.\n");
+    printf("\nEn modo de espera activa, por defecto se duerme tras %u sondeos vacíos seguidos; al terminar se informa de los ciclos gastados en espera y en trabajo útil.\n", DEFAULT_SPINS_BEFORE_SLEEP);
     printf("\nSi se especifica varias veces un argumento, el comportamiento está indefinido.\n");
 }
 
@@ -336,6 +2381,20 @@ static uint16_t getPortOrFail(char **argv, int pos) {
 }
 
 
+static long getNonNegativeNumberOrFail(char **argv, int pos) {
+    char *end;
+    long read_number = strtol(argv[pos], &end, 10);
+
+    if (end == argv[pos] || *end || read_number < 0 || read_number > 1000000000L) {
+        fprintf(stderr, "ERROR: El valor especificado (%s) no es un número válido\n", argv[pos]);
+        print_help(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    return read_number;
+}
+
+
 static void process_args(struct Arguments *args, int argc, char **argv) {
     char *current_arg_str;
 
@@ -352,11 +2411,11 @@ static void process_args(struct Arguments *args, int argc, char **argv) {
         if (current_arg_str[0] == OPT_OPTION_FLAG) { /* Flag de opción */
             /* Manejar las opciones largas */
             if (current_arg_str[1] == OPT_OPTION_FLAG) {
-                if (strcmp(current_arg_str, "--file")) {
+                if (!strcmp(current_arg_str, "--file")) {
                     current_arg_str = "-f";
                 } else if (!strcmp(current_arg_str, "--origen")) {
                     current_arg_str = "-o";
-                } else if (strcmp(current_arg_str, "--ip")) {
+                } else if (!strcmp(current_arg_str, "--ip")) {
                     current_arg_str = "-i";
                 } else if (!strcmp(current_arg_str, "--puerto")) {
                     current_arg_str = "-p";
@@ -364,6 +2423,44 @@ static void process_args(struct Arguments *args, int argc, char **argv) {
                     current_arg_str = "-l";
                 } else if (!strcmp(current_arg_str, "--no-log")) {
                     current_arg_str = "-n";
+                } else if (!strcmp(current_arg_str, "--spin")) {
+                    current_arg_str = "-s";
+                } else if (!strcmp(current_arg_str, "--busy-poll")) {
+                    current_arg_str = "-b";
+                } else if (!strcmp(current_arg_str, "--cpu")) {
+                    current_arg_str = "-c";
+                } else if (!strcmp(current_arg_str, "--espera")) {
+                    current_arg_str = "-w";
+                } else if (!strcmp(current_arg_str, "--comprimir")) {
+                    current_arg_str = "-z";
+                } else if (!strcmp(current_arg_str, "--udp")) {
+                    current_arg_str = "-u";
+                } else if (!strcmp(current_arg_str, "--seqpacket")) {
+                    current_arg_str = "-q";
+                } else if (!strcmp(current_arg_str, "--transformacion")) {
+                    current_arg_str = "-t";
+                } else if (!strcmp(current_arg_str, "--volcado")) {
+                    current_arg_str = "-d";
+                } else if (!strcmp(current_arg_str, "--conectado")) {
+                    current_arg_str = "-k";
+                } else if (!strcmp(current_arg_str, "--silencio")) {
+                    current_arg_str = "-m";
+                } else if (!strcmp(current_arg_str, "--progreso")) {
+                    current_arg_str = "-g";
+                } else if (!strcmp(current_arg_str, "--json")) {
+                    current_arg_str = "-j";
+                } else if (!strcmp(current_arg_str, "--sin-crc")) {
+                    current_arg_str = "-x";
+                } else if (!strcmp(current_arg_str, "--reintento")) {
+                    current_arg_str = "-r";
+                } else if (!strcmp(current_arg_str, "--punto-control")) {
+                    current_arg_str = "-e";
+                } else if (!strcmp(current_arg_str, "--lote")) {
+                    current_arg_str = "-a";
+                } else if (!strcmp(current_arg_str, "--concurrencia")) {
+                    current_arg_str = "-y";
+                } else if (!strcmp(current_arg_str, "--local")) {
+                    current_arg_str = "-v";
                 } else if (!strcmp(current_arg_str, "--help")) {
                     current_arg_str = "-h";
                 }
@@ -386,7 +2483,11 @@ static void process_args(struct Arguments *args, int argc, char **argv) {
 
                 case OPT_SOURCE_PORT: // 'o' /* Puerto Origen */
                     if (++pos < argc) {
-                        args->local_port = getPortOrFail(argv, pos);
+                        if (is_unix_socket_path(argv[pos])) {
+                            args->local_path = argv[pos];
+                        } else {
+                            args->local_port = getPortOrFail(argv, pos);
+                        }
                         set_local_port = true;
                     } else {
                         fprintf(stderr, "ERROR: Puerto no especificado tras la opción '-o'\n");
@@ -436,6 +2537,158 @@ static void process_args(struct Arguments *args, int argc, char **argv) {
                     args->logfile = NULL;
                     break;
 
+                case OPT_SPIN: // 's' /* Espera activa */
+                    args->spin.enabled = true;
+                    break;
+
+                case OPT_BUSY_POLL: // 'b' /* SO_BUSY_POLL */
+                    if (++pos < argc) {
+                        args->spin.busy_poll_us = (int) getNonNegativeNumberOrFail(argv, pos);
+                    } else {
+                        fprintf(stderr, "ERROR: Microsegundos no especificados tras la opción '-b'\n");
+                        print_help(argv[0]);
+                        exit(EXIT_FAILURE);
+                    }
+                    break;
+
+                case OPT_CPU: // 'c' /* CPU */
+                    if (++pos < argc) {
+                        args->spin.cpu = (int) getNonNegativeNumberOrFail(argv, pos);
+                    } else {
+                        fprintf(stderr, "ERROR: CPU no especificada tras la opción '-c'\n");
+                        print_help(argv[0]);
+                        exit(EXIT_FAILURE);
+                    }
+                    break;
+
+                case OPT_SPINS_BEFORE_SLEEP: // 'w' /* Sondeos antes de dormir */
+                    if (++pos < argc) {
+                        args->spin.spins_before_sleep = (unsigned) getNonNegativeNumberOrFail(argv, pos);
+                    } else {
+                        fprintf(stderr, "ERROR: Número de sondeos no especificado tras la opción '-w'\n");
+                        print_help(argv[0]);
+                        exit(EXIT_FAILURE);
+                    }
+                    break;
+
+                case OPT_COMPRESS: // 'z' /* Compresión */
+                    args->compress = true;
+                    break;
+
+                case OPT_UDP_ONLY: // 'u' /* Solo UDP */
+                    args->shared_memory = false;
+                    break;
+
+                case OPT_SEQPACKET: // 'q' /* SOCK_SEQPACKET */
+                    args->seqpacket = true;
+                    break;
+
+                case OPT_WRITEBACK: // 'd' /* Volcado a disco */
+                    args->writeback = true;
+                    break;
+
+                case OPT_CONNECTED: // 'k' /* Socket conectado */
+                    args->connected = true;
+                    break;
+
+                case OPT_QUIET: // 'm' /* Sin mostrar las líneas */
+                    args->report.quiet = true;
+                    break;
+
+                case OPT_PROGRESS: // 'g' /* Progreso */
+                    if (++pos < argc) {
+                        args->report.progress_s = (unsigned) getNonNegativeNumberOrFail(argv, pos);
+                    } else {
+                        fprintf(stderr, "ERROR: Segundos no especificados tras la opción '-g'\n");
+                        print_help(argv[0]);
+                        exit(EXIT_FAILURE);
+                    }
+                    break;
+
+                case OPT_JSON: // 'j' /* Informe JSON */
+                    if (++pos < argc) {
+                        args->report.json_file = argv[pos];
+                    } else {
+                        fprintf(stderr, "ERROR: Archivo JSON no especificado tras la opción '-j'\n");
+                        print_help(argv[0]);
+                        exit(EXIT_FAILURE);
+                    }
+                    break;
+
+                case OPT_NO_CHECKSUM: // 'x' /* Sin CRC32C */
+                    args->integrity.enabled = false;
+                    break;
+
+                case OPT_RETRANSMIT: // 'r' /* Reenvío */
+                    if (++pos < argc) {
+                        args->integrity.retransmit_ms = (unsigned) getNonNegativeNumberOrFail(argv, pos);
+                    } else {
+                        fprintf(stderr, "ERROR: Milisegundos no especificados tras la opción '-r'\n");
+                        print_help(argv[0]);
+                        exit(EXIT_FAILURE);
+                    }
+                    break;
+
+                case OPT_CHECKPOINT: // 'e' /* Punto de control */
+                    if (++pos < argc) {
+                        args->checkpoint_s = (unsigned) getNonNegativeNumberOrFail(argv, pos);
+                    } else {
+                        fprintf(stderr, "ERROR: Segundos no especificados tras la opción '-e'\n");
+                        print_help(argv[0]);
+                        exit(EXIT_FAILURE);
+                    }
+                    break;
+
+                case OPT_BATCH: // 'a' /* Lote de archivos */
+                    if (++pos < argc) {
+                        /* Puede repetirse: nunca habrá más rutas que argumentos */
+                        if (!args->batch.paths && !(args->batch.paths = malloc(argc * sizeof(char *)))) {
+                            fail("ERROR: No se pudo reservar memoria");
+                        }
+                        args->batch.paths[args->batch.path_count++] = argv[pos];
+                    } else {
+                        fprintf(stderr, "ERROR: Archivo, directorio o lista no especificado tras la opción '-a'\n");
+                        print_help(argv[0]);
+                        exit(EXIT_FAILURE);
+                    }
+                    break;
+
+                case OPT_CONCURRENCY: // 'y' /* Archivos a la vez */
+                    if (++pos < argc) {
+                        args->batch.concurrency = (unsigned) getNonNegativeNumberOrFail(argv, pos);
+                        if (!args->batch.concurrency || args->batch.concurrency > MAX_BATCH_CONCURRENCY) {
+                            fprintf(stderr, "ERROR: El número de archivos a la vez debe estar entre 1 y %d\n", MAX_BATCH_CONCURRENCY);
+                            print_help(argv[0]);
+                            exit(EXIT_FAILURE);
+                        }
+                    } else {
+                        fprintf(stderr, "ERROR: Número de archivos no especificado tras la opción '-y'\n");
+                        print_help(argv[0]);
+                        exit(EXIT_FAILURE);
+                    }
+                    break;
+
+                case OPT_LOCAL: // 'v' /* Sin servidor */
+                    args->local = true;
+                    break;
+
+                case OPT_TRANSFORM: // 't' /* Operación */
+                    if (++pos < argc) {
+                        int op = transform_from_name(argv[pos]);
+
+                        if (op < 0) {
+                            fprintf(stderr, "ERROR: Operación '%s' desconocida (operaciones: %s)\n\n", argv[pos], transform_names());
+                            print_help(argv[0]);
+                            exit(EXIT_FAILURE);
+                        }
+                        args->transform = op;
+                    } else {
+                        fprintf(stderr, "ERROR: Operación no especificada tras la opción '-t'\n");
+                        print_help(argv[0]);
+                        exit(EXIT_FAILURE);
+                    }
+                    break;
+
                 case OPT_HELP: // 'h' /* Ayuda */
                     print_help(argv[0]);
                     exit(EXIT_SUCCESS);
@@ -448,8 +2701,12 @@ static void process_args(struct Arguments *args, int argc, char **argv) {
         } else if (pos == 1) {    /* Se especificó el fichero como primer argumento */
             args->input_file_name = argv[pos];
             set_file = true;
-        } else if (pos == 2) {    /* Se especificó el puerto del cliente como cuartsegundoo argumento */
-            args->local_port = getPortOrFail(argv, pos);
+        } else if (pos == 2) {    /* Se especificó el puerto del cliente (o la ruta de su socket) como segundo argumento */
+            if (is_unix_socket_path(argv[pos])) {
+                args->local_path = argv[pos];
+            } else {
+                args->local_port = getPortOrFail(argv, pos);
+            }
             set_local_port = true;
         } else if (pos == 3) {    /* Se especificó la IP del servidor como tercer argumento */
             if (!strcmp(argv[pos], "localhost")) {
@@ -465,6 +2722,26 @@ static void process_args(struct Arguments *args, int argc, char **argv) {
         }
     }
 
+    /* Con un servidor local (ruta de socket) no hacen falta puertos */
+    if (set_ip && is_unix_socket_path(args->server_ip)) {
+        set_local_port = set_server_port = true;
+    }
+
+    /* En un lote los archivos salen de -a; cada respuesta se reconoce por su cabecera de integridad y, si se pierde, solo la recupera el reenvío */
+    if (args->batch.paths) {
+        if (!args->local && (!args->integrity.enabled || !args->integrity.retransmit_ms)) {
+            fprintf(stderr, "ERROR: Un lote de archivos (-a) necesita el CRC32C y el reenvío por tiempo (no admite -x ni -r 0)\n\n");
+            print_help(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+        set_file = true;
+    }
+
+    /* Sin servidor no hacen falta ni su dirección ni puerto local */
+    if (args->local) {
+        set_local_port = set_ip = set_server_port = true;
+    }
+
     if (!set_file || !set_local_port || !set_ip || !set_server_port) {
         fprintf(stderr, "ERROR:\n%s%s%s%s\n",
                 (set_file ? "" : "No se especificó fichero para convertir a mayúsculas.\n"),
@@ -3,18 +3,42 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <string.h>
-#include <wctype.h>
 #include <locale.h>
 #include <stdbool.h>
 #include <arpa/inet.h>
+#include <time.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <inttypes.h>
 
 #include "host.h"
 #include "loging.h"
-
-
-#define DEFAULT_MAX_BYTES_RECV 2048
+#include "timestamps.h"
+#include "traffic.h"
+#include "busypoll.h"
+#include "compress.h"
+#include "shmring.h"
+#include "transform.h"
+#include "ratelimit.h"
+#include "steering.h"
+#include "handoff.h"
+#include "bufferpool.h"
+#include "probes.h"
+#include "crc32c.h"
+
+
+#define DEFAULT_MAX_BYTES_RECV 65536    /* Cabe cualquier datagrama UDP, incluidas las tramas comprimidas */
 #define DEFAULT_SERVER_PORT 9200
 #define DEFAULT_LOG_FILE "servidorUDP.log"
+#define SHM_POLL_MS 100     /* Cada cuánto comprueban las sesiones (memoria compartida o conexiones) si hay que terminar */
+#define SHM_SHUTDOWN_MS 2000    /* Tiempo máximo que se espera al cierre de las sesiones al salir */
+#define DEFAULT_SPINS_BEFORE_SLEEP 1000000    /* Sondeos vacíos seguidos antes de dormir en modo de espera activa */
+#define RATE_LIMIT_REPORTED_CLIENTS 10      /* Clientes con más descartes que se muestran al salir */
+#define WORKER_STACK_SIZE (1U << 21)    /* Pila de cada trabajador (los buffers de sus peticiones van en su reserva) */
+#define REQUEST_BUFFER_SIZE (DEFAULT_MAX_BYTES_RECV + 1)   /* Cabe cualquier buffer de una petición: el datagrama con su nulo, el lote o la respuesta */
+#define REQUEST_BUFFERS 4   /* Buffers que usa a la vez una petición (ver struct RequestBuffers) */
+#define UPGRADE_DRAIN_MS 30000  /* Tiempo máximo que se deja a las sesiones en curso para terminar tras pasar los sockets a un proceso nuevo */
 
 /**
  * Estructura de datos para pasar a la función process_args.
@@ -23,9 +47,110 @@
  */
 struct Arguments {
     uint16_t server_port;
+    char *server_path;      /* Ruta del socket local (AF_UNIX) en la que atender en lugar del puerto UDP */
+    bool seqpacket;         /* Usar SOCK_SEQPACKET en lugar de datagramas (solo con sockets locales) */
     char *logfile;
+    SpinConfig spin;
+    uint64_t rate_limit;    /* Peticiones por segundo admitidas de cada cliente (0 para no limitar) */
+    uint64_t rate_burst;    /* Ráfaga máxima de cada cliente (0 para usar rate_limit) */
+    int worker_cpus[STEERING_MAX_CPUS];     /* CPU de cada trabajador */
+    int worker_count;       /* Número de trabajadores (0 para atenderlo todo en el hilo principal) */
+    bool huge_pages;        /* Reservar los buffers de las peticiones en páginas enormes */
+};
+
+/**
+ * Estadísticas de tiempos de las peticiones atendidas por el servidor.
+ */
+struct RequestStats {
+    uint64_t requests;              /* Peticiones atendidas */
+    uint64_t timestamped;           /* Peticiones con marca de tiempo de llegada del núcleo */
+    uint64_t queue_ns_total;        /* Suma de los tiempos de espera en la cola del socket */
+    uint64_t queue_ns_max;          /* Máximo tiempo de espera en la cola del socket */
+    uint64_t transform_ns_total;    /* Suma de los tiempos de transformación */
+    uint64_t transform_ns_max;      /* Máximo tiempo de transformación */
+    uint64_t frames;                /* Peticiones recibidas como trama comprimida */
+    uint64_t frame_raw_in;          /* Bytes originales de las tramas recibidas */
+    uint64_t frame_wire_in;         /* Bytes de las tramas recibidas tal y como llegaron */
+    uint64_t frame_raw_out;         /* Bytes originales de las tramas enviadas */
+    uint64_t frame_wire_out;        /* Bytes de las tramas enviadas tal y como salieron */
+    uint64_t truncated;             /* Peticiones descartadas por no caber en el buffer de recepción */
+    uint64_t checksummed;           /* Peticiones con cabecera de integridad (CRC32C) */
+    uint64_t checksum_errors;       /* De ellas, descartadas porque el CRC no coincidía */
+    BufferPoolStats buffers;        /* Uso de las reservas de buffers de los hilos que atendieron las peticiones */
+};
+
+/**
+ * Buffers de una petición, prestados por la reserva del hilo que la atiende.
+ */
+struct RequestBuffers {
+    char *input;            /* Petición recibida (con sitio para el nulo final) */
+    char *reply;            /* Respuesta a enviar */
+    char *batch;            /* Lote de líneas descomprimido */
+    char *transformed;      /* Lote transformado, antes de comprimirlo */
+};
+
+/**
+ * Sesión de un cliente de la misma máquina que se comunica por memoria compartida.
+ * La atiende su propio hilo hasta que el cliente cierra el canal.
+ */
+struct ShmSession {
+    Host *local_server;     /* Servidor al que pertenece la sesión */
+    ShmChannel channel;     /* Extremo del servidor del canal */
 };
 
+/**
+ * Conexión de un cliente por un socket local SOCK_SEQPACKET.
+ * La atiende su propio hilo hasta que el cliente la cierra.
+ */
+struct ConnectionSession {
+    Host *local_server;     /* Servidor que aceptó la conexión */
+    Host connection;        /* Conexión aceptada */
+};
+
+/* Sesiones en curso (de memoria compartida y conexiones SOCK_SEQPACKET), cada una con su hilo */
+static atomic_int active_sessions = 0;
+
+/* Estadísticas acumuladas de las sesiones ya cerradas */
+static struct RequestStats session_stats = {0};
+static pthread_mutex_t session_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Trabajador con su propio socket del grupo SO_REUSEPORT, fijado a una CPU.
+ * Se reserva entero (junto con su pila) en el nodo NUMA de su CPU.
+ */
+struct Worker {
+    Host host;                  /* Socket del trabajador (el primero es el del propio servidor) */
+    int cpu;                    /* CPU a la que está fijado */
+    pthread_t thread;           /* Hilo del trabajador */
+    void *stack;                /* Pila del hilo (WORKER_STACK_SIZE bytes) */
+    bool started;               /* El hilo llegó a arrancar */
+    atomic_bool stop;           /* Debe dejar de atender: el socket ya lo atiende el proceso nuevo */
+    uint64_t rate_limit;        /* Peticiones por segundo de cada cliente (0 para no limitar) */
+    uint64_t rate_burst;        /* Ráfaga máxima de cada cliente */
+    RateLimiter limiter;        /* Límite de peticiones por cliente del trabajador */
+    BufferPool buffers;         /* Buffers de las peticiones del trabajador */
+    struct RequestStats stats;  /* Estadísticas del trabajador */
+};
+
+/* Límite de peticiones por cliente del socket de datagramas que atiende el hilo (NULL si no se limita).
+ * Lo usan el hilo principal o, con trabajadores, cada trabajador el suyo: los datagramas de un cliente
+ * llegan siempre por la misma cola de red y por tanto al mismo trabajador */
+static _Thread_local RateLimiter *rate_limiter = NULL;
+
+/* Reserva de buffers de las peticiones del hilo: cada hilo que atiende peticiones (el principal, cada
+ * trabajador y cada sesión) tiene la suya, así que no necesita cerrojos */
+static _Thread_local BufferPool *buffer_pool = NULL;
+
+/* Reservar los buffers de las peticiones en páginas enormes (-g) */
+static bool huge_page_buffers = false;
+
+/* Mostrar y registrar cada petición atendida; en modo de espera activa (-s) no se hace, para que la escritura
+ * en la consola y el registro no se lleve la latencia que se gana sondeando */
+static bool log_requests = true;
+
+/* Sustitución del servidor por una versión nueva en curso (la pide SIGUSR2); solo la usa el hilo principal */
+static Handoff upgrade = {0};
+
 /**
  * Enumeración para manejar de forma más limpia las distintas opciones del programa.
  */
@@ -35,6 +160,15 @@ enum Option {
     OPT_SERVER_PORT = 'p',
     OPT_LOG_FILE_NAME = 'l',
     OPT_NO_LOG = 'n',
+    OPT_SPIN = 's',
+    OPT_BUSY_POLL = 'b',
+    OPT_CPU = 'c',
+    OPT_SPINS_BEFORE_SLEEP = 'w',
+    OPT_SEQPACKET = 'q',
+    OPT_RATE = 'r',
+    OPT_BURST = 'a',
+    OPT_WORKERS = 't',
+    OPT_HUGE_PAGES = 'g',
     OPT_HELP = 'h'
 };
 
@@ -71,38 +205,252 @@ static void print_help(char *exe_name);
  */
 static uint16_t getPortOrFail(char **argv, int pos);
 
-
 /**
- * @brief   Transforma una string a mayúsculas
+ * @brief   Obtiene un número no negativo de los argumentos del programa.
  *
- * Transforma la string source a mayúsculas, utilizando para ello wstrings para poder transformar
- * caracteres especiales que ocupen más de un byte. Por tanto, permite pasar a mayúsculas strings en
- * el idioma definido en locale.
- *
- * @param source    String fuente a transformar en mayúsculas.
+ * @param argv  Lista con los argumentos del programa.
+ * @param pos   Posición en argv en la que se encuentra la string que se quiere interpretar.
  *
- * @return  String dinámicamente alojada (por tanto, debe liberarse con un free) que contiene los mismos
- *          caracteres que source pero en mayúsculas.
+ * @return  Número leído de los argumentos del programa; falla si no es un número no negativo.
  */
-static char *toupper_string(const char *source);
+static long getNonNegativeNumberOrFail(char **argv, int pos);
+
 
 /**
  * @brief   Maneja los mensajes desde el lado del servidor.
  *
- * Recibe una string de un cliente, la pasa a mayúsculas y se la reenvía.
+ * Recibe una string de un cliente, le aplica la operación pedida (mayúsculas si no pide otra) y se la reenvía
+ * (ver build_reply). Si el cliente superó su límite de peticiones (ver rate_limiter), la descarta sin más.
+ * Si la petición lleva cabecera de integridad (ver crc32c.h), comprueba su CRC32C (si no coincide, la
+ * descarta para que el cliente la reenvíe) y protege la respuesta con otra cabecera igual.
+ * Con la marca de tiempo de llegada del núcleo mide cuánto esperó la petición en la cola
+ * del socket antes de leerse, y mide también cuánto tardó la transformación.
  *
  * @param local_server    Servidor que maneja la conexión.
+ * @param stats           Estadísticas de tiempos a actualizar.
+ *
+ * @return  true si se atendió una petición; false si no había ninguna pendiente en el socket.
+ */
+bool handle_message(Host *local_server, struct RequestStats *stats);
+
+/**
+ * @brief   Atiende una petición del socket con los buffers ya prestados (ver handle_message).
+ *
+ * @param local_server  Servidor que maneja la conexión.
+ * @param stats         Estadísticas de tiempos a actualizar.
+ * @param buffers       Buffers de la petición.
+ *
+ * @return  true si se atendió una petición; false si no había ninguna pendiente en el socket.
  */
-void handle_message(Host *local_server);
+static bool serve_message(Host *local_server, struct RequestStats *stats, const struct RequestBuffers *buffers);
+
+/**
+ * @brief   Genera la respuesta a una petición ya recibida.
+ *
+ * Lee la cabecera de operación, si la hay, descomprime la petición si es una trama, le aplica la operación
+ * y deja en reply la respuesta lista para enviar (comprimida si la petición lo estaba). Atiende además los tokens de negociación que lleve el
+ * mensaje tras su nulo: COMPRESS_TOKEN y, si llegó por el socket, el anuncio de un canal de memoria
+ * compartida. La usan tanto el socket como las sesiones de memoria compartida.
+ *
+ * @param local_server  Servidor que atiende la petición.
+ * @param buffers       Buffers de la petición: input, terminada en nulo tras recv_bytes; en reply se escribe la respuesta.
+ * @param recv_bytes    Longitud de la petición.
+ * @param from_socket   true si la petición llegó por el socket (solo entonces se aceptan canales nuevos).
+ * @param stats         Estadísticas a actualizar.
+ * @param transform_ns  Donde guardar el tiempo que llevó la transformación.
+ *
+ * @return  Longitud de la respuesta (de error si el resultado no cabe en un datagrama); -1 si la petición se descarta.
+ */
+static ssize_t build_reply(Host *local_server, const struct RequestBuffers *buffers, ssize_t recv_bytes, bool from_socket, struct RequestStats *stats, uint64_t *transform_ns);
+
+/**
+ * @brief   Escribe la respuesta de error (TRANSFORM_ERROR_MARKER) con la que se rechaza una petición.
+ *
+ * Así el cliente sabe enseguida que su petición no tiene respuesta posible, en lugar de esperarla o reenviarla.
+ *
+ * @param reply     Buffer de la respuesta.
+ * @param reason    Motivo del rechazo.
+ *
+ * @return  Longitud de la respuesta.
+ */
+static ssize_t build_error_reply(char *reply, const char *reason);
+
+/**
+ * @brief   Crea la reserva de buffers de las peticiones del hilo llamante.
+ *
+ * @param local_server  Servidor (para registrar el error).
+ * @param pool          Reserva a crear; queda como la del hilo (buffer_pool).
+ *
+ * @return  true si se creó; false si no hubo memoria.
+ */
+static bool open_request_buffers(Host *local_server, BufferPool *pool);
+
+/**
+ * @brief   Libera la reserva de buffers del hilo llamante, sumando su uso a unas estadísticas.
+ *
+ * @param pool      Reserva del hilo.
+ * @param stats     Estadísticas a las que sumar su uso.
+ */
+static void close_request_buffers(BufferPool *pool, struct RequestStats *stats);
+
+/**
+ * @brief   Toma prestados de la reserva del hilo los buffers de una petición.
+ *
+ * @param buffers   Donde guardar los buffers.
+ */
+static void acquire_request_buffers(struct RequestBuffers *buffers);
+
+/**
+ * @brief   Devuelve a la reserva del hilo los buffers de una petición.
+ *
+ * @param buffers   Buffers a devolver.
+ */
+static void release_request_buffers(const struct RequestBuffers *buffers);
+
+/**
+ * @brief   Registra la respuesta enviada a una petición.
+ *
+ * @param local_server  Servidor que atendió la petición.
+ * @param reply         Respuesta enviada.
+ * @param reply_len     Longitud de la respuesta.
+ */
+static void log_reply(Host *local_server, const char *reply, size_t reply_len);
+
+/**
+ * @brief   Abre el canal de memoria compartida anunciado por un cliente y lanza el hilo que lo atiende.
+ *
+ * @param local_server  Servidor que atiende la sesión.
+ * @param token         Token con el que el cliente anunció el canal.
+ *
+ * @return  true si la sesión quedó en marcha; false si no se pudo abrir el canal (el cliente seguirá por UDP).
+ */
+static bool start_shm_session(Host *local_server, const char *token);
+
+/**
+ * @brief   Hilo que atiende las peticiones de una sesión de memoria compartida.
+ *
+ * @param arg   Sesión a atender (struct ShmSession *); el hilo la libera al terminar.
+ *
+ * @return  Siempre NULL.
+ */
+static void *shm_session_thread(void *arg);
+
+/**
+ * @brief   Suma unas estadísticas de peticiones a otras.
+ *
+ * @param destination   Estadísticas acumuladas.
+ * @param source        Estadísticas a sumar.
+ */
+static void merge_request_stats(struct RequestStats *destination, const struct RequestStats *source);
+
+/**
+ * @brief   Acepta las conexiones pendientes en un servidor SOCK_SEQPACKET y lanza un hilo para cada una.
+ *
+ * @param local_server  Servidor que escucha conexiones.
+ */
+static void accept_connections(Host *local_server);
+
+/**
+ * @brief   Hilo que atiende las peticiones de una conexión SOCK_SEQPACKET.
+ *
+ * @param arg   Conexión a atender (struct ConnectionSession *); el hilo la cierra y libera al terminar.
+ *
+ * @return  Siempre NULL.
+ */
+static void *connection_thread(void *arg);
+
+/**
+ * @brief   Lanza un hilo de sesión que no atienda las señales del proceso.
+ *
+ * @param local_server  Servidor al que pertenece la sesión.
+ * @param routine       Función que ejecuta el hilo.
+ * @param session       Argumento del hilo.
+ *
+ * @return  true si el hilo quedó en marcha (y contado en active_sessions); false en otro caso.
+ */
+static bool start_session_thread(Host *local_server, void *(*routine)(void *), void *session);
+
+/**
+ * @brief   Muestra el resumen del límite de peticiones por cliente: admitidas, descartadas y los clientes con más descartes.
+ *
+ * @param local_server  Servidor.
+ * @param limiter       Limitador.
+ */
+static void report_rate_limiter(Host *local_server, const RateLimiter *limiter);
+
+/**
+ * @brief   Crea los sockets de los trabajadores, instala el reparto por CPU y atiende con ellos hasta que se pida terminar.
+ *
+ * El primer trabajador usa el socket del propio servidor; los demás, sockets nuevos de su grupo SO_REUSEPORT
+ * (o los heredados del proceso anterior, en el mismo orden). Mientras, el hilo principal atiende las
+ * peticiones de sustitución del servidor (ver upgrade_step).
+ *
+ * @param local_server      Servidor, creado con create_own_reuseport_host (o heredado).
+ * @param args              Argumentos del programa (CPUs de los trabajadores y límite de peticiones).
+ * @param workers           Donde guardar los trabajadores (args->worker_count).
+ * @param handed_sockets    Sockets heredados del proceso anterior (NULL si no hay).
+ *
+ * @return  true si los sockets pasaron a un proceso nuevo; false si se pidió terminar.
+ */
+static bool run_workers(Host *local_server, const struct Arguments *args, struct Worker **workers, const int *handed_sockets);
+
+/**
+ * @brief   Atiende la sustitución del servidor por una versión nueva: la inicia si se pidió (SIGUSR2) y comprueba si el proceso nuevo ya atiende.
+ *
+ * Si el proceso nuevo no llega a atender, este sigue como si nada.
+ *
+ * @param local_server  Servidor.
+ * @param workers       Trabajadores (NULL si no hay).
+ * @param worker_count  Número de trabajadores.
+ * @param timeout_ms    Tiempo máximo de espera por la confirmación del proceso nuevo.
+ *
+ * @return  true si el proceso nuevo ya atiende los sockets y este debe dejar de leerlos.
+ */
+static bool upgrade_step(Host *local_server, struct Worker **workers, int worker_count, int timeout_ms);
+
+/**
+ * @brief   Hilo de un trabajador: se fija a su CPU y atiende su socket hasta que se pida terminar.
+ *
+ * @param arg   Trabajador (struct Worker *).
+ *
+ * @return  Siempre NULL.
+ */
+static void *worker_thread(void *arg);
+
+/**
+ * @brief   Suma las estadísticas de los trabajadores, informa de cada uno y libera sus recursos.
+ *
+ * Debe llamarse cuando ya no queden sesiones que usen los sockets de los trabajadores.
+ *
+ * @param local_server  Servidor.
+ * @param workers       Trabajadores.
+ * @param count         Número de trabajadores.
+ * @param stats         Estadísticas del servidor a las que sumar las de los trabajadores.
+ */
+static void close_workers(Host *local_server, struct Worker **workers, int count, struct RequestStats *stats);
 
 
 int main(int argc, char **argv) {
     Host local_server;
+    char address_text[HOST_ADDRESS_STRLEN];
+    struct RequestStats stats = {0};
+    SpinStats spin_stats;
+    uint64_t poll_start;
+    struct Worker *workers[STEERING_MAX_CPUS] = {NULL};
+    int handed_sockets[STEERING_MAX_CPUS];
+    int handed_count, drain_ms;
+    bool upgraded = false;
 
     /* Inicializamos los parámetros a sus valores por defecto */
     struct Arguments args = {
             .server_port = DEFAULT_SERVER_PORT,
-            .logfile = DEFAULT_LOG_FILE
+            .logfile = DEFAULT_LOG_FILE,
+            .spin = {
+                    .enabled = false,
+                    .busy_poll_us = 0,
+                    .cpu = -1,
+                    .spins_before_sleep = DEFAULT_SPINS_BEFORE_SLEEP
+            }
     };
 
     set_colors();
@@ -115,59 +463,305 @@ int main(int argc, char **argv) {
     /* Recogemos los parámetros recibidos en la línea de comandos */
     process_args(&args, argc, argv);
 
-    printf("Ejecutando servidor de mayúsculas con parámetros: PUERTO=%u, LOG=%s\n", args.server_port, args.logfile);
-    local_server = create_own_host(AF_INET, SOCK_DGRAM, 0, args.server_port, args.logfile);
+    /* Para poder sustituirnos con SIGUSR2 por el ejecutable nuevo, con los mismos argumentos */
+    if (!handoff_init(argv) || enable_upgrade_requests() < 0) {
+        perror("No se podrá sustituir el servidor en marcha (SIGUSR2)");
+    }
+
+    /* Si nos lanzó la sustitución de un servidor en marcha, sus sockets ya están asociados y recibiendo */
+    if ((handed_count = handoff_receive(handed_sockets, STEERING_MAX_CPUS)) < 0) {
+        fail("ERROR: No se pudieron recibir los sockets del proceso anterior");
+    }
+    if (handed_count && handed_count != (args.worker_count ? args.worker_count : 1)) {
+        fprintf(stderr, "ERROR: El proceso anterior pasó %d sockets, pero con estos argumentos se necesitan %d\n", handed_count, args.worker_count ? args.worker_count : 1);
+        exit(EXIT_FAILURE);
+    }
+    if (handed_count) {
+        printf("Sustituyendo a un servidor en marcha: %d sockets heredados\n", handed_count);
+    }
+
+    if (args.server_path) {
+        if (args.worker_count) {
+            fprintf(stderr, "ERROR: La opción --trabajadores solo se admite con UDP (puerto en lugar de ruta)\n");
+            exit(EXIT_FAILURE);
+        }
+        if (args.seqpacket && args.spin.enabled) {
+            fprintf(stderr, "ERROR: El modo de espera activa no se admite con --seqpacket (cada conexión la atiende su hilo)\n");
+            exit(EXIT_FAILURE);
+        }
+        printf("Ejecutando servidor de mayúsculas con parámetros: RUTA=%s, LOG=%s\n", args.server_path, args.logfile);
+        local_server = handed_count ? adopt_own_host(handed_sockets[0], args.logfile)
+                                    : create_own_unix_host(args.seqpacket ? SOCK_SEQPACKET : SOCK_DGRAM, args.server_path, args.logfile);
+    } else if (args.seqpacket) {
+        fprintf(stderr, "ERROR: La opción --seqpacket solo se admite con un socket local (ruta en lugar de puerto)\n");
+        exit(EXIT_FAILURE);
+    } else if (args.worker_count) {
+        if (args.spin.enabled) {
+            fprintf(stderr, "ERROR: El modo de espera activa no se admite con --trabajadores\n");
+            exit(EXIT_FAILURE);
+        }
+        printf("Ejecutando servidor de mayúsculas con parámetros: PUERTO=%u, LOG=%s, TRABAJADORES=%d\n", args.server_port, args.logfile, args.worker_count);
+        local_server = handed_count ? adopt_own_host(handed_sockets[0], args.logfile)
+                                    : create_own_reuseport_host(AF_INET, SOCK_DGRAM, 0, args.server_port, args.logfile);
+    } else {
+        printf("Ejecutando servidor de mayúsculas con parámetros: PUERTO=%u, LOG=%s\n", args.server_port, args.logfile);
+        local_server = handed_count ? adopt_own_host(handed_sockets[0], args.logfile)
+                                    : create_own_host(AF_INET, SOCK_DGRAM, 0, args.server_port, args.logfile);
+    }
 
-    log_and_stdout_printf(local_server.log, "IPs v4 del servidor local     : %s\n", local_server.local_ips_v4);
-    log_and_stdout_printf(local_server.log, "IPs v6 del servidor local     : %s\n", local_server.local_ips_v6);
-    log_and_stdout_printf(local_server.log, "Puerto del servidor local     : %d UDP\n", local_server.port);
-    log_and_stdout_printf(local_server.log, "IP pública del servidor local : %s\n", local_server.public_ip);
+    wait_host_lookups(&local_server);
+    log_and_stdout_printf(local_server.log, "IPs v4 del servidor local     : %s\n", HOST_INFO_TEXT(local_server.local_ips_v4));
+    log_and_stdout_printf(local_server.log, "IPs v6 del servidor local     : %s\n", HOST_INFO_TEXT(local_server.local_ips_v6));
+    log_and_stdout_printf(local_server.log, "Dirección del servidor local  : %s %s\n",
+                          describe_address((struct sockaddr *) &local_server.address, local_server.address_len, address_text, sizeof(address_text)),
+                          host_transport_name(&local_server));
+    log_and_stdout_printf(local_server.log, "IP pública del servidor local : %s\n", HOST_INFO_TEXT(local_server.public_ip));
 
     log_and_stdout_printf(local_server.log, "---------------------\n");
 
-    while (!terminate) {
+    /* Marcas de tiempo de llegada del núcleo, para separar la espera en la cola del socket del tiempo de proceso */
+    enable_kernel_timestamps(&local_server, TIMESTAMP_RX);
+
+    /* Con trabajadores, cada uno crea su propio límite */
+    if (args.rate_limit && !args.worker_count) {
+        static RateLimiter limiter;
+
+        if (local_server.type != SOCK_DGRAM) {
+            fprintf(stderr, "ERROR: El límite de peticiones por cliente no se admite con --seqpacket\n");
+            close_host(&local_server);
+            exit(EXIT_FAILURE);
+        }
+        if (!rate_limiter_init(&limiter, args.rate_limit, args.rate_burst ? args.rate_burst : args.rate_limit)) {
+            fail("ERROR: No hay memoria para la tabla del límite de peticiones");
+        }
+        rate_limiter = &limiter;
+        log_and_stdout_printf(local_server.log, "Límite por cliente            : %" PRIu64 " peticiones/s, ráfagas de %" PRIu64 "\n", limiter.rate, limiter.burst);
+    }
+
+    /* Con trabajadores, cada uno crea su propia reserva de buffers */
+    huge_page_buffers = args.huge_pages;
+    if (!args.worker_count) {
+        static BufferPool pool;
+
+        if (!open_request_buffers(&local_server, &pool)) {
+            fail("ERROR: No hay memoria para los buffers de las peticiones");
+        }
+        log_and_stdout_printf(local_server.log, "Buffers de las peticiones     : %zu de %zu bytes%s\n", pool.count, pool.buffer_size,
+                              pool.huge_pages ? " en páginas enormes" : "");
+    }
+
+    if (args.worker_count) {
+        /* Vuelve cuando se pide terminar o los sockets pasan a un proceso nuevo */
+        upgraded = run_workers(&local_server, &args, workers, handed_count ? handed_sockets : NULL);
+    } else {
+        /* Si nos lanzó una sustitución, el proceso anterior ya puede dejar de atender */
+        handoff_confirm();
+    }
+
+    if (args.spin.enabled) {
+        /* Modo de baja latencia: sondeamos el socket sin dormir mientras haya tráfico reciente */
+        configure_spin_mode(&local_server, &args.spin, &spin_stats);
+        log_requests = false;
+
+        while (!is_host_terminating(&local_server)) {
+            if (upgrade_step(&local_server, NULL, 0, 0)) {
+                upgraded = true;
+                break;
+            }
+            poll_start = read_cycle_counter();
+            if (handle_message(&local_server, &stats)) {
+                spin_useful_poll(&spin_stats);
+            } else {
+                spin_idle_poll(&local_server, &args.spin, &spin_stats, poll_start, -1);
+            }
+        }
+    }
+
+    while (!upgraded && !is_host_terminating(&local_server)) {
+        if (upgrade_step(&local_server, NULL, 0, 0)) {
+            upgraded = true;
+            break;
+        }
+
         printf("\nEsperando mensajes...\n");
 
-        if (!socket_io_pending) {
-            /* Pausamos la ejecución hasta que se reciba una señal de I/O o de terminación */
-            pause();
+        if (!get_pending_io(&local_server)) {
+            /* Pausamos la ejecución hasta que haya actividad en el socket o se pida la terminación;
+             * durante una sustitución, despertamos de vez en cuando para ver si el proceso nuevo ya atiende */
+            wait_for_host_event(&local_server, upgrade.pid ? SHM_POLL_MS : -1);
+        }
+
+        if (local_server.type == SOCK_SEQPACKET) {
+            accept_connections(&local_server);
+        } else {
+            handle_message(&local_server, &stats);
+        }
+    }
+
+    /* Las sesiones ven la terminación en menos de SHM_POLL_MS; tras una sustitución, en cambio, se les deja
+     * terminar por su cuenta (las sesiones no se pasan al proceso nuevo) */
+    drain_ms = upgraded ? UPGRADE_DRAIN_MS : SHM_SHUTDOWN_MS;
+    if (upgraded && atomic_load(&active_sessions) > 0) {
+        log_and_stdout_printf(local_server.log, "[Servidor] Esperando a que terminen %d sesiones en curso\n", atomic_load(&active_sessions));
+    }
+    for (int waited_ms = 0; atomic_load(&active_sessions) > 0 && waited_ms < drain_ms; waited_ms += 10) {
+        nanosleep(&(struct timespec) {.tv_sec = 0, .tv_nsec = 10000000L}, NULL);
+    }
+
+    pthread_mutex_lock(&session_stats_lock);
+    merge_request_stats(&stats, &session_stats);
+    pthread_mutex_unlock(&session_stats_lock);
+
+    if (args.worker_count) {
+        close_workers(&local_server, workers, args.worker_count, &stats);
+    }
+    if (buffer_pool) {
+        close_request_buffers(buffer_pool, &stats);
+    }
+
+    if (stats.requests || stats.truncated) {
+        log_and_stdout_printf(local_server.log, "\nPeticiones atendidas          : %" PRIu64 "\n", stats.requests);
+        log_and_stdout_printf(local_server.log, "Peticiones truncadas          : %" PRIu64 " (descartadas por no caber en %d bytes)\n", stats.truncated, DEFAULT_MAX_BYTES_RECV);
+        if (stats.timestamped) {
+            log_and_stdout_printf(local_server.log, "Espera en cola del socket     : media %.3f µs, máxima %.3f µs\n",
+                                  stats.queue_ns_total / 1e3 / stats.timestamped, stats.queue_ns_max / 1e3);
+        }
+        if (stats.requests) {
+            log_and_stdout_printf(local_server.log, "Tiempo de transformación      : media %.3f µs, máxima %.3f µs\n",
+                                  stats.transform_ns_total / 1e3 / stats.requests, stats.transform_ns_max / 1e3);
         }
+    }
+
+    if (stats.checksummed || stats.checksum_errors) {
+        log_and_stdout_printf(local_server.log, "Peticiones con CRC32C         : %" PRIu64 " correctas, %" PRIu64 " descartadas por CRC erróneo (%s)\n",
+                              stats.checksummed, stats.checksum_errors, crc32c_implementation());
+    }
+
+    if (stats.buffers.acquired) {
+        /* En régimen estacionario, ninguna petición reserva memoria: todo sale de las reservas */
+        log_and_stdout_printf(local_server.log, "Buffers prestados             : %" PRIu64 " (máximo %" PRIu64 " a la vez en un hilo)\n", stats.buffers.acquired, stats.buffers.peak_in_use);
+        log_and_stdout_printf(local_server.log, "Reservas en el heap           : %" PRIu64 " (%.6f por petición)\n", stats.buffers.heap_allocations,
+                              stats.requests ? (double) stats.buffers.heap_allocations / stats.requests : 0.0);
+    }
 
-        handle_message(&local_server);
+    if (stats.frames) {
+        log_and_stdout_printf(local_server.log, "Tramas comprimidas            : %" PRIu64 "\n", stats.frames);
+        log_and_stdout_printf(local_server.log, "Recibido (original / red)     : %" PRIu64 " / %" PRIu64 " bytes\n", stats.frame_raw_in, stats.frame_wire_in);
+        log_and_stdout_printf(local_server.log, "Enviado (original / red)      : %" PRIu64 " / %" PRIu64 " bytes\n", stats.frame_raw_out, stats.frame_wire_out);
+    }
+
+    if (rate_limiter) {
+        report_rate_limiter(&local_server, rate_limiter);
+        rate_limiter_free(rate_limiter);
+    }
+
+    if (args.spin.enabled) {
+        report_spin_stats(&local_server, &spin_stats);
     }
 
     printf("\nCerrando el servidor y saliendo...\n");
 
+    /* Tras una sustitución, el socket sigue abierto en el proceso nuevo: su ruta (si la tiene) ya es suya */
+    if (upgraded) {
+        local_server.bound_path = false;
+    }
     close_host(&local_server);
 
     exit(EXIT_SUCCESS);
 }
 
 
-void handle_message(Host *local_server) {
-    struct sockaddr_in remote_client_address;
-    char input[DEFAULT_MAX_BYTES_RECV];
-    char *output;
-    ssize_t recv_bytes, sent_bytes;
-    socklen_t client_addr_size = sizeof(struct sockaddr_in);
+bool handle_message(Host *local_server, struct RequestStats *stats) {
+    struct RequestBuffers buffers;
+    bool served;
+
+    acquire_request_buffers(&buffers);
+    served = serve_message(local_server, stats, &buffers);
+    release_request_buffers(&buffers);
 
-    recv_bytes = recvfrom(local_server->socket, input, DEFAULT_MAX_BYTES_RECV, 0, (struct sockaddr *) &remote_client_address, &client_addr_size);
+    return served;
+}
+
+
+static bool serve_message(Host *local_server, struct RequestStats *stats, const struct RequestBuffers *buffers) {
+    struct sockaddr_storage remote_client_address;
+    char address_text[HOST_ADDRESS_STRLEN];
+    char *input = buffers->input, *reply = buffers->reply;
+    struct RequestBuffers request = *buffers;   /* Buffers tras la cabecera de integridad, si la hay */
+    ssize_t recv_bytes, sent_bytes, reply_len;
+    socklen_t client_addr_size = sizeof(remote_client_address);
+    struct timespec kernel_rx_ts;
+    uint64_t dequeued_ns, transform_ns, queue_ns = 0;
+    uint32_t sequence;
+    bool checksummed = false;
+
+    /* Con MSG_TRUNC se obtiene el tamaño real del datagrama, para no atender en silencio una petición truncada */
+    recv_bytes = recvfrom_timestamped(local_server, input, DEFAULT_MAX_BYTES_RECV, MSG_TRUNC, (struct sockaddr *) &remote_client_address, &client_addr_size, &kernel_rx_ts);
+    dequeued_ns = traffic_realtime_ns();
     if (recv_bytes == -1) {
         if (errno == EAGAIN || errno == EWOULDBLOCK) {  /* Hemos marcado al socket con O_NONBLOCK; no hay conexiones pendientes, así que lo registramos y salimos */
-            socket_io_pending = 0;
-            return;
+            PROBE1(request_eagain, local_server->socket);
+            clear_pending_io(local_server);
+            return false;
+        }
+        if (local_server->type == SOCK_SEQPACKET) {
+            /* Solo se pierde la conexión de este cliente: la cerramos y el servidor sigue */
+            log_printf_err(local_server->log, "Error al recibir por la conexión: %s; se cierra.\n", strerror(errno));
+            request_host_termination(local_server);
+            return false;
         }
         fail("ERROR: Error al recibir la línea de texto");
     }
+    if (recv_bytes == 0 && local_server->type == SOCK_SEQPACKET) {
+        /* El cliente cerró la conexión */
+        request_host_termination(local_server);
+        return false;
+    }
+    PROBE2(request_receive, local_server->socket, recv_bytes);
+    if (rate_limiter && local_server->type == SOCK_DGRAM
+        && !rate_limiter_admit(rate_limiter, (struct sockaddr *) &remote_client_address, client_addr_size, traffic_monotonic_ns())) {
+        /* Cliente por encima de su límite: se descarta antes de registrar ni transformar nada */
+        PROBE3(request_drop, local_server->socket, recv_bytes, PROBE_DROP_RATE_LIMIT);
+        consume_pending_io(local_server);
+        return true;
+    }
+    if (recv_bytes > DEFAULT_MAX_BYTES_RECV) {
+        /* Solo con sockets locales (en UDP nunca pasa de 65507 bytes): su respuesta tampoco cabría en un datagrama */
+        stats->truncated++;
+        PROBE3(request_drop, local_server->socket, recv_bytes, PROBE_DROP_TRUNCATED);
+        log_printf_err(local_server->log, "Petición de %zd bytes truncada a %d (de %s); se descarta.\n", recv_bytes, DEFAULT_MAX_BYTES_RECV,
+                       describe_address((struct sockaddr *) &remote_client_address, client_addr_size, address_text, sizeof(address_text)));
+        consume_pending_io(local_server);
+        return true;
+    }
+    input[recv_bytes] = '\0';   /* Por si el mensaje no venía terminado en nulo */
+
+    if (is_crc_header(input, recv_bytes)) {
+        /* La petición y la respuesta van tras sus cabeceras de integridad: se atienden en los buffers a continuación */
+        if (!crc_header_check(input, input + CRC_HEADER_LEN, recv_bytes - CRC_HEADER_LEN, &sequence)) {
+            stats->checksum_errors++;
+            PROBE3(request_drop, local_server->socket, recv_bytes, PROBE_DROP_CHECKSUM);
+            log_printf_err(local_server->log, "Petición de %zd bytes con CRC32C erróneo (de %s); se descarta.\n", recv_bytes,
+                           describe_address((struct sockaddr *) &remote_client_address, client_addr_size, address_text, sizeof(address_text)));
+            consume_pending_io(local_server);
+            return true;
+        }
+        checksummed = true;
+        stats->checksummed++;
+        request.input += CRC_HEADER_LEN;
+        request.reply += CRC_HEADER_LEN;
+        recv_bytes -= CRC_HEADER_LEN;
+    }
 
-    log_and_stdout_printf(local_server->log, "===================================\n");
-
-    log_and_stdout_printf(local_server->log, "[Servidor] Paquete recibido\n");
-    log_and_stdout_printf(local_server->log, "IP del cliente remoto         : %s\n", inet_ntoa(remote_client_address.sin_addr));
-    log_and_stdout_printf(local_server->log, "Puerto del cliente remoto     : %d UDP\n", ntohs(remote_client_address.sin_port));
-    log_and_stdout_printf(local_server->log, "---------------------\n");
+    if (log_requests) {
+        log_and_stdout_printf(local_server->log, "===================================\n");
 
-    log_and_stdout_printf(local_server->log, "\t[Servidor] Mensaje recibido : <<%s>>\n", input);
+        log_and_stdout_printf(local_server->log, "[Servidor] Paquete recibido\n");
+        log_and_stdout_printf(local_server->log, "Cliente remoto                : %s %s\n",
+                              describe_address((struct sockaddr *) &remote_client_address, client_addr_size, address_text, sizeof(address_text)),
+                              host_transport_name(local_server));
+        log_and_stdout_printf(local_server->log, "---------------------\n");
+    }
 
     /*
     if (!recv_bytes) {
@@ -176,83 +770,655 @@ void handle_message(Host *local_server) {
     }
     */
 
-    output = toupper_string(input);
+    /* Los canales de memoria compartida solo se aceptan por el socket del servidor: una conexión SOCK_SEQPACKET
+     * puede cerrarse antes que la sesión que abriera */
+    reply_len = build_reply(local_server, &request, recv_bytes, local_server->type == SOCK_DGRAM, stats, &transform_ns);
+    if (reply_len < 0) {
+        PROBE3(request_drop, local_server->socket, recv_bytes, PROBE_DROP_INVALID);
+        consume_pending_io(local_server);
+        return true;
+    }
+    if (checksummed && reply_len + CRC_HEADER_LEN > COMPRESS_MAX_FRAME) {
+        log_printf_err(local_server->log, "La respuesta no cabe en un datagrama con su CRC32C; se responde con un error.\n");
+        reply_len = build_error_reply(request.reply, "la respuesta no cabe en un datagrama");
+    }
+    if (checksummed) {
+        crc_header_write(reply, sequence, request.reply, reply_len);
+    }
+
+    if (kernel_rx_ts.tv_sec) {
+        /* Tiempo desde que el núcleo recibió el datagrama hasta que el servidor lo leyó */
+        queue_ns = dequeued_ns > timespec_to_ns(&kernel_rx_ts) ? dequeued_ns - timespec_to_ns(&kernel_rx_ts) : 0;
+        stats->timestamped++;
+        stats->queue_ns_total += queue_ns;
+        if (queue_ns > stats->queue_ns_max) stats->queue_ns_max = queue_ns;
+    }
 
-    sent_bytes = sendto(local_server->socket, output, strlen(output) + 1, 0, (struct sockaddr *) &remote_client_address, client_addr_size);
+    /* En una conexión SOCK_SEQPACKET el núcleo ignora la dirección; MSG_NOSIGNAL evita SIGPIPE si el cliente ya la cerró */
+    sent_bytes = sendto(local_server->socket, reply, reply_len + (checksummed ? CRC_HEADER_LEN : 0), MSG_NOSIGNAL, (struct sockaddr *) &remote_client_address, client_addr_size);
+    if (sent_bytes < 0 && local_server->type == SOCK_SEQPACKET) {
+        log_printf_err(local_server->log, "Error al enviar por la conexión: %s; se cierra.\n", strerror(errno));
+        request_host_termination(local_server);
+        return false;
+    }
     if (sent_bytes < 0) {
-        if (output) {
-            free(output);
-        }
-
         log_printf_err(local_server->log, "Error al enviar línea de texto al cliente.\n");
         fail("ERROR: Error al enviar la línea de texto al cliente");
     }
+    PROBE3(request_send, local_server->socket, sent_bytes, queue_ns);
 
-    log_and_stdout_printf(local_server->log, "\t[Servidor] Enviado          : <<%s>>\n", output);
+    if (log_requests) {
+        log_reply(local_server, request.reply, reply_len);
+        if (kernel_rx_ts.tv_sec) {
+            log_and_stdout_printf(local_server->log, "\t[Servidor] Espera en cola   : %.3f µs\n", queue_ns / 1e3);
+        }
+        log_and_stdout_printf(local_server->log, "\t[Servidor] Transformación   : %.3f µs\n", transform_ns / 1e3);
 
-    log_and_stdout_printf(local_server->log, "===================================\n");
+        log_and_stdout_printf(local_server->log, "===================================\n");
+    }
+
+    consume_pending_io(local_server);
+
+    return true;
+}
+
+
+static ssize_t build_reply(Host *local_server, const struct RequestBuffers *buffers, ssize_t recv_bytes, bool from_socket, struct RequestStats *stats, uint64_t *transform_ns) {
+    char *input = buffers->input, *reply = buffers->reply;
+    char *batch = buffers->batch;               /* Lote de líneas descomprimido */
+    char *transformed = buffers->transformed;   /* Lote transformado, antes de comprimirlo */
+    char *text;                                 /* Texto a transformar: el mensaje o el lote descomprimido */
+    char *output;                               /* Dónde dejar el texto transformado */
+    const char *token;
+    size_t text_len, reply_len, request_len = recv_bytes;
+    ssize_t batch_len = 0, frame_len, output_len;
+    bool compressed;
+    int op;
+    uint64_t transform_start_ns;
+
+    /* La cabecera de operación, si la hay, va delante de todo lo demás (texto o trama comprimida) */
+    if ((op = transform_header_parse(&input, &request_len)) < 0) {
+        log_printf_err(local_server->log, "Operación de transformación desconocida (%u); se descarta la petición.\n", (uint8_t) input[-1]);
+        return -1;
+    }
+    recv_bytes = request_len;
+
+    compressed = is_compressed_frame(input, recv_bytes);
+    if (compressed) {
+        batch_len = decompress_frame(input, recv_bytes, batch, COMPRESS_MAX_RAW);
+        if (batch_len < 0) {
+            log_printf_err(local_server->log, "Trama comprimida no válida (%zd bytes); se descarta.\n", recv_bytes);
+            return -1;
+        }
+        batch[batch_len] = '\0';
+        text = batch;
+        text_len = batch_len;
+        output = transformed;
+
+        if (log_requests) log_and_stdout_printf(local_server->log, "\t[Servidor] Lote recibido    : %zd bytes (%zd comprimidos)\n", batch_len, recv_bytes);
+    } else {
+        text = input;
+        text_len = strlen(input);
+        output = reply;     /* Sin compresión la respuesta es directamente el texto transformado */
+
+        if (log_requests) log_and_stdout_printf(local_server->log, "\t[Servidor] Mensaje recibido : <<%s>>\n", input);
+    }
+    if (log_requests) log_and_stdout_printf(local_server->log, "\t[Servidor] Operación        : %s\n", transform_name(op));
+
+    /* Dejamos sitio para el nulo final */
+    PROBE2(transform_start, op, text_len);
+    transform_start_ns = traffic_monotonic_ns();
+    output_len = transform_text(op, text, text_len, output, COMPRESS_MAX_FRAME - 1);
+    *transform_ns = traffic_monotonic_ns() - transform_start_ns;
+    PROBE3(transform_end, op, output_len, *transform_ns);
+    if (output_len < 0) {
+        log_printf_err(local_server->log, "La respuesta no cabe en un datagrama; se responde con un error.\n");
+        return build_error_reply(reply, "la respuesta no cabe en un datagrama");
+    }
+    output[output_len] = '\0';
+
+    stats->requests++;
+    stats->transform_ns_total += *transform_ns;
+    if (*transform_ns > stats->transform_ns_max) stats->transform_ns_max = *transform_ns;
+
+    if (compressed) {
+        frame_len = compress_frame(transformed, output_len, reply, COMPRESS_MAX_FRAME);
+        if (frame_len < 0) {
+            log_printf_err(local_server->log, "La respuesta al lote no cabe en un datagrama; se responde con un error.\n");
+            return build_error_reply(reply, "la respuesta al lote no cabe en un datagrama");
+        }
+        stats->frames++;
+        stats->frame_raw_in += batch_len;
+        stats->frame_wire_in += recv_bytes;
+        stats->frame_raw_out += output_len;
+        stats->frame_wire_out += frame_len;
 
-    if (output) {
-        free(output);
+        return frame_len;
     }
 
-    socket_io_pending--;
+    reply_len = output_len + 1;
+
+    /* Los tokens de negociación van tras el nulo del nombre del archivo; se aceptan repitiéndolos en la respuesta */
+    for (token = input + strlen(input) + 1; token < input + recv_bytes; token += strlen(token) + 1) {
+        bool accepted = false;
+
+        if (!strcmp(token, COMPRESS_TOKEN) || !strcmp(token, CRC_TOKEN)) {
+            accepted = true;
+        } else if (from_socket && !strncmp(token, SHM_TOKEN_PREFIX, strlen(SHM_TOKEN_PREFIX))) {
+            accepted = start_shm_session(local_server, token);
+        }
+
+        if (log_requests) log_and_stdout_printf(local_server->log, "\t[Servidor] Negociación     : %s %s\n", token, accepted ? "aceptado" : "rechazado");
+
+        if (accepted && reply_len + strlen(token) + 1 <= COMPRESS_MAX_FRAME) {
+            memcpy(reply + reply_len, token, strlen(token) + 1);
+            reply_len += strlen(token) + 1;
+        }
+    }
+
+    return reply_len;
+}
+
+
+static ssize_t build_error_reply(char *reply, const char *reason) {
+    reply[0] = TRANSFORM_ERROR_MARKER;
+    strcpy(reply + 1, reason);
+
+    return strlen(reason) + 2;
+}
+
+
+static void log_reply(Host *local_server, const char *reply, size_t reply_len) {
+    if (is_compressed_frame(reply, reply_len)) {
+        log_and_stdout_printf(local_server->log, "\t[Servidor] Lote enviado     : %zu bytes comprimidos\n", reply_len);
+    } else {
+        log_and_stdout_printf(local_server->log, "\t[Servidor] Enviado          : <<%s>>\n", reply);
+    }
+}
+
+
+static bool start_shm_session(Host *local_server, const char *token) {
+    struct ShmSession *session;
+
+    if (!(session = calloc(1, sizeof(struct ShmSession)))) {
+        return false;
+    }
+    session->local_server = local_server;
+
+    if (!shm_channel_attach(&session->channel, token)) {
+        log_printf_err(local_server->log, "No se pudo abrir el canal de memoria compartida (%s): %s\n", token, strerror(errno));
+        free(session);
+        return false;
+    }
+
+    if (!start_session_thread(local_server, shm_session_thread, session)) {
+        shm_channel_close(&session->channel);
+        free(session);
+        return false;
+    }
+
+    return true;
+}
+
+
+static bool start_session_thread(Host *local_server, void *(*routine)(void *), void *session) {
+    pthread_attr_t attributes;
+    pthread_t thread;
+    sigset_t blocked, previous;
+    int error;
+
+    /* El hilo no debe atender las señales del proceso: de eso se encarga el hilo principal */
+    sigfillset(&blocked);
+    pthread_sigmask(SIG_BLOCK, &blocked, &previous);
+
+    atomic_fetch_add(&active_sessions, 1);
+    pthread_attr_init(&attributes);
+    pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+    error = pthread_create(&thread, &attributes, routine, session);
+    pthread_attr_destroy(&attributes);
+
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+    if (error) {
+        atomic_fetch_sub(&active_sessions, 1);
+        log_printf_err(local_server->log, "No se pudo crear el hilo de la sesión: %s\n", strerror(error));
+        return false;
+    }
+
+    return true;
+}
+
+
+static void *shm_session_thread(void *arg) {
+    struct ShmSession *session = arg;
+    Host *local_server = session->local_server;
+    struct RequestStats stats = {0};
+    struct RequestBuffers buffers;
+    BufferPool pool;
+    ssize_t recv_bytes, reply_len;
+    uint64_t transform_ns;
+    int sent = 0;
+
+    log_and_stdout_printf(local_server->log, "[Servidor] Sesión de memoria compartida abierta (%s)\n", session->channel.name);
+    PROBE1(session_open, PROBE_SESSION_SHM);
+
+    /* La sesión usa siempre los mismos buffers: los toma al abrirse y los devuelve al cerrarse. Sin ellos
+     * no se puede atender, así que se cierra y el cliente lo verá como un canal cerrado */
+    if (open_request_buffers(local_server, &pool)) {
+        acquire_request_buffers(&buffers);
+    }
+
+    while (buffer_pool && !is_host_terminating(local_server)) {
+        recv_bytes = shm_recv(&session->channel, buffers.input, DEFAULT_MAX_BYTES_RECV, SHM_POLL_MS);
+        if (recv_bytes < 0) {
+            if (errno == ETIMEDOUT) {
+                continue;   /* Volvemos a comprobar si hay que terminar */
+            }
+            if (errno == EMSGSIZE) {
+                log_printf_err(local_server->log, "Mensaje demasiado largo en el canal de memoria compartida; se descarta.\n");
+                continue;
+            }
+            break;  /* El cliente cerró el canal (EPIPE) o la cola está corrupta (EPROTO) */
+        }
+        buffers.input[recv_bytes] = '\0';
+        PROBE2(request_receive, -1, recv_bytes);
+
+        if (log_requests) {
+            log_and_stdout_printf(local_server->log, "===================================\n");
+            log_and_stdout_printf(local_server->log, "[Servidor] Mensaje por memoria compartida (%s)\n", session->channel.name);
+        }
+
+        if ((reply_len = build_reply(local_server, &buffers, recv_bytes, false, &stats, &transform_ns)) < 0) {
+            PROBE3(request_drop, -1, recv_bytes, PROBE_DROP_INVALID);
+            continue;
+        }
+
+        while ((sent = shm_send(&session->channel, buffers.reply, reply_len, SHM_POLL_MS)) < 0 && errno == ETIMEDOUT && !is_host_terminating(local_server));
+        if (sent < 0) {
+            break;
+        }
+        PROBE3(request_send, -1, reply_len, 0);
+
+        if (log_requests) {
+            log_reply(local_server, buffers.reply, reply_len);
+            log_and_stdout_printf(local_server->log, "\t[Servidor] Transformación   : %.3f µs\n", transform_ns / 1e3);
+            log_and_stdout_printf(local_server->log, "===================================\n");
+        }
+    }
+
+    log_and_stdout_printf(local_server->log, "[Servidor] Sesión de memoria compartida cerrada (%s): %" PRIu64 " peticiones\n", session->channel.name, stats.requests);
+    PROBE2(session_close, PROBE_SESSION_SHM, stats.requests);
+
+    shm_channel_close(&session->channel);
+    if (buffer_pool) {
+        release_request_buffers(&buffers);
+        close_request_buffers(&pool, &stats);
+    }
+
+    pthread_mutex_lock(&session_stats_lock);
+    merge_request_stats(&session_stats, &stats);
+    pthread_mutex_unlock(&session_stats_lock);
+
+    free(session);
+    atomic_fetch_sub(&active_sessions, 1);
+
+    return NULL;
+}
+
+
+static void accept_connections(Host *local_server) {
+    struct ConnectionSession *session;
+
+    while (true) {
+        if (!(session = calloc(1, sizeof(struct ConnectionSession)))) {
+            log_printf_err(local_server->log, "No hay memoria para una conexión nueva.\n");
+            return;
+        }
+        session->local_server = local_server;
+
+        if (accept_host(local_server, &session->connection) < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {  /* No quedan conexiones pendientes */
+                clear_pending_io(local_server);
+            } else {
+                log_printf_err(local_server->log, "Error al aceptar una conexión: %s\n", strerror(errno));
+            }
+            free(session);
+            return;
+        }
+
+        if (!start_session_thread(local_server, connection_thread, session)) {
+            close_host(&session->connection);
+            free(session);
+        }
+    }
+}
+
+
+static void *connection_thread(void *arg) {
+    struct ConnectionSession *session = arg;
+    Host *local_server = session->local_server;
+    Host *connection = &session->connection;
+    struct RequestStats stats = {0};
+    char address_text[HOST_ADDRESS_STRLEN];
+    BufferPool pool;
+
+    describe_address((struct sockaddr *) &connection->address, connection->address_len, address_text, sizeof(address_text));
+    log_and_stdout_printf(local_server->log, "[Servidor] Conexión abierta (%s)\n", address_text);
+    PROBE1(session_open, PROBE_SESSION_CONNECTION);
+
+    enable_kernel_timestamps(connection, TIMESTAMP_RX);
+
+    /* Sin buffers no se puede atender: se cierra la conexión */
+    if (!open_request_buffers(local_server, &pool)) {
+        request_host_termination(connection);
+    }
+
+    while (!is_host_terminating(connection)) {
+        if (!get_pending_io(connection)) {
+            wait_for_host_event(connection, SHM_POLL_MS);
+        }
+
+        while (handle_message(connection, &stats));     /* Atendemos todas las peticiones pendientes */
+    }
+
+    log_and_stdout_printf(local_server->log, "[Servidor] Conexión cerrada (%s): %" PRIu64 " peticiones\n", address_text, stats.requests);
+    PROBE2(session_close, PROBE_SESSION_CONNECTION, stats.requests);
+
+    close_host(connection);
+    if (buffer_pool) {
+        close_request_buffers(&pool, &stats);
+    }
+
+    pthread_mutex_lock(&session_stats_lock);
+    merge_request_stats(&session_stats, &stats);
+    pthread_mutex_unlock(&session_stats_lock);
+
+    free(session);
+    atomic_fetch_sub(&active_sessions, 1);
+
+    return NULL;
+}
+
+
+static void report_rate_limiter(Host *local_server, const RateLimiter *limiter) {
+    const RateLimitEntry *top[RATE_LIMIT_REPORTED_CLIENTS];
+    char address_text[HOST_ADDRESS_STRLEN];
+    size_t count;
+
+    log_and_stdout_printf(local_server->log, "Límite por cliente            : %" PRIu64 " admitidas, %" PRIu64 " descartadas\n", limiter->passed, limiter->dropped);
+    if (limiter->evicted) {
+        log_and_stdout_printf(local_server->log, "Clientes retirados de la tabla: %" PRIu64 " (%" PRIu64 " descartes)\n", limiter->evicted, limiter->evicted_dropped);
+    }
+
+    count = rate_limiter_top_droppers(limiter, top, RATE_LIMIT_REPORTED_CLIENTS);
+    for (size_t i = 0; i < count; i++) {
+        log_and_stdout_printf(local_server->log, "\t%-40s: %" PRIu64 " descartadas, %" PRIu64 " admitidas\n",
+                              rate_limit_key_describe(&top[i]->key, address_text, sizeof(address_text)), top[i]->dropped, top[i]->passed);
+    }
+}
+
+
+static bool run_workers(Host *local_server, const struct Arguments *args, struct Worker **workers, const int *handed_sockets) {
+    pthread_attr_t attributes;
+    sigset_t blocked, previous;
+    struct Worker *worker;
+    bool upgraded = false;
+    int error;
+
+    for (int i = 0; i < args->worker_count; i++) {
+        /* Todo lo que usa el trabajador (su estado, sus estadísticas y su pila) va al nodo NUMA de su CPU */
+        if (!(worker = workers[i] = alloc_on_cpu_node(sizeof(struct Worker), args->worker_cpus[i]))
+            || !(worker->stack = alloc_on_cpu_node(WORKER_STACK_SIZE, args->worker_cpus[i]))) {
+            fail("ERROR: No hay memoria para los trabajadores");
+        }
+        worker->cpu = args->worker_cpus[i];
+        worker->rate_limit = args->rate_limit;
+        worker->rate_burst = args->rate_burst ? args->rate_burst : args->rate_limit;
+
+        /* El orden de creación de los sockets es su índice en el grupo, el que elige el programa de reparto */
+        if (i == 0) {
+            worker->host = *local_server;
+        } else if (add_reuseport_host(local_server, &worker->host, handed_sockets ? handed_sockets[i] : -1) < 0) {
+            fail("ERROR: No se pudo crear el socket de un trabajador");
+        } else {
+            enable_kernel_timestamps(&worker->host, TIMESTAMP_RX);
+        }
+        prepare_worker_socket(&worker->host, worker->cpu);
+    }
+
+    if (attach_cpu_steering(local_server, args->worker_cpus, args->worker_count)) {
+        log_and_stdout_printf(local_server->log, "Reparto por CPU               : SO_ATTACH_REUSEPORT_CBPF con %d trabajadores\n", args->worker_count);
+    } else {
+        perror("No se pudo instalar el reparto de datagramas por CPU");
+        log_printf_err(local_server->log, "Error al instalar el programa de reparto por CPU; queda SO_INCOMING_CPU.\n");
+    }
+
+    /* Los trabajadores no deben atender las señales del proceso: de eso se encarga el hilo principal */
+    sigfillset(&blocked);
+    pthread_sigmask(SIG_BLOCK, &blocked, &previous);
+    for (int i = 0; i < args->worker_count; i++) {
+        pthread_attr_init(&attributes);
+        pthread_attr_setstack(&attributes, workers[i]->stack, WORKER_STACK_SIZE);
+        error = pthread_create(&workers[i]->thread, &attributes, worker_thread, workers[i]);
+        pthread_attr_destroy(&attributes);
+
+        if (error) {
+            /* Su socket sigue en el grupo: sus datagramas se quedarán sin atender, así que terminamos */
+            log_printf_err(local_server->log, "No se pudo crear el hilo del trabajador de la CPU %d: %s\n", workers[i]->cpu, strerror(error));
+            request_host_termination(local_server);
+            for (int j = 1; j < i; j++) request_host_termination(&workers[j]->host);
+            break;
+        }
+        workers[i]->started = true;
+    }
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+    /* Si nos lanzó una sustitución, el proceso anterior ya puede dejar de atender */
+    handoff_confirm();
+
+    /* El hilo principal solo atiende las peticiones de terminar o de sustituir el servidor */
+    while (!is_host_terminating(local_server)) {
+        if (upgrade_step(local_server, workers, args->worker_count, 0)) {
+            upgraded = true;
+            break;
+        }
+        wait_for_process_request(upgrade.pid ? SHM_POLL_MS : -1);
+    }
+
+    for (int i = 0; i < args->worker_count; i++) {
+        atomic_store(&workers[i]->stop, true);
+    }
+    for (int i = 0; i < args->worker_count; i++) {
+        if (workers[i]->started) pthread_join(workers[i]->thread, NULL);
+    }
+
+    return upgraded;
+}
+
+
+static bool upgrade_step(Host *local_server, struct Worker **workers, int worker_count, int timeout_ms) {
+    int sockets[STEERING_MAX_CPUS];
+    int count = worker_count ? worker_count : 1;
+    int result;
+
+    if (take_upgrade_request() && !upgrade.pid) {
+        /* Con trabajadores, en el orden del grupo SO_REUSEPORT: el proceso nuevo los adopta en el mismo */
+        for (int i = 0; i < count; i++) {
+            sockets[i] = worker_count ? workers[i]->host.socket : local_server->socket;
+        }
+
+        if (handoff_start(&upgrade, sockets, count)) {
+            log_and_stdout_printf(local_server->log, "[Servidor] Sustitución pedida: proceso nuevo %d con %d sockets\n", upgrade.pid, count);
+        } else {
+            fprintf(stderr, "No se pudo lanzar el proceso nuevo: %s; se sigue atendiendo\n", strerror(errno));
+            log_printf_err(local_server->log, "Error al lanzar el proceso nuevo: %s.\n", strerror(errno));
+        }
+    }
+
+    if (!upgrade.pid) {
+        return false;
+    }
+
+    if ((result = handoff_poll(&upgrade, timeout_ms)) < 0) {
+        fprintf(stderr, "La sustitución falló: %s; se sigue atendiendo\n", strerror(errno));
+        log_printf_err(local_server->log, "Error en la sustitución del servidor: %s.\n", strerror(errno));
+        return false;
+    }
+    if (result > 0) {
+        log_and_stdout_printf(local_server->log, "[Servidor] El proceso nuevo (%d) ya atiende: se deja de leer y se sale\n", upgrade.pid);
+    }
+
+    return result > 0;
+}
+
+
+static void *worker_thread(void *arg) {
+    struct Worker *worker = arg;
+    Host *host = &worker->host;
+    int error;
+
+    if ((error = pin_thread_to_cpu(worker->cpu))) {
+        fprintf(stderr, "No se pudo fijar el trabajador a la CPU %d: %s\n", worker->cpu, strerror(error));
+        log_printf_err(host->log, "No se pudo fijar el trabajador a la CPU %d: %s\n", worker->cpu, strerror(error));
+    }
+
+    /* La tabla del límite se reserva ya desde la CPU del trabajador, y por tanto en su nodo */
+    if (worker->rate_limit) {
+        if (!rate_limiter_init(&worker->limiter, worker->rate_limit, worker->rate_burst)) {
+            fail("ERROR: No hay memoria para la tabla del límite de peticiones");
+        }
+        rate_limiter = &worker->limiter;
+    }
+
+    /* También su reserva de buffers: la memoria queda en el nodo de la CPU al tocarla el trabajador */
+    if (!open_request_buffers(host, &worker->buffers)) {
+        fail("ERROR: No hay memoria para los buffers de las peticiones");
+    }
+
+    log_and_stdout_printf(host->log, "[Servidor] Trabajador en marcha en la CPU %d (nodo NUMA %d)\n", worker->cpu, cpu_numa_node(worker->cpu));
+
+    while (!is_host_terminating(host) && !atomic_load(&worker->stop)) {
+        /* Sin aviso por señal: atendemos todo lo pendiente y esperamos en el propio socket, despertando
+         * de vez en cuando por si el socket pasó a un proceso nuevo */
+        while (!is_host_terminating(host) && !atomic_load(&worker->stop) && handle_message(host, &worker->stats));
+        wait_for_host_event(host, SHM_POLL_MS);
+    }
+
+    close_request_buffers(&worker->buffers, &worker->stats);
+
+    return NULL;
 }
 
 
-static char *toupper_string(const char *source) {
-    wchar_t *wide_source;
-    wchar_t *wide_destination;
-    ssize_t wide_size, size;
+static void close_workers(Host *local_server, struct Worker **workers, int count, struct RequestStats *stats) {
+    for (int i = 0; i < count; i++) {
+        struct Worker *worker = workers[i];
 
-    wide_size = mbstowcs(NULL, source, 0); /* Calcular el número de wchar_t que ocupa el string source */
+        if (!worker) continue;
 
-    /* Alojar espacio para wide_source y wide_destiny */
-    wide_source = (wchar_t *) calloc(wide_size + 1, sizeof(wchar_t));
-    wide_destination = (wchar_t *) calloc(wide_size + 1, sizeof(wchar_t));
+        log_and_stdout_printf(local_server->log, "\nTrabajador de la CPU %-9d: %" PRIu64 " peticiones\n", worker->cpu, worker->stats.requests);
+        merge_request_stats(stats, &worker->stats);
 
-    /* Transformar la fuente en un wstring */
-    mbstowcs(wide_source, source, wide_size + 1);
+        if (worker->limiter.entries) {
+            report_rate_limiter(local_server, &worker->limiter);
+            rate_limiter_free(&worker->limiter);
+        }
 
-    /* Transformar wide_source a mayúsculas y guardarlo en wide_destiny */
-    for (int i = 0; wide_source[i]; i++) {
-        wide_destination[i] = towupper(wide_source[i]);
+        /* El socket del primero es el del servidor, que se cierra aparte */
+        if (i > 0) close_host(&worker->host);
+        free_on_cpu_node(worker->stack, WORKER_STACK_SIZE);
+        free_on_cpu_node(worker, sizeof(struct Worker));
+        workers[i] = NULL;
     }
+}
 
-    /* Transoformar de vuelta a un string normal */
-    size = wcstombs(NULL, wide_destination, 0); /* Calcular el número de char que ocupa el wstring wide_destiny */
 
-    char *destination = (char *) calloc(size + 1, sizeof(char));
-    wcstombs(destination, wide_destination, size + 1);
+static void merge_request_stats(struct RequestStats *destination, const struct RequestStats *source) {
+    destination->requests += source->requests;
+    destination->timestamped += source->timestamped;
+    destination->queue_ns_total += source->queue_ns_total;
+    if (source->queue_ns_max > destination->queue_ns_max) destination->queue_ns_max = source->queue_ns_max;
+    destination->transform_ns_total += source->transform_ns_total;
+    if (source->transform_ns_max > destination->transform_ns_max) destination->transform_ns_max = source->transform_ns_max;
+    destination->frames += source->frames;
+    destination->frame_raw_in += source->frame_raw_in;
+    destination->frame_wire_in += source->frame_wire_in;
+    destination->frame_raw_out += source->frame_raw_out;
+    destination->frame_wire_out += source->frame_wire_out;
+    destination->truncated += source->truncated;
+    destination->checksummed += source->checksummed;
+    destination->checksum_errors += source->checksum_errors;
+    buffer_pool_stats_merge(&destination->buffers, &source->buffers);
+}
 
-    if (wide_source) {
-        free(wide_source);
+
+static bool open_request_buffers(Host *local_server, BufferPool *pool) {
+    if (!buffer_pool_init(pool, REQUEST_BUFFER_SIZE, REQUEST_BUFFERS, huge_page_buffers)) {
+        log_printf_err(local_server->log, "No hay memoria para los buffers de las peticiones: %s\n", strerror(errno));
+        return false;
     }
+    buffer_pool = pool;
+
+    return true;
+}
+
+
+static void close_request_buffers(BufferPool *pool, struct RequestStats *stats) {
+    buffer_pool_stats_merge(&stats->buffers, &pool->stats);
+    buffer_pool_free(pool);
+    buffer_pool = NULL;
+}
+
 
-    if (wide_destination) {
-        free(wide_destination);
+static void acquire_request_buffers(struct RequestBuffers *buffers) {
+    /* Solo fallan si la reserva se agotó y tampoco queda memoria en el heap */
+    if (!(buffers->input = buffer_pool_get(buffer_pool)) || !(buffers->reply = buffer_pool_get(buffer_pool))
+        || !(buffers->batch = buffer_pool_get(buffer_pool)) || !(buffers->transformed = buffer_pool_get(buffer_pool))) {
+        fail("ERROR: No hay memoria para los buffers de la petición");
     }
+}
+
 
-    return destination;
+static void release_request_buffers(const struct RequestBuffers *buffers) {
+    buffer_pool_put(buffer_pool, buffers->transformed);
+    buffer_pool_put(buffer_pool, buffers->batch);
+    buffer_pool_put(buffer_pool, buffers->reply);
+    buffer_pool_put(buffer_pool, buffers->input);
 }
 
 
 static void print_help(char *exe_name) {
     /** Cabecera y modo de ejecución **/
-    printf("Uso: %s [[-p] <puerto>] [-l <log> | --no-log] [-h]\n\n", exe_name);
+    printf("Uso: %s [[-p] <puerto> | <ruta> [-q]] [-l <log> | --no-log] [-s [-b <µs>] [-c <cpu>] [-w <sondeos>]] [-r <peticiones/s> [-a <peticiones>]] [-t <cpus>] [-g] [-h]\n\n", exe_name);
 
     /** Lista de opciones de uso **/
     printf(" Opción\t\tOpción larga\t\tSignificado\n");
 
-    printf(" -p <puerto>\t--puerto <puerto>\t\tPuerto en el que escuchará el servidor.\n");
+    printf(" -p <puerto>\t--puerto <puerto>\t\tPuerto en el que escuchará el servidor, o ruta de un socket local (AF_UNIX) si contiene alguna '/'.\n");
+    printf(" -q\t\t--seqpacket\t\tCon un socket local, usar SOCK_SEQPACKET: cada cliente se conecta y se atiende en su propio hilo.\n");
 
     printf(" -l <log>\t--log <log>\t\tNombre del archivo en el que guardar el registro de actividad del servidor.\n");
     printf(" -n\t\t--no-log\t\tNo crear archivo de registro de actividad.\n");
+    printf(" -s\t\t--spin\t\t\tModo de baja latencia: sondear el socket en espera activa en lugar de esperar la señal de E/S, sin mostrar ni registrar cada petición.\n");
+    printf(" -b <µs>\t--busy-poll <µs>\tActivar SO_BUSY_POLL en el socket con ese presupuesto en microsegundos (requiere -s).\n");
+    printf(" -c <cpu>\t--cpu <cpu>\t\tFijar el servidor a la CPU indicada (requiere -s).\n");
+    printf(" -w <sondeos>\t--espera <sondeos>\tSondeos vacíos seguidos antes de dormir hasta que llegue tráfico; 0 para no dormir nunca (requiere -s).\n");
+    printf(" -r <n>\t\t--ritmo <n>\t\tAdmitir como mucho n peticiones por segundo de cada cliente (dirección y puerto); las demás se descartan.\n");
+    printf(" -a <n>\t\t--rafaga <n>\t\tRáfaga máxima de peticiones seguidas de cada cliente (requiere -r; por defecto, el ritmo).\n");
+    printf(" -t <cpus>\t--trabajadores <cpus>\tUn trabajador fijado a cada CPU de la lista (p. ej. 0-3,8), cada uno con su socket (SO_REUSEPORT); solo UDP.\n");
+    printf(" -g\t\t--paginas-enormes\tReservar los buffers de las peticiones en páginas enormes (si el sistema no tiene reservadas, se pide al núcleo que las junte).\n");
     printf(" -h\t\t--help\t\t\tMostrar este texto de ayuda y salir.\n");
 
     /** Consideraciones adicionales **/
     printf("\nPuede especificarse el parámetro <puerto> para el puerto en el que escucha el servidor sin escribir la opción '-p', siempre y cuando este sea el primer parámetro que se pasa a la función.\n");
     printf("\nSi no se especifica alguno de los argumentos, el servidor se ejecutará con su valor por defecto, a saber: DEFAULT_PORT=%u; DEFAULT_LOG=%s\n", DEFAULT_SERVER_PORT, DEFAULT_LOG_FILE);
+    printf("\nEl servidor acepta siempre la compresión de los clientes que la piden (opción -z del cliente): los lotes comprimidos se responden también comprimidos.\n");
+    printf("\nLos clientes de la misma máquina pueden pedir un canal de memoria compartida; cada uno se atiende en su propio hilo.\n");
+    printf("\nEn modo de espera activa, por defecto se duerme tras %u sondeos vacíos seguidos; al salir se informa de los ciclos gastados en espera y en trabajo útil.\n", DEFAULT_SPINS_BEFORE_SLEEP);
+    printf("\nCon -r, cada cliente tiene un cubo de fichas propio: uno que inunde el servidor solo pierde sus propias peticiones, sin retrasar las de los demás. Al salir se muestran los clientes con más descartes.\n");
+    printf("\nCon -t, cada datagrama lo atiende el trabajador de la CPU que lo recibió de la tarjeta de red, y la memoria de cada trabajador se reserva en el nodo NUMA de su CPU. Con -r, cada trabajador lleva su propio límite por cliente.\n");
+    printf("\nCada hilo que atiende peticiones toma sus buffers de una reserva propia que se recicla: al salir se informa de cuántos tuvieron que reservarse en el heap (en régimen estacionario, ninguno).\n");
+    printf("\nCon la señal SIGUSR2, el servidor lanza el ejecutable (ya actualizado) con los mismos argumentos y le pasa sus sockets sin cerrarlos; cuando el nuevo atiende, el anterior termina lo que tenga en curso y sale, sin perder los datagramas que esperaban.\n");
     printf("\nSi se especifica varias veces un argumento, o se especifican las opciones \"--log\" y \"--no-log\" a la vez, el comportamiento está indefinido.\n");
 }
 
@@ -270,6 +1436,20 @@ static uint16_t getPortOrFail(char **argv, int pos) {
 }
 
 
+static long getNonNegativeNumberOrFail(char **argv, int pos) {
+    char *end;
+    long read_number = strtol(argv[pos], &end, 10);
+
+    if (end == argv[pos] || *end || read_number < 0 || read_number > 1000000000L) {
+        fprintf(stderr, "ERROR: El valor especificado (%s) no es un número válido\n", argv[pos]);
+        print_help(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    return read_number;
+}
+
+
 static void process_args(struct Arguments *args, int argc, char **argv) {
     char *current_arg_str;
 
@@ -285,6 +1465,24 @@ static void process_args(struct Arguments *args, int argc, char **argv) {
                     current_arg_str = "-l";
                 } else if (!strcmp(current_arg_str, "--no-log")) {
                     current_arg_str = "-n";
+                } else if (!strcmp(current_arg_str, "--spin")) {
+                    current_arg_str = "-s";
+                } else if (!strcmp(current_arg_str, "--busy-poll")) {
+                    current_arg_str = "-b";
+                } else if (!strcmp(current_arg_str, "--cpu")) {
+                    current_arg_str = "-c";
+                } else if (!strcmp(current_arg_str, "--espera")) {
+                    current_arg_str = "-w";
+                } else if (!strcmp(current_arg_str, "--seqpacket")) {
+                    current_arg_str = "-q";
+                } else if (!strcmp(current_arg_str, "--ritmo")) {
+                    current_arg_str = "-r";
+                } else if (!strcmp(current_arg_str, "--rafaga")) {
+                    current_arg_str = "-a";
+                } else if (!strcmp(current_arg_str, "--trabajadores")) {
+                    current_arg_str = "-t";
+                } else if (!strcmp(current_arg_str, "--paginas-enormes")) {
+                    current_arg_str = "-g";
                 } else if (!strcmp(current_arg_str, "--help")) {
                     current_arg_str = "-h";
                 }
@@ -296,7 +1494,11 @@ static void process_args(struct Arguments *args, int argc, char **argv) {
             switch (current_option) {
                 case OPT_SERVER_PORT: // 'p' /* Puerto del Servidor */
                     if (++pos < argc) {
-                        args->server_port = getPortOrFail(argv, pos);
+                        if (is_unix_socket_path(argv[pos])) {
+                            args->server_path = argv[pos];
+                        } else {
+                            args->server_port = getPortOrFail(argv, pos);
+                        }
                     } else {
                         fprintf(stderr, "ERROR: Puerto no especificado tras la opción '-p'\n");
                         print_help(argv[0]);
@@ -318,6 +1520,82 @@ static void process_args(struct Arguments *args, int argc, char **argv) {
                     args->logfile = NULL;
                     break;
 
+                case OPT_SPIN: // 's' /* Espera activa */
+                    args->spin.enabled = true;
+                    break;
+
+                case OPT_BUSY_POLL: // 'b' /* SO_BUSY_POLL */
+                    if (++pos < argc) {
+                        args->spin.busy_poll_us = (int) getNonNegativeNumberOrFail(argv, pos);
+                    } else {
+                        fprintf(stderr, "ERROR: Microsegundos no especificados tras la opción '-b'\n");
+                        print_help(argv[0]);
+                        exit(EXIT_FAILURE);
+                    }
+                    break;
+
+                case OPT_CPU: // 'c' /* CPU */
+                    if (++pos < argc) {
+                        args->spin.cpu = (int) getNonNegativeNumberOrFail(argv, pos);
+                    } else {
+                        fprintf(stderr, "ERROR: CPU no especificada tras la opción '-c'\n");
+                        print_help(argv[0]);
+                        exit(EXIT_FAILURE);
+                    }
+                    break;
+
+                case OPT_SPINS_BEFORE_SLEEP: // 'w' /* Sondeos antes de dormir */
+                    if (++pos < argc) {
+                        args->spin.spins_before_sleep = (unsigned) getNonNegativeNumberOrFail(argv, pos);
+                    } else {
+                        fprintf(stderr, "ERROR: Número de sondeos no especificado tras la opción '-w'\n");
+                        print_help(argv[0]);
+                        exit(EXIT_FAILURE);
+                    }
+                    break;
+
+                case OPT_SEQPACKET: // 'q' /* SOCK_SEQPACKET */
+                    args->seqpacket = true;
+                    break;
+
+                case OPT_RATE: // 'r' /* Límite de peticiones por cliente */
+                    if (++pos < argc) {
+                        args->rate_limit = (uint64_t) getNonNegativeNumberOrFail(argv, pos);
+                    } else {
+                        fprintf(stderr, "ERROR: Peticiones por segundo no especificadas tras la opción '-r'\n");
+                        print_help(argv[0]);
+                        exit(EXIT_FAILURE);
+                    }
+                    break;
+
+                case OPT_BURST: // 'a' /* Ráfaga por cliente */
+                    if (++pos < argc) {
+                        args->rate_burst = (uint64_t) getNonNegativeNumberOrFail(argv, pos);
+                    } else {
+                        fprintf(stderr, "ERROR: Número de peticiones no especificado tras la opción '-a'\n");
+                        print_help(argv[0]);
+                        exit(EXIT_FAILURE);
+                    }
+                    break;
+
+                case OPT_WORKERS: // 't' /* Trabajadores por CPU */
+                    if (++pos < argc) {
+                        if ((args->worker_count = parse_cpu_list(argv[pos], args->worker_cpus, STEERING_MAX_CPUS)) <= 0) {
+                            fprintf(stderr, "ERROR: La lista de CPUs especificada (%s) no es válida\n", argv[pos]);
+                            print_help(argv[0]);
+                            exit(EXIT_FAILURE);
+                        }
+                    } else {
+                        fprintf(stderr, "ERROR: Lista de CPUs no especificada tras la opción '-t'\n");
+                        print_help(argv[0]);
+                        exit(EXIT_FAILURE);
+                    }
+                    break;
+
+                case OPT_HUGE_PAGES: // 'g' /* Buffers en páginas enormes */
+                    args->huge_pages = true;
+                    break;
+
                 case OPT_HELP: // 'h' /* Ayuda */
                     print_help(argv[0]);
                     exit(EXIT_SUCCESS);
@@ -327,8 +1605,12 @@ static void process_args(struct Arguments *args, int argc, char **argv) {
                     print_help(argv[0]);
                     exit(EXIT_FAILURE);
             }
-        } else if (pos == 1) {    /* Se especificó el puerto como primer argumento */
-            args->server_port = getPortOrFail(argv, pos);
+        } else if (pos == 1) {    /* Se especificó el puerto (o la ruta del socket local) como primer argumento */
+            if (is_unix_socket_path(argv[pos])) {
+                args->server_path = argv[pos];
+            } else {
+                args->server_port = getPortOrFail(argv, pos);
+            }
         }
     }
 }
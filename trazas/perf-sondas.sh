@@ -0,0 +1,48 @@
+#!/bin/sh
+#
+# Registra con perf los puntos de traza (USDT) de un programa y, opcionalmente, los cuenta o graba
+# mientras corre.
+#
+# Uso (desde la raíz del repositorio):
+#   trazas/perf-sondas.sh [EJECUTABLE]              Registra los puntos (sdt_mayus:*) y los lista
+#   trazas/perf-sondas.sh EJECUTABLE stat PID [S]   Cuenta cada punto durante S segundos (10 por defecto)
+#   trazas/perf-sondas.sh EJECUTABLE record PID [S] Graba los eventos en perf.data (perf script los muestra)
+#
+# Registrar los puntos necesita permisos de administrador (o perf_event_paranoid bajo).
+
+set -e
+
+EXECUTABLE=${1:-mayus/servidorUDP}
+ACTION=${2:-list}
+PID=$3
+SECONDS_TO_RUN=${4:-10}
+
+if [ ! -x "$EXECUTABLE" ]; then
+    echo "No existe el ejecutable $EXECUTABLE (¿make?)" >&2
+    exit 1
+fi
+
+# perf busca los puntos en su caché de ejecutables; cada uno se convierte en un evento sdt_mayus:<nombre>
+perf buildid-cache --add "$EXECUTABLE"
+for probe in $(perf list sdt 2>/dev/null | sed -n 's/.*sdt_mayus:\([a-z_]*\).*/\1/p' | sort -u); do
+    perf probe --quiet --add "%sdt_mayus:$probe" 2>/dev/null || true     # Ya registrado de una vez anterior
+done
+
+case "$ACTION" in
+    list)
+        perf list 'sdt_mayus:*'
+        ;;
+    stat)
+        [ -n "$PID" ] || { echo "Falta el PID" >&2; exit 1; }
+        perf stat -e 'sdt_mayus:*' -p "$PID" -- sleep "$SECONDS_TO_RUN"
+        ;;
+    record)
+        [ -n "$PID" ] || { echo "Falta el PID" >&2; exit 1; }
+        perf record -e 'sdt_mayus:*' -p "$PID" -- sleep "$SECONDS_TO_RUN"
+        echo "Eventos en perf.data: perf script muestra cada uno con su marca de tiempo y argumentos"
+        ;;
+    *)
+        echo "Acción desconocida: $ACTION (list, stat o record)" >&2
+        exit 1
+        ;;
+esac